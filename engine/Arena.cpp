@@ -0,0 +1,91 @@
+
+#include "Arena.h"
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+
+/**
+ * The number of blocks allocated by all the arenas.
+ */
+std::atomic<unsigned long> allocatedBlocks {0};
+
+} // namespace
+
+g3::FrameArena::FrameArena():
+current {0},
+offset {0}
+{
+}
+
+/**
+ * Allocates uninitialized memory.
+ */
+void* g3::FrameArena::allocate(std::size_t bytes, std::size_t alignment)
+{
+  // go on in the current block, or in the next one that has room; blocks
+  // left behind stay unused until the arena is reset or rewound
+  for (; current < blocks.size(); current++, offset = 0) {
+    std::size_t start = (offset + alignment - 1) & ~(alignment - 1);
+    if (start + bytes <= blocks[current].size) {
+      offset = start + bytes;
+      return blocks[current].data.get() + start;
+    }
+  }
+
+  // the capacity at least doubles, so a growing frame adds few blocks
+  std::size_t size = std::max({ MIN_BLOCK_SIZE, bytes, getCapacity() });
+  allocatedBlocks++;
+  blocks.push_back({ std::unique_ptr<unsigned char[], AlignedDeleter>(
+    static_cast<unsigned char*>(alignedAlloc(size))), size });
+  current = blocks.size() - 1;
+  offset = bytes;
+  return blocks[current].data.get();
+}
+
+/**
+ * Releases everything allocated.
+ */
+void g3::FrameArena::reset()
+{
+  // a frame that needed several blocks gets them as one from now on
+  if (blocks.size() > 1) {
+    std::size_t size = getCapacity();
+    blocks.clear();
+    allocatedBlocks++;
+    blocks.push_back({ std::unique_ptr<unsigned char[], AlignedDeleter>(
+      static_cast<unsigned char*>(alignedAlloc(size))), size });
+  }
+  current = 0;
+  offset = 0;
+}
+
+/**
+ * Returns the size of all the blocks in bytes.
+ */
+std::size_t g3::FrameArena::getCapacity() const
+{
+  std::size_t capacity = 0;
+  for (const Block& block : blocks) {
+    capacity += block.size;
+  }
+  return capacity;
+}
+
+/**
+ * Returns the number of blocks allocated by all the arenas.
+ */
+unsigned long g3::FrameArena::getAllocatedBlockCount()
+{
+  return allocatedBlocks;
+}
+
+/**
+ * Returns the arena of the calling thread.
+ */
+g3::FrameArena& g3::threadArena()
+{
+  static thread_local FrameArena arena;
+  return arena;
+}
@@ -0,0 +1,49 @@
+
+#include "BatchRenderer.h"
+#include "Profiler.h"
+
+g3::BatchRenderer::BatchRenderer(ThreadPool& pool):
+pool {pool},
+nextCamera {0},
+stats {}
+{
+  for (unsigned int i = 0; i < pool.getThreadCount(); i++) {
+    workers.emplace_back(new Worker { {}, std::unique_ptr<FrameBuffer>(new FrameBuffer(1, 1)), {}, {} });
+    workers.back()->renderer.setThreadPool(pool);
+  }
+}
+
+/**
+ * Hands the state and the size of the frames to the workers.
+ */
+void g3::BatchRenderer::beginBatch(const FrameState& state, unsigned int w, unsigned int h)
+{
+  for (std::unique_ptr<Worker>& worker : workers) {
+    worker->frame->resize(w, h);
+    worker->state = state;
+    worker->stats = {};
+  }
+  nextCamera = 0;
+}
+
+/**
+ * Renders the frame of a camera with a worker.
+ */
+void g3::BatchRenderer::renderCamera(Worker& worker, const Camera& camera)
+{
+  G3_PROFILE_ZONE("batch frame");
+  worker.state.camera = camera;
+  worker.renderer.render(*worker.frame, worker.state);
+  worker.stats += worker.renderer.getStats();
+}
+
+/**
+ * Sums the counters of the workers.
+ */
+void g3::BatchRenderer::endBatch()
+{
+  stats = {};
+  for (const std::unique_ptr<Worker>& worker : workers) {
+    stats += worker->stats;
+  }
+}
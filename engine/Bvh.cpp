@@ -0,0 +1,188 @@
+
+#include "Bvh.h"
+#include "Arena.h"
+#include <algorithm>
+
+/**
+ * Builds the tree over n boxes.
+ */
+void g3::Bvh::build(const Aabb* bounds, unsigned int n)
+{
+  nodes.clear();
+  items.resize(n);
+  if (n == 0) {
+    return;
+  }
+
+  // a binary tree with at least one item per leaf has at most 2n-1 nodes,
+  // so the node references taken while subdividing stay valid
+  nodes.reserve(2 * n - 1);
+
+  // the centers are scratch, a rebuild during a frame needs no heap
+  ArenaScope scope(threadArena());
+  Vec3* centers = threadArena().allocate<Vec3>(n);
+  Aabb rootBounds = createEmptyAabb();
+  Aabb centerBounds = createEmptyAabb();
+  for (unsigned int i = 0; i < n; i++) {
+    items[i] = i;
+    centers[i] = center(bounds[i]);
+    grow(rootBounds, bounds[i]);
+    grow(centerBounds, centers[i]);
+  }
+
+  nodes.push_back({ rootBounds, 0, 0, n });
+  subdivide(0, centerBounds, bounds, centers);
+}
+
+/**
+ * Splits the node recursively.
+ */
+void g3::Bvh::subdivide(unsigned int index, const Aabb& centerBounds, const Aabb* bounds, const Vec3* centers)
+{
+  Node& node = nodes[index];
+  if (node.count <= 1) {
+    return;
+  }
+  unsigned int* first = &items[node.first];
+  unsigned int* last = first + node.count;
+
+  // split along the longest axis of the centers
+  Vec3 extent = centerBounds.max - centerBounds.min;
+  int axis = 0;
+  if (extent[1] > extent[axis]) axis = 1;
+  if (extent[2] > extent[axis]) axis = 2;
+
+  // the boxes of the children and of their centers
+  Aabb childBounds[2] { createEmptyAabb(), createEmptyAabb() };
+  Aabb childCenters[2] { createEmptyAabb(), createEmptyAabb() };
+  unsigned int* middle = first;
+
+  if (extent[axis] > 0) {
+    // sort the items into bins and sweep the bin boundaries for the split
+    // with the lowest cost: the area of each side times its item count
+    // small nodes get fewer bins, a bin per item is plenty
+    unsigned int binCount = std::min(BINS, node.count);
+    struct Bin { Aabb bounds; Aabb centers; unsigned int count; };
+    Bin bins[BINS];
+    for (unsigned int b = 0; b < binCount; b++) {
+      bins[b] = { createEmptyAabb(), createEmptyAabb(), 0 };
+    }
+
+    float scale = binCount / extent[axis];
+    float origin = centerBounds.min[axis];
+    auto binOf = [&](unsigned int item) {
+      unsigned int b = (centers[item][axis] - origin) * scale;
+      return std::min(b, binCount - 1);
+    };
+    for (unsigned int* it = first; it != last; it++) {
+      Bin& bin = bins[binOf(*it)];
+      grow(bin.bounds, bounds[*it]);
+      grow(bin.centers, centers[*it]);
+      bin.count++;
+    }
+
+    float rightCost[BINS];
+    Aabb box = createEmptyAabb();
+    unsigned int count = 0;
+    for (unsigned int b = binCount - 1; b > 0; b--) {
+      grow(box, bins[b].bounds);
+      count += bins[b].count;
+      rightCost[b] = count * surfaceArea(box);
+    }
+
+    // a split costs a visit of the node on top of the children, an item
+    // test and a node visit are taken to cost the same
+    float nodeArea = surfaceArea(node.bounds);
+    float bestCost = node.count * nodeArea - nodeArea;
+    unsigned int bestSplit = 0;
+    box = createEmptyAabb();
+    count = 0;
+    for (unsigned int b = 0; b < binCount - 1; b++) {
+      grow(box, bins[b].bounds);
+      count += bins[b].count;
+      float cost = count * surfaceArea(box) + rightCost[b + 1];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestSplit = b + 1;
+      }
+    }
+
+    if (bestSplit == 0 && node.count <= MAX_LEAF_SIZE) {
+      // testing all the items is cheaper than any split
+      return;
+    }
+    if (bestSplit > 0) {
+      middle = std::partition(first, last,
+        [&](unsigned int item) { return binOf(item) < bestSplit; });
+      for (unsigned int b = 0; b < binCount; b++) {
+        grow(childBounds[b >= bestSplit], bins[b].bounds);
+        grow(childCenters[b >= bestSplit], bins[b].centers);
+      }
+    }
+  } else if (node.count <= MAX_LEAF_SIZE) {
+    return;
+  }
+
+  if (middle == first || middle == last) {
+    // no useful split (all the centers in one place, or the split cost more
+    // than a leaf that would be too big): halve the items at the median
+    middle = first + node.count / 2;
+    std::nth_element(first, middle, last, [&](unsigned int a, unsigned int b) {
+      return centers[a][axis] < centers[b][axis];
+    });
+    for (unsigned int* it = first; it != last; it++) {
+      grow(childBounds[it >= middle], bounds[*it]);
+      grow(childCenters[it >= middle], centers[*it]);
+    }
+  }
+
+  unsigned int leftCount = middle - first;
+  unsigned int left = nodes.size();
+  node.left = left;
+  nodes.push_back({ childBounds[0], 0, node.first, leftCount });
+  nodes.push_back({ childBounds[1], 0, node.first + leftCount, node.count - leftCount });
+
+  subdivide(left, childCenters[0], bounds, centers);
+  subdivide(left + 1, childCenters[1], bounds, centers);
+}
+
+/**
+ * Updates the boxes of the tree after the items moved.
+ */
+void g3::Bvh::refit(const Aabb* bounds)
+{
+  // children always follow their parent, so a backwards sweep sees them first
+  for (std::size_t i = nodes.size(); i-- > 0; ) {
+    Node& node = nodes[i];
+    if (node.left == 0) {
+      node.bounds = createEmptyAabb();
+      for (unsigned int j = node.first; j < node.first + node.count; j++) {
+        grow(node.bounds, bounds[items[j]]);
+      }
+    } else {
+      node.bounds = nodes[node.left].bounds;
+      grow(node.bounds, nodes[node.left + 1].bounds);
+    }
+  }
+}
+
+/**
+ * Returns the surface area heuristic cost of the tree.
+ */
+float g3::Bvh::getCost() const
+{
+  if (nodes.empty()) {
+    return 0;
+  }
+  float rootArea = surfaceArea(nodes[0].bounds);
+  if (rootArea == 0) {
+    return items.size();
+  }
+
+  float cost = 0;
+  for (const Node& node : nodes) {
+    float area = surfaceArea(node.bounds);
+    cost += (node.left == 0) ? area * node.count : area;
+  }
+  return cost / rootArea;
+}
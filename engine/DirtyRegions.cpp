@@ -0,0 +1,106 @@
+
+#include "DirtyRegions.h"
+#include <algorithm>
+
+g3::DirtyRegions::DirtyRegions():
+frame {0},
+width {0},
+height {0}
+{
+  for (Frame& f : frames) {
+    f.number = 0;
+    f.changed = true;
+  }
+}
+
+/**
+ * Starts a frame of the given size.
+ */
+void g3::DirtyRegions::beginFrame(int width, int height, bool changed)
+{
+  frame++;
+  Frame& f = frames[frame % HISTORY];
+  f.number = frame;
+  f.changed = changed || width != this->width || height != this->height;
+  f.rects.clear();
+  this->width = width;
+  this->height = height;
+}
+
+/**
+ * Adds a rectangle where the frame differs from the last one.
+ */
+void g3::DirtyRegions::add(const ScreenRect& rect)
+{
+  // out to the tiles, and into the window
+  ScreenRect tiles {
+    std::max(0, rect.left / TILE_SIZE * TILE_SIZE),
+    std::max(0, rect.top / TILE_SIZE * TILE_SIZE),
+    std::min(width, (rect.right + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE),
+    std::min(height, (rect.bottom + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE)
+  };
+  if (!tiles.isEmpty()) {
+    frames[frame % HISTORY].rects.push_back(tiles);
+  }
+}
+
+/**
+ * Finds the regions to redraw in a frame buffer to bring it to the frame.
+ */
+bool g3::DirtyRegions::getRegions(const void* target, std::vector<ScreenRect>& regions) const
+{
+  regions.clear();
+  auto known = std::find_if(targets.begin(), targets.end(), [&](const Target& t) { return t.address == target; });
+  if (known == targets.end() || frame - known->frame > HISTORY) {
+    return false;
+  }
+
+  for (unsigned long n = known->frame + 1; n <= frame; n++) {
+    const Frame& f = frames[n % HISTORY];
+    if (f.number != n || f.changed) {
+      return false;
+    }
+    regions.insert(regions.end(), f.rects.begin(), f.rects.end());
+  }
+
+  // overlapping rectangles are replaced by their bounds until none overlap;
+  // the bounds may reach rectangles before them, so the passes go on until
+  // one merges nothing
+  for (bool merged = true; merged;) {
+    merged = false;
+    for (std::size_t i = 0; i < regions.size(); i++) {
+      for (std::size_t j = i + 1; j < regions.size(); j++) {
+        if (regions[i].intersects(regions[j])) {
+          ScreenRect& a = regions[i];
+          const ScreenRect& b = regions[j];
+          a = { std::min(a.left, b.left), std::min(a.top, b.top),
+                std::max(a.right, b.right), std::max(a.bottom, b.bottom) };
+          regions.erase(regions.begin() + j);
+          j = i;
+          merged = true;
+        }
+      }
+    }
+  }
+
+  long area = 0;
+  for (const ScreenRect& region : regions) {
+    area += region.getArea();
+  }
+  return regions.size() <= MAX_REGIONS && area <= MAX_COVERAGE * width * height;
+}
+
+/**
+ * Records that a frame buffer holds the frame.
+ */
+void g3::DirtyRegions::endFrame(const void* target)
+{
+  auto known = std::find_if(targets.begin(), targets.end(), [&](const Target& t) { return t.address == target; });
+  if (known != targets.end()) {
+    targets.erase(known);
+  }
+  targets.insert(targets.begin(), { target, frame });
+  if (targets.size() > HISTORY) {
+    targets.pop_back();
+  }
+}
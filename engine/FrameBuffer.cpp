@@ -0,0 +1,112 @@
+
+#include "FrameBuffer.h"
+#include "Kernels.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+
+/**
+ * Allocates memory aligned to BUFFER_ALIGNMENT bytes.
+ */
+void* g3::alignedAlloc(std::size_t bytes)
+{
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, BUFFER_ALIGNMENT, std::max<std::size_t>(bytes, 1)) != 0) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+/**
+ * Releases memory allocated by alignedAlloc.
+ */
+void g3::AlignedDeleter::operator()(void* ptr) const
+{
+  std::free(ptr);
+}
+
+g3::FrameBuffer::FrameBuffer(unsigned int w, unsigned int h):
+width {w},
+height {h},
+stride {(w + 15) & ~15u},
+capacity {(std::size_t)stride * h}
+{
+  colorBuffer.reset(static_cast<Color*>(alignedAlloc(capacity * sizeof(Color))));
+  depthBuffer.reset(static_cast<float*>(alignedAlloc(capacity * sizeof(float))));
+}
+
+/**
+ * Changes the size of the buffer, keeping its memory while it fits.
+ */
+void g3::FrameBuffer::resize(unsigned int w, unsigned int h)
+{
+  width = w;
+  height = h;
+  stride = (w + 15) & ~15u;
+  if ((std::size_t)stride * height <= capacity) {
+    return;
+  }
+
+  // the old pixels are not kept, so the memory is released first
+  capacity = (std::size_t)((stride + RESIZE_STEP - 1) / RESIZE_STEP * RESIZE_STEP)
+             * ((height + RESIZE_STEP - 1) / RESIZE_STEP * RESIZE_STEP);
+  colorBuffer.reset();
+  depthBuffer.reset();
+  colorBuffer.reset(static_cast<Color*>(alignedAlloc(capacity * sizeof(Color))));
+  depthBuffer.reset(static_cast<float*>(alignedAlloc(capacity * sizeof(float))));
+}
+
+/**
+ * Fills the color buffer with the given color and resets the depth buffer
+ * to infinity.
+ */
+void g3::FrameBuffer::clear(Color clearColor)
+{
+  clearRows(clearColor, 0, height);
+}
+
+/**
+ * Clears whole rows.
+ */
+void g3::FrameBuffer::clearRows(Color clearColor, unsigned int top, unsigned int bottom)
+{
+  std::size_t first = (std::size_t)stride * top;
+  std::size_t size = (std::size_t)stride * (bottom - top);
+  float far = std::numeric_limits<float>::infinity();
+  std::uint32_t farBits;
+  std::memcpy(&farBits, &far, sizeof(far));
+
+  const Kernels& k = kernels();
+  k.fill32(colorBuffer.get() + first, size, clearColor);
+  k.fill32(reinterpret_cast<std::uint32_t*>(depthBuffer.get()) + first, size, farBits);
+}
+
+/**
+ * Clears a rectangle of pixels.
+ */
+void g3::FrameBuffer::clear(Color clearColor, unsigned int left, unsigned int top, unsigned int right, unsigned int bottom)
+{
+  float far = std::numeric_limits<float>::infinity();
+  std::uint32_t farBits;
+  std::memcpy(&farBits, &far, sizeof(far));
+
+  const Kernels& k = kernels();
+  for (unsigned int y = top; y < bottom; y++) {
+    std::size_t row = indexOf(left, y);
+    k.fill32(colorBuffer.get() + row, right - left, clearColor);
+    k.fill32(reinterpret_cast<std::uint32_t*>(depthBuffer.get()) + row, right - left, farBits);
+  }
+}
+
+/**
+ * Resets the depth buffer to infinity.
+ */
+void g3::FrameBuffer::clearDepth()
+{
+  float far = std::numeric_limits<float>::infinity();
+  std::uint32_t farBits;
+  std::memcpy(&farBits, &far, sizeof(far));
+  kernels().fill32(reinterpret_cast<std::uint32_t*>(depthBuffer.get()), (std::size_t)stride * height, farBits);
+}
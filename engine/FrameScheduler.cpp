@@ -0,0 +1,205 @@
+
+#include "FrameScheduler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+/**
+ * Weight of the newest sample in the moving averages.
+ */
+const float SMOOTHING = 0.1f;
+
+/**
+ * Above this load the detail level is raised.
+ */
+const float LOAD_HIGH = 0.9f;
+
+/**
+ * Below this load the detail level is lowered.
+ */
+const float LOAD_LOW = 0.5f;
+
+/**
+ * The number of frames to wait after a detail change before the next one,
+ * so that the moving average can follow.
+ */
+const unsigned int SETTLE_FRAMES = 30;
+
+/**
+ * The load that dynamic resolution aims for, between LOAD_LOW and LOAD_HIGH.
+ */
+const float LOAD_TARGET = 0.7f;
+
+/**
+ * The number of frames to wait after a resolution change. The moving
+ * average of the load is corrected for the change right away, so the wait
+ * is shorter than that of the detail level.
+ */
+const unsigned int RESOLUTION_SETTLE_FRAMES = 8;
+
+}
+
+g3::FrameTimeHistogram::FrameTimeHistogram()
+{
+  reset();
+}
+
+/**
+ * Adds a frame time in nanoseconds.
+ */
+void g3::FrameTimeHistogram::add(unsigned long frameTime)
+{
+  unsigned long bucket = std::min<unsigned long>(frameTime / BUCKET_WIDTH, BUCKETS - 1);
+  counts[bucket]++;
+  total++;
+}
+
+/**
+ * Removes every sample.
+ */
+void g3::FrameTimeHistogram::reset()
+{
+  std::fill(counts, counts + BUCKETS, 0);
+  total = 0;
+}
+
+/**
+ * Returns the frame time in nanoseconds that the given fraction of the
+ * samples does not exceed.
+ */
+unsigned long g3::FrameTimeHistogram::percentile(float fraction) const
+{
+  unsigned long limit = (unsigned long)(fraction * total);
+  unsigned long sum = 0;
+  for (unsigned int i = 0; i < BUCKETS; i++) {
+    sum += counts[i];
+    if (sum >= limit && sum > 0) {
+      return (i + 1) * BUCKET_WIDTH;
+    }
+  }
+  return 0;
+}
+
+g3::FrameScheduler::FrameScheduler(unsigned long targetFrameTime, unsigned long simulationStep):
+targetFrameTime {targetFrameTime},
+simulationStep {simulationStep},
+lastTick {0},
+accumulator {0},
+lastPresent {0},
+averageFrameTime {(float)targetFrameTime},
+load {0},
+detailLevel {0},
+framesAtLevel {0},
+dynamicResolution {false},
+resolutionScale {1},
+framesAtScale {0}
+{
+}
+
+/**
+ * Starts a tick and returns the number of simulation steps to run.
+ */
+unsigned int g3::FrameScheduler::tick(unsigned long now)
+{
+  if (lastTick != 0) {
+    accumulator += now - lastTick;
+  }
+  lastTick = now;
+
+  unsigned int steps = accumulator / simulationStep;
+  accumulator -= steps * simulationStep;
+
+  // Do not try to catch up after a long stall, that would only make the
+  // following frames late as well.
+  return std::min(steps, MAX_STEPS);
+}
+
+/**
+ * Returns the fraction of a simulation step that elapsed after the last step.
+ */
+float g3::FrameScheduler::getInterpolation() const
+{
+  return accumulator / (float)simulationStep;
+}
+
+/**
+ * Records a presented frame.
+ */
+void g3::FrameScheduler::framePresented(unsigned long now, unsigned long renderTime)
+{
+  if (lastPresent != 0) {
+    unsigned long frameTime = now - lastPresent;
+    frameTimes.add(frameTime);
+    averageFrameTime += SMOOTHING * (frameTime - averageFrameTime);
+  }
+  lastPresent = now;
+
+  renderTimes.add(renderTime);
+  load += SMOOTHING * ((renderTime / (float)targetFrameTime) - load);
+
+  framesAtLevel++;
+  framesAtScale++;
+
+  // the resolution is lowered before the detail and restored after it
+  bool lowest = resolutionScale < MIN_RESOLUTION_SCALE + RESOLUTION_STEP / 2;
+  if (dynamicResolution && ((load > LOAD_HIGH) ? !lowest : detailLevel == 0)) {
+    adaptResolution();
+    return;
+  }
+
+  // adapt the amount of work to the measured load
+  if (framesAtLevel < SETTLE_FRAMES) {
+    return;
+  }
+
+  if (load > LOAD_HIGH && detailLevel < MAX_DETAIL_LEVEL) {
+    detailLevel++;
+    framesAtLevel = 0;
+  } else if (load < LOAD_LOW && detailLevel > 0) {
+    detailLevel--;
+    framesAtLevel = 0;
+  }
+}
+
+/**
+ * Turns dynamic resolution on or off.
+ */
+void g3::FrameScheduler::setDynamicResolution(bool enabled)
+{
+  dynamicResolution = enabled;
+  resolutionScale = 1;
+  framesAtScale = 0;
+}
+
+/**
+ * Moves the resolution scale towards the target load.
+ */
+void g3::FrameScheduler::adaptResolution()
+{
+  if (framesAtScale < RESOLUTION_SETTLE_FRAMES || (load >= LOAD_LOW && load <= LOAD_HIGH)) {
+    return;
+  }
+
+  // the render time goes with the number of pixels, the square of the scale
+  float scale = resolutionScale * std::sqrt(LOAD_TARGET / std::max(load, 0.01f));
+  scale = std::round(scale / RESOLUTION_STEP) * RESOLUTION_STEP;
+  scale = std::min(1.0f, std::max(MIN_RESOLUTION_SCALE, scale));
+  if (scale == resolutionScale) {
+    return;
+  }
+
+  // the next frames are expected to take that much less, or more
+  load *= (scale * scale) / (resolutionScale * resolutionScale);
+  resolutionScale = scale;
+  framesAtScale = 0;
+}
+
+/**
+ * Returns the achieved frames per second.
+ */
+float g3::FrameScheduler::getFps() const
+{
+  return (averageFrameTime > 0) ? 1e9f / averageFrameTime : 0;
+}
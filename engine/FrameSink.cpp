@@ -0,0 +1,516 @@
+
+#include "FrameSink.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+
+/**
+ * The largest block of stored (uncompressed) deflate data.
+ */
+const std::size_t STORED_BLOCK_SIZE = 65535;
+
+/**
+ * Returns a channel of a color, 0 for red to 3 for alpha.
+ */
+inline unsigned int channelOf(g3::Color color, unsigned int channel)
+{
+  return color >> (channel * 8) & 0xff;
+}
+
+/**
+ * Writes the red, green and blue bytes of n colors, four colors at a time
+ * as three 32-bit words.
+ */
+void packRgb(const g3::Color* in, std::uint8_t* out, std::size_t n)
+{
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4, out += 12) {
+    std::uint32_t words[3] {
+      (in[i] & 0xffffff) | in[i + 1] << 24,
+      (in[i + 1] >> 8 & 0xffff) | in[i + 2] << 16,
+      (in[i + 2] >> 16 & 0xff) | in[i + 3] << 8
+    };
+    std::memcpy(out, words, sizeof(words));
+  }
+  for (; i < n; i++) {
+    *out++ = channelOf(in[i], 0);
+    *out++ = channelOf(in[i], 1);
+    *out++ = channelOf(in[i], 2);
+  }
+}
+
+/**
+ * Appends a 32-bit value in big endian order, the byte order of PNG.
+ */
+void appendBigEndian(std::vector<std::uint8_t>& bytes, std::uint32_t value)
+{
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    bytes.push_back(value >> shift & 0xff);
+  }
+}
+
+/**
+ * Updates the CRC-32 of PNG chunks with n bytes, four bytes at a time with
+ * a table per byte (slicing by 4).
+ */
+std::uint32_t updateCrc(std::uint32_t crc, const std::uint8_t* data, std::size_t n)
+{
+  static const struct Tables
+  {
+    std::uint32_t entries[4][256];
+
+    Tables()
+    {
+      for (std::uint32_t i = 0; i < 256; i++) {
+        std::uint32_t c = i;
+        for (int bit = 0; bit < 8; bit++) {
+          c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        }
+        entries[0][i] = c;
+      }
+      for (int k = 1; k < 4; k++) {
+        for (std::uint32_t i = 0; i < 256; i++) {
+          entries[k][i] = entries[0][entries[k - 1][i] & 0xff] ^ (entries[k - 1][i] >> 8);
+        }
+      }
+    }
+  } tables;
+
+  crc = ~crc;
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    std::uint32_t word;
+    std::memcpy(&word, data + i, 4);
+    word ^= crc;
+    crc = tables.entries[3][word & 0xff] ^ tables.entries[2][word >> 8 & 0xff]
+          ^ tables.entries[1][word >> 16 & 0xff] ^ tables.entries[0][word >> 24];
+  }
+  for (; i < n; i++) {
+    crc = tables.entries[0][(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+/**
+ * Returns the Adler-32 checksum that ends a zlib stream.
+ */
+std::uint32_t adler32(const std::uint8_t* data, std::size_t n)
+{
+  // the sums are reduced every 5552 bytes, the most that cannot overflow;
+  // within 8 bytes, b gains 8 times a and the bytes weighted by the times
+  // they are added, which keeps the additions independent
+  std::uint32_t a = 1, b = 0;
+  while (n > 0) {
+    std::size_t chunk = std::min<std::size_t>(n, 5552);
+    std::size_t i = 0;
+    for (; i + 8 <= chunk; i += 8) {
+      const std::uint8_t* d = data + i;
+      b += 8 * a + 8 * d[0] + 7 * d[1] + 6 * d[2] + 5 * d[3] + 4 * d[4] + 3 * d[5] + 2 * d[6] + d[7];
+      a += d[0] + d[1] + d[2] + d[3] + d[4] + d[5] + d[6] + d[7];
+    }
+    for (; i < chunk; i++) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    data += chunk;
+    n -= chunk;
+  }
+  return b << 16 | a;
+}
+
+/**
+ * Appends a PNG chunk whose data were appended from offset on, with the
+ * length and the type before them and the CRC after them.
+ */
+void finishChunk(std::vector<std::uint8_t>& bytes, std::size_t offset)
+{
+  std::uint32_t length = bytes.size() - offset - 8;
+  for (int i = 0; i < 4; i++) {
+    bytes[offset + i] = length >> (24 - i * 8) & 0xff;
+  }
+  appendBigEndian(bytes, updateCrc(0, bytes.data() + offset + 4, length + 4));
+}
+
+/**
+ * Starts a PNG chunk of a type and returns its offset for finishChunk.
+ */
+std::size_t startChunk(std::vector<std::uint8_t>& bytes, const char* type)
+{
+  std::size_t offset = bytes.size();
+  bytes.insert(bytes.end(), 4, 0);
+  bytes.insert(bytes.end(), type, type + 4);
+  return offset;
+}
+
+/**
+ * Returns whether a pattern of file names holds exactly one conversion of
+ * an int, with flags, a width and a precision at most, and otherwise only
+ * escaped percent signs, so that printf formats it with the number of the
+ * frame safely.
+ */
+bool isFramePattern(const std::string& pattern)
+{
+  unsigned int conversions = 0;
+  for (std::size_t i = 0; i < pattern.size(); i++) {
+    if (pattern[i] != '%') {
+      continue;
+    }
+    if (++i < pattern.size() && pattern[i] == '%') {
+      continue;
+    }
+    i = pattern.find_first_not_of("-+ #0", i);
+    i = pattern.find_first_not_of("0123456789", i);
+    if (i < pattern.size() && pattern[i] == '.') {
+      i = pattern.find_first_not_of("0123456789", i + 1);
+    }
+    if (i >= pattern.size() || (pattern[i] != 'd' && pattern[i] != 'i')) {
+      return false;
+    }
+    conversions++;
+  }
+  return conversions == 1;
+}
+
+} // namespace
+
+/**
+ * Returns the name of a frame format.
+ */
+const char* g3::getFrameFormatName(FrameFormat format)
+{
+  switch (format) {
+    case FrameFormat::RAW:
+      return "raw";
+    case FrameFormat::PPM:
+      return "ppm";
+    case FrameFormat::PNG:
+      return "png";
+    case FrameFormat::Y4M:
+      return "y4m";
+  }
+  return "unknown";
+}
+
+/**
+ * Parses the name of a frame format.
+ */
+bool g3::parseFrameFormat(const char* name, FrameFormat& format)
+{
+  for (FrameFormat candidate : { FrameFormat::RAW, FrameFormat::PPM, FrameFormat::PNG, FrameFormat::Y4M }) {
+    if (std::strcmp(name, getFrameFormatName(candidate)) == 0) {
+      format = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+g3::FrameSink::FrameSink(FrameFormat format, const std::string& path, unsigned int w, unsigned int h,
+                         unsigned int framesPerSecond, bool wait):
+format {format},
+path {path},
+framesPerSecond {framesPerSecond},
+wait {wait},
+stream {nullptr},
+ownsStream {false},
+back {0},
+head {0},
+count {0},
+freeCount {0},
+writing {false},
+nextNumber {0},
+written {0},
+dropped {0},
+failed {0},
+stopping {false}
+{
+  // the sequences open a file per frame
+  if (format == FrameFormat::RAW || format == FrameFormat::Y4M) {
+    if (path == "-") {
+      stream = stdout;
+    } else {
+      stream = std::fopen(path.c_str(), "wb");
+      ownsStream = true;
+      if (!stream) {
+        throw std::runtime_error("cannot open " + path);
+      }
+    }
+  } else if (!isFramePattern(path)) {
+    throw std::runtime_error("not a pattern with one int conversion for the frame number, such as frame%05d."
+                             + std::string(getFrameFormatName(format)) + ": " + path);
+  }
+
+  for (unsigned int i = 0; i <= QUEUE_SIZE; i++) {
+    buffers[i].reset(new FrameBuffer(w, h));
+    if (i != back) {
+      freeBuffers[freeCount++] = i;
+    }
+  }
+
+  ioThread = std::thread(&FrameSink::ioLoop, this);
+}
+
+/**
+ * Writes the queued frames and closes the output.
+ */
+g3::FrameSink::~FrameSink()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  frameQueued.notify_one();
+  ioThread.join();
+
+  if (ownsStream) {
+    std::fclose(stream);
+  } else if (stream) {
+    std::fflush(stream);
+  }
+}
+
+/**
+ * Queues the back buffer for writing and hands the producer a new one.
+ */
+bool g3::FrameSink::present()
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (freeCount == 0) {
+      if (!wait) {
+        dropped++;
+        return false;
+      }
+      bufferFreed.wait(lock, [this] { return freeCount > 0; });
+    }
+
+    unsigned int tail = (head + count) % (QUEUE_SIZE + 1);
+    queue[tail] = back;
+    numbers[back] = nextNumber++;
+    count++;
+    back = freeBuffers[--freeCount];
+  }
+  frameQueued.notify_one();
+  return true;
+}
+
+/**
+ * Waits until the queued frames are written.
+ */
+void g3::FrameSink::flush()
+{
+  // the I/O thread waits for the lock before it writes again
+  std::unique_lock<std::mutex> lock(mutex);
+  bufferFreed.wait(lock, [this] { return count == 0 && !writing; });
+  if (stream) {
+    std::fflush(stream);
+  }
+}
+
+unsigned long g3::FrameSink::getWrittenCount() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return written;
+}
+
+unsigned long g3::FrameSink::getDroppedCount() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return dropped;
+}
+
+unsigned long g3::FrameSink::getFailedCount() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return failed;
+}
+
+/**
+ * The body of the I/O thread: writes the queued frames in order until the
+ * sink stops and the queue is empty.
+ */
+void g3::FrameSink::ioLoop()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    frameQueued.wait(lock, [this] { return count > 0 || stopping; });
+    if (count == 0) {
+      break;
+    }
+
+    unsigned int index = queue[head];
+    head = (head + 1) % (QUEUE_SIZE + 1);
+    count--;
+    writing = true;
+
+    // the producer only touches the queue while the frame is written
+    lock.unlock();
+    bool ok = write(*buffers[index], numbers[index]);
+    lock.lock();
+
+    (ok ? written : failed)++;
+    freeBuffers[freeCount++] = index;
+    writing = false;
+    bufferFreed.notify_all();
+  }
+}
+
+/**
+ * Encodes a frame and writes it out.
+ */
+bool g3::FrameSink::write(const FrameBuffer& frame, unsigned long number)
+{
+  if (format == FrameFormat::RAW) {
+    // the rows go out as they are, without a copy
+    bool ok = true;
+    for (unsigned int y = 0; y < frame.getHeight() && ok; y++) {
+      const Color* row = frame.getColorBuffer() + frame.indexOf(0, y);
+      ok = std::fwrite(row, sizeof(Color), frame.getWidth(), stream) == frame.getWidth();
+    }
+    return ok;
+  }
+
+  bytes.clear();
+  switch (format) {
+    case FrameFormat::RAW:
+      break;
+    case FrameFormat::PPM:
+      encodePpm(frame);
+      break;
+    case FrameFormat::PNG:
+      encodePng(frame);
+      break;
+    case FrameFormat::Y4M:
+      encodeY4m(frame, number);
+      break;
+  }
+
+  if (stream) {
+    return std::fwrite(bytes.data(), 1, bytes.size(), stream) == bytes.size();
+  }
+
+  std::vector<char> name(path.size() + 32);
+  std::snprintf(name.data(), name.size(), path.c_str(), (int)number);
+  std::FILE* file = std::fopen(name.data(), "wb");
+  if (!file) {
+    return false;
+  }
+  bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+  return (std::fclose(file) == 0) && ok;
+}
+
+/**
+ * Encodes a binary PPM file.
+ */
+void g3::FrameSink::encodePpm(const FrameBuffer& frame)
+{
+  std::string header = "P6\n" + std::to_string(frame.getWidth()) + " " + std::to_string(frame.getHeight())
+                       + "\n255\n";
+  bytes.insert(bytes.end(), header.begin(), header.end());
+
+  std::size_t offset = bytes.size();
+  bytes.resize(offset + (std::size_t)frame.getWidth() * frame.getHeight() * 3);
+  for (unsigned int y = 0; y < frame.getHeight(); y++) {
+    packRgb(frame.getColorBuffer() + frame.indexOf(0, y), bytes.data() + offset + (std::size_t)y * frame.getWidth() * 3,
+            frame.getWidth());
+  }
+}
+
+/**
+ * Encodes a PNG file, its image data in stored deflate blocks.
+ */
+void g3::FrameSink::encodePng(const FrameBuffer& frame)
+{
+  // the scanlines start with filter type 0, none
+  unsigned int width = frame.getWidth(), height = frame.getHeight();
+  std::size_t rowSize = 1 + (std::size_t)width * 3;
+  scanlines.resize(rowSize * height);
+  for (unsigned int y = 0; y < height; y++) {
+    std::uint8_t* out = scanlines.data() + y * rowSize;
+    *out = 0;
+    packRgb(frame.getColorBuffer() + frame.indexOf(0, y), out + 1, width);
+  }
+
+  static const std::uint8_t SIGNATURE[] { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  bytes.insert(bytes.end(), SIGNATURE, SIGNATURE + sizeof(SIGNATURE));
+
+  // 8-bit RGB, deflate, the default filters, not interlaced
+  std::size_t chunk = startChunk(bytes, "IHDR");
+  appendBigEndian(bytes, width);
+  appendBigEndian(bytes, height);
+  bytes.insert(bytes.end(), { 8, 2, 0, 0, 0 });
+  finishChunk(bytes, chunk);
+
+  // a zlib stream without compression: a header that declares the fastest
+  // level, the stored blocks, and the checksum of the data
+  chunk = startChunk(bytes, "IDAT");
+  bytes.insert(bytes.end(), { 0x78, 0x01 });
+  std::size_t remaining = scanlines.size();
+  const std::uint8_t* data = scanlines.data();
+  do {
+    std::size_t block = std::min(remaining, STORED_BLOCK_SIZE);
+    bytes.push_back(block == remaining);
+    bytes.insert(bytes.end(), { (std::uint8_t)(block & 0xff), (std::uint8_t)(block >> 8),
+                                (std::uint8_t)(~block & 0xff), (std::uint8_t)(~block >> 8 & 0xff) });
+    bytes.insert(bytes.end(), data, data + block);
+    data += block;
+    remaining -= block;
+  } while (remaining > 0);
+  appendBigEndian(bytes, adler32(scanlines.data(), scanlines.size()));
+  finishChunk(bytes, chunk);
+
+  finishChunk(bytes, startChunk(bytes, "IEND"));
+}
+
+/**
+ * Encodes a frame of a YUV4MPEG2 stream, after the header of the stream if
+ * it is the first frame.
+ */
+void g3::FrameSink::encodeY4m(const FrameBuffer& frame, unsigned long number)
+{
+  unsigned int width = frame.getWidth(), height = frame.getHeight();
+  if (number == 0) {
+    // C420jpeg places the chroma between the pixels, like JPEG; the range
+    // needs a tag of its own, or the readers take it for the limited one
+    std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) + " F"
+                         + std::to_string(framesPerSecond) + ":1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n";
+    bytes.insert(bytes.end(), header.begin(), header.end());
+  }
+  static const char FRAME[] = "FRAME\n";
+  bytes.insert(bytes.end(), FRAME, FRAME + 6);
+
+  // full range BT.601 in 8.8 fixed point
+  unsigned int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+  std::size_t offset = bytes.size();
+  bytes.resize(offset + (std::size_t)width * height + 2 * (std::size_t)chromaWidth * chromaHeight);
+  std::uint8_t* luma = bytes.data() + offset;
+  for (unsigned int y = 0; y < height; y++) {
+    const Color* row = frame.getColorBuffer() + frame.indexOf(0, y);
+    for (unsigned int x = 0; x < width; x++) {
+      *luma++ = (77 * channelOf(row[x], 0) + 150 * channelOf(row[x], 1) + 29 * channelOf(row[x], 2) + 128) >> 8;
+    }
+  }
+
+  // the chroma of the average of every 2x2 pixels, the edges repeated
+  std::uint8_t* cb = luma;
+  std::uint8_t* cr = cb + (std::size_t)chromaWidth * chromaHeight;
+  for (unsigned int y = 0; y < height; y += 2) {
+    const Color* row0 = frame.getColorBuffer() + frame.indexOf(0, y);
+    const Color* row1 = frame.getColorBuffer() + frame.indexOf(0, std::min(y + 1, height - 1));
+    for (unsigned int x = 0; x < width; x += 2) {
+      unsigned int x1 = std::min(x + 1, width - 1);
+      int rgb[3];
+      for (unsigned int c = 0; c < 3; c++) {
+        rgb[c] = (channelOf(row0[x], c) + channelOf(row0[x1], c) + channelOf(row1[x], c)
+                  + channelOf(row1[x1], c) + 2) / 4;
+      }
+      *cb++ = std::min(255, (-43 * rgb[0] - 85 * rgb[1] + 128 * rgb[2] + 128 * 256 + 128) >> 8);
+      *cr++ = std::min(255, (128 * rgb[0] - 107 * rgb[1] - 21 * rgb[2] + 128 * 256 + 128) >> 8);
+    }
+  }
+}
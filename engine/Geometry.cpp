@@ -0,0 +1,162 @@
+
+#include "Geometry.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/**
+ * Returns a box that contains nothing, ready to be grown.
+ */
+g3::Aabb g3::createEmptyAabb()
+{
+  float inf = std::numeric_limits<float>::infinity();
+  return { Vec3{inf, inf, inf}, Vec3{-inf, -inf, -inf} };
+}
+
+/**
+ * Grows the box to contain the point.
+ */
+void g3::grow(Aabb& box, const Vec3& point)
+{
+  for (int i = 0; i < 3; i++) {
+    box.min[i] = std::min(box.min[i], point[i]);
+    box.max[i] = std::max(box.max[i], point[i]);
+  }
+}
+
+/**
+ * Grows the box to contain another box.
+ */
+void g3::grow(Aabb& box, const Aabb& other)
+{
+  for (int i = 0; i < 3; i++) {
+    box.min[i] = std::min(box.min[i], other.min[i]);
+    box.max[i] = std::max(box.max[i], other.max[i]);
+  }
+}
+
+/**
+ * Returns the smallest box containing both boxes.
+ */
+g3::Aabb g3::merge(const Aabb& lhs, const Aabb& rhs)
+{
+  Aabb res;
+  for (int i = 0; i < 3; i++) {
+    res.min[i] = std::min(lhs.min[i], rhs.min[i]);
+    res.max[i] = std::max(lhs.max[i], rhs.max[i]);
+  }
+  return res;
+}
+
+/**
+ * Returns the center of the box.
+ */
+g3::Vec3 g3::center(const Aabb& box)
+{
+  return (box.min + box.max) * 0.5f;
+}
+
+/**
+ * Returns the surface area of the box.
+ */
+float g3::surfaceArea(const Aabb& box)
+{
+  Vec3 d = box.max - box.min;
+  if (d[0] < 0 || d[1] < 0 || d[2] < 0) {
+    return 0;
+  }
+  return 2 * (d[0]*d[1] + d[1]*d[2] + d[2]*d[0]);
+}
+
+/**
+ * Returns the box containing the box transformed by an affine matrix.
+ */
+g3::Aabb g3::transformAabb(const Aabb& box, const Mat4& mat)
+{
+  // Arvo: transform the center and grow the extent by the absolute matrix
+  Vec3 c = center(box);
+  Vec3 e = (box.max - box.min) * 0.5f;
+
+  Vec3 tc, te;
+  for (int j = 0; j < 3; j++) {
+    tc[j] = c[0]*mat[j] + c[1]*mat[4+j] + c[2]*mat[8+j] + mat[12+j];
+    te[j] = e[0]*std::abs(mat[j]) + e[1]*std::abs(mat[4+j]) + e[2]*std::abs(mat[8+j]);
+  }
+  return { tc - te, tc + te };
+}
+
+/**
+ * Creates a ray.
+ */
+g3::Ray g3::createRay(const Vec3& origin, const Vec3& direction)
+{
+  // 1/0 gives infinity, which the slab test handles
+  return { origin, direction, Vec3{1 / direction[0], 1 / direction[1], 1 / direction[2]} };
+}
+
+/**
+ * Intersects a ray with a box.
+ */
+bool g3::intersect(const Ray& ray, const Aabb& box, float tMax, float& tNear)
+{
+  float t0 = 0;
+  float t1 = tMax;
+  for (int i = 0; i < 3; i++) {
+    float tA = (box.min[i] - ray.origin[i]) * ray.invDirection[i];
+    float tB = (box.max[i] - ray.origin[i]) * ray.invDirection[i];
+    // a NaN (0 * infinity, origin on the slab) must not reject the box
+    if (tA > tB) std::swap(tA, tB);
+    if (tA > t0) t0 = tA;
+    if (tB < t1) t1 = tB;
+    if (t0 > t1) {
+      return false;
+    }
+  }
+  tNear = t0;
+  return true;
+}
+
+/**
+ * Extracts the frustum of a view projection matrix in row major order.
+ */
+g3::Frustum g3::createFrustum(const Mat4& m, float halfWidth, float halfHeight)
+{
+  // With row vectors clip = p * M, so each clip coordinate is a dot product
+  // with a column of M.
+  Vec4 x {m[0], m[4], m[8],  m[12]};
+  Vec4 y {m[1], m[5], m[9],  m[13]};
+  Vec4 z {m[2], m[6], m[10], m[14]};
+  Vec4 w {m[3], m[7], m[11], m[15]};
+
+  return { {
+    w * halfWidth + x,   // left:   x >= -halfWidth * w
+    w * halfWidth - x,   // right:  x <=  halfWidth * w
+    w * halfHeight + y,  // bottom: y >= -halfHeight * w
+    w * halfHeight - y,  // top:    y <=  halfHeight * w
+    z,                   // near:   z >= 0
+    w - z                // far:    z <= w
+  } };
+}
+
+/**
+ * Classifies a box against a frustum.
+ */
+g3::Containment g3::classify(const Frustum& frustum, const Aabb& box)
+{
+  Containment res = Containment::INSIDE;
+  for (const Vec4& p : frustum.planes) {
+    // the corners furthest along and against the plane normal
+    float outer = p[3], inner = p[3];
+    for (int i = 0; i < 3; i++) {
+      outer += p[i] * ((p[i] >= 0) ? box.max[i] : box.min[i]);
+      inner += p[i] * ((p[i] >= 0) ? box.min[i] : box.max[i]);
+    }
+    if (outer < 0) {
+      return Containment::OUTSIDE;
+    }
+    if (inner < 0) {
+      res = Containment::INTERSECTING;
+    }
+  }
+  return res;
+}
@@ -0,0 +1,901 @@
+
+#include "Kernels.h"
+#include "FrameBuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define G3_X86 1
+#endif
+
+namespace
+{
+
+using g3::Isa;
+using g3::Kernels;
+
+/**
+ * Spans of at least this many bytes are written with non-temporal stores.
+ * Smaller buffers stay in the cache for the rasterizer that follows the
+ * clear, which measured faster than streaming them (900x600 clears).
+ */
+const std::size_t STREAMING_THRESHOLD = 16 * 1024 * 1024;
+
+// *****************************************************************************
+// scalar
+// *****************************************************************************
+
+void multiplyMat4Scalar(const float* lhs, const float* rhs, float* res)
+{
+  for (int i = 0; i < 4; i++) {
+    for (int k = 0; k < 4; k++) {
+      res[i*4+k] = lhs[i*4] * rhs[k] + lhs[i*4+1] * rhs[4+k]
+                 + lhs[i*4+2] * rhs[8+k] + lhs[i*4+3] * rhs[12+k];
+    }
+  }
+}
+
+void transformPointsScalar(const float* in, std::size_t stride, float* out, std::size_t n, const float* mat)
+{
+  for (std::size_t i = 0; i < n; i++, in += stride, out += 3) {
+    float x = (in[0] * mat[0]) + (in[1] * mat[4]) + (in[2] * mat[8])  + mat[12];
+    float y = (in[0] * mat[1]) + (in[1] * mat[5]) + (in[2] * mat[9])  + mat[13];
+    float z = (in[0] * mat[2]) + (in[1] * mat[6]) + (in[2] * mat[10]) + mat[14];
+    float w = (in[0] * mat[3]) + (in[1] * mat[7]) + (in[2] * mat[11]) + mat[15];
+
+    if (w != 1 && w != 0) {
+      x /= w;
+      y /= w;
+      z /= w;
+    }
+
+    out[0] = x;
+    out[1] = y;
+    out[2] = z;
+  }
+}
+
+void fill32Scalar(std::uint32_t* dst, std::size_t n, std::uint32_t value)
+{
+  std::fill_n(dst, n, value);
+}
+
+/**
+ * Hits closer than this are ignored, so that rays leaving a surface do not
+ * hit it again.
+ */
+const float RAY_EPSILON = 1e-6f;
+
+int intersectTrianglesScalar(const float* packet, const float* ray, float* distance)
+{
+  const unsigned int N = g3::TRIANGLE_PACKET_SIZE;
+  int closest = -1;
+
+  for (unsigned int i = 0; i < N; i++) {
+    float v0[3], e1[3], e2[3];
+    for (int k = 0; k < 3; k++) {
+      v0[k] = packet[k*N + i];
+      e1[k] = packet[(3+k)*N + i];
+      e2[k] = packet[(6+k)*N + i];
+    }
+    const float* o = ray;
+    const float* d = ray + 3;
+
+    float p[3] { d[1]*e2[2] - d[2]*e2[1], d[2]*e2[0] - d[0]*e2[2], d[0]*e2[1] - d[1]*e2[0] };
+    float det = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+    if (det == 0) {
+      continue;
+    }
+    float inv = 1 / det;
+
+    float t[3] { o[0] - v0[0], o[1] - v0[1], o[2] - v0[2] };
+    float u = (t[0]*p[0] + t[1]*p[1] + t[2]*p[2]) * inv;
+    float q[3] { t[1]*e1[2] - t[2]*e1[1], t[2]*e1[0] - t[0]*e1[2], t[0]*e1[1] - t[1]*e1[0] };
+    float v = (d[0]*q[0] + d[1]*q[1] + d[2]*q[2]) * inv;
+    float dist = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2]) * inv;
+
+    if (u >= 0 && v >= 0 && u + v <= 1 && dist > RAY_EPSILON && dist < *distance) {
+      *distance = dist;
+      closest = i;
+    }
+  }
+  return closest;
+}
+
+/**
+ * Packs a color with channels from 0 to 1, clamping them.
+ */
+std::uint32_t packColor(float r, float g, float b)
+{
+  auto channel = [](float c) { return (int)std::nearbyint(std::min(std::max(c, 0.0f), 1.0f) * 255); };
+  return g3::createRGBA(channel(r), channel(g), channel(b), 255);
+}
+
+void lightVerticesScalar(const float* positions, const float* normals, std::size_t stride, std::size_t n,
+                         const float* lights, std::size_t lightCount, const float* material, std::uint32_t* colors)
+{
+  for (std::size_t i = 0; i < n; i++, positions += stride, normals += stride) {
+    float r = 0, g = 0, b = 0;
+    for (const float* light = lights; light < lights + lightCount * g3::LIGHT_SIZE; light += g3::LIGHT_SIZE) {
+      float lx = light[0] - light[3] * positions[0];
+      float ly = light[1] - light[3] * positions[1];
+      float lz = light[2] - light[3] * positions[2];
+      float distance2 = lx * lx + ly * ly + lz * lz;
+      float cosine = normals[0] * lx + normals[1] * ly + normals[2] * lz;
+      if (cosine <= 0) {
+        continue;
+      }
+      float intensity = cosine / std::sqrt(distance2) * std::max(1 - distance2 * light[7], 0.0f);
+      r += light[4] * intensity;
+      g += light[5] * intensity;
+      b += light[6] * intensity;
+    }
+    colors[i] = packColor(material[0] + material[4] * r, material[1] + material[5] * g,
+                          material[2] + material[6] * b);
+  }
+}
+
+void mergeMinDepthScalar(std::uint32_t* dstColor, float* dstDepth, const std::uint32_t* srcColor,
+                         const float* srcDepth, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; i++) {
+    if (srcDepth[i] < dstDepth[i]) {
+      dstDepth[i] = srcDepth[i];
+      dstColor[i] = srcColor[i];
+    }
+  }
+}
+
+/**
+ * Blends two colors channel by channel, the second one by weight / BLEND_ONE.
+ */
+inline std::uint32_t blendColors(std::uint32_t a, std::uint32_t b, unsigned int weight)
+{
+  std::uint32_t color = 0;
+  for (int shift = 0; shift < 32; shift += 8) {
+    unsigned int channel = ((a >> shift & 0xff) * (g3::BLEND_ONE - weight) + (b >> shift & 0xff) * weight
+                            + g3::BLEND_ONE / 2) / g3::BLEND_ONE;
+    color |= channel << shift;
+  }
+  return color;
+}
+
+void scaleRowScalar(const std::uint32_t* in, const std::uint32_t* columns, std::uint32_t* out, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; i++) {
+    const std::uint32_t* pair = in + (columns[i] >> 8);
+    out[i] = blendColors(pair[0], pair[1], columns[i] & 0xff);
+  }
+}
+
+void blendRowsScalar(const std::uint32_t* a, const std::uint32_t* b, std::uint32_t* out, std::size_t n,
+                     unsigned int weight)
+{
+  for (std::size_t i = 0; i < n; i++) {
+    out[i] = blendColors(a[i], b[i], weight);
+  }
+}
+
+const Kernels SCALAR_KERNELS {
+  Isa::SCALAR, multiplyMat4Scalar, transformPointsScalar, fill32Scalar,
+  intersectTrianglesScalar, lightVerticesScalar, mergeMinDepthScalar,
+  scaleRowScalar, blendRowsScalar
+};
+
+#ifdef G3_X86
+
+// *****************************************************************************
+// SSE4.1
+// *****************************************************************************
+
+__attribute__((target("sse4.1")))
+void multiplyMat4Sse41(const float* lhs, const float* rhs, float* res)
+{
+  __m128 r0 = _mm_loadu_ps(rhs);
+  __m128 r1 = _mm_loadu_ps(rhs + 4);
+  __m128 r2 = _mm_loadu_ps(rhs + 8);
+  __m128 r3 = _mm_loadu_ps(rhs + 12);
+
+  for (int i = 0; i < 4; i++) {
+    __m128 row = _mm_mul_ps(_mm_set1_ps(lhs[i*4]), r0);
+    row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(lhs[i*4+1]), r1));
+    row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(lhs[i*4+2]), r2));
+    row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(lhs[i*4+3]), r3));
+    _mm_storeu_ps(res + i*4, row);
+  }
+}
+
+__attribute__((target("sse4.1")))
+void transformPointsSse41(const float* in, std::size_t stride, float* out, std::size_t n, const float* mat)
+{
+  __m128 m0 = _mm_loadu_ps(mat);
+  __m128 m1 = _mm_loadu_ps(mat + 4);
+  __m128 m2 = _mm_loadu_ps(mat + 8);
+  __m128 m3 = _mm_loadu_ps(mat + 12);
+  __m128 zero = _mm_setzero_ps();
+  __m128 one = _mm_set1_ps(1);
+
+  for (std::size_t i = 0; i < n; i++, in += stride, out += 3) {
+    // x, y, z, w in one register
+    __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(in[0]), m0), _mm_mul_ps(_mm_set1_ps(in[1]), m1));
+    p = _mm_add_ps(_mm_add_ps(p, _mm_mul_ps(_mm_set1_ps(in[2]), m2)), m3);
+
+    // divide by w unless it is 0
+    __m128 w = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3));
+    w = _mm_blendv_ps(w, one, _mm_cmpeq_ps(w, zero));
+    p = _mm_div_ps(p, w);
+
+    _mm_storel_pi(reinterpret_cast<__m64*>(out), p);
+    _mm_store_ss(out + 2, _mm_movehl_ps(p, p));
+  }
+}
+
+__attribute__((target("sse4.1")))
+void fill32Sse41(std::uint32_t* dst, std::size_t n, std::uint32_t value)
+{
+  for (; n > 0 && (reinterpret_cast<std::uintptr_t>(dst) & 15); n--) {
+    *dst++ = value;
+  }
+
+  __m128i v = _mm_set1_epi32(value);
+  bool streaming = n * 4 >= STREAMING_THRESHOLD;
+  for (; n >= 4; n -= 4, dst += 4) {
+    if (streaming) {
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dst), v);
+    } else {
+      _mm_store_si128(reinterpret_cast<__m128i*>(dst), v);
+    }
+  }
+  if (streaming) {
+    _mm_sfence();
+  }
+
+  for (; n > 0; n--) {
+    *dst++ = value;
+  }
+}
+
+__attribute__((target("sse4.1")))
+int intersectTrianglesSse41(const float* packet, const float* ray, float* distance)
+{
+  const unsigned int N = g3::TRIANGLE_PACKET_SIZE;
+  __m128 ox = _mm_set1_ps(ray[0]), oy = _mm_set1_ps(ray[1]), oz = _mm_set1_ps(ray[2]);
+  __m128 dx = _mm_set1_ps(ray[3]), dy = _mm_set1_ps(ray[4]), dz = _mm_set1_ps(ray[5]);
+  __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+  __m128 epsilon = _mm_set1_ps(RAY_EPSILON);
+  int closest = -1;
+
+  // the packet in two halves of four lanes
+  for (unsigned int half = 0; half < N; half += 4) {
+    const float* lane = packet + half;
+    __m128 v0x = _mm_loadu_ps(lane),       v0y = _mm_loadu_ps(lane + N),   v0z = _mm_loadu_ps(lane + 2*N);
+    __m128 e1x = _mm_loadu_ps(lane + 3*N), e1y = _mm_loadu_ps(lane + 4*N), e1z = _mm_loadu_ps(lane + 5*N);
+    __m128 e2x = _mm_loadu_ps(lane + 6*N), e2y = _mm_loadu_ps(lane + 7*N), e2z = _mm_loadu_ps(lane + 8*N);
+
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    __m128 inv = _mm_div_ps(one, det);
+
+    __m128 tx = _mm_sub_ps(ox, v0x), ty = _mm_sub_ps(oy, v0y), tz = _mm_sub_ps(oz, v0z);
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv);
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv);
+    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+
+    // ordered compares are false for the NaNs of zero determinants
+    __m128 hit = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+    hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, epsilon));
+    hit = _mm_and_ps(hit, _mm_cmplt_ps(t, _mm_set1_ps(*distance)));
+
+    int mask = _mm_movemask_ps(hit);
+    if (mask) {
+      float ts[4];
+      _mm_storeu_ps(ts, t);
+      for (int i = 0; i < 4; i++) {
+        if ((mask >> i & 1) && ts[i] < *distance) {
+          *distance = ts[i];
+          closest = half + i;
+        }
+      }
+    }
+  }
+  return closest;
+}
+
+/**
+ * Returns a channel of the colors of lit vertices from 0 to 255.
+ */
+__attribute__((target("sse4.1")))
+inline __m128i lightChannelSse41(const float* material, int k, __m128 light)
+{
+  __m128 c = _mm_add_ps(_mm_set1_ps(material[k]), _mm_mul_ps(_mm_set1_ps(material[4 + k]), light));
+  c = _mm_min_ps(_mm_max_ps(c, _mm_setzero_ps()), _mm_set1_ps(1));
+  return _mm_cvtps_epi32(_mm_mul_ps(c, _mm_set1_ps(255)));
+}
+
+__attribute__((target("sse4.1")))
+void lightVerticesSse41(const float* positions, const float* normals, std::size_t stride, std::size_t n,
+                        const float* lights, std::size_t lightCount, const float* material, std::uint32_t* colors)
+{
+  const std::size_t s = stride;
+  __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+  std::size_t i = 0;
+
+  // four vertices per iteration, their coordinates gathered into lanes
+  for (; i + 4 <= n; i += 4, positions += 4 * s, normals += 4 * s) {
+    const float* p = positions;
+    const float* q = normals;
+    __m128 px = _mm_setr_ps(p[0], p[s], p[2*s], p[3*s]);
+    __m128 py = _mm_setr_ps(p[1], p[s+1], p[2*s+1], p[3*s+1]);
+    __m128 pz = _mm_setr_ps(p[2], p[s+2], p[2*s+2], p[3*s+2]);
+    __m128 nx = _mm_setr_ps(q[0], q[s], q[2*s], q[3*s]);
+    __m128 ny = _mm_setr_ps(q[1], q[s+1], q[2*s+1], q[3*s+1]);
+    __m128 nz = _mm_setr_ps(q[2], q[s+2], q[2*s+2], q[3*s+2]);
+
+    __m128 r = zero, g = zero, b = zero;
+    for (const float* light = lights; light < lights + lightCount * g3::LIGHT_SIZE; light += g3::LIGHT_SIZE) {
+      __m128 w = _mm_set1_ps(light[3]);
+      __m128 lx = _mm_sub_ps(_mm_set1_ps(light[0]), _mm_mul_ps(w, px));
+      __m128 ly = _mm_sub_ps(_mm_set1_ps(light[1]), _mm_mul_ps(w, py));
+      __m128 lz = _mm_sub_ps(_mm_set1_ps(light[2]), _mm_mul_ps(w, pz));
+      __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz));
+      __m128 cosine = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, lx), _mm_mul_ps(ny, ly)), _mm_mul_ps(nz, lz));
+
+      // the lanes facing away are zeroed, which also drops the NaN of a
+      // vertex at the position of a point light
+      __m128 falloff = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(distance2, _mm_set1_ps(light[7]))), zero);
+      __m128 intensity = _mm_mul_ps(_mm_div_ps(cosine, _mm_sqrt_ps(distance2)), falloff);
+      intensity = _mm_and_ps(intensity, _mm_cmpgt_ps(cosine, zero));
+
+      r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(light[4]), intensity));
+      g = _mm_add_ps(g, _mm_mul_ps(_mm_set1_ps(light[5]), intensity));
+      b = _mm_add_ps(b, _mm_mul_ps(_mm_set1_ps(light[6]), intensity));
+    }
+
+    __m128i color = _mm_or_si128(lightChannelSse41(material, 0, r), _mm_slli_epi32(lightChannelSse41(material, 1, g), 8));
+    color = _mm_or_si128(color, _mm_slli_epi32(lightChannelSse41(material, 2, b), 16));
+    color = _mm_or_si128(color, _mm_set1_epi32(0xff000000));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(colors + i), color);
+  }
+
+  lightVerticesScalar(positions, normals, stride, n - i, lights, lightCount, material, colors + i);
+}
+
+__attribute__((target("sse4.1")))
+void mergeMinDepthSse41(std::uint32_t* dstColor, float* dstDepth, const std::uint32_t* srcColor,
+                        const float* srcDepth, std::size_t n)
+{
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 depth = _mm_loadu_ps(dstDepth + i);
+    __m128 source = _mm_loadu_ps(srcDepth + i);
+    __m128 nearer = _mm_cmplt_ps(source, depth);
+    _mm_storeu_ps(dstDepth + i, _mm_blendv_ps(depth, source, nearer));
+
+    // the colors are blended as floats, the bits go through untouched
+    __m128 color = _mm_loadu_ps(reinterpret_cast<const float*>(dstColor + i));
+    __m128 sourceColor = _mm_loadu_ps(reinterpret_cast<const float*>(srcColor + i));
+    _mm_storeu_ps(reinterpret_cast<float*>(dstColor + i), _mm_blendv_ps(color, sourceColor, nearer));
+  }
+
+  mergeMinDepthScalar(dstColor + i, dstDepth + i, srcColor + i, srcDepth + i, n - i);
+}
+
+/**
+ * Blends the channel pairs of 16 bytes, each color channel next to the one
+ * it is blended with, by pairs of byte weights: BLEND_ONE - weight, weight.
+ */
+__attribute__((target("sse4.1")))
+inline __m128i blendPairsSse41(__m128i pairs, __m128i weights)
+{
+  __m128i sum = _mm_maddubs_epi16(pairs, weights);
+  return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(g3::BLEND_ONE / 2)), 6);
+}
+
+__attribute__((target("sse4.1")))
+void scaleRowSse41(const std::uint32_t* in, const std::uint32_t* columns, std::uint32_t* out, std::size_t n)
+{
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    // the two colors of every column, their channels interleaved
+    __m128i pairs[4];
+    for (int j = 0; j < 4; j++) {
+      __m128i pair = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + (columns[i + j] >> 8)));
+      pairs[j] = _mm_unpacklo_epi8(pair, _mm_srli_si128(pair, 4));
+    }
+
+    // BLEND_ONE - weight, weight in every 16 bits of a column, twice
+    __m128i weight = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(columns + i)),
+                                   _mm_set1_epi32(0xff));
+    __m128i weights = _mm_or_si128(_mm_sub_epi32(_mm_set1_epi32(g3::BLEND_ONE), weight), _mm_slli_epi32(weight, 8));
+    weights = _mm_or_si128(weights, _mm_slli_epi32(weights, 16));
+
+    __m128i low = blendPairsSse41(_mm_unpacklo_epi64(pairs[0], pairs[1]), _mm_unpacklo_epi32(weights, weights));
+    __m128i high = blendPairsSse41(_mm_unpacklo_epi64(pairs[2], pairs[3]), _mm_unpackhi_epi32(weights, weights));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(low, high));
+  }
+
+  scaleRowScalar(in, columns + i, out + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+void blendRowsSse41(const std::uint32_t* a, const std::uint32_t* b, std::uint32_t* out, std::size_t n,
+                    unsigned int weight)
+{
+  __m128i weights = _mm_set1_epi16((std::int16_t)((g3::BLEND_ONE - weight) | weight << 8));
+
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    __m128i low = blendPairsSse41(_mm_unpacklo_epi8(first, second), weights);
+    __m128i high = blendPairsSse41(_mm_unpackhi_epi8(first, second), weights);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(low, high));
+  }
+
+  blendRowsScalar(a + i, b + i, out + i, n - i, weight);
+}
+
+const Kernels SSE41_KERNELS {
+  Isa::SSE41, multiplyMat4Sse41, transformPointsSse41, fill32Sse41,
+  intersectTrianglesSse41, lightVerticesSse41, mergeMinDepthSse41,
+  scaleRowSse41, blendRowsSse41
+};
+
+// *****************************************************************************
+// AVX2
+// *****************************************************************************
+
+__attribute__((target("avx2,fma")))
+void multiplyMat4Avx2(const float* lhs, const float* rhs, float* res)
+{
+  // every rhs row twice, so that two result rows are computed at once
+  __m256 r0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(rhs));
+  __m256 r1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(rhs + 4));
+  __m256 r2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(rhs + 8));
+  __m256 r3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(rhs + 12));
+
+  for (int i = 0; i < 4; i += 2) {
+    const float* a = lhs + i*4;
+    __m256 row = _mm256_mul_ps(_mm256_setr_m128(_mm_set1_ps(a[0]), _mm_set1_ps(a[4])), r0);
+    row = _mm256_fmadd_ps(_mm256_setr_m128(_mm_set1_ps(a[1]), _mm_set1_ps(a[5])), r1, row);
+    row = _mm256_fmadd_ps(_mm256_setr_m128(_mm_set1_ps(a[2]), _mm_set1_ps(a[6])), r2, row);
+    row = _mm256_fmadd_ps(_mm256_setr_m128(_mm_set1_ps(a[3]), _mm_set1_ps(a[7])), r3, row);
+    _mm256_storeu_ps(res + i*4, row);
+  }
+}
+
+__attribute__((target("avx2,fma")))
+void transformPointsAvx2(const float* in, std::size_t stride, float* out, std::size_t n, const float* mat)
+{
+  __m256 m0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(mat));
+  __m256 m1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(mat + 4));
+  __m256 m2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(mat + 8));
+  __m256 m3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(mat + 12));
+  __m256 zero = _mm256_setzero_ps();
+  __m256 one = _mm256_set1_ps(1);
+
+  // two points per iteration, the last odd point goes through the same code
+  // with its lane duplicated
+  for (std::size_t i = 0; i < n; i += 2, in += 2 * stride, out += 6) {
+    const float* second = (i + 1 < n) ? in + stride : in;
+    __m256 x = _mm256_setr_m128(_mm_set1_ps(in[0]), _mm_set1_ps(second[0]));
+    __m256 y = _mm256_setr_m128(_mm_set1_ps(in[1]), _mm_set1_ps(second[1]));
+    __m256 z = _mm256_setr_m128(_mm_set1_ps(in[2]), _mm_set1_ps(second[2]));
+
+    __m256 p = _mm256_fmadd_ps(x, m0, _mm256_fmadd_ps(y, m1, _mm256_fmadd_ps(z, m2, m3)));
+
+    __m256 w = _mm256_permute_ps(p, _MM_SHUFFLE(3, 3, 3, 3));
+    w = _mm256_blendv_ps(w, one, _mm256_cmp_ps(w, zero, _CMP_EQ_OQ));
+    p = _mm256_div_ps(p, w);
+
+    __m128 lo = _mm256_castps256_ps128(p);
+    _mm_storel_pi(reinterpret_cast<__m64*>(out), lo);
+    _mm_store_ss(out + 2, _mm_movehl_ps(lo, lo));
+    if (i + 1 < n) {
+      __m128 hi = _mm256_extractf128_ps(p, 1);
+      _mm_storel_pi(reinterpret_cast<__m64*>(out + 3), hi);
+      _mm_store_ss(out + 5, _mm_movehl_ps(hi, hi));
+    }
+  }
+}
+
+__attribute__((target("avx2")))
+void fill32Avx2(std::uint32_t* dst, std::size_t n, std::uint32_t value)
+{
+  for (; n > 0 && (reinterpret_cast<std::uintptr_t>(dst) & 31); n--) {
+    *dst++ = value;
+  }
+
+  __m256i v = _mm256_set1_epi32(value);
+  bool streaming = n * 4 >= STREAMING_THRESHOLD;
+  for (; n >= 8; n -= 8, dst += 8) {
+    if (streaming) {
+      _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), v);
+    } else {
+      _mm256_store_si256(reinterpret_cast<__m256i*>(dst), v);
+    }
+  }
+  if (streaming) {
+    _mm_sfence();
+  }
+
+  for (; n > 0; n--) {
+    *dst++ = value;
+  }
+}
+
+__attribute__((target("avx2,fma")))
+int intersectTrianglesAvx2(const float* packet, const float* ray, float* distance)
+{
+  const unsigned int N = g3::TRIANGLE_PACKET_SIZE;
+  __m256 ox = _mm256_set1_ps(ray[0]), oy = _mm256_set1_ps(ray[1]), oz = _mm256_set1_ps(ray[2]);
+  __m256 dx = _mm256_set1_ps(ray[3]), dy = _mm256_set1_ps(ray[4]), dz = _mm256_set1_ps(ray[5]);
+
+  __m256 v0x = _mm256_loadu_ps(packet),       v0y = _mm256_loadu_ps(packet + N),   v0z = _mm256_loadu_ps(packet + 2*N);
+  __m256 e1x = _mm256_loadu_ps(packet + 3*N), e1y = _mm256_loadu_ps(packet + 4*N), e1z = _mm256_loadu_ps(packet + 5*N);
+  __m256 e2x = _mm256_loadu_ps(packet + 6*N), e2y = _mm256_loadu_ps(packet + 7*N), e2z = _mm256_loadu_ps(packet + 8*N);
+
+  __m256 px = _mm256_fmsub_ps(dy, e2z, _mm256_mul_ps(dz, e2y));
+  __m256 py = _mm256_fmsub_ps(dz, e2x, _mm256_mul_ps(dx, e2z));
+  __m256 pz = _mm256_fmsub_ps(dx, e2y, _mm256_mul_ps(dy, e2x));
+  __m256 det = _mm256_fmadd_ps(e1x, px, _mm256_fmadd_ps(e1y, py, _mm256_mul_ps(e1z, pz)));
+  __m256 inv = _mm256_div_ps(_mm256_set1_ps(1), det);
+
+  __m256 tx = _mm256_sub_ps(ox, v0x), ty = _mm256_sub_ps(oy, v0y), tz = _mm256_sub_ps(oz, v0z);
+  __m256 u = _mm256_mul_ps(_mm256_fmadd_ps(tx, px, _mm256_fmadd_ps(ty, py, _mm256_mul_ps(tz, pz))), inv);
+  __m256 qx = _mm256_fmsub_ps(ty, e1z, _mm256_mul_ps(tz, e1y));
+  __m256 qy = _mm256_fmsub_ps(tz, e1x, _mm256_mul_ps(tx, e1z));
+  __m256 qz = _mm256_fmsub_ps(tx, e1y, _mm256_mul_ps(ty, e1x));
+  __m256 v = _mm256_mul_ps(_mm256_fmadd_ps(dx, qx, _mm256_fmadd_ps(dy, qy, _mm256_mul_ps(dz, qz))), inv);
+  __m256 t = _mm256_mul_ps(_mm256_fmadd_ps(e2x, qx, _mm256_fmadd_ps(e2y, qy, _mm256_mul_ps(e2z, qz))), inv);
+
+  // ordered compares are false for the NaNs of zero determinants
+  __m256 zero = _mm256_setzero_ps();
+  __m256 hit = _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1), _CMP_LE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, _mm256_set1_ps(RAY_EPSILON), _CMP_GT_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, _mm256_set1_ps(*distance), _CMP_LT_OQ));
+  if (_mm256_testz_ps(hit, hit)) {
+    return -1;
+  }
+
+  // the smallest distance of the hits, broadcast to every lane
+  __m256 ts = _mm256_blendv_ps(_mm256_set1_ps(*distance), t, hit);
+  __m256 m = _mm256_min_ps(ts, _mm256_permute_ps(ts, _MM_SHUFFLE(2, 3, 0, 1)));
+  m = _mm256_min_ps(m, _mm256_permute_ps(m, _MM_SHUFFLE(1, 0, 3, 2)));
+  m = _mm256_min_ps(m, _mm256_permute2f128_ps(m, m, 1));
+
+  int lanes = _mm256_movemask_ps(_mm256_and_ps(hit, _mm256_cmp_ps(ts, m, _CMP_EQ_OQ)));
+  *distance = _mm256_cvtss_f32(m);
+  return __builtin_ctz(lanes);
+}
+
+/**
+ * Returns a channel of the colors of lit vertices from 0 to 255.
+ */
+__attribute__((target("avx2,fma")))
+inline __m256i lightChannelAvx2(const float* material, int k, __m256 light)
+{
+  __m256 c = _mm256_fmadd_ps(_mm256_set1_ps(material[4 + k]), light, _mm256_set1_ps(material[k]));
+  c = _mm256_min_ps(_mm256_max_ps(c, _mm256_setzero_ps()), _mm256_set1_ps(1));
+  return _mm256_cvtps_epi32(_mm256_mul_ps(c, _mm256_set1_ps(255)));
+}
+
+__attribute__((target("avx2,fma")))
+void lightVerticesAvx2(const float* positions, const float* normals, std::size_t stride, std::size_t n,
+                       const float* lights, std::size_t lightCount, const float* material, std::uint32_t* colors)
+{
+  const int s = stride;
+  __m256i offsets = _mm256_setr_epi32(0, s, 2*s, 3*s, 4*s, 5*s, 6*s, 7*s);
+  __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1);
+  std::size_t i = 0;
+
+  // eight vertices per iteration, their coordinates gathered into lanes
+  for (; i + 8 <= n; i += 8, positions += 8 * stride, normals += 8 * stride) {
+    __m256 px = _mm256_i32gather_ps(positions, offsets, 4);
+    __m256 py = _mm256_i32gather_ps(positions + 1, offsets, 4);
+    __m256 pz = _mm256_i32gather_ps(positions + 2, offsets, 4);
+    __m256 nx = _mm256_i32gather_ps(normals, offsets, 4);
+    __m256 ny = _mm256_i32gather_ps(normals + 1, offsets, 4);
+    __m256 nz = _mm256_i32gather_ps(normals + 2, offsets, 4);
+
+    __m256 r = zero, g = zero, b = zero;
+    for (const float* light = lights; light < lights + lightCount * g3::LIGHT_SIZE; light += g3::LIGHT_SIZE) {
+      __m256 w = _mm256_set1_ps(light[3]);
+      __m256 lx = _mm256_fnmadd_ps(w, px, _mm256_set1_ps(light[0]));
+      __m256 ly = _mm256_fnmadd_ps(w, py, _mm256_set1_ps(light[1]));
+      __m256 lz = _mm256_fnmadd_ps(w, pz, _mm256_set1_ps(light[2]));
+      __m256 distance2 = _mm256_fmadd_ps(lx, lx, _mm256_fmadd_ps(ly, ly, _mm256_mul_ps(lz, lz)));
+      __m256 cosine = _mm256_fmadd_ps(nx, lx, _mm256_fmadd_ps(ny, ly, _mm256_mul_ps(nz, lz)));
+
+      __m256 falloff = _mm256_max_ps(_mm256_fnmadd_ps(distance2, _mm256_set1_ps(light[7]), one), zero);
+      __m256 intensity = _mm256_mul_ps(_mm256_div_ps(cosine, _mm256_sqrt_ps(distance2)), falloff);
+      intensity = _mm256_and_ps(intensity, _mm256_cmp_ps(cosine, zero, _CMP_GT_OQ));
+
+      r = _mm256_fmadd_ps(_mm256_set1_ps(light[4]), intensity, r);
+      g = _mm256_fmadd_ps(_mm256_set1_ps(light[5]), intensity, g);
+      b = _mm256_fmadd_ps(_mm256_set1_ps(light[6]), intensity, b);
+    }
+
+    __m256i color = _mm256_or_si256(lightChannelAvx2(material, 0, r), _mm256_slli_epi32(lightChannelAvx2(material, 1, g), 8));
+    color = _mm256_or_si256(color, _mm256_slli_epi32(lightChannelAvx2(material, 2, b), 16));
+    color = _mm256_or_si256(color, _mm256_set1_epi32(0xff000000));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(colors + i), color);
+  }
+
+  lightVerticesScalar(positions, normals, stride, n - i, lights, lightCount, material, colors + i);
+}
+
+__attribute__((target("avx2,fma")))
+void mergeMinDepthAvx2(std::uint32_t* dstColor, float* dstDepth, const std::uint32_t* srcColor,
+                       const float* srcDepth, std::size_t n)
+{
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 depth = _mm256_loadu_ps(dstDepth + i);
+    __m256 source = _mm256_loadu_ps(srcDepth + i);
+    __m256 nearer = _mm256_cmp_ps(source, depth, _CMP_LT_OQ);
+    _mm256_storeu_ps(dstDepth + i, _mm256_blendv_ps(depth, source, nearer));
+
+    __m256 color = _mm256_loadu_ps(reinterpret_cast<const float*>(dstColor + i));
+    __m256 sourceColor = _mm256_loadu_ps(reinterpret_cast<const float*>(srcColor + i));
+    _mm256_storeu_ps(reinterpret_cast<float*>(dstColor + i), _mm256_blendv_ps(color, sourceColor, nearer));
+  }
+
+  mergeMinDepthScalar(dstColor + i, dstDepth + i, srcColor + i, srcDepth + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+void blendRowsAvx2(const std::uint32_t* a, const std::uint32_t* b, std::uint32_t* out, std::size_t n,
+                   unsigned int weight)
+{
+  __m256i weights = _mm256_set1_epi16((std::int16_t)((g3::BLEND_ONE - weight) | weight << 8));
+  __m256i half = _mm256_set1_epi16(g3::BLEND_ONE / 2);
+
+  // the unpacks and the pack work within 128-bit lanes, the order survives
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    __m256i low = _mm256_maddubs_epi16(_mm256_unpacklo_epi8(first, second), weights);
+    __m256i high = _mm256_maddubs_epi16(_mm256_unpackhi_epi8(first, second), weights);
+    low = _mm256_srli_epi16(_mm256_add_epi16(low, half), 6);
+    high = _mm256_srli_epi16(_mm256_add_epi16(high, half), 6);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_packus_epi16(low, high));
+  }
+
+  blendRowsScalar(a + i, b + i, out + i, n - i, weight);
+}
+
+// Scaling a row is bound by its loads of pairs of colors, which no gather
+// makes faster, so the SSE4.1 version is used.
+const Kernels AVX2_KERNELS {
+  Isa::AVX2, multiplyMat4Avx2, transformPointsAvx2, fill32Avx2,
+  intersectTrianglesAvx2, lightVerticesAvx2, mergeMinDepthAvx2,
+  scaleRowSse41, blendRowsAvx2
+};
+
+// *****************************************************************************
+// AVX-512
+// *****************************************************************************
+
+// GCC 12 builds the undefined vectors of its AVX-512 headers from an
+// uninitialized variable, so _mm512_broadcast_f32x4, _mm512_permutexvar_ps
+// and others warn of it once inlined at -O2.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx512f")))
+void multiplyMat4Avx512(const float* lhs, const float* rhs, float* res)
+{
+  // all four result rows at once: column k of lhs splatted per row times
+  // row k of rhs repeated in every 128-bit lane
+  __m512 a = _mm512_loadu_ps(lhs);
+  __m512i column = _mm512_setr_epi32(0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12);
+  __m512i next = _mm512_set1_epi32(1);
+
+  __m512 row = _mm512_mul_ps(_mm512_permutexvar_ps(column, a), _mm512_broadcast_f32x4(_mm_loadu_ps(rhs)));
+  for (int k = 1; k < 4; k++) {
+    column = _mm512_add_epi32(column, next);
+    row = _mm512_fmadd_ps(_mm512_permutexvar_ps(column, a), _mm512_broadcast_f32x4(_mm_loadu_ps(rhs + k*4)), row);
+  }
+  _mm512_storeu_ps(res, row);
+}
+
+__attribute__((target("avx512f")))
+void transformPointsAvx512(const float* in, std::size_t stride, float* out, std::size_t n, const float* mat)
+{
+  __m512 m0 = _mm512_broadcast_f32x4(_mm_loadu_ps(mat));
+  __m512 m1 = _mm512_broadcast_f32x4(_mm_loadu_ps(mat + 4));
+  __m512 m2 = _mm512_broadcast_f32x4(_mm_loadu_ps(mat + 8));
+  __m512 m3 = _mm512_broadcast_f32x4(_mm_loadu_ps(mat + 12));
+  __m512 one = _mm512_set1_ps(1);
+
+  // packed points are loaded at once, points further apart are gathered
+  // into the lanes of their results, x, y, z and z again
+  bool packed = stride == 3;
+  int s = stride;
+  __m512i gather = _mm512_setr_epi32(0, 1, 2, 2, s, s+1, s+2, s+2,
+                                     2*s, 2*s+1, 2*s+2, 2*s+2, 3*s, 3*s+1, 3*s+2, 3*s+2);
+  __m512i splatX = packed ? _mm512_setr_epi32(0, 0, 0, 0, 3, 3, 3, 3, 6, 6, 6, 6, 9, 9, 9, 9)
+                          : _mm512_setr_epi32(0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12);
+  __m512i splatY = _mm512_add_epi32(splatX, _mm512_set1_epi32(1));
+  __m512i splatZ = _mm512_add_epi32(splatX, _mm512_set1_epi32(2));
+
+  // four points per iteration, the tail uses masked loads and stores
+  for (std::size_t i = 0; i < n; i += 4, in += 4 * stride, out += 12) {
+    std::size_t count = std::min<std::size_t>(4, n - i);
+    __mmask16 loadMask = (1u << (3 * count)) - 1;
+    __mmask16 gatherMask = (1u << (4 * count)) - 1;
+    __mmask16 storeMask = 0x7777 & gatherMask;
+
+    __m512 xyz = packed ? _mm512_maskz_loadu_ps(loadMask, in)
+                        : _mm512_mask_i32gather_ps(_mm512_setzero_ps(), gatherMask, gather, in, 4);
+    __m512 x = _mm512_permutexvar_ps(splatX, xyz);
+    __m512 y = _mm512_permutexvar_ps(splatY, xyz);
+    __m512 z = _mm512_permutexvar_ps(splatZ, xyz);
+
+    __m512 p = _mm512_fmadd_ps(x, m0, _mm512_fmadd_ps(y, m1, _mm512_fmadd_ps(z, m2, m3)));
+
+    __m512 w = _mm512_permute_ps(p, _MM_SHUFFLE(3, 3, 3, 3));
+    w = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(w, _mm512_setzero_ps(), _CMP_EQ_OQ), w, one);
+    p = _mm512_div_ps(p, w);
+
+    // drop the w lanes, x, y, z of the points end up next to each other
+    _mm512_mask_compressstoreu_ps(out, storeMask, p);
+  }
+}
+
+__attribute__((target("avx512f")))
+void fill32Avx512(std::uint32_t* dst, std::size_t n, std::uint32_t value)
+{
+  for (; n > 0 && (reinterpret_cast<std::uintptr_t>(dst) & 63); n--) {
+    *dst++ = value;
+  }
+
+  __m512i v = _mm512_set1_epi32(value);
+  bool streaming = n * 4 >= STREAMING_THRESHOLD;
+  for (; n >= 16; n -= 16, dst += 16) {
+    if (streaming) {
+      _mm512_stream_si512(reinterpret_cast<__m512i*>(dst), v);
+    } else {
+      _mm512_store_si512(dst, v);
+    }
+  }
+  if (streaming) {
+    _mm_sfence();
+  }
+
+  if (n > 0) {
+    _mm512_mask_storeu_epi32(dst, (1u << n) - 1, v);
+  }
+}
+
+__attribute__((target("avx512f")))
+void mergeMinDepthAvx512(std::uint32_t* dstColor, float* dstDepth, const std::uint32_t* srcColor,
+                         const float* srcDepth, std::size_t n)
+{
+  // the nearer pixels are written under a mask, the tail under a mask too
+  for (std::size_t i = 0; i < n; i += 16) {
+    __mmask16 lanes = (n - i >= 16) ? 0xffff : (1u << (n - i)) - 1;
+    __m512 depth = _mm512_maskz_loadu_ps(lanes, dstDepth + i);
+    __m512 source = _mm512_maskz_loadu_ps(lanes, srcDepth + i);
+    __mmask16 nearer = _mm512_mask_cmp_ps_mask(lanes, source, depth, _CMP_LT_OQ);
+    _mm512_mask_storeu_ps(dstDepth + i, nearer, source);
+    _mm512_mask_storeu_epi32(dstColor + i, nearer, _mm512_maskz_loadu_epi32(nearer, srcColor + i));
+  }
+}
+
+#pragma GCC diagnostic pop
+
+// A packet fills a 256-bit register, so the AVX2 intersection is used: every
+// CPU with AVX-512 has AVX2 and FMA. Lighting is bound by its gathers, which
+// are no faster at 512 bits. The byte arithmetic of the blends would need
+// AVX-512BW, the AVX2 versions are used.
+const Kernels AVX512_KERNELS {
+  Isa::AVX512, multiplyMat4Avx512, transformPointsAvx512, fill32Avx512,
+  intersectTrianglesAvx2, lightVerticesAvx2, mergeMinDepthAvx512,
+  scaleRowSse41, blendRowsAvx2
+};
+
+#endif // G3_X86
+
+/**
+ * Chooses the kernels, honouring G3_ISA.
+ */
+const Kernels& selectKernels()
+{
+  Isa isa = g3::detectIsa();
+
+  if (const char* requested = std::getenv("G3_ISA")) {
+    bool found = false;
+    for (Isa candidate : { Isa::SCALAR, Isa::SSE41, Isa::AVX2, Isa::AVX512 }) {
+      if (std::strcmp(requested, g3::getIsaName(candidate)) != 0) {
+        continue;
+      }
+      found = true;
+      if (g3::getKernels(candidate)) {
+        isa = candidate;
+      } else {
+        std::cerr << "G3_ISA: " << requested << " is not supported by this CPU, using "
+          << g3::getIsaName(isa) << std::endl;
+      }
+    }
+    if (!found) {
+      std::cerr << "G3_ISA: unknown instruction set " << requested << std::endl;
+    }
+  }
+
+  return *g3::getKernels(isa);
+}
+
+}
+
+/**
+ * Returns the kernels chosen for this process.
+ */
+const g3::Kernels& g3::kernels()
+{
+  static const Kernels& selected = selectKernels();
+  return selected;
+}
+
+/**
+ * Returns the kernels of an instruction set, or nullptr if not supported.
+ */
+const g3::Kernels* g3::getKernels(Isa isa)
+{
+#ifdef G3_X86
+  switch (isa) {
+    case Isa::AVX512:
+      return __builtin_cpu_supports("avx512f") ? &AVX512_KERNELS : nullptr;
+    case Isa::AVX2:
+      return (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) ? &AVX2_KERNELS : nullptr;
+    case Isa::SSE41:
+      return __builtin_cpu_supports("sse4.1") ? &SSE41_KERNELS : nullptr;
+    case Isa::SCALAR:
+      return &SCALAR_KERNELS;
+  }
+  return nullptr;
+#else
+  return (isa == Isa::SCALAR) ? &SCALAR_KERNELS : nullptr;
+#endif
+}
+
+/**
+ * Returns the best instruction set supported by the CPU.
+ */
+g3::Isa g3::detectIsa()
+{
+  for (Isa isa : { Isa::AVX512, Isa::AVX2, Isa::SSE41 }) {
+    if (getKernels(isa)) {
+      return isa;
+    }
+  }
+  return Isa::SCALAR;
+}
+
+/**
+ * Returns the name of an instruction set.
+ */
+const char* g3::getIsaName(Isa isa)
+{
+  switch (isa) {
+    case Isa::SCALAR: return "scalar";
+    case Isa::SSE41: return "sse4.1";
+    case Isa::AVX2: return "avx2";
+    case Isa::AVX512: return "avx512";
+  }
+  return "unknown";
+}
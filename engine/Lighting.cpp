@@ -0,0 +1,45 @@
+
+#include "Lighting.h"
+#include "Kernels.h"
+#include <algorithm>
+
+/**
+ * Packs the lights in the model space of a mesh instance.
+ */
+void g3::packLights(const Lighting& lighting, const Mat4& toModel, float* lights)
+{
+  // a normal n in model space and a direction l in world space make the
+  // angle of n and l transformed by the inverse world matrix, so neither
+  // normals nor positions need to leave model space
+  for (const DirectionalLight& light : lighting.directionalLights) {
+    Vec3 direction = normalize(transformV3(light.direction, toModel));
+    float packed[LIGHT_SIZE] { direction[0], direction[1], direction[2], 0,
+                               light.color[0], light.color[1], light.color[2], 0 };
+    std::copy(packed, packed + LIGHT_SIZE, lights);
+    lights += LIGHT_SIZE;
+  }
+
+  for (const PointLight& light : lighting.pointLights) {
+    Vec3 position = transformP3(light.position, toModel);
+    float packed[LIGHT_SIZE] { position[0], position[1], position[2], 1,
+                               light.color[0], light.color[1], light.color[2],
+                               1 / (light.range * light.range) };
+    std::copy(packed, packed + LIGHT_SIZE, lights);
+    lights += LIGHT_SIZE;
+  }
+}
+
+/**
+ * Packs the material of a surface of the given color.
+ */
+void g3::packMaterial(const Lighting& lighting, Color color, float* material)
+{
+  // the channels are in R, G, B, A order in memory
+  const unsigned char* channels = reinterpret_cast<const unsigned char*>(&color);
+  for (int k = 0; k < 3; k++) {
+    float diffuse = channels[k] / 255.0f;
+    material[k] = lighting.ambient[k] * diffuse;
+    material[4 + k] = diffuse;
+  }
+  material[3] = material[7] = 0;
+}
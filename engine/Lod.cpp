@@ -0,0 +1,465 @@
+
+#include "Lod.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+/**
+ * Border edges are kept in place by planes through them, perpendicular to
+ * their face, weighted this much more than the faces.
+ */
+const double BORDER_WEIGHT = 100;
+
+/**
+ * A symmetric 4x4 matrix whose quadratic form is the weighted sum of the
+ * squared distances of a point to a set of planes.
+ */
+struct Quadric
+{
+  double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+  /**
+   * The sum of the weights of the face planes.
+   */
+  double area;
+};
+
+Quadric& operator+=(Quadric& q, const Quadric& other)
+{
+  q.a2 += other.a2; q.ab += other.ab; q.ac += other.ac; q.ad += other.ad;
+  q.b2 += other.b2; q.bc += other.bc; q.bd += other.bd;
+  q.c2 += other.c2; q.cd += other.cd; q.d2 += other.d2;
+  q.area += other.area;
+  return q;
+}
+
+/**
+ * Adds the plane a*x + b*y + c*z + d = 0, with a unit normal.
+ */
+void addPlane(Quadric& q, double a, double b, double c, double d, double weight)
+{
+  q.a2 += weight * a * a; q.ab += weight * a * b; q.ac += weight * a * c; q.ad += weight * a * d;
+  q.b2 += weight * b * b; q.bc += weight * b * c; q.bd += weight * b * d;
+  q.c2 += weight * c * c; q.cd += weight * c * d; q.d2 += weight * d * d;
+}
+
+/**
+ * Returns the weighted sum of the squared distances of p to the planes.
+ */
+double evaluate(const Quadric& q, const double* p)
+{
+  double x = p[0], y = p[1], z = p[2];
+  return q.a2*x*x + 2*q.ab*x*y + 2*q.ac*x*z + 2*q.ad*x
+       + q.b2*y*y + 2*q.bc*y*z + 2*q.bd*y
+       + q.c2*z*z + 2*q.cd*z
+       + q.d2;
+}
+
+/**
+ * Finds the point with the smallest error, if the planes determine one.
+ */
+bool findOptimum(const Quadric& q, double* p)
+{
+  // solve [a2 ab ac; ab b2 bc; ac bc c2] p = -[ad bd cd] by Cramer's rule
+  double det = q.a2 * (q.b2*q.c2 - q.bc*q.bc) - q.ab * (q.ab*q.c2 - q.bc*q.ac) + q.ac * (q.ab*q.bc - q.b2*q.ac);
+  double scale = q.a2 + q.b2 + q.c2;
+  if (std::abs(det) <= 1e-9 * scale * scale * scale) {
+    return false;
+  }
+  double bx = -q.ad, by = -q.bd, bz = -q.cd;
+  p[0] = (bx * (q.b2*q.c2 - q.bc*q.bc) - q.ab * (by*q.c2 - q.bc*bz) + q.ac * (by*q.bc - q.b2*bz)) / det;
+  p[1] = (q.a2 * (by*q.c2 - q.bc*bz) - bx * (q.ab*q.c2 - q.bc*q.ac) + q.ac * (q.ab*bz - by*q.ac)) / det;
+  p[2] = (q.a2 * (q.b2*bz - by*q.bc) - q.ab * (q.ab*bz - by*q.ac) + bx * (q.ab*q.bc - q.b2*q.ac)) / det;
+  return true;
+}
+
+void cross(const double* a, const double* b, double* res)
+{
+  res[0] = a[1]*b[2] - a[2]*b[1];
+  res[1] = a[2]*b[0] - a[0]*b[2];
+  res[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+/**
+ * A candidate edge collapse in the queue. The versions of the vertices tell
+ * whether it is outdated.
+ */
+struct Candidate
+{
+  double cost;
+  unsigned int u, v;
+  unsigned int versionU, versionV;
+  double position[3];
+
+  bool operator>(const Candidate& other) const { return cost > other.cost; }
+};
+
+/**
+ * The working state of the simplification of a mesh.
+ */
+class Simplifier
+{
+  public:
+
+  explicit Simplifier(const g3::TriangleMesh& mesh);
+
+  /**
+   * Collapses edges until at most targetFaces faces remain or no edge can be
+   * collapsed. Returns false in the latter case.
+   */
+  bool collapseTo(unsigned int targetFaces);
+
+  /**
+   * Writes the current mesh.
+   */
+  void write(const g3::TriangleMesh& source, g3::TriangleMesh& target) const;
+
+  unsigned int getFaceCount() const { return liveFaces; }
+
+  /**
+   * The largest error of a collapse so far: the area weighted RMS distance
+   * of the merged vertex to the planes of the faces it came from.
+   */
+  float getError() const { return std::sqrt(maxCost); }
+
+  private:
+
+  void computeCandidate(unsigned int u, unsigned int v);
+  bool flipsFace(unsigned int moved, unsigned int other, const double* p) const;
+  void collapse(const Candidate& c);
+
+  std::vector<std::array<double, 3>> positions;
+  std::vector<Quadric> quadrics;
+  std::vector<std::array<unsigned int, 3>> faces;
+  std::vector<bool> faceAlive;
+  std::vector<bool> vertexAlive;
+  std::vector<unsigned int> versions;
+  std::vector<std::vector<unsigned int>> vertexFaces;
+  std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+  unsigned int liveFaces;
+  double maxCost;
+};
+
+Simplifier::Simplifier(const g3::TriangleMesh& mesh):
+positions (mesh.nVertices),
+quadrics (mesh.nVertices, Quadric {}),
+faces (mesh.nFaces),
+faceAlive (mesh.nFaces, true),
+vertexAlive (mesh.nVertices, true),
+versions (mesh.nVertices, 0),
+vertexFaces (mesh.nVertices),
+liveFaces {mesh.nFaces},
+maxCost {0}
+{
+  for (unsigned int i = 0; i < mesh.nVertices; i++) {
+    for (int k = 0; k < 3; k++) {
+      positions[i][k] = mesh.vertices[i].pos[k];
+    }
+  }
+
+  // the plane of every face goes to the quadrics of its corners, weighted by
+  // the area of the face
+  std::vector<std::pair<unsigned int, unsigned int>> edges;
+  for (unsigned int f = 0; f < mesh.nFaces; f++) {
+    const unsigned int* index = mesh.faces[f].vertexIndex;
+    faces[f] = { index[0], index[1], index[2] };
+
+    const double* p0 = positions[index[0]].data();
+    double e1[3], e2[3], n[3];
+    for (int k = 0; k < 3; k++) {
+      e1[k] = positions[index[1]][k] - p0[k];
+      e2[k] = positions[index[2]][k] - p0[k];
+    }
+    cross(e1, e2, n);
+    double length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    double area = length / 2;
+
+    for (int j = 0; j < 3; j++) {
+      vertexFaces[index[j]].push_back(f);
+      unsigned int a = index[j], b = index[(j + 1) % 3];
+      edges.push_back({ std::min(a, b), std::max(a, b) });
+    }
+    if (length == 0) {
+      continue;
+    }
+    for (int k = 0; k < 3; k++) {
+      n[k] /= length;
+    }
+    double d = -(n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2]);
+    for (int j = 0; j < 3; j++) {
+      addPlane(quadrics[index[j]], n[0], n[1], n[2], d, area);
+      quadrics[index[j]].area += area;
+    }
+  }
+
+  // an edge of a single face is a border edge
+  std::sort(edges.begin(), edges.end());
+  for (std::size_t i = 0; i < edges.size(); ) {
+    std::size_t j = i;
+    while (j < edges.size() && edges[j] == edges[i]) j++;
+    if (j - i == 1) {
+      unsigned int a = edges[i].first, b = edges[i].second;
+      for (unsigned int f : vertexFaces[a]) {
+        const std::array<unsigned int, 3>& face = faces[f];
+        if (face[0] != b && face[1] != b && face[2] != b) continue;
+
+        // the plane through the edge, perpendicular to the face
+        double edge[3], e2[3], n[3], normal[3];
+        unsigned int c = face[0] + face[1] + face[2] - a - b;
+        for (int k = 0; k < 3; k++) {
+          edge[k] = positions[b][k] - positions[a][k];
+          e2[k] = positions[c][k] - positions[a][k];
+        }
+        cross(edge, e2, n);
+        cross(edge, n, normal);
+        double length = std::sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+        if (length == 0) break;
+        for (int k = 0; k < 3; k++) {
+          normal[k] /= length;
+        }
+        double d = -(normal[0]*positions[a][0] + normal[1]*positions[a][1] + normal[2]*positions[a][2]);
+        double weight = BORDER_WEIGHT * (edge[0]*edge[0] + edge[1]*edge[1] + edge[2]*edge[2]);
+        addPlane(quadrics[a], normal[0], normal[1], normal[2], d, weight);
+        addPlane(quadrics[b], normal[0], normal[1], normal[2], d, weight);
+        break;
+      }
+    }
+    i = j;
+  }
+
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+  for (const auto& edge : edges) {
+    computeCandidate(edge.first, edge.second);
+  }
+}
+
+/**
+ * Queues the collapse of an edge into its best position.
+ */
+void Simplifier::computeCandidate(unsigned int u, unsigned int v)
+{
+  Quadric q = quadrics[u];
+  q += quadrics[v];
+
+  Candidate c { 0, u, v, versions[u], versions[v], {} };
+  if (!findOptimum(q, c.position)) {
+    // the planes are (nearly) parallel, try the ends and the middle
+    double best = INFINITY;
+    for (double t : { 0.0, 0.5, 1.0 }) {
+      double p[3];
+      for (int k = 0; k < 3; k++) {
+        p[k] = positions[u][k] + t * (positions[v][k] - positions[u][k]);
+      }
+      double cost = evaluate(q, p);
+      if (cost < best) {
+        best = cost;
+        std::copy(p, p + 3, c.position);
+      }
+    }
+  }
+
+  double area = std::max(q.area, 1e-30);
+  c.cost = std::max(evaluate(q, c.position), 0.0) / area;
+  queue.push(c);
+}
+
+/**
+ * Returns true if moving the vertex to p flips a face around it that the
+ * collapse keeps, or makes it degenerate.
+ */
+bool Simplifier::flipsFace(unsigned int moved, unsigned int other, const double* p) const
+{
+  for (unsigned int f : vertexFaces[moved]) {
+    if (!faceAlive[f]) continue;
+    const std::array<unsigned int, 3>& face = faces[f];
+    if (face[0] == other || face[1] == other || face[2] == other) continue;
+
+    double before[3][3], after[3][3];
+    for (int j = 0; j < 3; j++) {
+      for (int k = 0; k < 3; k++) {
+        before[j][k] = positions[face[j]][k];
+        after[j][k] = (face[j] == moved) ? p[k] : before[j][k];
+      }
+    }
+    double a1[3], a2[3], b1[3], b2[3], n0[3], n1[3];
+    for (int k = 0; k < 3; k++) {
+      a1[k] = before[1][k] - before[0][k];
+      a2[k] = before[2][k] - before[0][k];
+      b1[k] = after[1][k] - after[0][k];
+      b2[k] = after[2][k] - after[0][k];
+    }
+    cross(a1, a2, n0);
+    cross(b1, b2, n1);
+    if (n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2] <= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Merges v into u.
+ */
+void Simplifier::collapse(const Candidate& c)
+{
+  unsigned int u = c.u, v = c.v;
+  std::copy(c.position, c.position + 3, positions[u].data());
+  quadrics[u] += quadrics[v];
+  vertexAlive[v] = false;
+  versions[u]++;
+  versions[v]++;
+  maxCost = std::max(maxCost, c.cost);
+
+  for (unsigned int f : vertexFaces[v]) {
+    if (!faceAlive[f]) continue;
+    std::array<unsigned int, 3>& face = faces[f];
+    if (face[0] == u || face[1] == u || face[2] == u) {
+      // the faces along the edge disappear
+      faceAlive[f] = false;
+      liveFaces--;
+    } else {
+      for (unsigned int& index : face) {
+        if (index == v) index = u;
+      }
+      vertexFaces[u].push_back(f);
+    }
+  }
+  vertexFaces[v].clear();
+
+  // drop the dead faces and queue the edges around the merged vertex again
+  std::vector<unsigned int>& around = vertexFaces[u];
+  around.erase(std::remove_if(around.begin(), around.end(),
+    [&](unsigned int f) { return !faceAlive[f]; }), around.end());
+
+  std::vector<unsigned int> neighbours;
+  for (unsigned int f : around) {
+    for (unsigned int index : faces[f]) {
+      if (index != u) neighbours.push_back(index);
+    }
+  }
+  std::sort(neighbours.begin(), neighbours.end());
+  neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+  for (unsigned int n : neighbours) {
+    computeCandidate(u, n);
+  }
+}
+
+/**
+ * Collapses edges until at most targetFaces faces remain.
+ */
+bool Simplifier::collapseTo(unsigned int targetFaces)
+{
+  while (liveFaces > targetFaces) {
+    if (queue.empty()) {
+      return false;
+    }
+    Candidate c = queue.top();
+    queue.pop();
+
+    if (!vertexAlive[c.u] || !vertexAlive[c.v] ||
+        c.versionU != versions[c.u] || c.versionV != versions[c.v]) {
+      continue;
+    }
+    if (flipsFace(c.u, c.v, c.position) || flipsFace(c.v, c.u, c.position)) {
+      continue;
+    }
+    collapse(c);
+  }
+  return true;
+}
+
+/**
+ * Writes the current mesh.
+ */
+void Simplifier::write(const g3::TriangleMesh& source, g3::TriangleMesh& target) const
+{
+  std::vector<unsigned int> remap(positions.size(), 0);
+  unsigned int nVertices = 0;
+  for (std::size_t f = 0; f < faces.size(); f++) {
+    if (!faceAlive[f]) continue;
+    for (unsigned int index : faces[f]) {
+      if (remap[index] == 0) remap[index] = ++nVertices;
+    }
+  }
+
+  target.nVertices = nVertices;
+  target.vertices.reset(new g3::Vertex[nVertices]);
+  for (std::size_t i = 0; i < positions.size(); i++) {
+    if (remap[i] == 0) continue;
+    const std::array<double, 3>& p = positions[i];
+    target.vertices[remap[i] - 1].pos = { (float)p[0], (float)p[1], (float)p[2] };
+    // a kept vertex keeps its texture coordinates where it moved to
+    target.vertices[remap[i] - 1].uv = source.vertices[i].uv;
+  }
+
+  target.nFaces = liveFaces;
+  target.faces.reset(new g3::Triangle[liveFaces]);
+  for (std::size_t f = 0, i = 0; f < faces.size(); f++) {
+    if (!faceAlive[f]) continue;
+    for (int j = 0; j < 3; j++) {
+      target.faces[i].vertexIndex[j] = remap[faces[f][j]] - 1;
+    }
+    i++;
+  }
+
+  target.bounds = g3::computeBounds(target);
+  g3::computeNormals(target);
+  target.rotationX = source.rotationX;
+  target.rotationY = source.rotationY;
+  target.rotationZ = source.rotationZ;
+  target.loc = source.loc;
+}
+
+}
+
+/**
+ * Builds the levels of detail of a mesh.
+ */
+void g3::buildLodChain(const TriangleMesh& mesh, LodChain& chain, unsigned int maxLevels)
+{
+  chain.levels.clear();
+  chain.errors.clear();
+
+  // a single run of collapses, the levels are snapshots on the way
+  Simplifier simplifier(mesh);
+  unsigned int faces = mesh.nFaces;
+  while (chain.levels.size() < maxLevels && faces > LOD_MIN_FACES) {
+    unsigned int target = std::max<unsigned int>(faces * LOD_REDUCTION, LOD_MIN_FACES);
+    bool reached = simplifier.collapseTo(target);
+
+    // a level must save a good part of the faces to be worth keeping
+    if (simplifier.getFaceCount() > faces * (1 + LOD_REDUCTION) / 2) {
+      break;
+    }
+    faces = simplifier.getFaceCount();
+    chain.levels.emplace_back();
+    simplifier.write(mesh, chain.levels.back());
+    optimizeMesh(chain.levels.back());
+    chain.errors.push_back(simplifier.getError());
+
+    if (!reached) {
+      break;
+    }
+  }
+}
+
+/**
+ * Selects the coarsest level of detail whose error stays below a number of
+ * pixels on the screen.
+ */
+unsigned int g3::selectLod(const LodChain& chain, float pixelsPerUnit, float maxPixelError)
+{
+  // the errors grow along the chain
+  unsigned int level = 0;
+  while (level < chain.errors.size() && chain.errors[level] * pixelsPerUnit <= maxPixelError) {
+    level++;
+  }
+  return level;
+}
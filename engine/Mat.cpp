@@ -1,7 +1,23 @@
 
 #include "Mat.h"
+#include "Kernels.h"
+#include <algorithm>
 #include <cmath>
 
+static_assert(sizeof(g3::Vec3) == 3 * sizeof(float), "Vec3 must be three packed floats");
+static_assert(sizeof(g3::Mat4) == 16 * sizeof(float), "Mat4 must be sixteen packed floats");
+
+/**
+ * Matrix multiplication of 4x4 matrices, done by the kernel chosen for the CPU.
+ */
+template<>
+g3::Mat4 g3::Mat4::operator*(const Mat4& other) const
+{
+	Mat4 res;
+	kernels().multiplyMat4(&(*this)[0], &other[0], &res[0]);
+	return res;
+}
+
 /**
  * Transponses a matrix.
  */
@@ -15,6 +31,56 @@ g3::Mat4 g3::transponse(const Mat4& mat)
 	};
 }
 
+/**
+ * Inverts a matrix by the adjugate: the 2x2 minors of the upper and lower
+ * halves are shared by the cofactors. The arithmetic is done in double
+ * precision, because projection matrices with a near plane close to the eye
+ * are badly conditioned.
+ */
+g3::Mat4 g3::inverse(const Mat4& mat)
+{
+	double m[16];
+	std::copy(&mat[0], &mat[0] + 16, m);
+
+	double s0 = m[0]*m[5] - m[4]*m[1];
+	double s1 = m[0]*m[6] - m[4]*m[2];
+	double s2 = m[0]*m[7] - m[4]*m[3];
+	double s3 = m[1]*m[6] - m[5]*m[2];
+	double s4 = m[1]*m[7] - m[5]*m[3];
+	double s5 = m[2]*m[7] - m[6]*m[3];
+
+	double c5 = m[10]*m[15] - m[14]*m[11];
+	double c4 = m[9]*m[15]  - m[13]*m[11];
+	double c3 = m[9]*m[14]  - m[13]*m[10];
+	double c2 = m[8]*m[15]  - m[12]*m[11];
+	double c1 = m[8]*m[14]  - m[12]*m[10];
+	double c0 = m[8]*m[13]  - m[12]*m[9];
+
+	double inv = 1 / (s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0);
+
+	return {
+		float(( m[5]*c5 - m[6]*c4 + m[7]*c3) * inv),
+		float((-m[1]*c5 + m[2]*c4 - m[3]*c3) * inv),
+		float(( m[13]*s5 - m[14]*s4 + m[15]*s3) * inv),
+		float((-m[9]*s5 + m[10]*s4 - m[11]*s3) * inv),
+
+		float((-m[4]*c5 + m[6]*c2 - m[7]*c1) * inv),
+		float(( m[0]*c5 - m[2]*c2 + m[3]*c1) * inv),
+		float((-m[12]*s5 + m[14]*s2 - m[15]*s1) * inv),
+		float(( m[8]*s5 - m[10]*s2 + m[11]*s1) * inv),
+
+		float(( m[4]*c4 - m[5]*c2 + m[7]*c0) * inv),
+		float((-m[0]*c4 + m[1]*c2 - m[3]*c0) * inv),
+		float(( m[12]*s4 - m[13]*s2 + m[15]*s0) * inv),
+		float((-m[8]*s4 + m[9]*s2 - m[11]*s0) * inv),
+
+		float((-m[4]*c3 + m[5]*c1 - m[6]*c0) * inv),
+		float(( m[0]*c3 - m[1]*c1 + m[2]*c0) * inv),
+		float((-m[12]*s3 + m[13]*s1 - m[14]*s0) * inv),
+		float(( m[8]*s3 - m[9]*s1 + m[10]*s0) * inv)
+	};
+}
+
 /**
  * Transforms a 3D point with a 4x4 matrix.
  */
@@ -35,6 +101,14 @@ g3::Vec3 g3::transformP3(const Vec3& vec, const Mat4& mat)
 	return Vec3 { x, y, z };
 }
 
+/**
+ * Transforms n 3D points with a 4x4 matrix, done by the kernel chosen for the CPU.
+ */
+void g3::transformP3(const Vec3* in, Vec3* out, std::size_t n, const Mat4& mat)
+{
+	kernels().transformPoints(&in[0][0], 3, &out[0][0], n, &mat[0]);
+}
+
 /**
  * Transforms a 3D vector with a 4x4 matrix.
  */
@@ -210,3 +284,16 @@ g3::Mat4 g3::createPerspectiveFovLHMatrix(float fieldOfViewY, float aspectRatio,
 		0, 0, (-zNearPlane*zFarPlane) / (zFarPlane - zNearPlane), 0
 	};
 }
+
+/**
+ * Creates a left-handed orthographic projection matrix in row major order.
+ */
+g3::Mat4 g3::createOrthographicLHMatrix(float width, float height, float zNearPlane, float zFarPlane)
+{
+	return Mat4 {
+		2 / width, 0,          0,                                    0,
+		0,         2 / height, 0,                                    0,
+		0,         0,          1 / (zFarPlane - zNearPlane),         0,
+		0,         0,          zNearPlane / (zNearPlane - zFarPlane), 1
+	};
+}
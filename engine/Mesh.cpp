@@ -3,34 +3,132 @@
 #include "Vec.h"
 #include "Quaternion.h"
 #include "Mat.h"
+#include <cmath>
 
 /**
  * Loads a cube triangle mesh.
  */
 void g3::loadCube(g3::TriangleMesh& mesh)
 {
-  mesh.nVertices = 8;
-  mesh.vertices.reset(new Vertex[mesh.nVertices]);
-
-  float vs[] {-1,1,1,  -1,1,-1,  1,1,-1,  1,1,1,  -1,-1,1,  -1,-1,-1,  1,-1,-1,  1,-1,1};
-  for (unsigned int i = 0, j = 0; i < mesh.nVertices; i++, j+=3) {
-    mesh.vertices[i].pos = { vs[j], vs[j+1], vs[j+2] };
-  }
+  // the normal of every side and two axes along it whose cross product is
+  // the normal, so that the corners go counterclockwise seen from outside
+  float sides[6][3][3] {
+    { {1,0,0},  {0,1,0}, {0,0,1} },
+    { {-1,0,0}, {0,0,1}, {0,1,0} },
+    { {0,1,0},  {0,0,1}, {1,0,0} },
+    { {0,-1,0}, {1,0,0}, {0,0,1} },
+    { {0,0,1},  {1,0,0}, {0,1,0} },
+    { {0,0,-1}, {0,1,0}, {1,0,0} }
+  };
+  float corners[4][2] { {-1,-1}, {1,-1}, {1,1}, {-1,1} };
 
+  mesh.nVertices = 24;
+  mesh.vertices.reset(new Vertex[mesh.nVertices]);
   mesh.nFaces = 12;
   mesh.faces.reset(new Triangle[mesh.nFaces]);
 
-  unsigned int indices[] {0,1,2,  2,3,0,  4,5,6,  6,7,4,  0,5,1,  0,4,5,  3,6,7,  3,2,6,  1,5,6,  1,6,2,  0,7,3,  0,4,7};
-  for (unsigned int i = 0, j = 0; i < mesh.nFaces; i++, j+=3) {
-    mesh.faces[i].vertexIndex[0] = indices[j];
-    mesh.faces[i].vertexIndex[1] = indices[j+1];
-    mesh.faces[i].vertexIndex[2] = indices[j+2];
+  for (unsigned int side = 0; side < 6; side++) {
+    Vec3 normal {sides[side][0][0], sides[side][0][1], sides[side][0][2]};
+    Vec3 s {sides[side][1][0], sides[side][1][1], sides[side][1][2]};
+    Vec3 t {sides[side][2][0], sides[side][2][1], sides[side][2][2]};
+    for (unsigned int i = 0; i < 4; i++) {
+      Vertex& vertex = mesh.vertices[4*side + i];
+      vertex.pos = normal + s * corners[i][0] + t * corners[i][1];
+      vertex.uv = { (corners[i][0] + 1) / 2, (corners[i][1] + 1) / 2 };
+    }
+
+    unsigned int v = 4 * side;
+    mesh.faces[2*side]   = { { v, v + 1, v + 2 } };
+    mesh.faces[2*side+1] = { { v, v + 2, v + 3 } };
   }
 
+  mesh.bounds = computeBounds(mesh);
+  computeNormals(mesh);
+
   mesh.rotationX = mesh.rotationY = mesh.rotationZ = 0;
   mesh.loc = {4, 2, -2};
 }
 
+/**
+ * Loads a rolling terrain.
+ */
+void g3::loadTerrain(g3::TriangleMesh& mesh, unsigned int divisions)
+{
+  unsigned int side = divisions + 1;
+  mesh.nVertices = side * side;
+  mesh.vertices.reset(new Vertex[mesh.nVertices]);
+
+  float step = 8.0f / divisions;
+  for (unsigned int z = 0, i = 0; z < side; z++) {
+    for (unsigned int x = 0; x < side; x++, i++) {
+      float px = x * step - 4;
+      float pz = z * step - 4;
+      float py = 0.3f * std::sin(px * 1.3f) * std::cos(pz * 0.9f) + 0.1f * std::sin(px * 4.1f + pz * 3.7f);
+      mesh.vertices[i].pos = { px, py, pz };
+      mesh.vertices[i].uv = { px / 2, pz / 2 };
+    }
+  }
+
+  mesh.nFaces = 2 * divisions * divisions;
+  mesh.faces.reset(new Triangle[mesh.nFaces]);
+  for (unsigned int z = 0, i = 0; z < divisions; z++) {
+    for (unsigned int x = 0; x < divisions; x++, i += 2) {
+      unsigned int v = z * side + x;
+      mesh.faces[i]   = { { v, v + side, v + side + 1 } };
+      mesh.faces[i+1] = { { v, v + side + 1, v + 1 } };
+    }
+  }
+
+  mesh.bounds = computeBounds(mesh);
+  computeNormals(mesh);
+
+  mesh.rotationX = mesh.rotationY = mesh.rotationZ = 0;
+  mesh.loc = {0, 0, 0};
+}
+
+/**
+ * Returns the box around the vertices of the mesh in model space.
+ */
+g3::Aabb g3::computeBounds(const TriangleMesh& mesh)
+{
+  Aabb box = createEmptyAabb();
+  for (unsigned int i = 0; i < mesh.nVertices; i++) {
+    grow(box, mesh.vertices[i].pos);
+  }
+  return box;
+}
+
+/**
+ * Computes the normals of the faces and of the vertices of a mesh.
+ */
+void g3::computeNormals(TriangleMesh& mesh)
+{
+  for (unsigned int i = 0; i < mesh.nVertices; i++) {
+    mesh.vertices[i].normal = Vec3 {0, 0, 0};
+  }
+
+  // the cross product is as long as twice the area of the face, so adding
+  // it up weights the faces by their areas
+  for (unsigned int i = 0; i < mesh.nFaces; i++) {
+    Triangle& face = mesh.faces[i];
+    const Vec3& v0 = mesh.vertices[face.vertexIndex[0]].pos;
+    Vec3 cross = crossProduct(mesh.vertices[face.vertexIndex[1]].pos - v0,
+                              mesh.vertices[face.vertexIndex[2]].pos - v0);
+    float length = cross.length();
+    face.normal = (length > 0) ? cross * (1 / length) : Vec3 {0, 0, 0};
+    for (unsigned int index : face.vertexIndex) {
+      mesh.vertices[index].normal = mesh.vertices[index].normal + cross;
+    }
+  }
+
+  for (unsigned int i = 0; i < mesh.nVertices; i++) {
+    Vec3& normal = mesh.vertices[i].normal;
+    float length = normal.length();
+    if (length > 0) {
+      normal = normal * (1 / length);
+    }
+  }
+}
 
 /**
  * Calculates the world transformation matrix of the triangle mesh object.
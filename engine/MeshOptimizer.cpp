@@ -0,0 +1,256 @@
+
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+/**
+ * The score of the vertices of the last face, which are not favoured as
+ * much, so that strips do not turn back on themselves.
+ */
+const float LAST_FACE_SCORE = 0.75f;
+
+/**
+ * The score of a cached vertex falls with its position by this power.
+ */
+const float CACHE_DECAY_POWER = 1.5f;
+
+/**
+ * Vertices with few faces left are boosted, to finish them off and leave no
+ * lonely faces behind.
+ */
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+/**
+ * The valence score table covers this many faces, more faces score the same.
+ */
+const unsigned int MAX_VALENCE = 32;
+
+/**
+ * The scores of the positions in the cache and of the face counts.
+ */
+struct ScoreTables
+{
+  float cache[g3::VERTEX_CACHE_SIZE];
+  float valence[MAX_VALENCE + 1];
+
+  ScoreTables()
+  {
+    const unsigned int N = g3::VERTEX_CACHE_SIZE;
+    for (unsigned int i = 0; i < N; i++) {
+      cache[i] = (i < 3) ? LAST_FACE_SCORE
+                         : std::pow(1 - (i - 3) / float(N - 3), CACHE_DECAY_POWER);
+    }
+    valence[0] = 0;
+    for (unsigned int i = 1; i <= MAX_VALENCE; i++) {
+      valence[i] = VALENCE_BOOST_SCALE * std::pow(float(i), -VALENCE_BOOST_POWER);
+    }
+  }
+
+  /**
+   * Returns the score of a vertex, -1 once all its faces are emitted.
+   */
+  float score(int cachePosition, unsigned int facesLeft) const
+  {
+    if (facesLeft == 0) {
+      return -1;
+    }
+    float s = valence[std::min(facesLeft, MAX_VALENCE)];
+    return (cachePosition >= 0) ? s + cache[cachePosition] : s;
+  }
+};
+
+}
+
+/**
+ * Reorders the faces of a mesh for the vertex cache.
+ */
+void g3::optimizeVertexCache(TriangleMesh& mesh)
+{
+  const unsigned int N = VERTEX_CACHE_SIZE;
+  static const ScoreTables tables;
+  unsigned int nFaces = mesh.nFaces;
+  unsigned int nVertices = mesh.nVertices;
+  if (nFaces == 0) {
+    return;
+  }
+
+  // the faces around every vertex, in one array; the faces not emitted yet
+  // are kept at the front of the range of each vertex
+  std::vector<unsigned int> facesLeft(nVertices, 0);
+  for (unsigned int f = 0; f < nFaces; f++) {
+    for (unsigned int index : mesh.faces[f].vertexIndex) {
+      facesLeft[index]++;
+    }
+  }
+  std::vector<unsigned int> offsets(nVertices + 1, 0);
+  for (unsigned int v = 0; v < nVertices; v++) {
+    offsets[v + 1] = offsets[v] + facesLeft[v];
+  }
+  std::vector<unsigned int> adjacency(offsets[nVertices]);
+  {
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (unsigned int f = 0; f < nFaces; f++) {
+      for (unsigned int index : mesh.faces[f].vertexIndex) {
+        adjacency[fill[index]++] = f;
+      }
+    }
+  }
+
+  std::vector<int> cachePosition(nVertices, -1);
+  std::vector<float> vertexScore(nVertices);
+  for (unsigned int v = 0; v < nVertices; v++) {
+    vertexScore[v] = tables.score(-1, facesLeft[v]);
+  }
+
+  std::vector<float> faceScore(nFaces);
+  std::vector<bool> emitted(nFaces, false);
+  int best = 0;
+  for (unsigned int f = 0; f < nFaces; f++) {
+    const unsigned int* index = mesh.faces[f].vertexIndex;
+    faceScore[f] = vertexScore[index[0]] + vertexScore[index[1]] + vertexScore[index[2]];
+    if (faceScore[f] > faceScore[best]) {
+      best = f;
+    }
+  }
+
+  // the cache holds up to three vertices more while it is updated
+  unsigned int cache[N + 3];
+  unsigned int cacheSize = 0;
+  unsigned int nextScan = 0;
+  std::unique_ptr<Triangle[]> order(new Triangle[nFaces]);
+
+  for (unsigned int i = 0; i < nFaces; i++) {
+    if (best < 0) {
+      // nothing in the cache has faces left: go on with the next face in
+      // the source order, cheaper than looking for the best one
+      while (emitted[nextScan]) {
+        nextScan++;
+      }
+      best = nextScan;
+    }
+
+    const Triangle face = mesh.faces[best];
+    order[i] = face;
+    emitted[best] = true;
+
+    // take the face off the lists of its vertices
+    for (unsigned int index : face.vertexIndex) {
+      unsigned int* first = &adjacency[offsets[index]];
+      unsigned int* last = first + facesLeft[index] - 1;
+      for (unsigned int* it = first; it <= last; it++) {
+        if (*it == (unsigned int)best) {
+          std::swap(*it, *last);
+          break;
+        }
+      }
+      facesLeft[index]--;
+    }
+
+    // the vertices of the face move to the front of the cache, the others
+    // move back and the last ones fall out
+    unsigned int newCache[N + 3];
+    unsigned int newSize = 0;
+    for (unsigned int index : face.vertexIndex) {
+      newCache[newSize++] = index;
+    }
+    for (unsigned int j = 0; j < cacheSize; j++) {
+      unsigned int index = cache[j];
+      if (index != face.vertexIndex[0] && index != face.vertexIndex[1] && index != face.vertexIndex[2]) {
+        newCache[newSize++] = index;
+      }
+    }
+    for (unsigned int j = 0; j < newSize; j++) {
+      unsigned int index = newCache[j];
+      cachePosition[index] = (j < N) ? (int)j : -1;
+      vertexScore[index] = tables.score(cachePosition[index], facesLeft[index]);
+    }
+
+    // rescore the faces around the vertices that changed and pick the best
+    best = -1;
+    float bestScore = -1;
+    for (unsigned int j = 0; j < newSize; j++) {
+      unsigned int index = newCache[j];
+      const unsigned int* around = &adjacency[offsets[index]];
+      for (unsigned int k = 0; k < facesLeft[index]; k++) {
+        unsigned int f = around[k];
+        const unsigned int* fi = mesh.faces[f].vertexIndex;
+        faceScore[f] = vertexScore[fi[0]] + vertexScore[fi[1]] + vertexScore[fi[2]];
+        if (faceScore[f] > bestScore) {
+          bestScore = faceScore[f];
+          best = f;
+        }
+      }
+    }
+
+    cacheSize = std::min(newSize, N);
+    std::copy(newCache, newCache + cacheSize, cache);
+  }
+
+  mesh.faces = std::move(order);
+}
+
+/**
+ * Renumbers the vertices of a mesh in the order the faces first use them.
+ */
+void g3::optimizeVertexFetch(TriangleMesh& mesh)
+{
+  const unsigned int UNUSED = ~0u;
+  std::vector<unsigned int> remap(mesh.nVertices, UNUSED);
+  unsigned int next = 0;
+  for (unsigned int f = 0; f < mesh.nFaces; f++) {
+    for (unsigned int& index : mesh.faces[f].vertexIndex) {
+      if (remap[index] == UNUSED) {
+        remap[index] = next++;
+      }
+      index = remap[index];
+    }
+  }
+
+  std::unique_ptr<Vertex[]> vertices(new Vertex[mesh.nVertices]);
+  for (unsigned int v = 0; v < mesh.nVertices; v++) {
+    if (remap[v] == UNUSED) {
+      remap[v] = next++;
+    }
+    vertices[remap[v]] = mesh.vertices[v];
+  }
+  mesh.vertices = std::move(vertices);
+}
+
+/**
+ * Reorders the faces and then the vertices of a mesh for locality.
+ */
+void g3::optimizeMesh(TriangleMesh& mesh)
+{
+  optimizeVertexCache(mesh);
+  optimizeVertexFetch(mesh);
+}
+
+/**
+ * Returns the average cache miss ratio of the faces of a mesh.
+ */
+float g3::computeAcmr(const TriangleMesh& mesh, unsigned int cacheSize)
+{
+  if (mesh.nFaces == 0) {
+    return 0;
+  }
+
+  // a vertex is in the cache while fewer than cacheSize misses happened
+  // since the miss that loaded it
+  std::vector<unsigned long> loadedAt(mesh.nVertices, 0);
+  unsigned long misses = 0;
+  for (unsigned int f = 0; f < mesh.nFaces; f++) {
+    for (unsigned int index : mesh.faces[f].vertexIndex) {
+      if (loadedAt[index] == 0 || misses - loadedAt[index] >= cacheSize) {
+        misses++;
+        loadedAt[index] = misses;
+      }
+    }
+  }
+  return misses / float(mesh.nFaces);
+}
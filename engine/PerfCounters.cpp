@@ -0,0 +1,110 @@
+
+#include "PerfCounters.h"
+
+#if defined(__linux__)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+g3::PerfCounters::PerfCounters()
+{
+  for (int& fd : fds) {
+    fd = -1;
+  }
+
+#if defined(__linux__)
+  struct Event { std::uint32_t type; std::uint64_t config; };
+  const Event events[COUNTER_COUNT] {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                          | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+  };
+
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+#endif
+}
+
+g3::PerfCounters::~PerfCounters()
+{
+#if defined(__linux__)
+  for (int fd : fds) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+#endif
+}
+
+/**
+ * Starts counting.
+ */
+void g3::PerfCounters::start()
+{
+#if defined(__linux__)
+  for (int fd : fds) {
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+}
+
+/**
+ * Stops counting.
+ */
+void g3::PerfCounters::stop()
+{
+#if defined(__linux__)
+  for (int fd : fds) {
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+#endif
+}
+
+/**
+ * Returns the count of an event while the counters ran.
+ */
+std::uint64_t g3::PerfCounters::get(Counter counter) const
+{
+  std::uint64_t value = 0;
+#if defined(__linux__)
+  if (fds[counter] >= 0 && read(fds[counter], &value, sizeof(value)) != sizeof(value)) {
+    value = 0;
+  }
+#endif
+  return value;
+}
+
+/**
+ * Returns a short name of the counter.
+ */
+const char* g3::PerfCounters::getName(Counter counter)
+{
+  switch (counter) {
+    case CYCLES:           return "cycles";
+    case INSTRUCTIONS:     return "instructions";
+    case CACHE_REFERENCES: return "cache refs";
+    case CACHE_MISSES:     return "cache misses";
+    case L1D_READ_MISSES:  return "L1d read misses";
+    default:               return "?";
+  }
+}
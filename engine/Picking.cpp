@@ -0,0 +1,134 @@
+
+#include "Picking.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace
+{
+
+/**
+ * Spreads the lower 10 bits of a value to every third bit.
+ */
+std::uint32_t spreadBits(std::uint32_t v)
+{
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v << 8))  & 0x0300f00f;
+  v = (v | (v << 4))  & 0x030c30c3;
+  v = (v | (v << 2))  & 0x09249249;
+  return v;
+}
+
+}
+
+g3::TriangleBvh::TriangleBvh(const TriangleMesh& mesh)
+{
+  const unsigned int N = TRIANGLE_PACKET_SIZE;
+
+  // order the faces along a Morton curve through their centers, so that
+  // every packet holds neighbouring triangles and has a small box
+  Vec3 extent = mesh.bounds.max - mesh.bounds.min;
+  Vec3 scale;
+  for (int k = 0; k < 3; k++) {
+    scale[k] = (extent[k] > 0) ? 1023 / extent[k] : 0;
+  }
+
+  std::vector<std::pair<std::uint32_t, unsigned int>> order(mesh.nFaces);
+  for (unsigned int i = 0; i < mesh.nFaces; i++) {
+    const unsigned int* index = mesh.faces[i].vertexIndex;
+    Vec3 c = (mesh.vertices[index[0]].pos + mesh.vertices[index[1]].pos
+              + mesh.vertices[index[2]].pos) * (1 / 3.0f);
+    std::uint32_t code = 0;
+    for (int k = 0; k < 3; k++) {
+      float cell = std::min(std::max((c[k] - mesh.bounds.min[k]) * scale[k], 0.0f), 1023.0f);
+      code |= spreadBits(cell) << k;
+    }
+    order[i] = { code, i };
+  }
+  std::sort(order.begin(), order.end());
+
+  packets.resize((mesh.nFaces + N - 1) / N);
+  std::vector<Aabb> bounds(packets.size(), createEmptyAabb());
+
+  for (std::size_t p = 0; p < packets.size(); p++) {
+    TrianglePacket& packet = packets[p];
+    for (unsigned int lane = 0; lane < N; lane++) {
+      std::size_t i = p * N + lane;
+      if (i >= order.size()) {
+        // zero edges never hit
+        for (int k = 0; k < 9; k++) {
+          packet.data[k][lane] = 0;
+        }
+        packet.faces[lane] = 0;
+        continue;
+      }
+
+      unsigned int face = order[i].second;
+      const unsigned int* index = mesh.faces[face].vertexIndex;
+      const Vec3& v0 = mesh.vertices[index[0]].pos;
+      const Vec3& v1 = mesh.vertices[index[1]].pos;
+      const Vec3& v2 = mesh.vertices[index[2]].pos;
+      for (int k = 0; k < 3; k++) {
+        packet.data[k][lane] = v0[k];
+        packet.data[3+k][lane] = v1[k] - v0[k];
+        packet.data[6+k][lane] = v2[k] - v0[k];
+      }
+      packet.faces[lane] = face;
+
+      grow(bounds[p], v0);
+      grow(bounds[p], v1);
+      grow(bounds[p], v2);
+    }
+  }
+
+  bvh.build(bounds.data(), bounds.size());
+}
+
+/**
+ * Finds the closest face that a ray in model space hits.
+ */
+bool g3::TriangleBvh::intersect(const Ray& ray, float& distance, unsigned int& face) const
+{
+  const Kernels& k = kernels();
+  float r[6] { ray.origin[0], ray.origin[1], ray.origin[2],
+               ray.direction[0], ray.direction[1], ray.direction[2] };
+
+  int packet = bvh.intersect(ray, distance, [&](unsigned int p, float& tMax) {
+    int lane = k.intersectTriangles(&packets[p].data[0][0], r, &tMax);
+    if (lane < 0) {
+      return false;
+    }
+    face = packets[p].faces[lane];
+    return true;
+  });
+  return packet >= 0;
+}
+
+/**
+ * Casts a world space ray at the instances.
+ */
+g3::PickHit g3::Picker::pick(const std::vector<MeshInstance>& instances, const SceneBvh& scene, const Ray& ray)
+{
+  PickHit result { -1, 0, std::numeric_limits<float>::infinity() };
+
+  result.instance = scene.intersect(ray, result.distance, [&](unsigned int i, float& tMax) {
+    // the direction is not normalized again, so that distances along the
+    // model space ray are the same as along the world space ray
+    Mat4 toModel = inverse(instances[i].worldMatrix);
+    Ray local = createRay(transformP3(ray.origin, toModel), transformV3(ray.direction, toModel));
+    return getTriangleBvh(*instances[i].mesh).intersect(local, tMax, result.face);
+  });
+  return result;
+}
+
+/**
+ * Returns the triangle tree of a mesh, building it on first use.
+ */
+const g3::TriangleBvh& g3::Picker::getTriangleBvh(const TriangleMesh& mesh)
+{
+  std::unique_ptr<TriangleBvh>& bvh = meshes[&mesh];
+  if (!bvh) {
+    bvh.reset(new TriangleBvh(mesh));
+  }
+  return *bvh;
+}
@@ -0,0 +1,98 @@
+
+#include "Profiler.h"
+#include <algorithm>
+#include <time.h>
+
+namespace
+{
+
+/**
+ * Returns CLOCK_MONOTONIC in nanoseconds.
+ */
+std::uint64_t monotonicTime()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+}
+
+/**
+ * Returns the profiler of the process.
+ */
+g3::Profiler& g3::Profiler::get()
+{
+  static Profiler profiler;
+  return profiler;
+}
+
+g3::Profiler::Profiler():
+enabled {true},
+startTicks {now()},
+startTime {monotonicTime()}
+{
+}
+
+/**
+ * Registers a buffer for the calling thread.
+ */
+g3::ProfileBuffer* g3::Profiler::createThreadBuffer()
+{
+  std::lock_guard<std::mutex> lock(buffersMutex);
+  buffers.emplace_back(new ProfileBuffer(buffers.size() + 1));
+  return buffers.back().get();
+}
+
+/**
+ * Returns the number of profiler ticks per nanosecond.
+ */
+double g3::Profiler::getTicksPerNanosecond() const
+{
+  std::uint64_t ticks = now() - startTicks;
+  std::uint64_t time = monotonicTime() - startTime;
+  return (time > 0 && ticks > 0) ? ticks / (double)time : 1.0;
+}
+
+/**
+ * Writes the recorded zones of every thread as Chrome trace event JSON.
+ */
+void g3::Profiler::writeChromeTrace(std::ostream& out) const
+{
+  double ticksPerMicrosecond = getTicksPerNanosecond() * 1000;
+  std::lock_guard<std::mutex> lock(buffersMutex);
+
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+  bool first = true;
+  std::vector<ProfileEvent> events;
+  for (const std::unique_ptr<ProfileBuffer>& buffer : buffers) {
+    // copy the events out of the ring, then drop those that the owning
+    // thread may have overwritten while we were copying, and the one in the
+    // slot it may be filling right now, event after - CAPACITY
+    std::uint64_t end = buffer->count.load(std::memory_order_acquire);
+    std::uint64_t begin = (end > ProfileBuffer::CAPACITY) ? end - ProfileBuffer::CAPACITY : 0;
+    events.clear();
+    for (std::uint64_t i = begin; i < end; i++) {
+      events.push_back(buffer->events[i & (ProfileBuffer::CAPACITY - 1)]);
+    }
+    std::uint64_t after = buffer->count.load(std::memory_order_acquire);
+    std::size_t overwritten = (after >= ProfileBuffer::CAPACITY + begin)
+      ? std::min<std::size_t>(after - ProfileBuffer::CAPACITY - begin + 1, events.size()) : 0;
+
+    for (std::size_t i = overwritten; i < events.size(); i++) {
+      const ProfileEvent& event = events[i];
+      out << (first ? "" : ",") << "\n{\"name\":\"";
+      for (const char* c = event.name; *c; c++) {
+        if (*c == '"' || *c == '\\') out << '\\';
+        out << *c;
+      }
+      out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+          << ",\"ts\":" << (event.start - startTicks) / ticksPerMicrosecond
+          << ",\"dur\":" << (event.end - event.start) / ticksPerMicrosecond << "}";
+      first = false;
+    }
+  }
+
+  out << "\n]}\n";
+}
@@ -0,0 +1,1689 @@
+
+#include "Renderer.h"
+#include "Profiler.h"
+#include "Kernels.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <atomic>
+#include <limits>
+#include <optional>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+
+/**
+ * Returns an approximation of the base 2 logarithm of a positive x, within
+ * 0.09 of it: the exponent of the float, plus its mantissa taken as linear.
+ * Plenty for selecting mip levels, and far cheaper than std::log2.
+ */
+inline float approximateLog2(float x)
+{
+  std::uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  return bits * (1.0f / (1 << 23)) - 127;
+}
+
+bool equal(const g3::Vec3& lhs, const g3::Vec3& rhs)
+{
+  return lhs[0] == rhs[0] && lhs[1] == rhs[1] && lhs[2] == rhs[2];
+}
+
+bool equal(const g3::Mat4& lhs, const g3::Mat4& rhs)
+{
+  for (int i = 0; i < 16; i++) {
+    if (lhs[i] != rhs[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Returns whether two frame states show the same view: all but the world
+ * matrices of the instances are equal.
+ */
+bool sameView(const g3::FrameState& lhs, const g3::FrameState& rhs)
+{
+  if (!equal(lhs.camera.eye, rhs.camera.eye) || !equal(lhs.camera.target, rhs.camera.target)
+      || lhs.camera.zoomFactor != rhs.camera.zoomFactor
+      || lhs.shading != rhs.shading || lhs.textureFilter != rhs.textureFilter
+      || lhs.visibilityBuffer != rhs.visibilityBuffer || lhs.shadows != rhs.shadows
+      || lhs.msaa != rhs.msaa || lhs.detailLevel != rhs.detailLevel
+      || lhs.instances.size() != rhs.instances.size()) {
+    return false;
+  }
+
+  const g3::Lighting& a = lhs.lighting;
+  const g3::Lighting& b = rhs.lighting;
+  if (!equal(a.ambient, b.ambient) || a.directionalLights.size() != b.directionalLights.size()
+      || a.pointLights.size() != b.pointLights.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < a.directionalLights.size(); i++) {
+    if (!equal(a.directionalLights[i].direction, b.directionalLights[i].direction)
+        || !equal(a.directionalLights[i].color, b.directionalLights[i].color)) {
+      return false;
+    }
+  }
+  for (std::size_t i = 0; i < a.pointLights.size(); i++) {
+    if (!equal(a.pointLights[i].position, b.pointLights[i].position)
+        || !equal(a.pointLights[i].color, b.pointLights[i].color)
+        || a.pointLights[i].range != b.pointLights[i].range) {
+      return false;
+    }
+  }
+
+  for (std::size_t i = 0; i < lhs.instances.size(); i++) {
+    const g3::MeshInstance& x = lhs.instances[i];
+    const g3::MeshInstance& y = rhs.instances[i];
+    if (x.mesh != y.mesh || x.lods != y.lods || x.color != y.color || x.texture != y.texture) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+g3::Renderer::Renderer():
+pool {&defaultThreadPool()},
+shadowing {false},
+multisampling {false},
+visibilitySize {0},
+nextVisibilityId {1},
+lastView {},
+layered {false},
+previousState {},
+scissor {},
+target {nullptr},
+state {nullptr},
+stats {nullptr},
+frameStats {},
+lastStats {},
+countCoverage {false},
+width {0},
+height {0}
+{
+}
+
+/**
+ * Renders the scene into the target buffer, at the resolution scale of the
+ * state.
+ */
+void g3::Renderer::render(FrameBuffer& target, const FrameState& state)
+{
+  if (state.resolutionScale >= 1) {
+    renderFrame(target, state);
+    return;
+  }
+
+  unsigned int scaledWidth = std::max(1.0f, std::round(target.getWidth() * state.resolutionScale));
+  unsigned int scaledHeight = std::max(1.0f, std::round(target.getHeight() * state.resolutionScale));
+  if (!scaledTarget) {
+    scaledTarget.reset(new FrameBuffer(scaledWidth, scaledHeight));
+  } else {
+    scaledTarget->resize(scaledWidth, scaledHeight);
+  }
+
+  // the zoom is in pixels, the scene keeps its size in the frame
+  scaledState = state;
+  scaledState.camera.zoomFactor *= scaledHeight / (float)target.getHeight();
+  renderFrame(*scaledTarget, scaledState);
+
+  G3_PROFILE_ZONE("upscale");
+  upscaler.upscale(*scaledTarget, target);
+}
+
+/**
+ * Renders the scene into the target buffer at its full resolution.
+ */
+void g3::Renderer::renderFrame(FrameBuffer& target, const FrameState& state)
+{
+  G3_PROFILE_ZONE("render");
+
+  beginFrame(target, state);
+
+  multisampling = state.msaa;
+  if (multisampling) {
+    samples.reset(width, height);
+  }
+
+  Mat4 viewProjMatrix = createViewProjMatrix(state.camera, width / (float)height);
+
+  {
+    G3_PROFILE_ZONE("cull");
+    sceneBvh.update(state.instances);
+  }
+
+  shadowing = state.shadows && state.shading != ShadingMode::WIREFRAME
+              && !state.lighting.directionalLights.empty() && !state.instances.empty();
+  if (shadowing) {
+    renderShadowMap(viewProjMatrix);
+  }
+
+  bool deferred = state.visibilityBuffer && state.shading != ShadingMode::WIREFRAME && !multisampling;
+  if (deferred) {
+    prepareVisibilityBuffer();
+  }
+
+  layered = prepareStaticLayer(viewProjMatrix);
+
+  if (findDirtyRegions(viewProjMatrix)) {
+    for (const ScreenRect& region : regions) {
+      scissor = region;
+      renderScissor(viewProjMatrix, deferred, true);
+    }
+    scissor = { 0, 0, (int)width, (int)height };
+  } else {
+    renderScissor(viewProjMatrix, deferred, false);
+  }
+  stats->instancesCulled = state.instances.size() - std::min<std::size_t>(stats->instances, state.instances.size());
+  dirtyRegions.endFrame(&target);
+
+  if (multisampling) {
+    G3_PROFILE_ZONE("resolve");
+    auto start = std::chrono::steady_clock::now();
+    samples.resolve(target);
+    stats->resolveTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+    stats->expandedTiles = samples.getExpandedTileCount();
+    stats->sampleBytes = samples.getMemorySize();
+  }
+
+  if (countCoverage) {
+    stats->coveredPixels = countCoveredPixels();
+  }
+  lastStats = *stats;
+}
+
+/**
+ * Renders the depth of the faces of the scene that face the camera.
+ */
+void g3::Renderer::renderDepth(FrameBuffer& target, const FrameState& state)
+{
+  G3_PROFILE_ZONE("render depth");
+
+  beginFrame(target, state);
+  target.clearDepth();
+
+  // the colors of the target are no frame, nor is any target that missed
+  // this one
+  dirtyRegions.beginFrame(width, height, true);
+
+  Mat4 viewProjMatrix = createViewProjMatrix(state.camera, width / (float)height);
+  Mat4 windowMatrix = createWindowMatrix();
+  DepthTarget depthTarget = getDepthTarget();
+
+  sceneBvh.update(state.instances);
+  Frustum frustum = createViewFrustum(state.camera, width, height);
+  sceneBvh.cull(frustum, [&](unsigned int instance) {
+    const TriangleMesh& mesh = selectMesh(instance, viewProjMatrix);
+    const MeshInstance& meshInstance = state.instances[instance];
+    renderDepthOnly(meshInstance, mesh, meshInstance.worldMatrix * viewProjMatrix * windowMatrix, depthTarget, true);
+    stats->instances++;
+  });
+  stats->instancesCulled = state.instances.size() - stats->instances;
+
+  if (countCoverage) {
+    stats->coveredPixels = countCoveredPixels();
+  }
+  lastStats = *stats;
+}
+
+/**
+ * Starts a frame.
+ */
+void g3::Renderer::beginFrame(FrameBuffer& target, const FrameState& state)
+{
+  this->target = &target;
+  this->state = &state;
+  width = target.getWidth();
+  height = target.getHeight();
+
+  stats = &frameStats;
+  *stats = FrameStats {};
+  shadowing = false;
+  multisampling = false;
+  scissor = { 0, 0, (int)width, (int)height };
+
+  // the transient arrays of the last frame are released
+  arena.reset();
+}
+
+/**
+ * Returns the matrix from clip space to the window coordinates.
+ */
+g3::Mat4 g3::Renderer::createWindowMatrix() const
+{
+  // x and y scaled and moved by w, so that they are after the division
+  float scaleX = state->camera.zoomFactor / (width / (float)height);
+  float scaleY = -state->camera.zoomFactor;
+  return Mat4 {
+    scaleX,         0,               0, 0,
+    0,              scaleY,          0, 0,
+    0,              0,               1, 0,
+    width / 2.0f,   height / 2.0f,   0, 1
+  };
+}
+
+/**
+ * Returns the depth buffer of the target.
+ */
+g3::Renderer::DepthTarget g3::Renderer::getDepthTarget()
+{
+  return { target->getDepthBuffer(), target->getStride(), scissor, stats };
+}
+
+/**
+ * Returns the name of a shading mode.
+ */
+const char* g3::getShadingModeName(ShadingMode mode)
+{
+  switch (mode) {
+    case ShadingMode::WIREFRAME: return "wireframe";
+    case ShadingMode::FLAT:      return "flat";
+    case ShadingMode::GOURAUD:   return "gouraud";
+  }
+  return "?";
+}
+
+/**
+ * Parses the name of a shading mode.
+ */
+bool g3::parseShadingMode(const char* name, ShadingMode& mode)
+{
+  for (ShadingMode candidate : { ShadingMode::WIREFRAME, ShadingMode::FLAT, ShadingMode::GOURAUD }) {
+    if (std::strcmp(name, getShadingModeName(candidate)) == 0) {
+      mode = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Creates the view projection matrix the renderer uses for a camera.
+ */
+g3::Mat4 g3::createViewProjMatrix(const Camera& camera, float aspectRatio)
+{
+  Vec3 upWorld {0,1,0};
+
+  return g3::createLookAtLHMatrix(camera.eye, camera.target, upWorld)
+          * g3::createPerspectiveFovLHMatrix(FIELD_OF_VIEW, aspectRatio, NEAR_PLANE, FAR_PLANE);
+}
+
+/**
+ * Returns the frustum that the renderer shows of the world.
+ */
+g3::Frustum g3::createViewFrustum(const Camera& camera, unsigned int width, unsigned int height)
+{
+  // the inverse of mapXToWin and mapYToWin at the edges of the target
+  float aspectRatio = width / (float)height;
+  return createFrustum(createViewProjMatrix(camera, aspectRatio),
+                       width / 2.0f * aspectRatio / camera.zoomFactor,
+                       height / 2.0f / camera.zoomFactor);
+}
+
+/**
+ * Creates the world space ray through a point of a target.
+ */
+g3::Ray g3::createPickingRay(const Camera& camera, unsigned int width, unsigned int height, float x, float y)
+{
+  float aspectRatio = width / (float)height;
+  Mat4 inv = inverse(createViewProjMatrix(camera, aspectRatio));
+
+  // the inverse of mapXToWin and mapYToWin, at the near and far planes
+  float px = (x - width / 2.0f) * aspectRatio / camera.zoomFactor;
+  float py = -(y - height / 2.0f) / camera.zoomFactor;
+  Vec3 near = transformP3(Vec3{px, py, 0}, inv);
+  Vec3 far = transformP3(Vec3{px, py, 1}, inv);
+
+  Vec3 direction = far - near;
+  return createRay(near, direction * (1 / direction.length()));
+}
+
+/**
+ * Counts the pixels of the target whose depth was written.
+ */
+unsigned long g3::Renderer::countCoveredPixels() const
+{
+  const float* depth = target->getDepthBuffer();
+  const float far = std::numeric_limits<float>::infinity();
+  unsigned long covered = 0;
+
+  for (unsigned int y = 0; y < height; y++) {
+    const float* row = depth + target->indexOf(0, y);
+    for (unsigned int x = 0; x < width; x++) {
+      covered += (row[x] != far);
+    }
+  }
+  return covered;
+}
+
+/**
+ * Clears the buffers.
+ */
+void g3::Renderer::clear()
+{
+	G3_PROFILE_ZONE("clear");
+
+	// Fill the buffer with color light goldenrod yellow and reset the depth,
+	// in bands of rows on the threads
+	bool whole = scissor.getArea() == (long)width * height;
+	pool->parallelFor(scissor.top, scissor.bottom, CLEAR_ROWS_PER_TASK, [&](std::size_t first, std::size_t last) {
+		if (whole) {
+			target->clearRows(CLEAR_COLOR, first, last);
+		} else {
+			target->clear(CLEAR_COLOR, scissor.left, first, scissor.right, last);
+		}
+	});
+	stats->redrawnPixels += scissor.getArea();
+}
+
+/**
+ * Compares the frame with the last one and finds the regions to redraw.
+ */
+bool g3::Renderer::findDirtyRegions(const Mat4& viewProjMatrix)
+{
+  if (!state->dirtyRegions) {
+    // the frames drawn meanwhile are no help to the targets
+    dirtyRegions.beginFrame(width, height, true);
+    return false;
+  }
+
+  G3_PROFILE_ZONE("dirty regions");
+
+  // the instances whose world matrix changed are redrawn where they were
+  // and where they are, in every target that holds the last frame
+  std::swap(instanceRects, previousInstanceRects);
+  Mat4 toWindow = viewProjMatrix * createWindowMatrix();
+  instanceRects.resize(state->instances.size());
+  for (unsigned int i = 0; i < state->instances.size(); i++) {
+    instanceRects[i] = getScreenRect(sceneBvh.getBounds(i), toWindow);
+  }
+
+  bool changed = shadowing || !sameView(*state, previousState);
+  dirtyRegions.beginFrame(width, height, changed);
+  if (!changed) {
+    for (unsigned int i = 0; i < state->instances.size(); i++) {
+      if (!equal(state->instances[i].worldMatrix, previousState.instances[i].worldMatrix)) {
+        dirtyRegions.add(previousInstanceRects[i]);
+        dirtyRegions.add(instanceRects[i]);
+      }
+    }
+  }
+  previousState = *state;
+
+  return dirtyRegions.getRegions(target, regions);
+}
+
+/**
+ * Returns the rectangle of the window that the bounds of an instance cover.
+ */
+g3::ScreenRect g3::Renderer::getScreenRect(const Aabb& bounds, const Mat4& toWindow) const
+{
+  const ScreenRect window { 0, 0, (int)width, (int)height };
+  const Mat4& m = toWindow;
+  float minX = width, minY = height, maxX = 0, maxY = 0;
+  for (int corner = 0; corner < 8; corner++) {
+    float p0 = (corner & 1) ? bounds.max[0] : bounds.min[0];
+    float p1 = (corner & 2) ? bounds.max[1] : bounds.min[1];
+    float p2 = (corner & 4) ? bounds.max[2] : bounds.min[2];
+    float w = p0*m[3] + p1*m[7] + p2*m[11] + m[15];
+    if (w <= NEAR_PLANE) {
+      return window;
+    }
+    float x = (p0*m[0] + p1*m[4] + p2*m[8] + m[12]) / w;
+    float y = (p0*m[1] + p1*m[5] + p2*m[9] + m[13]) / w;
+    minX = std::min(minX, x);
+    maxX = std::max(maxX, x);
+    minY = std::min(minY, y);
+    maxY = std::max(maxY, y);
+  }
+
+  // the lines reach a pixel past their ends, and the samples of
+  // multisampling half a pixel more
+  const float MARGIN = 2;
+  return {
+    (int)std::floor(std::max(minX - MARGIN, -1.0f)), (int)std::floor(std::max(minY - MARGIN, -1.0f)),
+    (int)std::ceil(std::min(maxX + MARGIN, width + 1.0f)), (int)std::ceil(std::min(maxY + MARGIN, height + 1.0f))
+  };
+}
+
+/**
+ * Clears the scissor rectangle of the target and draws the scene into it.
+ */
+void g3::Renderer::renderScissor(const Mat4& viewProjMatrix, bool deferred, bool dirty)
+{
+  clear();
+
+  if (layered) {
+    G3_PROFILE_ZONE("static layer");
+    staticLayer.merge(*target, scissor.left, scissor.top, scissor.right, scissor.bottom);
+  } else {
+    renderAxesAndGrid(viewProjMatrix);
+  }
+
+  Frustum frustum = createViewFrustum(state->camera, width, height);
+  sceneBvh.cull(frustum, [&](unsigned int instance) {
+    if (dirty && !instanceRects[instance].intersects(scissor)) {
+      return;
+    }
+    const TriangleMesh& mesh = selectMesh(instance, viewProjMatrix);
+    if (state->shading == ShadingMode::WIREFRAME) {
+      renderWireframe(state->instances[instance], mesh, viewProjMatrix);
+    } else {
+      renderShaded(state->instances[instance], mesh, viewProjMatrix);
+    }
+    stats->instances++;
+  });
+
+  if (deferred) {
+    shadeVisibilityBuffer();
+  }
+}
+
+/**
+ * Selects the level of detail of an instance by its size on the screen.
+ */
+const g3::TriangleMesh& g3::Renderer::selectMesh(unsigned int index, const Mat4& viewProjMatrix) const
+{
+  const MeshInstance& instance = state->instances[index];
+  if (!instance.lods) {
+    return *instance.mesh;
+  }
+
+  // the depth of the nearest point of the bounding sphere, the clip space w
+  // of the projection is the view space z
+  const Aabb& bounds = sceneBvh.getBounds(index);
+  Vec3 c = center(bounds);
+  float radius = (bounds.max - bounds.min).length() / 2;
+  const Mat4& m = viewProjMatrix;
+  float depth = c[0]*m[3] + c[1]*m[7] + c[2]*m[11] + m[15] - radius;
+
+  // a model space unit grows by the largest scale of the world matrix, and
+  // a view space unit at depth 1 covers zoomFactor * cot(fov / 2) pixels
+  const Mat4& w = instance.worldMatrix;
+  float scale = 0;
+  for (int i = 0; i < 3; i++) {
+    scale = std::max(scale, Vec3{w[i*4], w[i*4+1], w[i*4+2]}.length());
+  }
+  float pixelsPerUnit = scale * state->camera.zoomFactor / std::tan(FIELD_OF_VIEW / 2)
+                      / std::max(depth, NEAR_PLANE);
+
+  float maxError = LOD_PIXEL_ERROR * (1 << state->detailLevel);
+  unsigned int level = selectLod(*instance.lods, pixelsPerUnit, maxError);
+  return (level == 0) ? *instance.mesh : instance.lods->levels[level - 1];
+}
+
+/**
+ * Renders the wireframe of a mesh instance.
+ */
+void g3::Renderer::renderWireframe(const MeshInstance& instance, const TriangleMesh& mesh, const g3::Mat4& viewProjMatrix)
+{
+  G3_PROFILE_ZONE("wireframe");
+
+  Mat4 transformMatrix = instance.worldMatrix * viewProjMatrix;
+
+  // the post-transform cache: every vertex is transformed and mapped to the
+  // window once, however many faces share it, into scratch arrays of the
+  // frame arena; the positions are read in one batch straight from the
+  // vertex array
+  ArenaScope scope(arena);
+  Vec3* transformed = arena.allocate<Vec3>(mesh.nVertices);
+  int* windowPoints = arena.allocate<int>(2 * mesh.nVertices);
+  kernels().transformPoints(&mesh.vertices[0].pos[0], VERTEX_STRIDE, &transformed[0][0],
+                            mesh.nVertices, &transformMatrix[0]);
+  stats->vertices += mesh.nVertices;
+
+  for (unsigned int i = 0; i < mesh.nVertices; i++) {
+    windowPoints[2*i]   = mapXToWin( transformed[i][0] );
+    windowPoints[2*i+1] = mapYToWin( transformed[i][1] );
+  }
+
+  Color color = instance.color;
+  for (unsigned int i = 0; i < mesh.nFaces; i++) {
+    const unsigned int* index = mesh.faces[i].vertexIndex;
+    const int* p0 = &windowPoints[2*index[0]];
+    const int* p1 = &windowPoints[2*index[1]];
+    const int* p2 = &windowPoints[2*index[2]];
+    float z0 = transformed[index[0]][2];
+    float z1 = transformed[index[1]][2];
+    float z2 = transformed[index[2]][2];
+
+    drawLine(p0[0], p0[1], z0, p1[0], p1[1], z1, color);
+    drawLine(p1[0], p1[1], z1, p2[0], p2[1], z2, color);
+    drawLine(p2[0], p2[1], z2, p0[0], p0[1], z0, color);
+  }
+}
+
+/**
+ * Renders the lit, filled faces of a mesh instance that face the camera.
+ */
+void g3::Renderer::renderShaded(const MeshInstance& instance, const TriangleMesh& mesh, const g3::Mat4& viewProjMatrix)
+{
+  G3_PROFILE_ZONE("shaded");
+
+  // the arrays are released after the mesh is drawn, unless the shading
+  // pass of the visibility buffer reads them at the end of the frame
+  bool deferred = state->visibilityBuffer && !multisampling;
+  FrameArena::Marker marker = arena.getMarker();
+  const Kernels& k = kernels();
+  Mat4 transformMatrix = instance.worldMatrix * viewProjMatrix;
+  Mat4 toModel = inverse(instance.worldMatrix);
+
+  // the lights move into model space, where the normals are; a textured
+  // surface is lit as a white one, and the light modulates the texels
+  const Lighting& lighting = state->lighting;
+  float* lights = arena.allocate<float>(lighting.getLightCount() * LIGHT_SIZE);
+  packLights(lighting, toModel, lights);
+  float material[8];
+  packMaterial(lighting, instance.texture ? createRGBA(255, 255, 255, 255) : instance.color, material);
+
+  // the shadow casting light is the first one; its part of the colors is
+  // lit again on its own, without the ambient light
+  float sunMaterial[8];
+  std::copy(material, material + 8, sunMaterial);
+  std::fill(sunMaterial, sunMaterial + 3, 0.0f);
+
+  // every vertex is transformed once into window coordinates, kept in
+  // floats for the rasterizer, with the inverse of its clip space w for
+  // interpolating the texture coordinates in perspective; Gouraud shading
+  // lights every vertex once too. Large meshes are split into ranges of
+  // vertices on the threads of the pool.
+  bool gouraud = state->shading == ShadingMode::GOURAUD;
+  Mat4 toWindow = transformMatrix * createWindowMatrix();
+  Mat4 toShadow = shadowing ? instance.worldMatrix * shadowMap.getMatrix() : Mat4 {};
+  Vec3* screen = arena.allocate<Vec3>(mesh.nVertices);
+  RasterVertex* raster = arena.allocate<RasterVertex>(mesh.nVertices);
+  Color* colors = nullptr;
+  Color* sunColors = nullptr;
+  if (gouraud) {
+    colors = arena.allocate<Color>(mesh.nVertices);
+    sunColors = shadowing ? arena.allocate<Color>(mesh.nVertices) : nullptr;
+  }
+  pool->parallelFor(0, mesh.nVertices, VERTICES_PER_TASK, [&](std::size_t first, std::size_t last) {
+    const float* positions = &mesh.vertices[first].pos[0];
+    k.transformPoints(positions, VERTEX_STRIDE, &screen[first][0], last - first, &toWindow[0]);
+
+    const Mat4& m = transformMatrix;
+    for (std::size_t i = first; i < last; i++) {
+      const Vertex& vertex = mesh.vertices[i];
+      float w = vertex.pos[0]*m[3] + vertex.pos[1]*m[7] + vertex.pos[2]*m[11] + m[15];
+      raster[i] = { screen[i][0], screen[i][1], screen[i][2], 1 / w, vertex.uv[0], vertex.uv[1] };
+    }
+
+    // the shadow map is an orthographic view, its coordinates need no
+    // division by w
+    if (shadowing) {
+      k.transformPoints(positions, VERTEX_STRIDE, &screen[first][0], last - first, &toShadow[0]);
+      for (std::size_t i = first; i < last; i++) {
+        raster[i].sx = screen[i][0];
+        raster[i].sy = screen[i][1];
+        raster[i].sz = screen[i][2];
+      }
+    }
+
+    if (gouraud) {
+      const float* normals = &mesh.vertices[first].normal[0];
+      k.lightVertices(positions, normals, VERTEX_STRIDE, last - first, lights, lighting.getLightCount(), material,
+                      colors + first);
+      if (sunColors) {
+        k.lightVertices(positions, normals, VERTEX_STRIDE, last - first, lights, 1, sunMaterial, sunColors + first);
+      }
+      for (std::size_t i = first; i < last; i++) {
+        raster[i].color = colors[i];
+        raster[i].sunColor = sunColors ? sunColors[i] : 0;
+      }
+    }
+  });
+  stats->vertices += mesh.nVertices;
+
+  // flat shading lights every face at its center, in batches
+  if (!gouraud) {
+    float* centers = arena.allocate<float>(6 * mesh.nFaces);
+    colors = arena.allocate<Color>(mesh.nFaces);
+    sunColors = shadowing ? arena.allocate<Color>(mesh.nFaces) : nullptr;
+    pool->parallelFor(0, mesh.nFaces, VERTICES_PER_TASK, [&](std::size_t first, std::size_t last) {
+      for (std::size_t i = first; i < last; i++) {
+        const unsigned int* index = mesh.faces[i].vertexIndex;
+        Vec3 center = (mesh.vertices[index[0]].pos + mesh.vertices[index[1]].pos
+                       + mesh.vertices[index[2]].pos) * (1 / 3.0f);
+        for (int j = 0; j < 3; j++) {
+          centers[6*i + j] = center[j];
+          centers[6*i + 3 + j] = mesh.faces[i].normal[j];
+        }
+      }
+      k.lightVertices(centers + 6 * first, centers + 6 * first + 3, 6, last - first, lights, lighting.getLightCount(),
+                      material, colors + first);
+      if (sunColors) {
+        k.lightVertices(centers + 6 * first, centers + 6 * first + 3, 6, last - first, lights, 1, sunMaterial,
+                        sunColors + first);
+      }
+    });
+  }
+
+  std::uint32_t firstId = nextVisibilityId;
+  if (deferred) {
+    bool flat = state->shading == ShadingMode::FLAT;
+    visibilityDraws.push_back({ firstId, &mesh, raster, flat ? colors : nullptr,
+                                flat ? sunColors : nullptr, instance.texture });
+    nextVisibilityId += mesh.nFaces;
+  }
+
+  // the faces that are drawn, in their order
+  unsigned int* faces = arena.allocate<unsigned int>(mesh.nFaces);
+  unsigned int faceCount = 0;
+  Vec3 eye = transformP3(state->camera.eye, toModel);
+  const float maxDepth = FAR_PLANE / (FAR_PLANE - NEAR_PLANE);
+  for (unsigned int i = 0; i < mesh.nFaces; i++) {
+    const Triangle& face = mesh.faces[i];
+    const unsigned int* index = face.vertexIndex;
+
+    // the faces seen from behind are hidden by the front of the mesh
+    if (dotProduct(face.normal, eye - mesh.vertices[index[0]].pos) <= 0) {
+      stats->trianglesCulled++;
+      continue;
+    }
+
+    // there is no clipping yet: faces that reach in front of the near plane
+    // are left out, like the ones reaching behind the camera, whose depth
+    // ends up beyond that of the points at infinity
+    float minZ = std::min({raster[index[0]].z, raster[index[1]].z, raster[index[2]].z});
+    float maxZ = std::max({raster[index[0]].z, raster[index[1]].z, raster[index[2]].z});
+    if (minZ < 0 || maxZ >= maxDepth) {
+      stats->trianglesCulled++;
+      continue;
+    }
+
+    stats->triangles++;
+    faces[faceCount++] = i;
+  }
+
+  auto drawFace = [&](const DepthTarget& depthTarget, unsigned int i) {
+    const unsigned int* index = mesh.faces[i].vertexIndex;
+    RasterVertex v0 = raster[index[0]];
+    RasterVertex v1 = raster[index[1]];
+    RasterVertex v2 = raster[index[2]];
+    if (deferred) {
+      drawTriangleVisibility(depthTarget, v0, v1, v2, firstId + i);
+      return;
+    }
+    if (state->shading == ShadingMode::FLAT) {
+      v0.color = v1.color = v2.color = colors[i];
+      v0.sunColor = v1.sunColor = v2.sunColor = sunColors ? sunColors[i] : 0;
+    }
+    drawTriangle(depthTarget, v0, v1, v2, instance.texture);
+  };
+  if (pool->getThreadCount() > 1 && faceCount >= BINNED_FACES && !multisampling) {
+    drawBinned(mesh, raster, faces, faceCount, drawFace);
+  } else {
+    DepthTarget depthTarget = getDepthTarget();
+    for (unsigned int n = 0; n < faceCount; n++) {
+      drawFace(depthTarget, faces[n]);
+    }
+  }
+
+  if (!deferred) {
+    arena.rewind(marker);
+  }
+}
+
+/**
+ * Draws the faces of a mesh in parallel over bands of rows.
+ */
+template <class DrawFunction>
+void g3::Renderer::drawBinned(const TriangleMesh& mesh, const RasterVertex* raster, const unsigned int* faces,
+                              unsigned int faceCount, DrawFunction draw)
+{
+  ArenaScope scope(arena);
+  unsigned int bandCount = (scissor.bottom - scissor.top + ROWS_PER_BAND - 1) / ROWS_PER_BAND;
+
+  // the bands that every face reaches, and the size of every bin; a face
+  // out of the scissor rectangle reaches none
+  unsigned int* firstBand = arena.allocate<unsigned int>(faceCount);
+  unsigned int* lastBand = arena.allocate<unsigned int>(faceCount);
+  unsigned int* binStart = arena.allocate<unsigned int>(bandCount + 1);
+  std::fill(binStart, binStart + bandCount + 1, 0u);
+  for (unsigned int n = 0; n < faceCount; n++) {
+    const unsigned int* index = mesh.faces[faces[n]].vertexIndex;
+    float minY = std::min({raster[index[0]].y, raster[index[1]].y, raster[index[2]].y});
+    float maxY = std::max({raster[index[0]].y, raster[index[1]].y, raster[index[2]].y});
+    int top = std::max(scissor.top, (int)std::floor(minY));
+    int bottom = std::min(scissor.bottom - 1, (int)std::ceil(maxY));
+    if (top > bottom) {
+      firstBand[n] = 1;
+      lastBand[n] = 0;
+      continue;
+    }
+    firstBand[n] = (top - scissor.top) / ROWS_PER_BAND;
+    lastBand[n] = (bottom - scissor.top) / ROWS_PER_BAND;
+    for (unsigned int band = firstBand[n]; band <= lastBand[n]; band++) {
+      binStart[band + 1]++;
+    }
+  }
+  for (unsigned int band = 0; band < bandCount; band++) {
+    binStart[band + 1] += binStart[band];
+  }
+
+  unsigned int* bins = arena.allocate<unsigned int>(binStart[bandCount]);
+  unsigned int* binEnd = arena.allocate<unsigned int>(bandCount);
+  std::copy(binStart, binStart + bandCount, binEnd);
+  for (unsigned int n = 0; n < faceCount; n++) {
+    for (unsigned int band = firstBand[n]; band <= lastBand[n]; band++) {
+      bins[binEnd[band]++] = faces[n];
+    }
+  }
+
+  // every band counts its pixels on its own
+  DepthTarget depthTarget = getDepthTarget();
+  FrameStats* bandStats = arena.allocate<FrameStats>(bandCount);
+  pool->parallelFor(0, bandCount, 1, [&](std::size_t first, std::size_t last) {
+    for (std::size_t band = first; band < last; band++) {
+      DepthTarget bandTarget = depthTarget;
+      bandTarget.bounds.top = scissor.top + band * ROWS_PER_BAND;
+      bandTarget.bounds.bottom = std::min<int>(bandTarget.bounds.top + ROWS_PER_BAND, scissor.bottom);
+      bandTarget.stats = &bandStats[band];
+      bandStats[band] = FrameStats {};
+      for (unsigned int n = binStart[band]; n < binEnd[band]; n++) {
+        draw(bandTarget, bins[n]);
+      }
+    }
+  });
+
+  for (unsigned int band = 0; band < bandCount; band++) {
+    stats->pixelsTested += bandStats[band].pixelsTested;
+    stats->pixelsWritten += bandStats[band].pixelsWritten;
+    stats->depthRejects += bandStats[band].depthRejects;
+    stats->pixelsShaded += bandStats[band].pixelsShaded;
+  }
+}
+
+/**
+ * Rasterizes the faces of a mesh instance into a depth buffer only.
+ */
+void g3::Renderer::renderDepthOnly(const MeshInstance& instance, const TriangleMesh& mesh, const Mat4& toWindow,
+                                   const DepthTarget& depthTarget, bool cullBackFaces)
+{
+  ArenaScope scope(arena);
+  Vec3* screen = arena.allocate<Vec3>(mesh.nVertices);
+  kernels().transformPoints(&mesh.vertices[0].pos[0], VERTEX_STRIDE, &screen[0][0], mesh.nVertices, &toWindow[0]);
+  RasterVertex* raster = arena.allocate<RasterVertex>(mesh.nVertices);
+  for (unsigned int i = 0; i < mesh.nVertices; i++) {
+    raster[i].x = screen[i][0];
+    raster[i].y = screen[i][1];
+    raster[i].z = screen[i][2];
+  }
+  stats->vertices += mesh.nVertices;
+
+  Vec3 eye = transformP3(state->camera.eye, inverse(instance.worldMatrix));
+  const float maxDepth = FAR_PLANE / (FAR_PLANE - NEAR_PLANE);
+  for (unsigned int i = 0; i < mesh.nFaces; i++) {
+    const Triangle& face = mesh.faces[i];
+    const unsigned int* index = face.vertexIndex;
+    if (cullBackFaces && dotProduct(face.normal, eye - mesh.vertices[index[0]].pos) <= 0) {
+      stats->trianglesCulled++;
+      continue;
+    }
+
+    const RasterVertex& v0 = raster[index[0]];
+    const RasterVertex& v1 = raster[index[1]];
+    const RasterVertex& v2 = raster[index[2]];
+    if (std::min({v0.z, v1.z, v2.z}) < 0 || std::max({v0.z, v1.z, v2.z}) >= maxDepth) {
+      stats->trianglesCulled++;
+      continue;
+    }
+
+    stats->triangles++;
+    rasterize(depthTarget, v0, v1, v2, [](std::size_t, float, float) {});
+  }
+}
+
+/**
+ * Renders the shadow map of the first directional light.
+ */
+void g3::Renderer::renderShadowMap(const Mat4& viewProjMatrix)
+{
+  G3_PROFILE_ZONE("shadow map");
+
+  // the map holds the whole scene, so that shadows of instances out of view
+  // still fall into it
+  Aabb bounds = createEmptyAabb();
+  for (unsigned int i = 0; i < state->instances.size(); i++) {
+    grow(bounds, sceneBvh.getBounds(i));
+  }
+  shadowMap.resize(state->shadowMapSize);
+  shadowMap.setLight(state->lighting.directionalLights[0].direction, bounds);
+  shadowMap.clear();
+
+  // the faces seen from behind by the light cast shadows too, and the
+  // counters of the frame are left to the camera pass
+  FrameStats* frameStats = stats;
+  FrameStats shadowStats {};
+  DepthTarget depthTarget { shadowMap.getDepthBuffer(), shadowMap.getSize(),
+                            { 0, 0, (int)shadowMap.getSize(), (int)shadowMap.getSize() }, &shadowStats };
+  stats = &shadowStats;
+  for (unsigned int i = 0; i < state->instances.size(); i++) {
+    const MeshInstance& instance = state->instances[i];
+    renderDepthOnly(instance, selectMesh(i, viewProjMatrix), instance.worldMatrix * shadowMap.getMatrix(),
+                    depthTarget, false);
+  }
+  stats = frameStats;
+}
+
+/**
+ * Renders the axes and the grid ground.
+ */
+void g3::Renderer::renderAxesAndGrid(const g3::Mat4& viewProjMat)
+{
+  G3_PROFILE_ZONE("axes and grid");
+
+  Mat4 staticMatrix = createScaleMatrix(1) * viewProjMat;
+
+  // render axes
+  Vec3 origo {0, 0, 0};
+  origo = transformP3( origo, staticMatrix );
+  stats->vertices++;
+
+  int origoX = mapXToWin( origo[0] );
+  int origoY = mapYToWin( origo[1] );
+
+  Vec3 axes[] { {1, 0, 0}, {0, 1, 0}, {0, 0, 1} };
+  Color axesColor[] {
+    createRGBA(255, 0, 0, 255),
+    createRGBA(0, 255, 0, 255),
+    createRGBA(0, 0, 255, 255)
+  };
+
+  for (int k = 0; k < 3; k++) {
+    Vec3 axisEnd = transformP3( axes[k], staticMatrix );
+    stats->vertices++;
+    int endX = mapXToWin( axisEnd[0] );
+    int endY = mapYToWin( axisEnd[1] );
+    drawLine(origoX, origoY, origo[2], endX, endY, axisEnd[2], axesColor[k]);
+  }
+
+
+  // render grid ground, thinned out and then left out under load
+  if (state->detailLevel >= 2) {
+    return;
+  }
+  int gridStride = (state->detailLevel == 1) ? 2 : 1;
+
+  float step = 1;
+  int size = 8; // size X size
+  Vec3 grid [ 4*(size+1) ];
+
+  Vec3 startX {  size/2.0f*step, 0, size/2.0f*step  };
+  for (int n = 0, m = 0; n < (size+1); n++, m+=4) {
+    grid[m]   = { startX[0],               0, startX[2] - (n*step) };	
+    grid[m+1] = { startX[0] - (size*step), 0, startX[2] - (n*step) };	
+    grid[m+2] = { startX[0] - (n*step),    0, startX[2] };	
+    grid[m+3] = { startX[0] - (n*step),    0, startX[2] - (size*step) };	
+  }
+
+	// transform all the endpoints in one batch
+	Vec3 projected [ 4*(size+1) ];
+	transformP3( grid, projected, 4*(size+1), staticMatrix );
+	stats->vertices += 4*(size+1);
+
+	Color gridColor = createRGBA(205, 201, 201, 255);
+	for (int n = 0; n < 4*(size+1); n+=2) {
+		if ((n/4) % gridStride != 0) continue;
+
+		const Vec3& g1 = projected[n];
+		int g1X = mapXToWin( g1[0] );
+		int g1Y = mapYToWin( g1[1] );
+		const Vec3& g2 = projected[n+1];
+		int g2X = mapXToWin( g2[0] );
+		int g2Y = mapYToWin( g2[1] );
+		drawLine(g1X, g1Y, g1[2], g2X, g2Y, g2[2], gridColor);
+	}
+
+}
+
+/**
+ * Captures the axes and the grid into the static layer once the view has
+ * held for two frames.
+ */
+bool g3::Renderer::prepareStaticLayer(const Mat4& viewProjMatrix)
+{
+  // the lines of multisampling cover samples, which the layer cannot hold
+  if (multisampling) {
+    return false;
+  }
+
+  StaticLayer::View view { state->camera, width, height, state->detailLevel };
+  if (staticLayer.holds(view)) {
+    return true;
+  }
+  if (view != lastView) {
+    // a view that changes every frame, like an orbit, is not worth keeping
+    lastView = view;
+    return false;
+  }
+
+  G3_PROFILE_ZONE("capture static layer");
+  if (!layerTarget) {
+    layerTarget.reset(new FrameBuffer(width, height));
+  } else {
+    layerTarget->resize(width, height);
+  }
+  layerTarget->clear(CLEAR_COLOR);
+
+  // the capture draws no part of the frame, so it keeps out of its counters
+  FrameBuffer* frameTarget = target;
+  FrameStats* frameStats = stats;
+  FrameStats layerStats {};
+  target = layerTarget.get();
+  stats = &layerStats;
+  renderAxesAndGrid(viewProjMatrix);
+  target = frameTarget;
+  stats = frameStats;
+  staticLayer.capture(*layerTarget, view);
+  return true;
+}
+
+/**
+ * Maps the x coordinate to the window coordinate system
+ */
+inline int g3::Renderer::mapXToWin(float x)
+{
+	return ( x * state->camera.zoomFactor / (width/(float)height)  ) + (width / 2.0f);
+}
+
+/**
+ * Maps the y coordinate to the window coordinate system
+ */
+inline int g3::Renderer::mapYToWin(float y)
+{
+	return ( -y * state->camera.zoomFactor ) + (height / 2.0f);
+}
+
+
+/**
+ * Draws a line.
+ */
+void g3::Renderer::drawLine(int x0, int y0, float z0, int x1, int y1, float z1, Color color)
+{
+  // The line visible?
+  if ( (std::min(std::abs(x0), std::abs(x1)) > width) &&
+     (std::min(std::abs(y0), std::abs(y1)) > height) )
+  {
+    stats->linesCulled++;
+    return;
+  }
+  stats->lines++;
+
+  // the pixels of the line are the ones whose centers it goes through
+  if (multisampling) {
+    drawLineMultisample(x0 + 0.5f, y0 + 0.5f, z0, x1 + 0.5f, y1 + 0.5f, z1, color);
+    return;
+  }
+
+  int dx = std::abs(x1 - x0);
+  int dy = std::abs(y1 - y0);
+  float dz = z1 - z0;
+  int sx = (x0 < x1) ? 1 : -1;
+  int sy = (y0 < y1) ? 1 : -1;
+
+  int err = dx - dy;
+  float gradient = 0;
+
+  int x = x0;
+  int y = y0;
+  float z = z0;
+
+  while (true) {
+    drawPoint(x, y, z, color);
+
+    if ((x == x1) && (y == y1)) break;
+    int e2 = 2 * err;
+    if (e2 > -dy) { err -= dy; x += sx; }
+    if (e2 < dx) { err += dx; y += sy; }
+
+    // interpolate z depth values along the longer axis
+    gradient = (dx > dy) ? std::abs(x - x0) / (float)dx : std::abs(y - y0) / (float)dy;
+    z = z0 + (dz * gradient);
+  }
+
+}
+
+/**
+ * Draws a line of a pixel's width into the samples.
+ */
+void g3::Renderer::drawLineMultisample(float x0, float y0, float z0, float x1, float y1, float z1, Color color)
+{
+  // half a pixel to the sides and past the ends, so that the line covers
+  // what drawLine covers
+  float dx = x1 - x0, dy = y1 - y0;
+  float length = std::sqrt(dx * dx + dy * dy);
+  if (length > 0) {
+    dx *= 0.5f / length;
+    dy *= 0.5f / length;
+  } else {
+    dx = 0.5f;
+    dy = 0;
+  }
+  RasterVertex corners[4] {};
+  corners[0].x = x0 - dx + dy;  corners[0].y = y0 - dy - dx;  corners[0].z = z0;
+  corners[1].x = x1 + dx + dy;  corners[1].y = y1 + dy - dx;  corners[1].z = z1;
+  corners[2].x = x1 + dx - dy;  corners[2].y = y1 + dy + dx;  corners[2].z = z1;
+  corners[3].x = x0 - dx - dy;  corners[3].y = y0 - dy + dx;  corners[3].z = z0;
+  auto shade = [color](float, float) { return color; };
+  rasterizeMultisample(corners[0], corners[1], corners[2], shade);
+  rasterizeMultisample(corners[0], corners[2], corners[3], shade);
+}
+
+/**
+ * Interpolates the attributes of a triangle and shades its pixels.
+ */
+struct g3::Renderer::TriangleShader
+{
+  /**
+   * The features, as bits of the FEATURES of the pixel loops. The filter
+   * only counts with a texture.
+   */
+  enum Feature : unsigned int
+  {
+    TEXTURED = 1,
+    BILINEAR = 2,
+    SHADOWED = 4,
+
+    /**
+     * The number of combinations.
+     */
+    VARIANTS = 8
+  };
+
+  /**
+   * The depth, the channels, 1/w, the texture and the shadow map
+   * coordinates divided by w and the channels lit by the shadow casting
+   * light, at the first vertex and their changes towards the second and
+   * the third vertex.
+   */
+  static const int ATTRIBUTES = 13;
+  float base[ATTRIBUTES], delta1[ATTRIBUTES], delta2[ATTRIBUTES];
+
+  /**
+   * The first vertex, the changes of the weights of the second and the
+   * third vertex along x and y on the screen.
+   */
+  float x0, y0;
+  float b1dx, b1dy, b2dx, b2dy;
+
+  const Texture* texture;
+  float texelsX, texelsY;
+  const ShadowMap* shadowMap;
+  unsigned int features;
+
+  /**
+   * Sets up a triangle. Its area on the screen must not be 0 for the
+   * weights to be defined. Without a shadow map the shadow attributes are
+   * left out.
+   */
+  TriangleShader(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2,
+                 const Texture* texture, TextureFilter filter, const ShadowMap* shadowMap);
+
+  /**
+   * Returns the weights of the second and the third vertex at a point.
+   */
+  void getWeights(float x, float y, float& b1, float& b2) const
+  {
+    b1 = (x - x0) * b1dx + (y - y0) * b1dy;
+    b2 = (x - x0) * b2dx + (y - y0) * b2dy;
+  }
+
+  /**
+   * Returns the color at the point of the given weights. FEATURES must be
+   * the features of the shader.
+   */
+  template <unsigned int FEATURES>
+  Color shade(float b1, float b2) const;
+};
+
+/**
+ * Sets up a triangle.
+ */
+g3::Renderer::TriangleShader::TriangleShader(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2,
+                                            const Texture* texture, TextureFilter filter,
+                                            const ShadowMap* shadowMap):
+x0 {v0.x},
+y0 {v0.y},
+texture {texture},
+texelsX {texture ? (float)texture->getWidth() : 0},
+texelsY {texture ? (float)texture->getHeight() : 0},
+shadowMap {shadowMap},
+features {(texture ? TEXTURED : 0u) | (texture && filter == TextureFilter::BILINEAR ? BILINEAR : 0u)
+          | (shadowMap ? SHADOWED : 0u)}
+{
+  const RasterVertex* v[3] { &v0, &v1, &v2 };
+  float attributes[3][ATTRIBUTES];
+  for (int i = 0; i < 3; i++) {
+    const unsigned char* channels = reinterpret_cast<const unsigned char*>(&v[i]->color);
+    attributes[i][0] = v[i]->z;
+    for (int k = 0; k < 3; k++) {
+      attributes[i][k + 1] = channels[k];
+    }
+    attributes[i][4] = v[i]->invW;
+    attributes[i][5] = v[i]->u * v[i]->invW;
+    attributes[i][6] = v[i]->v * v[i]->invW;
+    attributes[i][7] = v[i]->sx * v[i]->invW;
+    attributes[i][8] = v[i]->sy * v[i]->invW;
+    attributes[i][9] = v[i]->sz * v[i]->invW;
+    const unsigned char* sunChannels = reinterpret_cast<const unsigned char*>(&v[i]->sunColor);
+    for (int k = 0; k < 3; k++) {
+      attributes[i][k + 10] = sunChannels[k];
+    }
+  }
+  int count = shadowMap ? ATTRIBUTES : 7;
+  for (int a = 0; a < count; a++) {
+    base[a] = attributes[0][a];
+    delta1[a] = attributes[1][a] - attributes[0][a];
+    delta2[a] = attributes[2][a] - attributes[0][a];
+  }
+
+  // the weight of a vertex is the edge function of the opposite edge over
+  // the signed area, linear in x and y
+  float invArea = 1 / ((v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x));
+  b1dx = (v2.y - v0.y) * invArea;
+  b1dy = (v0.x - v2.x) * invArea;
+  b2dx = (v0.y - v1.y) * invArea;
+  b2dy = (v1.x - v0.x) * invArea;
+}
+
+/**
+ * Returns the color at the point of the given weights.
+ */
+template <unsigned int FEATURES>
+g3::Color g3::Renderer::TriangleShader::shade(float b1, float b2) const
+{
+  float r = base[1] + delta1[1] * b1 + delta2[1] * b2;
+  float g = base[2] + delta1[2] * b1 + delta2[2] * b2;
+  float b = base[3] + delta1[3] * b1 + delta2[3] * b2;
+
+  if constexpr ((FEATURES & SHADOWED) != 0) {
+    // the part of the light that the shadow casting light brings is taken
+    // away as far as the point is in its shadow; the map is not read where
+    // that light does not reach anyway
+    float sunR = base[10] + delta1[10] * b1 + delta2[10] * b2;
+    float sunG = base[11] + delta1[11] * b1 + delta2[11] * b2;
+    float sunB = base[12] + delta1[12] * b1 + delta2[12] * b2;
+    if (sunR + sunG + sunB >= 0.5f) {
+      float W = 1 / (base[4] + delta1[4] * b1 + delta2[4] * b2);
+      float sx = (base[7] + delta1[7] * b1 + delta2[7] * b2) * W;
+      float sy = (base[8] + delta1[8] * b1 + delta2[8] * b2) * W;
+      float sz = (base[9] + delta1[9] * b1 + delta2[9] * b2) * W;
+      float shadow = 1 - shadowMap->getVisibility(sx, sy, sz);
+      r -= shadow * sunR;
+      g -= shadow * sunG;
+      b -= shadow * sunB;
+    }
+  }
+
+  if constexpr ((FEATURES & TEXTURED) != 0) {
+    // u = (u/w) / (1/w), and its derivatives on the screen by the quotient
+    // rule give the texels per pixel, which select the mip level
+    float invW = base[4] + delta1[4] * b1 + delta2[4] * b2;
+    float W = 1 / invW;
+    float u = (base[5] + delta1[5] * b1 + delta2[5] * b2) * W;
+    float v = (base[6] + delta1[6] * b1 + delta2[6] * b2) * W;
+    float invWdx = delta1[4] * b1dx + delta2[4] * b2dx;
+    float invWdy = delta1[4] * b1dy + delta2[4] * b2dy;
+    float dudx = (delta1[5] * b1dx + delta2[5] * b2dx - u * invWdx) * W * texelsX;
+    float dvdx = (delta1[6] * b1dx + delta2[6] * b2dx - v * invWdx) * W * texelsY;
+    float dudy = (delta1[5] * b1dy + delta2[5] * b2dy - u * invWdy) * W * texelsX;
+    float dvdy = (delta1[6] * b1dy + delta2[6] * b2dy - v * invWdy) * W * texelsY;
+    float rho2 = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+    float lod = 0.5f * approximateLog2(std::max(rho2, 1e-12f));
+
+    Color texel = ((FEATURES & BILINEAR) != 0) ? texture->sampleBilinear(u, v, lod)
+                                               : texture->sampleNearest(u, v, lod);
+    const unsigned char* channels = reinterpret_cast<const unsigned char*>(&texel);
+    r = r * channels[0] * (1 / 255.0f);
+    g = g * channels[1] * (1 / 255.0f);
+    b = b * channels[2] * (1 / 255.0f);
+  }
+  return createRGBA(r + 0.5f, g + 0.5f, b + 0.5f, 255);
+}
+
+/**
+ * Calls pixel(index, b1, b2) for every pixel of a triangle that passes the
+ * depth test.
+ */
+template <class PixelFunction>
+void g3::Renderer::rasterize(const DepthTarget& depthTarget, const RasterVertex& v0, const RasterVertex& v1,
+                             const RasterVertex& v2, PixelFunction pixel)
+{
+  // the edge functions are positive inside for this winding on the screen,
+  // the other one is swapped into it, and so are the weights handed out
+  const RasterVertex* v[3] { &v0, &v1, &v2 };
+  auto edge = [](const RasterVertex& a, const RasterVertex& b, float x, float y) {
+    return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+  };
+  float area = edge(v0, v1, v2.x, v2.y);
+  if (area == 0) {
+    return;
+  }
+  bool swapped = area < 0;
+  if (swapped) {
+    std::swap(v[1], v[2]);
+    area = -area;
+  }
+
+  const ScreenRect& bounds = depthTarget.bounds;
+  int minX = std::max(bounds.left, (int)std::floor(std::min({v0.x, v1.x, v2.x})));
+  int maxX = std::min(bounds.right - 1, (int)std::ceil(std::max({v0.x, v1.x, v2.x})));
+  int minY = std::max(bounds.top, (int)std::floor(std::min({v0.y, v1.y, v2.y})));
+  int maxY = std::min(bounds.bottom - 1, (int)std::ceil(std::max({v0.y, v1.y, v2.y})));
+  if (minX > maxX || minY > maxY) {
+    return;
+  }
+
+  // a pixel center on an edge belongs to the triangle only if the edge is a
+  // top or a left edge, so that neighbouring triangles share no pixels
+  bool topLeft[3];
+  float stepX[3];
+  for (int e = 0; e < 3; e++) {
+    const RasterVertex& a = *v[(e + 1) % 3];
+    const RasterVertex& b = *v[(e + 2) % 3];
+    float dx = b.x - a.x, dy = b.y - a.y;
+    topLeft[e] = dy < 0 || (dy == 0 && dx > 0);
+    stepX[e] = -dy;
+  }
+
+  float invArea = 1 / area;
+  float z0 = v0.z, dz1 = v1.z - v0.z, dz2 = v2.z - v0.z;
+  int weight1 = swapped ? 2 : 1;
+  int weight2 = swapped ? 1 : 2;
+
+  unsigned long tested = 0, written = 0;
+  float px = minX + 0.5f;
+  for (int y = minY; y <= maxY; y++) {
+    float py = y + 0.5f;
+    float w[3];
+    for (int e = 0; e < 3; e++) {
+      w[e] = edge(*v[(e + 1) % 3], *v[(e + 2) % 3], px, py);
+    }
+    std::size_t row = (std::size_t)y * depthTarget.stride;
+    float* depth = depthTarget.depth;
+
+    for (int x = minX; x <= maxX; x++) {
+      bool inside = true;
+      for (int e = 0; e < 3; e++) {
+        inside &= w[e] > 0 || (w[e] == 0 && topLeft[e]);
+      }
+
+      if (inside) {
+        tested++;
+        float b1 = w[weight1] * invArea;
+        float b2 = w[weight2] * invArea;
+        float z = z0 + dz1 * b1 + dz2 * b2;
+        if (z < depth[row + x]) {
+          depth[row + x] = z;
+          pixel(row + x, b1, b2);
+          written++;
+        }
+      }
+
+      for (int e = 0; e < 3; e++) {
+        w[e] += stepX[e];
+      }
+    }
+  }
+  depthTarget.stats->pixelsTested += tested;
+  depthTarget.stats->pixelsWritten += written;
+  depthTarget.stats->depthRejects += tested - written;
+}
+
+/**
+ * Rasterizes a triangle into the samples of the target.
+ */
+template <class ShadeFunction>
+void g3::Renderer::rasterizeMultisample(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2,
+                                        ShadeFunction shade)
+{
+  const unsigned int SAMPLES = SampleBuffer::SAMPLES;
+  const RasterVertex* v[3] { &v0, &v1, &v2 };
+  auto edge = [](const RasterVertex& a, const RasterVertex& b, float x, float y) {
+    return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+  };
+  float area = edge(v0, v1, v2.x, v2.y);
+  if (area == 0) {
+    return;
+  }
+  bool swapped = area < 0;
+  if (swapped) {
+    std::swap(v[1], v[2]);
+    area = -area;
+  }
+
+  int minX = std::max(scissor.left, (int)std::floor(std::min({v0.x, v1.x, v2.x})));
+  int maxX = std::min(scissor.right - 1, (int)std::ceil(std::max({v0.x, v1.x, v2.x})));
+  int minY = std::max(scissor.top, (int)std::floor(std::min({v0.y, v1.y, v2.y})));
+  int maxY = std::min(scissor.bottom - 1, (int)std::ceil(std::max({v0.y, v1.y, v2.y})));
+  if (minX > maxX || minY > maxY) {
+    return;
+  }
+
+  // the edge functions change by stepX along x and by stepY along y, so
+  // the ones of a sample are those of the pixel center and an offset
+  bool topLeft[3];
+  float stepX[3], stepY[3];
+  float sampleOffset[3][SAMPLES], minOffset[3], maxOffset[3];
+  for (int e = 0; e < 3; e++) {
+    const RasterVertex& a = *v[(e + 1) % 3];
+    const RasterVertex& b = *v[(e + 2) % 3];
+    float dx = b.x - a.x, dy = b.y - a.y;
+    topLeft[e] = dy < 0 || (dy == 0 && dx > 0);
+    stepX[e] = -dy;
+    stepY[e] = dx;
+    minOffset[e] = std::numeric_limits<float>::infinity();
+    maxOffset[e] = -std::numeric_limits<float>::infinity();
+    for (unsigned int s = 0; s < SAMPLES; s++) {
+      sampleOffset[e][s] = SampleBuffer::SAMPLE_X[s] * stepX[e] + SampleBuffer::SAMPLE_Y[s] * stepY[e];
+      minOffset[e] = std::min(minOffset[e], sampleOffset[e][s]);
+      maxOffset[e] = std::max(maxOffset[e], sampleOffset[e][s]);
+    }
+  }
+
+  float invArea = 1 / area;
+  float z0 = v0.z, dz1 = v1.z - v0.z, dz2 = v2.z - v0.z;
+  int weight1 = swapped ? 2 : 1;
+  int weight2 = swapped ? 1 : 2;
+
+  float* depth = target->getDepthBuffer();
+  Color* color = target->getColorBuffer();
+  unsigned long tested = 0, written = 0;
+  float px = minX + 0.5f;
+  for (int y = minY; y <= maxY; y++) {
+    float py = y + 0.5f;
+    float w[3];
+    for (int e = 0; e < 3; e++) {
+      w[e] = edge(*v[(e + 1) % 3], *v[(e + 2) % 3], px, py);
+    }
+    std::size_t row = target->indexOf(0, y);
+
+    // the row is walked only where every edge may have a sample inside, so
+    // that long thin triangles like the lines cost their area and not the
+    // area of their bounds; a pixel of margin absorbs the rounding
+    float first = minX, last = maxX;
+    for (int e = 0; e < 3; e++) {
+      float reach = w[e] + maxOffset[e];
+      if (stepX[e] > 0) {
+        first = std::max(first, minX - reach / stepX[e] - 1);
+      } else if (stepX[e] < 0) {
+        last = std::min(last, minX - reach / stepX[e] + 1);
+      } else if (reach < 0) {
+        last = first - 1;
+      }
+    }
+    if (first > last) {
+      continue;
+    }
+    int firstX = std::ceil(first), lastX = std::floor(last);
+    for (int e = 0; e < 3; e++) {
+      w[e] += stepX[e] * (firstX - minX);
+    }
+
+    for (int x = firstX; x <= lastX; x++) {
+      // inside the faces every sample is inside every edge, which the
+      // nearest sample to each edge tells at once
+      unsigned int mask = (w[0] + minOffset[0] > 0 && w[1] + minOffset[1] > 0 && w[2] + minOffset[2] > 0)
+                          ? SampleBuffer::FULL_MASK : 0;
+      for (unsigned int s = 0; s < SAMPLES && mask != SampleBuffer::FULL_MASK; s++) {
+        bool inside = true;
+        for (int e = 0; e < 3; e++) {
+          float ws = w[e] + sampleOffset[e][s];
+          inside &= ws > 0 || (ws == 0 && topLeft[e]);
+        }
+        mask |= (unsigned int)inside << s;
+      }
+
+      if (mask) {
+        tested++;
+        SampleBuffer::Tile* tile = samples.getTile(x, y);
+        if (!tile && mask == SampleBuffer::FULL_MASK) {
+          // the samples of the pixel stay equal, to the pixel center
+          float b1 = w[weight1] * invArea;
+          float b2 = w[weight2] * invArea;
+          float z = z0 + dz1 * b1 + dz2 * b2;
+          if (z < depth[row + x]) {
+            depth[row + x] = z;
+            color[row + x] = shade(b1, b2);
+            written++;
+          }
+        } else {
+          // the samples of a compressed tile have the depth of the pixel,
+          // the tile is expanded only if one of them is written
+          unsigned int pixel = SampleBuffer::indexInTile(x, y);
+          unsigned int passed = 0;
+          float sampleDepth[SAMPLES] {};
+          for (unsigned int s = 0; s < SAMPLES; s++) {
+            if (mask & (1u << s)) {
+              float b1 = (w[weight1] + sampleOffset[weight1][s]) * invArea;
+              float b2 = (w[weight2] + sampleOffset[weight2][s]) * invArea;
+              sampleDepth[s] = z0 + dz1 * b1 + dz2 * b2;
+              if (sampleDepth[s] < (tile ? tile->depth[pixel][s] : depth[row + x])) {
+                passed |= 1u << s;
+              }
+            }
+          }
+          if (passed) {
+            if (!tile) {
+              tile = samples.expand(x, y, *target);
+            }
+            float cx, cy;
+            SampleBuffer::getCentroid(mask, cx, cy);
+            float b1 = (w[weight1] + cx * stepX[weight1] + cy * stepY[weight1]) * invArea;
+            float b2 = (w[weight2] + cx * stepX[weight2] + cy * stepY[weight2]) * invArea;
+            Color c = shade(b1, b2);
+            for (unsigned int s = 0; s < SAMPLES; s++) {
+              if (passed & (1u << s)) {
+                tile->depth[pixel][s] = sampleDepth[s];
+                tile->color[pixel][s] = c;
+              }
+            }
+            written++;
+          }
+        }
+      }
+
+      for (int e = 0; e < 3; e++) {
+        w[e] += stepX[e];
+      }
+    }
+  }
+  stats->pixelsTested += tested;
+  stats->pixelsWritten += written;
+  stats->depthRejects += tested - written;
+}
+
+/**
+ * Fills a triangle, interpolating the depth and the colors of its vertices.
+ */
+void g3::Renderer::drawTriangle(const DepthTarget& depthTarget, const RasterVertex& v0, const RasterVertex& v1,
+                                const RasterVertex& v2, const Texture* texture)
+{
+  using FillFunction = void (Renderer::*)(const DepthTarget&, const TriangleShader&, const RasterVertex&,
+                                          const RasterVertex&, const RasterVertex&);
+  static const FillFunction fillFunctions[TriangleShader::VARIANTS] {
+    &Renderer::fillTriangle<0>, &Renderer::fillTriangle<1>, &Renderer::fillTriangle<2>, &Renderer::fillTriangle<3>,
+    &Renderer::fillTriangle<4>, &Renderer::fillTriangle<5>, &Renderer::fillTriangle<6>, &Renderer::fillTriangle<7>
+  };
+
+  TriangleShader shader(v0, v1, v2, texture, state->textureFilter, shadowing ? &shadowMap : nullptr);
+  (this->*fillFunctions[shader.features])(depthTarget, shader, v0, v1, v2);
+}
+
+/**
+ * Fills a triangle with the pixel loop of a combination of features.
+ */
+template <unsigned int FEATURES>
+void g3::Renderer::fillTriangle(const DepthTarget& depthTarget, const TriangleShader& shader, const RasterVertex& v0,
+                                const RasterVertex& v1, const RasterVertex& v2)
+{
+  unsigned long shaded = 0;
+  if (multisampling) {
+    rasterizeMultisample(v0, v1, v2, [&](float b1, float b2) {
+      shaded++;
+      return shader.shade<FEATURES>(b1, b2);
+    });
+  } else {
+    Color* color = target->getColorBuffer();
+    rasterize(depthTarget, v0, v1, v2, [&](std::size_t index, float b1, float b2) {
+      color[index] = shader.shade<FEATURES>(b1, b2);
+      shaded++;
+    });
+  }
+  depthTarget.stats->pixelsShaded += shaded;
+}
+
+/**
+ * Rasterizes a triangle into the depth and the visibility buffers.
+ */
+void g3::Renderer::drawTriangleVisibility(const DepthTarget& depthTarget, const RasterVertex& v0, const RasterVertex& v1,
+                                          const RasterVertex& v2, std::uint32_t id)
+{
+  std::uint32_t* ids = visibility.get();
+  rasterize(depthTarget, v0, v1, v2, [&](std::size_t index, float, float) {
+    ids[index] = id;
+  });
+}
+
+/**
+ * Sizes the visibility buffer to the target.
+ */
+void g3::Renderer::prepareVisibilityBuffer()
+{
+  // the shading pass clears what it reads, so a buffer of the right size is
+  // already clear
+  std::size_t size = (std::size_t)target->getStride() * height;
+  if (size > visibilitySize) {
+    visibility.reset(static_cast<std::uint32_t*>(alignedAlloc(size * sizeof(std::uint32_t))));
+    visibilitySize = size;
+    std::memset(visibility.get(), 0, size * sizeof(std::uint32_t));
+  }
+  visibilityDraws.clear();
+  nextVisibilityId = 1;
+}
+
+/**
+ * Shades the pixels of the visibility buffer, in parallel over the rows.
+ */
+void g3::Renderer::shadeVisibilityBuffer()
+{
+  G3_PROFILE_ZONE("shade visibility");
+
+  std::atomic<unsigned long> shaded {0};
+  pool->parallelFor(scissor.top, scissor.bottom, VISIBILITY_ROWS_PER_TASK, [&](std::size_t first, std::size_t last) {
+    shaded += shadeVisibilityRows(first, last);
+  });
+  stats->pixelsShaded += shaded;
+}
+
+/**
+ * Shades the pixels of the visibility buffer in a range of rows.
+ */
+unsigned long g3::Renderer::shadeVisibilityRows(unsigned int first, unsigned int last)
+{
+  using SpanFunction = void (Renderer::*)(const TriangleShader&, unsigned int, unsigned int, unsigned int) const;
+  static const SpanFunction spanFunctions[TriangleShader::VARIANTS] {
+    &Renderer::shadeSpan<0>, &Renderer::shadeSpan<1>, &Renderer::shadeSpan<2>, &Renderer::shadeSpan<3>,
+    &Renderer::shadeSpan<4>, &Renderer::shadeSpan<5>, &Renderer::shadeSpan<6>, &Renderer::shadeSpan<7>
+  };
+
+  const std::uint32_t* ids = visibility.get();
+  unsigned long shaded = 0;
+
+  // neighbouring pixels mostly show the same face, whose shader is kept
+  // from one span to the next
+  std::optional<TriangleShader> shader;
+  std::uint32_t shaderId = 0;
+
+  for (unsigned int y = first; y < last; y++) {
+    const std::uint32_t* row = ids + target->indexOf(0, y);
+    unsigned int x = scissor.left;
+    while (x < (unsigned int)scissor.right) {
+      std::uint32_t id = row[x];
+      unsigned int end = x + 1;
+      while (end < (unsigned int)scissor.right && row[end] == id) {
+        end++;
+      }
+      if (id == 0) {
+        x = end;
+        continue;
+      }
+
+      if (id != shaderId) {
+        // the draw whose range of identifiers holds the face
+        auto draw = std::upper_bound(visibilityDraws.begin(), visibilityDraws.end(), id,
+          [](std::uint32_t id, const VisibilityDraw& draw) { return id < draw.firstId; }) - 1;
+        unsigned int face = id - draw->firstId;
+        const unsigned int* index = draw->mesh->faces[face].vertexIndex;
+        RasterVertex v0 = draw->vertices[index[0]];
+        RasterVertex v1 = draw->vertices[index[1]];
+        RasterVertex v2 = draw->vertices[index[2]];
+        if (draw->faceColors) {
+          v0.color = v1.color = v2.color = draw->faceColors[face];
+        }
+        if (draw->faceSunColors) {
+          v0.sunColor = v1.sunColor = v2.sunColor = draw->faceSunColors[face];
+        }
+        shader.emplace(v0, v1, v2, draw->texture, state->textureFilter, shadowing ? &shadowMap : nullptr);
+        shaderId = id;
+      }
+
+      (this->*spanFunctions[shader->features])(*shader, y, x, end);
+      shaded += end - x;
+      x = end;
+    }
+  }
+  return shaded;
+}
+
+/**
+ * Shades a span of a row of the visibility buffer.
+ */
+template <unsigned int FEATURES>
+void g3::Renderer::shadeSpan(const TriangleShader& shader, unsigned int y, unsigned int first, unsigned int last) const
+{
+  std::size_t row = target->indexOf(0, y);
+  Color* color = target->getColorBuffer() + row;
+  std::uint32_t* ids = visibility.get() + row;
+  for (unsigned int x = first; x < last; x++) {
+    float b1, b2;
+    shader.getWeights(x + 0.5f, y + 0.5f, b1, b2);
+    color[x] = shader.shade<FEATURES>(b1, b2);
+    ids[x] = 0;
+  }
+}
+
+/**
+ * Draws a point on the screen.
+ */
+void g3::Renderer::drawPoint(int x, int y, float z, Color color)
+{
+  if ((x >= scissor.left) && (y >= scissor.top) && (x < scissor.right) && (y < scissor.bottom)) {
+    // depth test
+    stats->pixelsTested++;
+    std::size_t targetPixel = target->indexOf(x, y);
+    float* depth = target->getDepthBuffer();
+    if ( z < depth[targetPixel] ) {
+      // saves the new depth value
+      depth[targetPixel] = z;
+
+      // sets the color of the pixel with a single store
+      target->getColorBuffer()[targetPixel] = color;
+      stats->pixelsWritten++;
+    } else {
+      stats->depthRejects++;
+    }
+  } else {
+    stats->offscreenRejects++;
+  }
+}
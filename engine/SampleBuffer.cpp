@@ -0,0 +1,121 @@
+
+#include "SampleBuffer.h"
+#include <algorithm>
+
+g3::SampleBuffer::SampleBuffer():
+tilesX {0},
+tilesY {0}
+{
+}
+
+/**
+ * Compresses every tile for a frame of the given size.
+ */
+void g3::SampleBuffer::reset(unsigned int width, unsigned int height)
+{
+  unsigned int newTilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+  unsigned int newTilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+  if (newTilesX != tilesX || newTilesY != tilesY) {
+    tilesX = newTilesX;
+    tilesY = newTilesY;
+    tiles.assign((std::size_t)tilesX * tilesY, 0);
+  } else {
+    // only the tiles of the last frame are cleared, not the whole table
+    for (unsigned int tile : expanded) {
+      tiles[tile] = 0;
+    }
+  }
+  expanded.clear();
+}
+
+/**
+ * Expands the compressed tile of a pixel.
+ */
+g3::SampleBuffer::Tile* g3::SampleBuffer::expand(unsigned int x, unsigned int y, const FrameBuffer& target)
+{
+  unsigned int index = (y / TILE_SIZE) * tilesX + x / TILE_SIZE;
+  if (expanded.size() == blocks.size()) {
+    blocks.emplace_back(new Tile);
+  }
+  Tile* tile = blocks[expanded.size()].get();
+  expanded.push_back(index);
+  tiles[index] = expanded.size();
+
+  // the pixels of the tile beyond the target are never drawn
+  unsigned int left = x - x % TILE_SIZE, top = y - y % TILE_SIZE;
+  unsigned int right = std::min(left + TILE_SIZE, target.getWidth());
+  unsigned int bottom = std::min(top + TILE_SIZE, target.getHeight());
+  for (unsigned int py = top; py < bottom; py++) {
+    std::size_t row = target.indexOf(0, py);
+    for (unsigned int px = left; px < right; px++) {
+      unsigned int pixel = indexInTile(px, py);
+      std::fill(tile->depth[pixel], tile->depth[pixel] + SAMPLES, target.getDepthBuffer()[row + px]);
+      std::fill(tile->color[pixel], tile->color[pixel] + SAMPLES, target.getColorBuffer()[row + px]);
+    }
+  }
+  return tile;
+}
+
+/**
+ * Writes the samples of the expanded tiles into the target.
+ */
+void g3::SampleBuffer::resolve(FrameBuffer& target) const
+{
+  Color* color = target.getColorBuffer();
+  float* depth = target.getDepthBuffer();
+  for (unsigned int index : expanded) {
+    const Tile& tile = *blocks[tiles[index] - 1];
+    unsigned int left = (index % tilesX) * TILE_SIZE, top = (index / tilesX) * TILE_SIZE;
+    unsigned int right = std::min(left + TILE_SIZE, target.getWidth());
+    unsigned int bottom = std::min(top + TILE_SIZE, target.getHeight());
+    for (unsigned int y = top; y < bottom; y++) {
+      std::size_t row = target.indexOf(0, y);
+      for (unsigned int x = left; x < right; x++) {
+        unsigned int pixel = indexInTile(x, y);
+
+        // the channels are averaged in place: they are summed in 10 bits
+        // each, out of the way of their neighbours
+        unsigned int evenSum = 0, oddSum = 0;
+        float nearest = tile.depth[pixel][0];
+        for (unsigned int s = 0; s < SAMPLES; s++) {
+          Color c = tile.color[pixel][s];
+          evenSum += c & 0x00ff00ff;
+          oddSum += (c >> 8) & 0x00ff00ff;
+          nearest = std::min(nearest, tile.depth[pixel][s]);
+        }
+        evenSum = ((evenSum + 0x00020002) >> 2) & 0x00ff00ff;
+        oddSum = ((oddSum + 0x00020002) >> 2) & 0x00ff00ff;
+        color[row + x] = evenSum | (oddSum << 8);
+        depth[row + x] = nearest;
+      }
+    }
+  }
+}
+
+/**
+ * Returns the memory the samples of the frame take beyond the frame buffer.
+ */
+std::size_t g3::SampleBuffer::getMemorySize() const
+{
+  return tiles.size() * sizeof(tiles[0]) + expanded.size() * sizeof(Tile);
+}
+
+/**
+ * Returns the position of the centroid of the covered samples of a pixel.
+ */
+void g3::SampleBuffer::getCentroid(unsigned int mask, float& x, float& y)
+{
+  x = y = 0;
+  unsigned int count = 0;
+  for (unsigned int s = 0; s < SAMPLES; s++) {
+    if (mask & (1u << s)) {
+      x += SAMPLE_X[s];
+      y += SAMPLE_Y[s];
+      count++;
+    }
+  }
+  if (count) {
+    x /= count;
+    y /= count;
+  }
+}
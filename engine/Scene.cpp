@@ -0,0 +1,48 @@
+
+#include "Scene.h"
+#include <limits>
+
+g3::SceneBvh::SceneBvh():
+builtCost {0},
+buildCount {0}
+{
+}
+
+/**
+ * Updates the tree to the current world matrices of the instances.
+ */
+void g3::SceneBvh::update(const std::vector<MeshInstance>& instances)
+{
+  bool sizeChanged = instances.size() != bounds.size();
+  bounds.resize(instances.size());
+  for (std::size_t i = 0; i < instances.size(); i++) {
+    bounds[i] = transformAabb(instances[i].mesh->bounds, instances[i].worldMatrix);
+  }
+
+  if (!sizeChanged) {
+    bvh.refit(bounds.data());
+    if (bvh.getCost() <= builtCost * REBUILD_COST_RATIO) {
+      return;
+    }
+  }
+
+  bvh.build(bounds.data(), bounds.size());
+  builtCost = bvh.getCost();
+  buildCount++;
+}
+
+/**
+ * Returns the index of the instance whose box the ray hits first.
+ */
+int g3::SceneBvh::pick(const Ray& ray, float& distance) const
+{
+  distance = std::numeric_limits<float>::infinity();
+  return bvh.intersect(ray, distance, [&](unsigned int item, float& tMax) {
+    float t;
+    if (g3::intersect(ray, bounds[item], tMax, t) && t < tMax) {
+      tMax = t;
+      return true;
+    }
+    return false;
+  });
+}
@@ -0,0 +1,92 @@
+
+#include "ShadowMap.h"
+#include "Kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+g3::ShadowMap::ShadowMap():
+size {0}
+{
+  loadIdentity(matrix);
+}
+
+/**
+ * Sizes the map.
+ */
+void g3::ShadowMap::resize(unsigned int size)
+{
+  if (size != this->size) {
+    depth.reset(static_cast<float*>(alignedAlloc((std::size_t)size * size * sizeof(float))));
+    this->size = size;
+  }
+}
+
+/**
+ * Resets every texel to the far side of the scene.
+ */
+void g3::ShadowMap::clear()
+{
+  float far = 1;
+  std::uint32_t farBits;
+  std::memcpy(&farBits, &far, sizeof(far));
+  kernels().fill32(reinterpret_cast<std::uint32_t*>(depth.get()), (std::size_t)size * size, farBits);
+}
+
+/**
+ * Points the map from a directional light at a box of the world.
+ */
+void g3::ShadowMap::setLight(const Vec3& direction, const Aabb& bounds)
+{
+  // an orthographic view along the light that just holds the bounding
+  // sphere of the box, whatever the direction
+  Vec3 c = center(bounds);
+  float radius = std::max((bounds.max - bounds.min).length() / 2, 1e-3f);
+  Vec3 towardsLight = normalize(direction);
+  Vec3 up = (std::abs(towardsLight[1]) < 0.99f) ? Vec3{0, 1, 0} : Vec3{1, 0, 0};
+  Mat4 view = createLookAtLHMatrix(c + towardsLight * radius, c, up);
+  Mat4 projection = createOrthographicLHMatrix(2 * radius, 2 * radius, 0, 2 * radius);
+
+  // from -1..1 to texels, y down like the screen
+  float half = size / 2.0f;
+  Mat4 toTexels {
+    half, 0,     0, 0,
+    0,    -half, 0, 0,
+    0,    0,     1, 0,
+    half, half,  0, 1
+  };
+  matrix = view * projection * toTexels;
+}
+
+/**
+ * Returns how much of a point in map coordinates the light reaches.
+ */
+float g3::ShadowMap::getVisibility(float x, float y, float z) const
+{
+  if (!(x >= 0 && y >= 0 && x < size && y < size)) {
+    return 1;
+  }
+  int cx = (int)x;
+  int cy = (int)y;
+  float reference = z - SHADOW_BIAS;
+
+  // inside the border the 3x3 texels are all there, which is the common case
+  if (cx > 0 && cy > 0 && cx < (int)size - 1 && cy < (int)size - 1) {
+    const float* row = depth.get() + (std::size_t)(cy - 1) * size + cx;
+    int lit = 0;
+    for (int ty = 0; ty < 3; ty++, row += size) {
+      lit += (reference <= row[-1]) + (reference <= row[0]) + (reference <= row[1]);
+    }
+    return lit * (1 / 9.0f);
+  }
+
+  int lit = 0, samples = 0;
+  for (int ty = std::max(cy - 1, 0); ty <= std::min(cy + 1, (int)size - 1); ty++) {
+    const float* row = depth.get() + (std::size_t)ty * size;
+    for (int tx = std::max(cx - 1, 0); tx <= std::min(cx + 1, (int)size - 1); tx++) {
+      lit += reference <= row[tx];
+      samples++;
+    }
+  }
+  return lit / (float)samples;
+}
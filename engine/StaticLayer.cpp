@@ -0,0 +1,85 @@
+
+#include "StaticLayer.h"
+#include "Kernels.h"
+#include <algorithm>
+#include <limits>
+
+/**
+ * Returns whether two views show the same layer.
+ */
+bool g3::StaticLayer::View::operator==(const View& other) const
+{
+  for (int i = 0; i < 3; i++) {
+    if (camera.eye[i] != other.camera.eye[i] || camera.target[i] != other.camera.target[i]) {
+      return false;
+    }
+  }
+  return camera.zoomFactor == other.camera.zoomFactor && width == other.width && height == other.height
+         && detailLevel == other.detailLevel;
+}
+
+g3::StaticLayer::StaticLayer():
+valid {false},
+view {}
+{
+}
+
+/**
+ * Keeps the pixels of the source whose depth was written.
+ */
+void g3::StaticLayer::capture(const FrameBuffer& source, const View& view)
+{
+  spans.clear();
+  colors.clear();
+  depths.clear();
+
+  const float far = std::numeric_limits<float>::infinity();
+  for (unsigned int y = 0; y < source.getHeight(); y++) {
+    std::size_t row = source.indexOf(0, y);
+    const float* depth = source.getDepthBuffer() + row;
+    const Color* color = source.getColorBuffer() + row;
+    unsigned int x = 0;
+    while (x < source.getWidth()) {
+      if (depth[x] == far) {
+        x++;
+        continue;
+      }
+
+      // the span ends at the last drawn pixel with none within GAP after it
+      unsigned int end = x + 1;
+      for (unsigned int next = end; next < std::min(end + GAP, source.getWidth()); next++) {
+        if (depth[next] != far) {
+          end = next + 1;
+        }
+      }
+      spans.push_back({ y, x, end, depths.size() });
+      colors.insert(colors.end(), color + x, color + end);
+      depths.insert(depths.end(), depth + x, depth + end);
+      x = end;
+    }
+  }
+
+  valid = true;
+  this->view = view;
+}
+
+/**
+ * Merges the pixels of the layer in a rectangle into the target.
+ */
+void g3::StaticLayer::merge(FrameBuffer& target, unsigned int left, unsigned int top, unsigned int right,
+                            unsigned int bottom) const
+{
+  const Kernels& k = kernels();
+  auto span = std::lower_bound(spans.begin(), spans.end(), top,
+                               [](const Span& span, unsigned int y) { return span.y < y; });
+  for (; span != spans.end() && span->y < bottom; ++span) {
+    unsigned int first = std::max(span->left, left);
+    unsigned int last = std::min(span->right, right);
+    if (first < last) {
+      std::size_t row = target.indexOf(0, span->y);
+      std::size_t offset = span->offset + (first - span->left);
+      k.mergeMinDepth(target.getColorBuffer() + row + first, target.getDepthBuffer() + row + first,
+                      colors.data() + offset, depths.data() + offset, last - first);
+    }
+  }
+}
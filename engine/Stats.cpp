@@ -0,0 +1,87 @@
+
+#include "Stats.h"
+
+/**
+ * Adds the counters of another thread or frame.
+ */
+g3::FrameStats& g3::FrameStats::operator+=(const FrameStats& other)
+{
+  instances += other.instances;
+  instancesCulled += other.instancesCulled;
+  vertices += other.vertices;
+  triangles += other.triangles;
+  trianglesCulled += other.trianglesCulled;
+  lines += other.lines;
+  linesCulled += other.linesCulled;
+  pixelsTested += other.pixelsTested;
+  pixelsWritten += other.pixelsWritten;
+  depthRejects += other.depthRejects;
+  offscreenRejects += other.offscreenRejects;
+  pixelsShaded += other.pixelsShaded;
+  expandedTiles += other.expandedTiles;
+  sampleBytes += other.sampleBytes;
+  resolveTime += other.resolveTime;
+  redrawnPixels += other.redrawnPixels;
+  coveredPixels += other.coveredPixels;
+  renderTime += other.renderTime;
+  return *this;
+}
+
+/**
+ * Writes the names of the columns written by writeCsvRow.
+ */
+void g3::writeCsvHeader(std::ostream& out)
+{
+  out << "frame,render_time_ns,instances,instances_culled,vertices,triangles,triangles_culled,lines,lines_culled,pixels_tested,"
+      << "pixels_written,depth_rejects,offscreen_rejects,pixels_shaded,expanded_tiles,sample_bytes,"
+      << "resolve_time_ns,redrawn_pixels,covered_pixels,overdraw"
+      << std::endl;
+}
+
+/**
+ * Writes the counters of a frame as a line of comma separated values.
+ */
+void g3::writeCsvRow(std::ostream& out, unsigned long frame, const FrameStats& stats)
+{
+  out << frame << ','
+      << stats.renderTime << ','
+      << stats.instances << ','
+      << stats.instancesCulled << ','
+      << stats.vertices << ','
+      << stats.triangles << ','
+      << stats.trianglesCulled << ','
+      << stats.lines << ','
+      << stats.linesCulled << ','
+      << stats.pixelsTested << ','
+      << stats.pixelsWritten << ','
+      << stats.depthRejects << ','
+      << stats.offscreenRejects << ','
+      << stats.pixelsShaded << ','
+      << stats.expandedTiles << ','
+      << stats.sampleBytes << ','
+      << stats.resolveTime << ','
+      << stats.redrawnPixels << ','
+      << stats.coveredPixels << ','
+      << stats.getOverdraw() << '\n';
+}
+
+/**
+ * Prints the counters in a single line.
+ */
+std::ostream& g3::operator<<(std::ostream& out, const FrameStats& stats)
+{
+  out << "instances " << stats.instances << " (culled " << stats.instancesCulled << ")"
+      << " | vertices " << stats.vertices
+      << " | triangles " << stats.triangles << " (culled " << stats.trianglesCulled << ")"
+      << " | lines " << stats.lines << " (culled " << stats.linesCulled << ")"
+      << " | pixels " << stats.pixelsWritten << "/" << stats.pixelsTested
+      << " | depth rejects " << stats.depthRejects
+      << " | off-screen " << stats.offscreenRejects
+      << " | shaded " << stats.pixelsShaded
+      << " | redrawn " << stats.redrawnPixels;
+  if (stats.sampleBytes) {
+    out << " | msaa tiles " << stats.expandedTiles << " (" << stats.sampleBytes / 1024 << " KiB)"
+        << " resolve " << stats.resolveTime / 1e6 << " ms";
+  }
+  return (out << " | overdraw " << stats.getOverdraw());
+}
@@ -0,0 +1,36 @@
+
+#include "SwapChain.h"
+
+g3::SwapChain::SwapChain(unsigned int w, unsigned int h):
+back {0},
+front {1},
+ready {2}
+{
+  for (unsigned int i = 0; i < SIZE; i++) {
+    buffers[i].reset(new FrameBuffer(w, h));
+  }
+}
+
+/**
+ * Publishes the back buffer as the newest completed frame and hands the
+ * producer a new back buffer.
+ */
+void g3::SwapChain::present()
+{
+  // release: the pixels written to the back buffer become visible to the
+  // consumer; acquire: we take over the buffer the consumer gave back.
+  back = ready.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
+
+/**
+ * Takes the newest completed frame if there is one.
+ */
+bool g3::SwapChain::acquire()
+{
+  if ((ready.load(std::memory_order_relaxed) & FRESH) == 0) {
+    return false;
+  }
+
+  front = ready.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+  return true;
+}
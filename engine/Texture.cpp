@@ -0,0 +1,196 @@
+
+#include "Texture.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+
+/**
+ * Spreads the low 16 bits of n to the even bits of the result.
+ */
+inline std::size_t spreadBits(std::size_t n)
+{
+  n &= 0xffff;
+  n = (n | (n << 8)) & 0x00ff00ff;
+  n = (n | (n << 4)) & 0x0f0f0f0f;
+  n = (n | (n << 2)) & 0x33333333;
+  n = (n | (n << 1)) & 0x55555555;
+  return n;
+}
+
+/**
+ * Returns the base 2 logarithm of a power of two.
+ */
+unsigned int log2Of(unsigned int n)
+{
+  unsigned int log = 0;
+  while ((1u << log) < n) {
+    log++;
+  }
+  return log;
+}
+
+/**
+ * Returns the largest integer not greater than x, without the call to
+ * floor that targets without SSE4.1 make.
+ */
+inline int floorToInt(float x)
+{
+  int i = (int)x;
+  return i - (x < i);
+}
+
+/**
+ * Returns the channel k of a color, in R, G, B, A order.
+ */
+inline unsigned int channelOf(g3::Color color, int k)
+{
+  return reinterpret_cast<const unsigned char*>(&color)[k];
+}
+
+} // namespace
+
+/**
+ * Creates a texture from a row major image and builds its mip chain.
+ */
+g3::Texture::Texture(unsigned int width, unsigned int height, const Color* pixels, TextureLayout layout):
+layout {layout}
+{
+  if (!width || !height || (width & (width - 1)) || (height & (height - 1))) {
+    throw std::invalid_argument("texture sizes must be powers of two");
+  }
+
+  // the levels follow each other in one block
+  std::size_t size = 0;
+  for (unsigned int w = width, h = height; ; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u)) {
+    levels.push_back({ w, h, log2Of(std::min(w, h)), size, offsetsX.size(), offsetsY.size() });
+    size += (std::size_t)w * h;
+    for (unsigned int x = 0; x < w; x++) {
+      offsetsX.push_back(indexOf(levels.back(), x, 0));
+    }
+    for (unsigned int y = 0; y < h; y++) {
+      offsetsY.push_back(indexOf(levels.back(), 0, y));
+    }
+    if (w == 1 && h == 1) {
+      break;
+    }
+  }
+  texels.reset(static_cast<Color*>(alignedAlloc(size * sizeof(Color))));
+
+  for (unsigned int y = 0; y < height; y++) {
+    for (unsigned int x = 0; x < width; x++) {
+      texels[indexOf(levels[0], x, y)] = pixels[(std::size_t)y * width + x];
+    }
+  }
+
+  // every texel of a level averages the 2x2 texels under it, or the 2x1
+  // ones once a side is down to one texel
+  for (std::size_t i = 1; i < levels.size(); i++) {
+    const Level& level = levels[i];
+    const Level& parent = levels[i - 1];
+    unsigned int sx = parent.width / level.width;
+    unsigned int sy = parent.height / level.height;
+    for (unsigned int y = 0; y < level.height; y++) {
+      for (unsigned int x = 0; x < level.width; x++) {
+        unsigned int sum[4] {0, 0, 0, 0};
+        for (unsigned int dy = 0; dy < sy; dy++) {
+          for (unsigned int dx = 0; dx < sx; dx++) {
+            Color texel = fetch(i - 1, x * sx + dx, y * sy + dy);
+            for (int k = 0; k < 4; k++) {
+              sum[k] += channelOf(texel, k);
+            }
+          }
+        }
+        unsigned int n = sx * sy;
+        texels[level.offset + indexOf(level, x, y)] =
+          createRGBA((sum[0] + n / 2) / n, (sum[1] + n / 2) / n, (sum[2] + n / 2) / n, (sum[3] + n / 2) / n);
+      }
+    }
+  }
+}
+
+/**
+ * Returns the index of a texel within its level.
+ */
+std::size_t g3::Texture::indexOf(const Level& level, unsigned int x, unsigned int y) const
+{
+  if (layout == TextureLayout::LINEAR) {
+    return (std::size_t)y * level.width + x;
+  }
+
+  // a level that is not square is a row or a column of square Morton tiles;
+  // the bits of x and y do not overlap, so the index is the sum of a part
+  // of x and a part of y
+  unsigned int k = level.minLog;
+  unsigned int mask = (1u << k) - 1;
+  std::size_t tile = (x >> k) + (y >> k);
+  return (spreadBits(x & mask) | (spreadBits(y & mask) << 1)) + (tile << (2 * k));
+}
+
+/**
+ * Samples the texture at texture coordinates u, v.
+ */
+g3::Color g3::Texture::sample(float u, float v, float lod, TextureFilter filter) const
+{
+  return (filter == TextureFilter::NEAREST) ? sampleNearest(u, v, lod) : sampleBilinear(u, v, lod);
+}
+
+/**
+ * Samples the texel under texture coordinates u, v.
+ */
+g3::Color g3::Texture::sampleNearest(float u, float v, float lod) const
+{
+  unsigned int level = selectLevel(lod);
+  return fetch(level, floorToInt(u * levels[level].width), floorToInt(v * levels[level].height));
+}
+
+/**
+ * Samples the four texels around texture coordinates u, v.
+ */
+g3::Color g3::Texture::sampleBilinear(float u, float v, float lod) const
+{
+  unsigned int level = selectLevel(lod);
+  float x = u * levels[level].width;
+  float y = v * levels[level].height;
+
+  // the texel centers are at half coordinates
+  x -= 0.5f;
+  y -= 0.5f;
+  int x0 = floorToInt(x), y0 = floorToInt(y);
+  float wx = x - x0, wy = y - y0;
+  Color c00 = fetch(level, x0, y0);
+  Color c10 = fetch(level, x0 + 1, y0);
+  Color c01 = fetch(level, x0, y0 + 1);
+  Color c11 = fetch(level, x0 + 1, y0 + 1);
+
+  int channels[4];
+  for (int k = 0; k < 4; k++) {
+    float top = channelOf(c00, k) + (channelOf(c10, k) - (float)channelOf(c00, k)) * wx;
+    float bottom = channelOf(c01, k) + (channelOf(c11, k) - (float)channelOf(c01, k)) * wx;
+    channels[k] = top + (bottom - top) * wy + 0.5f;
+  }
+  return createRGBA(channels[0], channels[1], channels[2], channels[3]);
+}
+
+/**
+ * Creates a checkerboard texture.
+ */
+g3::Texture g3::createCheckerboardTexture(unsigned int size, unsigned int cells, TextureLayout layout)
+{
+  std::vector<Color> pixels((std::size_t)size * size);
+  unsigned int cell = std::max(size / cells, 1u);
+  for (unsigned int y = 0; y < size; y++) {
+    for (unsigned int x = 0; x < size; x++) {
+      bool dark = ((x / cell) + (y / cell)) % 2;
+      // darker towards the edges of the square
+      unsigned int ex = std::min(x % cell, cell - 1 - x % cell);
+      unsigned int ey = std::min(y % cell, cell - 1 - y % cell);
+      int shade = 40 * std::min(ex, ey) / std::max(cell / 2, 1u);
+      pixels[(std::size_t)y * size + x] = dark ? createRGBA(60 + shade, 70 + shade, 150 + shade, 255)
+                                               : createRGBA(200 + shade, 190 + shade, 170 + shade, 255);
+    }
+  }
+  return Texture(size, size, pixels.data(), layout);
+}
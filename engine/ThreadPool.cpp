@@ -0,0 +1,352 @@
+
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * A loop being run.
+ */
+struct g3::ThreadPool::Loop
+{
+  ChunkFunction function;
+  void* body;
+  std::size_t grain;
+
+  /**
+   * The number of chunks not done yet.
+   */
+  std::atomic<std::size_t> pending;
+};
+
+/**
+ * The deque of tasks of a thread, after Chase and Lev, in the formulation
+ * for weak memory models of Lê et al. The thread that owns it pushes and
+ * pops tasks at the bottom, the others steal them from the top. It does not
+ * grow: a thread whose deque is full runs the range it would have pushed.
+ */
+struct alignas(64) g3::ThreadPool::Deque
+{
+  static constexpr std::int64_t SIZE = 256;
+
+  /**
+   * A range of a loop.
+   */
+  struct Task
+  {
+    Loop* loop;
+    std::size_t first, last;
+  };
+
+  /**
+   * A task in the deque. A thief may read a slot while the owner reuses it,
+   * and then fails to take it, so the fields are atomic.
+   */
+  struct Slot
+  {
+    std::atomic<Loop*> loop;
+    std::atomic<std::size_t> first, last;
+  };
+
+  alignas(64) std::atomic<std::int64_t> top {0};
+  alignas(64) std::atomic<std::int64_t> bottom {0};
+  Slot slots[SIZE];
+
+  /**
+   * Pushes a task at the bottom, by the owner.
+   *
+   * @return false if the deque is full.
+   */
+  bool push(const Task& task)
+  {
+    std::int64_t b = bottom.load(std::memory_order_relaxed);
+    std::int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= SIZE) {
+      return false;
+    }
+    store(slots[b & (SIZE - 1)], task);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Pops the task at the bottom, by the owner.
+   *
+   * @return false if the deque is empty.
+   */
+  bool pop(Task& task)
+  {
+    std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    load(slots[b & (SIZE - 1)], task);
+    if (t < b) {
+      return true;
+    }
+
+    // the last task, which a thief may take at the same time
+    bool taken = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return taken;
+  }
+
+  /**
+   * Steals the task at the top, by another thread.
+   *
+   * @return false if the deque is empty or another thread took the task.
+   */
+  bool steal(Task& task)
+  {
+    std::int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return false;
+    }
+    load(slots[t & (SIZE - 1)], task);
+    return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+  }
+
+  static void store(Slot& slot, const Task& task)
+  {
+    slot.loop.store(task.loop, std::memory_order_relaxed);
+    slot.first.store(task.first, std::memory_order_relaxed);
+    slot.last.store(task.last, std::memory_order_relaxed);
+  }
+
+  static void load(const Slot& slot, Task& task)
+  {
+    task.loop = slot.loop.load(std::memory_order_relaxed);
+    task.first = slot.first.load(std::memory_order_relaxed);
+    task.last = slot.last.load(std::memory_order_relaxed);
+  }
+};
+
+namespace
+{
+
+/**
+ * The number of times an idle worker looks for tasks in vain before it
+ * sleeps.
+ */
+const unsigned int IDLE_ROUNDS = 64;
+
+/**
+ * The pool the thread runs loops for, a worker or the caller of a loop, and
+ * the index of its deque.
+ */
+thread_local const g3::ThreadPool* currentPool = nullptr;
+thread_local unsigned int currentThread = 0;
+
+/**
+ * Picks the deques to steal from, different on every thread.
+ */
+thread_local std::uint32_t victimSeed = 0;
+
+/**
+ * Binds the calling thread to the n-th of the processors it may run on.
+ */
+void pinThread(unsigned int n)
+{
+#ifdef __linux__
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return;
+  }
+  n %= std::max(CPU_COUNT(&allowed), 1);
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed) && n-- == 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      return;
+    }
+  }
+#else
+  (void)n;
+#endif
+}
+
+}
+
+g3::ThreadPool::ThreadPool(unsigned int threadCount, bool pinned):
+threadCount {threadCount ? threadCount : std::max(std::thread::hardware_concurrency(), 1u)},
+pinned {pinned},
+epoch {0},
+sleepers {0},
+stopping {false}
+{
+  deques.reset(new Deque[this->threadCount]);
+  workers.reserve(this->threadCount - 1);
+  for (unsigned int i = 1; i < this->threadCount; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+g3::ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+/**
+ * Runs a loop.
+ */
+void g3::ThreadPool::run(std::size_t begin, std::size_t end, std::size_t grain, ChunkFunction function, void* body)
+{
+  // a thread of the pool uses its own deque, a thread outside of it the
+  // first one, if no other thread outside has it. A thread busy with
+  // another pool runs the loop inline.
+  std::unique_lock<std::mutex> callerLock;
+  if (currentPool != this) {
+    if (currentPool == nullptr) {
+      callerLock = std::unique_lock<std::mutex>(callerMutex, std::try_to_lock);
+    }
+    if (!callerLock.owns_lock()) {
+      for (std::size_t first = begin; first < end; first += grain) {
+        function(body, first, std::min(first + grain, end));
+      }
+      return;
+    }
+    currentPool = this;
+    currentThread = 0;
+  }
+  unsigned int thread = currentThread;
+
+  Loop loop {function, body, grain, {(end - begin + grain - 1) / grain}};
+  runRange(thread, loop, begin, end);
+
+  // the other chunks, or the tasks of other loops meanwhile
+  while (loop.pending.load(std::memory_order_acquire) != 0) {
+    if (!runTask(thread)) {
+      std::this_thread::yield();
+    }
+  }
+
+  if (callerLock.owns_lock()) {
+    currentPool = nullptr;
+  }
+}
+
+/**
+ * Runs a range of a loop on a thread of the pool.
+ */
+void g3::ThreadPool::runRange(unsigned int thread, Loop& loop, std::size_t first, std::size_t last)
+{
+  // the upper halves go to the deque, the largest one first, where the
+  // thieves find them
+  std::size_t grain = loop.grain;
+  while (last - first > grain) {
+    std::size_t middle = first + (last - first + grain - 1) / grain / 2 * grain;
+    if (!deques[thread].push({ &loop, middle, last })) {
+      break;
+    }
+    wakeWorkers();
+    last = middle;
+  }
+
+  // a chunk, or the chunks that did not fit into the deque
+  std::size_t chunks = 0;
+  for (std::size_t chunk = first; chunk < last; chunk += grain) {
+    loop.function(loop.body, chunk, std::min(chunk + grain, last));
+    chunks++;
+  }
+  loop.pending.fetch_sub(chunks, std::memory_order_acq_rel);
+}
+
+/**
+ * Takes a task and runs it.
+ */
+bool g3::ThreadPool::runTask(unsigned int thread)
+{
+  Deque::Task task;
+  if (deques[thread].pop(task)) {
+    runRange(thread, *task.loop, task.first, task.last);
+    return true;
+  }
+
+  victimSeed = victimSeed * 1664525 + 1013904223;
+  unsigned int start = (victimSeed >> 16) % threadCount;
+  for (unsigned int i = 0; i < threadCount; i++) {
+    unsigned int victim = (start + i) % threadCount;
+    if (victim != thread && deques[victim].steal(task)) {
+      runRange(thread, *task.loop, task.first, task.last);
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Wakes up the sleeping workers.
+ */
+void g3::ThreadPool::wakeWorkers()
+{
+  epoch.fetch_add(1);
+  if (sleepers.load() != 0) {
+    // a worker between its last look at the epoch and its wait holds the
+    // mutex, so the notification does not pass it by
+    { std::lock_guard<std::mutex> lock(mutex); }
+    wake.notify_all();
+  }
+}
+
+/**
+ * The body of the worker threads.
+ */
+void g3::ThreadPool::workerLoop(unsigned int thread)
+{
+  currentPool = this;
+  currentThread = thread;
+  victimSeed = thread;
+  if (pinned) {
+    pinThread(thread);
+  }
+
+  unsigned int idle = 0;
+  while (!stopping.load(std::memory_order_relaxed)) {
+    unsigned long seen = epoch.load();
+    if (runTask(thread)) {
+      idle = 0;
+      continue;
+    }
+    if (++idle < IDLE_ROUNDS) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    sleepers++;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return stopping || epoch.load() != seen; });
+    }
+    sleepers--;
+    idle = 0;
+  }
+}
+
+/**
+ * Returns the pool shared by the engine.
+ */
+g3::ThreadPool& g3::defaultThreadPool()
+{
+  static ThreadPool pool(std::getenv("G3_THREADS") ? std::strtoul(std::getenv("G3_THREADS"), nullptr, 10) : 0,
+                         std::getenv("G3_PIN_THREADS") != nullptr);
+  return pool;
+}
@@ -0,0 +1,100 @@
+
+#include "Upscaler.h"
+#include "Kernels.h"
+#include <algorithm>
+
+namespace
+{
+
+/**
+ * Returns the position of the center of a target pixel in the source, in
+ * 16.16 fixed point from the center of the first source pixel, clamped to
+ * it.
+ */
+inline std::int32_t mapToSource(unsigned int target, unsigned int sourceSize, unsigned int targetSize)
+{
+  std::int64_t position = (((std::int64_t)target * 2 + 1) * sourceSize << 15) / targetSize - 0x8000;
+  return std::max<std::int64_t>(position, 0);
+}
+
+/**
+ * Returns the weight of the second of two source pixels at a position, out
+ * of BLEND_ONE, rounded.
+ */
+inline unsigned int getWeight(std::int32_t position)
+{
+  return ((position & 0xffff) * g3::BLEND_ONE + 0x8000) >> 16;
+}
+
+} // namespace
+
+g3::Upscaler::Upscaler():
+sourceWidth {0},
+targetWidth {0},
+rowSource {-1, -1},
+nextRow {0}
+{
+}
+
+/**
+ * Scales the colors of the source to the size of the target.
+ */
+void g3::Upscaler::upscale(const FrameBuffer& source, FrameBuffer& target)
+{
+  if (source.getWidth() != sourceWidth || target.getWidth() != targetWidth) {
+    sourceWidth = source.getWidth();
+    targetWidth = target.getWidth();
+    columns.resize(targetWidth);
+    for (unsigned int x = 0; x < targetWidth; x++) {
+      // the pair of a column past the last source pixel ends with it
+      std::int32_t position = mapToSource(x, sourceWidth, targetWidth);
+      unsigned int x0 = position >> 16, weight = getWeight(position);
+      if (x0 + 1 >= sourceWidth) {
+        x0 = std::max(sourceWidth, 2u) - 2;
+        weight = BLEND_ONE;
+      }
+      columns[x] = x0 << 8 | weight;
+    }
+    rows[0].resize(targetWidth);
+    rows[1].resize(targetWidth);
+  }
+
+  // the rows of the last frame are stale
+  rowSource[0] = rowSource[1] = -1;
+
+  const Kernels& k = kernels();
+  unsigned int sourceHeight = source.getHeight();
+  for (unsigned int y = 0; y < target.getHeight(); y++) {
+    std::int32_t position = mapToSource(y, sourceHeight, target.getHeight());
+    unsigned int y0 = position >> 16;
+    const Color* row0 = scaleRow(source, y0);
+    const Color* row1 = scaleRow(source, std::min(y0 + 1, sourceHeight - 1));
+    k.blendRows(row0, row1, target.getColorBuffer() + target.indexOf(0, y), targetWidth, getWeight(position));
+  }
+}
+
+/**
+ * Scales a row of the source along x into one of the kept rows.
+ */
+const g3::Color* g3::Upscaler::scaleRow(const FrameBuffer& source, unsigned int y)
+{
+  for (unsigned int i = 0; i < 2; i++) {
+    if (rowSource[i] == (int)y) {
+      return rows[i].data();
+    }
+  }
+
+  // the rows are asked for in order, the one not asked for last goes
+  Color* out = rows[nextRow].data();
+  rowSource[nextRow] = y;
+  nextRow ^= 1;
+
+  const Color* in = source.getColorBuffer() + source.indexOf(0, y);
+  if (sourceWidth < 2) {
+    // no pair to blend
+    kernels().fill32(out, targetWidth, in[0]);
+  } else {
+    kernels().scaleRow(in, columns.data(), out, targetWidth);
+  }
+  return out;
+}
@@ -1,49 +1,105 @@
 
 #include "World.h"
+#include <algorithm>
 #include <iostream>
-#include <thread>
-#include <chrono>
 #include "Mat.h"
 #include "Quaternion.h"
 #include "Mesh.h"
+#include "Profiler.h"
 #include <memory>
-#include <limits>
+#include <cstdlib>
+#include <sstream>
 
 g3::World::World(unsigned int w, unsigned int h):
 width {w},
 height {h},
-frontBuffer {Gdk::Pixbuf::create(Gdk::Colorspace::COLORSPACE_RGB, true, 8, width, height)},
-targetFrameTime {33300000},
-camera { Vec3{17, 10, -20}, Vec3{1, 0, 2}, 1280 }
+swapChain {w, h},
+scheduler {33300000, 16666667},
+cubeAngle {0},
+previousCubeAngle {0},
+lastRenderTime {0},
+camera { Vec3{17, 10, -20}, Vec3{1, 0, 2}, 1280 },
+renderer {},
+pendingWidth {w},
+pendingHeight {h},
+framePending {false},
+running {true},
+frameStats {},
+showStats {std::getenv("G3_STATS") != nullptr},
+shading {ShadingMode::WIREFRAME},
+visibilityBuffer {std::getenv("G3_VISIBILITY") != nullptr},
+shadows {std::getenv("G3_SHADOWS") != nullptr},
+msaa {std::getenv("G3_MSAA") != nullptr},
+dirtyRegions {std::getenv("G3_DIRTY") != nullptr},
+resolutionScale {1},
+cubeTexture {createCheckerboardTexture(256, 8)}
 {
-	// initializes the depth buffer.
-	depthBuffer.reset(new float[width * height]);
-
-	// start frame time
-	startFrameTime = clock_time();
+	// wrap the buffers of the swap chain, start with an empty frame
+	for (unsigned int i = 0; i < SwapChain::SIZE; i++) {
+		FrameBuffer& buffer = swapChain.getBuffer(i);
+		buffer.clear(CLEAR_COLOR);
+		getPixbuf(buffer, i);
+	}
 
 	g3::loadCube(cube);
+	instances.push_back({ &cube, g3::getWorldMatrix(cube) });
+
+	// build the picking trees of the meshes up front, not on the first click
+	picker.getTriangleBvh(cube);
+
+	// G3_STATS=1 shows the frame counters, including the overdraw ratio,
+	// G3_MSAA=1 antialiases the edges and the lines, G3_DIRTY=1 redraws
+	// only the regions of the buffers that changed
+	renderer.setCountCoverage(showStats);
+
+	// G3_SHADING=flat or gouraud draws lit faces instead of the wireframe,
+	// G3_VISIBILITY=1 shades them once per pixel after rasterizing them,
+	// G3_SHADOWS=1 lets the sun cast shadows on them
+	const char* shadingName = std::getenv("G3_SHADING");
+	if (shadingName && !parseShadingMode(shadingName, shading)) {
+		std::cerr << "G3_SHADING: unknown shading mode " << shadingName << std::endl;
+	}
+
+	// G3_SCALE=0.5 renders at half the resolution of the window and scales
+	// the frames up
+	if (const char* scale = std::getenv("G3_SCALE")) {
+		resolutionScale = std::min(1.0f, std::max(FrameState::MIN_USER_RESOLUTION_SCALE, std::strtof(scale, nullptr)));
+	}
+
+	// G3_DYNAMIC_RESOLUTION=1 lowers the resolution when the frames take
+	// too long to render, and restores it when they are fast again
+	if (std::getenv("G3_DYNAMIC_RESOLUTION")) {
+		scheduler.setDynamicResolution(true);
+	}
+
+	// G3_TEXTURE=1 maps a checkerboard onto the filled faces of the cube
+	if (std::getenv("G3_TEXTURE")) {
+		instances[0].texture = &cubeTexture;
+	}
+
+	// present the frames completed by the render thread
+	frameReady.connect(sigc::mem_fun(*this, &World::on_frame_ready));
+	renderThread = std::thread(&World::renderLoop, this);
 	
 	// enable mouse wheel detection
 	add_events(Gdk::BUTTON_PRESS_MASK | Gdk::SCROLL_MASK);
 
-	// register idle function
-	Glib::signal_idle().connect(sigc::mem_fun(*this, &World::on_idle));
+	// register the frame timer
+	Glib::signal_timeout().connect(sigc::mem_fun(*this, &World::on_tick),
+		scheduler.getTargetFrameTime() / 1000000);
 }
 
-
-/**
- * Clears the buffers.
- */
-void g3::World::clear()
+g3::World::~World()
 {
-	// Fill the buffer with color white
-	frontBuffer->fill(0xfafad2ff);
-
-	// Clears the depth buffer
-	std::fill(depthBuffer.get(), depthBuffer.get() + (width*height), std::numeric_limits<float>::infinity());
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		running = false;
+	}
+	frameRequested.notify_one();
+	renderThread.join();
 }
 
+
 /**
  * Detects mouse wheel movements. Called by the GUI.
  */
@@ -61,221 +117,180 @@ bool g3::World::on_scroll_event(GdkEventScroll* event)
 }
 
 /**
- * The drawing function, called by the GUI.
+ * Picks the face under the mouse and highlights its mesh. Called by the GUI.
  */
-bool g3::World::on_draw(const Cairo::RefPtr<Cairo::Context>& cr) {
-	
-	render();
-	
-	// Draw the buffer
-	Gdk::Cairo::set_source_pixbuf(cr, frontBuffer);
-	cr->paint();
+bool g3::World::on_button_press_event(GdkEventButton* event)
+{
+	G3_PROFILE_ZONE("pick");
+
+	// the instances are where the last requested frame shows them
+	Ray ray = createPickingRay(camera, width, height, event->x, event->y);
+	pickingBvh.update(instances);
+	PickHit hit = picker.pick(instances, pickingBvh, ray);
+
+	for (int i = 0; i < (int)instances.size(); i++) {
+		instances[i].color = (i == hit.instance) ? createRGBA(255, 140, 0, 255) : WIREFRAME_COLOR;
+	}
+	if (hit.instance >= 0) {
+		std::cout << "picked instance " << hit.instance << ", face " << hit.face
+			<< " at distance " << hit.distance << std::endl;
+	}
 
 	return true;
 }
 
 /**
- * Renders the scene.
+ * Takes the new size of the window for the next frames. Called by the GUI.
  */
-void g3::World::render()
+void g3::World::on_size_allocate(Gtk::Allocation& allocation)
 {
-  clear();
-
-  Vec3 upWorld {0,1,0};
+	Gtk::DrawingArea::on_size_allocate(allocation);
 
-  Mat4 viewProjMatrix = g3::createLookAtLHMatrix(camera.eye, camera.target, upWorld)
-          * g3::createPerspectiveFovLHMatrix(0.78f, width / (float)height, 0.01f, 25.0f);
-
-
-  renderAxesAndGrid(viewProjMatrix);	
-  renderWireframe(viewProjMatrix);
+	// picking follows at once, the buffers with the next frames
+	width = std::max(1, allocation.get_width());
+	height = std::max(1, allocation.get_height());
+	requestFrame();
 }
 
 /**
- * Renders the cube wireframe.
+ * Returns the pixbuf of a buffer of the swap chain.
  */
-void g3::World::renderWireframe(const g3::Mat4& viewProjMatrix)
+const Glib::RefPtr<Gdk::Pixbuf>& g3::World::getPixbuf(const FrameBuffer& buffer, unsigned int index)
 {
-  Mat4 transformMatrix = g3::getWorldMatrix(cube) * viewProjMatrix;
-
-  for (unsigned int i = 0; i < cube.nFaces; i++) {
-    Vec3 v[3];
-    int mapToWin[6];
-
-    for (unsigned int j = 0; j < 3; j++) {
-      v[j] = transformP3( cube.vertices[ cube.faces[i].vertexIndex[j] ].pos, transformMatrix );
-
-      mapToWin[2*j]   = mapXToWin( v[j][0] );
-      mapToWin[2*j+1] = mapYToWin( v[j][1] );
-    }
-
-    unsigned long color = createRGBA(0, 0, 128, 255);
-    drawLine(mapToWin[0], mapToWin[1], v[0][2], mapToWin[2], mapToWin[3], v[1][2], color);
-    drawLine(mapToWin[2], mapToWin[3], v[1][2], mapToWin[4], mapToWin[5], v[2][2], color);
-    drawLine(mapToWin[4], mapToWin[5], v[2][2], mapToWin[0], mapToWin[1], v[0][2], color);
-  }
+	const guint8* pixels = reinterpret_cast<const guint8*>(buffer.getColorBuffer());
+	Glib::RefPtr<Gdk::Pixbuf>& pixbuf = pixbufs[index];
+	if (!pixbuf || pixbuf->get_pixels() != pixels || pixbuf->get_width() != (int)buffer.getWidth()
+	    || pixbuf->get_height() != (int)buffer.getHeight()) {
+		pixbuf = Gdk::Pixbuf::create_from_data(pixels, Gdk::Colorspace::COLORSPACE_RGB, true, 8,
+			buffer.getWidth(), buffer.getHeight(), buffer.getStride() * sizeof(Color));
+	}
+	return pixbuf;
 }
 
 /**
- * Renders the axes and the grid ground.
+ * The drawing function, called by the GUI.
  */
-void g3::World::renderAxesAndGrid(const g3::Mat4& viewProjMat)
-{
-  Mat4 staticMatrix = createScaleMatrix(1) * viewProjMat;
-
-  // render axes
-  Vec3 origo {0, 0, 0};
-  origo = transformP3( origo, staticMatrix );
-
-  int origoX = mapXToWin( origo[0] );
-  int origoY = mapYToWin( origo[1] );
-
-  Vec3 axes[] { {1, 0, 0}, {0, 1, 0}, {0, 0, 1} };
-  unsigned long axesColor[] {
-    createRGBA(255, 0, 0, 255),
-    createRGBA(0, 255, 0, 255),
-    createRGBA(0, 0, 255, 255)
-  };
-
-  for (int k = 0; k < 3; k++) {
-    Vec3 axisEnd = transformP3( axes[k], staticMatrix );
-    int endX = mapXToWin( axisEnd[0] );
-    int endY = mapYToWin( axisEnd[1] );
-    drawLine(origoX, origoY, origo[2], endX, endY, axisEnd[2], axesColor[k]);
-  }
-
-
-  // render grid ground
-  float step = 1;
-  int size = 8; // size X size
-  Vec3 grid [ 4*(size+1) ];
+bool g3::World::on_draw(const Cairo::RefPtr<Cairo::Context>& cr) {
+	G3_PROFILE_ZONE("present");
 
-  Vec3 startX {  size/2.0f*step, 0, size/2.0f*step  };
-  for (int n = 0, m = 0; n < (size+1); n++, m+=4) {
-    grid[m]   = { startX[0],               0, startX[2] - (n*step) };	
-    grid[m+1] = { startX[0] - (size*step), 0, startX[2] - (n*step) };	
-    grid[m+2] = { startX[0] - (n*step),    0, startX[2] };	
-    grid[m+3] = { startX[0] - (n*step),    0, startX[2] - (size*step) };	
-  }
+	// Take the newest completed frame, if any, and draw it
+	swapChain.acquire();
+	Gdk::Cairo::set_source_pixbuf(cr, getPixbuf(swapChain.getFrontBuffer(), swapChain.getFrontIndex()));
+	cr->paint();
 
-	unsigned long gridColor = createRGBA(205, 201, 201, 255);
-	for (int n = 0; n < 4*(size+1); n+=2) {
-		Vec3 g1 = transformP3( grid[n], staticMatrix );
-		int g1X = mapXToWin( g1[0] );
-		int g1Y = mapYToWin( g1[1] );
-		Vec3 g2 = transformP3( grid[n+1], staticMatrix );
-		int g2X = mapXToWin( g2[0] );
-		int g2Y = mapYToWin( g2[1] );
-		drawLine(g1X, g1Y, g1[2], g2X, g2Y, g2[2], gridColor);
+	if (showStats) {
+		drawStatsOverlay(cr);
 	}
 
+	return true;
 }
 
 /**
- * Maps the x coordinate to the window coordinate system
- */
-inline int g3::World::mapXToWin(float x)
-{
-	return ( x * camera.zoomFactor / (width/(float)height)  ) + (width / 2.0f);
-}
-
-/**
- * Maps the y coordinate to the window coordinate system
+ * Draws the frame rate and the counters of the presented frame.
  */
-inline int g3::World::mapYToWin(float y)
+void g3::World::drawStatsOverlay(const Cairo::RefPtr<Cairo::Context>& cr)
 {
-	return ( -y * camera.zoomFactor ) + (height / 2.0f);
+	const FrameStats& stats = frameStats[swapChain.getFrontIndex()];
+
+	std::ostringstream timing;
+	timing.precision(3);
+	timing << "fps " << scheduler.getFps()
+		<< " | render " << stats.renderTime / 1e6 << " ms"
+		<< " | p99 frame " << scheduler.getFrameTimes().percentile(0.99f) / 1e6 << " ms";
+	if (scheduler.hasDynamicResolution()) {
+		timing << " | scale " << scheduler.getResolutionScale();
+	}
+	std::ostringstream counters;
+	counters.precision(3);
+	counters << stats;
+
+	cr->set_source_rgb(0, 0, 0);
+	cr->set_font_size(12);
+	cr->move_to(8, 16);
+	cr->show_text(timing.str());
+	cr->move_to(8, 32);
+	cr->show_text(counters.str());
 }
 
-
 /**
- * Creates an RGBA color as a long.
+ * Presents a completed frame. Called on the GUI thread by frameReady.
  */
-inline unsigned long g3::createRGBA(int r, int g, int b, int a)
+void g3::World::on_frame_ready()
 {
-	return ((r & 0xff) << 24) 
-		+ ((g & 0xff) << 16) 
-		+ ((b & 0xff) << 8) 
-		+ (a & 0xff);
+	scheduler.framePresented(clock_time(), lastRenderTime.load(std::memory_order_relaxed));
+	queue_draw();
 }
 
-
 /**
- * Draws a line.
+ * Hands a copy of the current scene state to the render thread.
  */
-void g3::World::drawLine(int x0, int y0, float z0, int x1, int y1, float z1, unsigned long color)
+void g3::World::requestFrame()
 {
-  // The line visible?
-  if ( (std::min(std::abs(x0), std::abs(x1)) > width) &&
-     (std::min(std::abs(y0), std::abs(y1)) > height) )
-  {
-    /*
-    std::cout
-    << x0 << ',' << y0 << '|'
-    << x1 << ',' << y1 << '|'
-    << width << '|'
-    << height << '|'
-    << (std::min(std::abs(x0), std::abs(x1)) > width/2) << '|'
-          << (std::min(std::abs(y0), std::abs(y1)) > height/2)
-    << std::endl;
-    */
-
-
-    return;
-  }
-
-  int dx = std::abs(x1 - x0);
-  int dy = std::abs(y1 - y0);
-  float dz = std::abs(z1 - z0);
-  int sx = (x0 < x1) ? 1 : -1;
-  int sy = (y0 < y1) ? 1 : -1;
-
-  int err = dx - dy;
-  float gradient = 0;
-
-  int x = x0;
-  int y = y0;
-  int z = z0;
-
-  while (true) {
-    drawPoint(x, y, z, color);
-
-    if ((x == x1) && (y == y1)) break;
-    int e2 = 2 * err;
-    if (e2 > -dy) { err -= dy; x += sx; }
-    if (e2 < dx) { err += dx; y += sy; }
-
-    // interpolate z depth values
-    gradient = (dx > dy) ?  ((x-x0) / dx) : ((y-y0) / dy);
-    z = z0 + (dz * gradient);
-  }
-
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		// interpolate between the last two simulation steps
+		float alpha = scheduler.getInterpolation();
+		cube.rotationX = cube.rotationY = previousCubeAngle + alpha * (cubeAngle - previousCubeAngle);
+
+		instances[0].worldMatrix = g3::getWorldMatrix(cube);
+
+		pendingState.camera = camera;
+		pendingState.instances = instances;
+		pendingState.detailLevel = scheduler.getDetailLevel();
+		pendingState.shading = shading;
+		pendingState.visibilityBuffer = visibilityBuffer;
+		pendingState.shadows = shadows;
+		pendingState.msaa = msaa;
+		pendingState.dirtyRegions = dirtyRegions;
+		pendingState.resolutionScale = scheduler.hasDynamicResolution() ? scheduler.getResolutionScale() : resolutionScale;
+		pendingWidth = width;
+		pendingHeight = height;
+		framePending = true;
+	}
+	frameRequested.notify_one();
 }
 
 /**
- * Draws a point on the screen.
+ * The body of the render thread.
  */
-void g3::World::drawPoint(int x, int y, float z, unsigned long color)
+void g3::World::renderLoop()
 {
-  if ((x >= 0) && (y >=0) && (x < width) && (y < height)) {
-    // depth test
-    int targetPixel = y * width + x;
-    if ( z < depthBuffer[targetPixel] ) {
-      // saves the new depth value
-      depthBuffer[targetPixel] = z;
-
-      // sets the color of the pixel
-      int offset  = y * frontBuffer->get_rowstride() + x * frontBuffer->get_n_channels();
-      guchar* pixel = &frontBuffer->get_pixels()[ offset ];
-
-      pixel[0] = (color >> 24) & 0xff; // red
-      pixel[1] = (color >> 16) & 0xff; // blue
-      pixel[2] = (color >>  8) & 0xff; // grenn
-
-      // alpha ignored
-      // pixel[3] =  color & 0xff;         // alpha
-    }
-  }
+	FrameState state;
+	unsigned int frameWidth, frameHeight;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(stateMutex);
+			frameRequested.wait(lock, [this] { return framePending || !running; });
+			if (!running) {
+				break;
+			}
+			state = pendingState;
+			frameWidth = pendingWidth;
+			frameHeight = pendingHeight;
+			framePending = false;
+		}
+
+		// the memory of the buffer is kept while the window does not outgrow
+		// it, the GUI wraps it again when it is presented
+		FrameBuffer& target = swapChain.getBackBuffer();
+		target.resize(frameWidth, frameHeight);
+
+		unsigned long start = clock_time();
+		renderer.render(target, state);
+		unsigned long renderTime = clock_time() - start;
+
+		// the counters travel with the buffer, present() publishes both
+		FrameStats& stats = frameStats[swapChain.getBackIndex()];
+		stats = renderer.getStats();
+		stats.renderTime = renderTime;
+
+		swapChain.present();
+		lastRenderTime.store(renderTime, std::memory_order_relaxed);
+
+		// wake up the GUI thread to present the frame
+		frameReady.emit();
+	}
 }
 
 /**
@@ -291,40 +306,31 @@ unsigned long g3::World::clock_time()
 }
 
 /**
- * This idle callback function is executed as often as possible, 
- * hence it is ideal for processing intensive tasks.
+ * The timer callback that paces the frames. Runs the due simulation steps
+ * and requests a new frame.
  */
-bool g3::World::on_idle()
+bool g3::World::on_tick()
 {
-  // finish current frame
-  finishFrameTime = clock_time();
-
-  // The amount of time that the frame spent in nanoseconds.
-  unsigned long timeSpentInFrame = finishFrameTime - startFrameTime;
-
-  if (timeSpentInFrame <= targetFrameTime)
-  {
-    // sleep
-    std::chrono::duration<float, std::nano> wait { targetFrameTime - timeSpentInFrame };
-    std::this_thread::sleep_for( wait );
-
-    // redraw only if we were too fast in the prevoius frame.
-    queue_draw();
-  } else {
-    // Here we were too slow so we will skip the next redrawing.
-    std::cout << "Frame dropping: " << timeSpentInFrame << std::endl;
+  unsigned int steps = scheduler.tick(clock_time());
+  for (unsigned int i = 0; i < steps; i++) {
+    simulate();
   }
 
-  // start new frame
-  startFrameTime = clock_time();
+  // If the previous frame is still being rendered, the request replaces the
+  // pending one, so slow frames reduce the frame rate instead of queueing up.
+  requestFrame();
 
-  // Elapsed time calculation between two frames goes here
-  // ...
+  return true;
+}
 
-  // Rotates the cube around the y axis in radians.
-  cube.rotationX += 0.01;
-  cube.rotationY += 0.01;
-  //cube.rotationZ += 0.001;
+/**
+ * Advances the simulation by one fixed step.
+ */
+void g3::World::simulate()
+{
+  // The angular velocity of the cube in radians per second.
+  const float cubeSpeed = 0.3f;
 
-  return true;
+  previousCubeAngle = cubeAngle;
+  cubeAngle += cubeSpeed * (scheduler.getSimulationStep() / 1e9f);
 }
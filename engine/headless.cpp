@@ -0,0 +1,597 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <time.h>
+#include <vector>
+#include "BatchRenderer.h"
+#include "FrameBuffer.h"
+#include "FrameScheduler.h"
+#include "FrameSink.h"
+#include "Kernels.h"
+#include "Lod.h"
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "PerfCounters.h"
+#include "Picking.h"
+#include "Profiler.h"
+#include "Renderer.h"
+#include "Stats.h"
+#include "Texture.h"
+
+namespace
+{
+
+/**
+ * Returns a time point in nanoseconds.
+ */
+unsigned long clock_time()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/**
+ * Scrambles the faces and the vertices of a mesh, like a mesh from a source
+ * that stores them in no useful order.
+ */
+void shuffleMesh(g3::TriangleMesh& mesh)
+{
+  std::mt19937 random(1);
+  std::shuffle(mesh.faces.get(), mesh.faces.get() + mesh.nFaces, random);
+
+  std::vector<unsigned int> remap(mesh.nVertices);
+  for (unsigned int i = 0; i < mesh.nVertices; i++) {
+    remap[i] = i;
+  }
+  std::shuffle(remap.begin(), remap.end(), random);
+
+  std::unique_ptr<g3::Vertex[]> vertices(new g3::Vertex[mesh.nVertices]);
+  for (unsigned int i = 0; i < mesh.nVertices; i++) {
+    vertices[remap[i]] = mesh.vertices[i];
+  }
+  mesh.vertices = std::move(vertices);
+  for (unsigned int f = 0; f < mesh.nFaces; f++) {
+    for (unsigned int& index : mesh.faces[f].vertexIndex) {
+      index = remap[index];
+    }
+  }
+}
+
+}
+
+/**
+ * Renders the scene without a window, as fast as possible, and reports the
+ * counters of every frame. This is the benchmark scene of the engine.
+ *
+ * --instances N places N cubes on a square field around the cube of the
+ * window, most of them outside the view, to measure culling.
+ *
+ * --terrain N replaces the cubes by terrains of about N triangles with
+ * levels of detail, --zoom Z sets the zoom factor of the camera (1280).
+ * The terrain is reordered for the vertex cache at load like any mesh;
+ * --shuffle scrambles it first and --no-optimize leaves it as it is, to
+ * compare the orders.
+ *
+ * --shading MODE draws wireframes (the default) or lit faces, flat or
+ * gouraud; --lights N adds N point lights around the scene;
+ * --visibility-buffer shades them in a pass after the rasterization;
+ * --shadows casts the shadows of the first directional light through a
+ * shadow map of --shadow-map SIZE texels a side (1024). --depth-only
+ * renders only the depth of the faces, the pass the shadow map takes.
+ * --msaa antialiases the edges with 4 samples per pixel, and reports the
+ * memory of the samples against that of the frame buffer.
+ * --dirty-regions redraws only the regions of the frame that changed, and
+ * reports their share of the pixels; --moving N animates only the first N
+ * cubes, so that the others stay still. --scale S renders at S times the
+ * resolution, 0.1 at least, and scales the frames up to the size; the share
+ * of the redrawn pixels is then one of the smaller frames. --target-time MS
+ * lets the frame scheduler choose the resolution and the detail level of
+ * every frame from the render times of the last ones, aiming for MS per
+ * frame, and reports the average and the last scale.
+ *
+ * --texture SIZE maps a checkerboard texture of SIZE x SIZE texels onto the
+ * filled faces, stored in Morton order or, with --texture-layout linear,
+ * row by row, to compare the cache behavior of the layouts on the rotating
+ * cubes; --filter nearest|bilinear sets the sampling (bilinear).
+ *
+ * --perf reads the hardware counters around the rendering of every frame,
+ * for the cache misses.
+ *
+ * --output PATH writes the frames out in --output-format raw (the default),
+ * ppm, png or y4m on a background thread, see FrameSink; "-" writes raw and
+ * y4m to the standard output, and the sequences take a pattern such as
+ * frame%05d.png. Frames the output cannot keep up with are dropped, unless
+ * --output-wait makes the rendering wait for it. The wall clock frame rate
+ * and the dropped frames are reported.
+ *
+ * --cameras N renders the last state afterwards from N cameras on a circle
+ * around the target, the frames of different cameras at once on a thread
+ * each, see BatchRenderer, with --batch-threads T threads (one per hardware
+ * thread), and again on one thread for the speedup.
+ *
+ * --scaling N renders the last state afterwards with the clear, the vertices
+ * and the rasterization of large meshes spread over 1, 2, 4 ... and N
+ * threads, see ThreadPool, and reports the speedup and the efficiency of
+ * every count against one thread; --pin binds the workers to processors.
+ *
+ * --pick N measures picking afterwards: rays through a grid of window
+ * positions are cast at a terrain of about N triangles.
+ *
+ * Usage: headless [--frames N] [--size WxH] [--instances N] [--terrain N]
+ *                 [--zoom Z] [--shuffle] [--no-optimize]
+ *                 [--shading MODE] [--lights N] [--visibility-buffer] [--shadows]
+ *                 [--shadow-map SIZE] [--depth-only] [--msaa] [--dirty-regions] [--moving N] [--scale S] [--target-time MS] [--texture SIZE] [--texture-layout linear|morton] [--filter nearest|bilinear] [--output PATH] [--output-format FORMAT] [--output-wait] [--cameras N] [--batch-threads T] [--scaling N] [--pin] [--perf] [--pick N] [--csv FILE|-] [--trace FILE]
+ */
+int main (int argc, char** argv)
+{
+  unsigned long frames = 300;
+  unsigned int width = 900;
+  unsigned int height = 600;
+  unsigned int instanceCount = 1;
+  unsigned long pickTriangles = 0;
+  unsigned long terrainTriangles = 0;
+  float zoomFactor = 1280;
+  bool shuffle = false;
+  bool optimize = true;
+  bool perf = false;
+  g3::ShadingMode shading = g3::ShadingMode::WIREFRAME;
+  unsigned int pointLights = 0;
+  bool visibilityBuffer = false;
+  bool shadows = false;
+  unsigned int shadowMapSize = 1024;
+  bool depthOnly = false;
+  bool msaa = false;
+  bool dirtyRegions = false;
+  unsigned int movingCount = std::numeric_limits<unsigned int>::max();
+  float resolutionScale = 1;
+  float targetTime = 0;
+  unsigned int textureSize = 0;
+  g3::TextureLayout textureLayout = g3::TextureLayout::MORTON;
+  g3::TextureFilter textureFilter = g3::TextureFilter::BILINEAR;
+  const char* csvPath = nullptr;
+  const char* tracePath = nullptr;
+  const char* outputPath = nullptr;
+  g3::FrameFormat outputFormat = g3::FrameFormat::RAW;
+  bool outputWait = false;
+  unsigned long cameraCount = 0;
+  unsigned int batchThreads = 0;
+  unsigned int scalingThreads = 0;
+  bool pin = false;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--frames") && hasValue) {
+      frames = std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--size") && hasValue) {
+      if (std::sscanf(argv[++i], "%ux%u", &width, &height) != 2 || !width || !height) {
+        std::cerr << "invalid size: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (!std::strcmp(argv[i], "--instances") && hasValue) {
+      instanceCount = std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--terrain") && hasValue) {
+      terrainTriangles = std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--zoom") && hasValue) {
+      zoomFactor = std::strtof(argv[++i], nullptr);
+    } else if (!std::strcmp(argv[i], "--shuffle")) {
+      shuffle = true;
+    } else if (!std::strcmp(argv[i], "--no-optimize")) {
+      optimize = false;
+    } else if (!std::strcmp(argv[i], "--shading") && hasValue) {
+      if (!g3::parseShadingMode(argv[++i], shading)) {
+        std::cerr << "unknown shading mode: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (!std::strcmp(argv[i], "--lights") && hasValue) {
+      pointLights = std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--visibility-buffer")) {
+      visibilityBuffer = true;
+    } else if (!std::strcmp(argv[i], "--shadows")) {
+      shadows = true;
+    } else if (!std::strcmp(argv[i], "--shadow-map") && hasValue) {
+      shadowMapSize = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+    } else if (!std::strcmp(argv[i], "--depth-only")) {
+      depthOnly = true;
+    } else if (!std::strcmp(argv[i], "--msaa")) {
+      msaa = true;
+    } else if (!std::strcmp(argv[i], "--dirty-regions")) {
+      dirtyRegions = true;
+    } else if (!std::strcmp(argv[i], "--moving") && hasValue) {
+      movingCount = std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--scale") && hasValue) {
+      resolutionScale = std::min(1.0f, std::max(g3::FrameState::MIN_USER_RESOLUTION_SCALE, std::strtof(argv[++i], nullptr)));
+    } else if (!std::strcmp(argv[i], "--target-time") && hasValue) {
+      targetTime = std::max(0.0f, std::strtof(argv[++i], nullptr));
+    } else if (!std::strcmp(argv[i], "--texture") && hasValue) {
+      textureSize = std::strtoul(argv[++i], nullptr, 10);
+      if (!textureSize || (textureSize & (textureSize - 1))) {
+        std::cerr << "texture size is not a power of two: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (!std::strcmp(argv[i], "--texture-layout") && hasValue) {
+      if (!std::strcmp(argv[++i], "linear")) {
+        textureLayout = g3::TextureLayout::LINEAR;
+      } else if (!std::strcmp(argv[i], "morton")) {
+        textureLayout = g3::TextureLayout::MORTON;
+      } else {
+        std::cerr << "unknown texture layout: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (!std::strcmp(argv[i], "--filter") && hasValue) {
+      if (!std::strcmp(argv[++i], "nearest")) {
+        textureFilter = g3::TextureFilter::NEAREST;
+      } else if (!std::strcmp(argv[i], "bilinear")) {
+        textureFilter = g3::TextureFilter::BILINEAR;
+      } else {
+        std::cerr << "unknown texture filter: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (!std::strcmp(argv[i], "--output") && hasValue) {
+      outputPath = argv[++i];
+    } else if (!std::strcmp(argv[i], "--output-format") && hasValue) {
+      if (!g3::parseFrameFormat(argv[++i], outputFormat)) {
+        std::cerr << "unknown output format: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (!std::strcmp(argv[i], "--output-wait")) {
+      outputWait = true;
+    } else if (!std::strcmp(argv[i], "--cameras") && hasValue) {
+      cameraCount = std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--batch-threads") && hasValue) {
+      batchThreads = std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--scaling") && hasValue) {
+      scalingThreads = std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--pin")) {
+      pin = true;
+    } else if (!std::strcmp(argv[i], "--perf")) {
+      perf = true;
+    } else if (!std::strcmp(argv[i], "--pick") && hasValue) {
+      pickTriangles = std::strtoul(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--csv") && hasValue) {
+      csvPath = argv[++i];
+    } else if (!std::strcmp(argv[i], "--trace") && hasValue) {
+      tracePath = argv[++i];
+    } else {
+      std::cerr << "usage: " << argv[0]
+        << " [--frames N] [--size WxH] [--instances N] [--terrain N] [--zoom Z]"
+        << " [--shuffle] [--no-optimize] [--shading MODE] [--lights N] [--visibility-buffer]"
+        << " [--shadows] [--shadow-map SIZE] [--depth-only] [--msaa] [--dirty-regions] [--moving N] [--scale S]"
+        << " [--target-time MS]"
+        << " [--texture SIZE]"
+        << " [--texture-layout linear|morton] [--filter nearest|bilinear]"
+        << " [--output PATH] [--output-format FORMAT] [--output-wait] [--cameras N] [--batch-threads T]"
+        << " [--scaling N] [--pin]"
+        << " [--perf] [--pick N]"
+        << " [--csv FILE|-] [--trace FILE]"
+        << std::endl;
+      return 1;
+    }
+  }
+
+  g3::TriangleMesh cube;
+  g3::loadCube(cube);
+
+  g3::TriangleMesh terrain;
+  g3::LodChain terrainLods;
+  if (terrainTriangles > 0) {
+    g3::loadTerrain(terrain, std::max(1.0, std::sqrt(terrainTriangles / 2.0)));
+    if (shuffle) {
+      shuffleMesh(terrain);
+    }
+    float sourceAcmr = g3::computeAcmr(terrain);
+    unsigned long start = clock_time();
+    if (optimize) {
+      g3::optimizeMesh(terrain);
+    }
+    unsigned long optimizeTime = clock_time() - start;
+    std::cout << "terrain acmr " << sourceAcmr << " -> " << g3::computeAcmr(terrain)
+      << " | optimized in " << optimizeTime / 1e6 << " ms" << std::endl;
+
+    start = clock_time();
+    g3::buildLodChain(terrain, terrainLods);
+    std::cout << "terrain " << terrain.nFaces << " triangles | lods";
+    for (const g3::TriangleMesh& level : terrainLods.levels) {
+      std::cout << " " << level.nFaces;
+    }
+    std::cout << " | built in " << (clock_time() - start) / 1e6 << " ms" << std::endl;
+  }
+
+  std::unique_ptr<g3::Texture> texture;
+  if (textureSize > 0) {
+    unsigned long start = clock_time();
+    texture.reset(new g3::Texture(g3::createCheckerboardTexture(textureSize, 8, textureLayout)));
+    std::cout << "texture " << textureSize << "x" << textureSize
+      << (textureLayout == g3::TextureLayout::MORTON ? " morton" : " linear")
+      << " | " << texture->getLevelCount() << " levels"
+      << " | built in " << (clock_time() - start) / 1e6 << " ms" << std::endl;
+  }
+
+  g3::FrameBuffer frameBuffer(width, height);
+  g3::Renderer renderer;
+  renderer.setCountCoverage(true);
+
+  g3::FrameState state;
+  state.camera = { g3::Vec3{17, 10, -20}, g3::Vec3{1, 0, 2}, zoomFactor };
+  state.shading = shading;
+  state.textureFilter = textureFilter;
+  state.visibilityBuffer = visibilityBuffer;
+  state.shadows = shadows;
+  state.shadowMapSize = shadowMapSize;
+  state.msaa = msaa;
+  state.dirtyRegions = dirtyRegions;
+  state.resolutionScale = resolutionScale;
+
+  // colored point lights on a circle above the scene
+  for (unsigned int i = 0; i < pointLights; i++) {
+    float angle = i * 6.2832f / pointLights;
+    g3::Vec3 color { 0.5f + 0.5f * std::cos(angle), 0.5f + 0.5f * std::cos(angle + 2.1f),
+                     0.5f + 0.5f * std::cos(angle + 4.2f) };
+    state.lighting.pointLights.push_back({ g3::Vec3{6 * std::cos(angle), 3, 6 * std::sin(angle)}, color, 12 });
+  }
+
+  // the cubes stand 4 units apart on a square field centered on the cube of
+  // the window
+  std::vector<g3::Vec3> locations;
+  unsigned int side = std::ceil(std::sqrt((float)instanceCount));
+  for (unsigned int i = 0; i < instanceCount; i++) {
+    float x = (i % side) * 4.0f - (side / 2) * 4.0f;
+    float z = (i / side) * 4.0f - (side / 2) * 4.0f;
+    locations.push_back(cube.loc + g3::Vec3{x, 0, z});
+    state.instances.push_back({ &cube, g3::Mat4{} });
+    state.instances.back().texture = texture.get();
+    if (terrainTriangles > 0) {
+      state.instances.back().mesh = &terrain;
+      state.instances.back().lods = &terrainLods;
+    }
+  }
+
+  std::ofstream csvFile;
+  std::ostream* csv = nullptr;
+  if (csvPath) {
+    if (std::strcmp(csvPath, "-") != 0) {
+      csvFile.open(csvPath);
+      csv = &csvFile;
+    } else {
+      csv = &std::cout;
+    }
+    g3::writeCsvHeader(*csv);
+  }
+
+  std::unique_ptr<g3::FrameSink> sink;
+  if (outputPath) {
+    try {
+      sink.reset(new g3::FrameSink(outputFormat, outputPath, width, height, 30, outputWait));
+    } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // The summary goes to stderr when the rows or the frames go to stdout.
+  bool toStdout = (csv == &std::cout) || (outputPath && !std::strcmp(outputPath, "-"));
+  std::ostream& report = toStdout ? std::cerr : std::cout;
+
+  // the scheduler only adapts the frames, the simulation is not stepped
+  unsigned long targetFrameTime = std::max(1.0f, targetTime * 1e6f);
+  g3::FrameScheduler scheduler(targetFrameTime, targetFrameTime);
+  scheduler.setDynamicResolution(targetTime > 0);
+  float scaleSum = 0;
+  // the pixels of the frames as rendered, below the target's when scaled
+  double renderedPixels = 0;
+
+  g3::PerfCounters counters;
+  g3::FrameStats total {};
+  unsigned long loopStart = clock_time();
+  for (unsigned long frame = 0; frame < frames; frame++) {
+    g3::FrameBuffer& target = sink ? sink->getBackBuffer() : frameBuffer;
+    // the same animation as the window: 0.3 rad/s at 30 frames per second
+    cube.rotationX = cube.rotationY = frame * 0.01f;
+    // the still cubes keep the matrices of the first frame
+    unsigned int moving = (frame == 0) ? instanceCount : std::min(instanceCount, movingCount);
+    for (unsigned int i = 0; i < moving; i++) {
+      cube.loc = locations[i];
+      state.instances[i].worldMatrix = g3::getWorldMatrix(cube);
+    }
+
+    if (scheduler.hasDynamicResolution()) {
+      state.resolutionScale = scheduler.getResolutionScale();
+      state.detailLevel = scheduler.getDetailLevel();
+      scaleSum += state.resolutionScale;
+    }
+
+    unsigned long start = clock_time();
+    if (perf) counters.start();
+    if (depthOnly) {
+      renderer.renderDepth(target, state);
+    } else {
+      renderer.render(target, state);
+    }
+    if (perf) counters.stop();
+
+    g3::FrameStats stats = renderer.getStats();
+    stats.renderTime = clock_time() - start;
+    const g3::FrameBuffer* rendered = (state.resolutionScale < 1 && !depthOnly) ? renderer.getScaledTarget() : &target;
+    renderedPixels += (double)rendered->getWidth() * rendered->getHeight();
+    total += stats;
+    if (scheduler.hasDynamicResolution()) {
+      scheduler.framePresented(clock_time(), stats.renderTime);
+    }
+    if (sink) {
+      sink->present();
+    }
+
+    if (csv) {
+      g3::writeCsvRow(*csv, frame, stats);
+    }
+  }
+
+  // the frames still queued for the output are written after the loop
+  unsigned long loopTime = clock_time() - loopStart;
+  unsigned long flushStart = clock_time();
+  if (sink) {
+    sink->flush();
+  }
+  unsigned long flushTime = clock_time() - flushStart;
+
+  if (frames > 0) {
+    report.precision(4);
+    report << frames << " frames " << width << "x" << height
+      << " | avg render " << total.renderTime / 1e6 / frames << " ms"
+      << " | " << frames * 1e9 / total.renderTime << " fps"
+      << " | " << g3::getShadingModeName(shading) << (visibilityBuffer ? " (visibility buffer)" : "")
+      << (shadows ? " | shadows " + std::to_string(shadowMapSize) : "")
+      << (depthOnly ? " | depth only" : "")
+      << (msaa ? " | msaa 4x" : "")
+      << (dirtyRegions ? " | dirty regions" : "")
+      << (scheduler.hasDynamicResolution() ? " | target " + std::to_string(targetTime).substr(0, 4)
+          + " ms, scale avg " + std::to_string(scaleSum / frames).substr(0, 4) + " last "
+          + std::to_string(state.resolutionScale).substr(0, 4) + " detail " + std::to_string(state.detailLevel)
+          : renderer.getScaledTarget() ? " | scale " + std::to_string(resolutionScale).substr(0, 4) + " ("
+          + std::to_string(renderer.getScaledTarget()->getWidth()) + "x"
+          + std::to_string(renderer.getScaledTarget()->getHeight()) + ")" : "")
+      << " | kernels " << g3::getIsaName(g3::kernels().isa) << std::endl;
+    report << "total: " << total << std::endl;
+    if (msaa) {
+      // the color and the depth of a pixel take 8 bytes
+      double frameBytes = 8.0 * frameBuffer.getStride() * height;
+      report << "msaa per frame: " << total.expandedTiles / frames << " tiles expanded"
+        << " | samples " << total.sampleBytes / frames / 1024 << " KiB, "
+        << 100 * total.sampleBytes / frames / frameBytes << "% of the frame buffer"
+        << " (" << 100.0 * (g3::SampleBuffer::SAMPLES - 1) << "% uncompressed)"
+        << " | resolve " << total.resolveTime / 1e6 / frames << " ms" << std::endl;
+    }
+    if (dirtyRegions) {
+      report << "dirty regions per frame: " << total.redrawnPixels / frames << " pixels redrawn, "
+        << 100.0 * total.redrawnPixels / renderedPixels << "% of the frame" << std::endl;
+    }
+    if (sink) {
+      report << "output " << g3::getFrameFormatName(outputFormat) << ": " << sink->getWrittenCount() << " written, "
+        << sink->getDroppedCount() << " dropped, " << sink->getFailedCount() << " failed"
+        << " | " << frames * 1e9 / loopTime << " fps wall clock | flushed in " << flushTime / 1e6 << " ms"
+        << std::endl;
+    }
+  }
+
+  if (perf && frames > 0) {
+    report << "perf per frame:";
+    bool any = false;
+    for (int i = 0; i < g3::PerfCounters::COUNTER_COUNT; i++) {
+      g3::PerfCounters::Counter counter = g3::PerfCounters::Counter(i);
+      if (counters.isAvailable(counter)) {
+        report << " | " << g3::PerfCounters::getName(counter) << " " << counters.get(counter) / frames;
+        any = true;
+      }
+    }
+    report << (any ? "" : " counters unavailable") << std::endl;
+  }
+
+  if (cameraCount > 0) {
+    std::vector<g3::Camera> cameras;
+    g3::Vec3 offset = state.camera.eye - state.camera.target;
+    float radius = std::sqrt(offset[0] * offset[0] + offset[2] * offset[2]);
+    for (unsigned long i = 0; i < cameraCount; i++) {
+      float angle = 2 * 3.14159265f * i / cameraCount;
+      g3::Vec3 eye = state.camera.target + g3::Vec3{radius * std::cos(angle), offset[1], radius * std::sin(angle)};
+      cameras.push_back({ eye, state.camera.target, state.camera.zoomFactor });
+    }
+
+    // the same batch on the threads and on one thread, after a batch that
+    // warms the caches up
+    g3::ThreadPool batchPool(batchThreads);
+    g3::ThreadPool serialPool(1);
+    double times[2];
+    for (int serial = 0; serial < 2; serial++) {
+      g3::BatchRenderer batch(serial ? serialPool : batchPool);
+      auto ignore = [](std::size_t, const g3::FrameBuffer&, const g3::FrameStats&) {};
+      batch.render(state, cameras, width, height, ignore);
+      unsigned long start = clock_time();
+      batch.render(state, cameras, width, height, ignore);
+      times[serial] = (clock_time() - start) / 1e6;
+      if (!serial) {
+        report << "batch " << cameraCount << " cameras " << width << "x" << height << " on "
+          << batch.getWorkerCount() << " threads: " << times[0] << " ms, " << cameraCount * 1e3 / times[0]
+          << " frames/s | pixels " << batch.getStats().pixelsWritten;
+      }
+    }
+    report << " | one thread " << cameraCount * 1e3 / times[1] << " frames/s, speedup " << times[1] / times[0]
+      << std::endl;
+  }
+
+  if (scalingThreads > 0) {
+    // the same frames on ever more threads, after a few that warm the
+    // caches up
+    unsigned long scalingFrames = std::min(frames, 100ul);
+    g3::FrameBuffer target(width, height);
+    double serialTime = 0;
+    for (unsigned int threads = 1; threads <= scalingThreads; threads = std::min(threads * 2, scalingThreads)) {
+      g3::ThreadPool pool(threads, pin);
+      g3::Renderer scalingRenderer;
+      scalingRenderer.setThreadPool(pool);
+      for (int i = 0; i < 5; i++) {
+        scalingRenderer.render(target, state);
+      }
+      unsigned long start = clock_time();
+      for (unsigned long i = 0; i < scalingFrames; i++) {
+        scalingRenderer.render(target, state);
+      }
+      double time = (clock_time() - start) / 1e6 / std::max(scalingFrames, 1ul);
+      if (threads == 1) {
+        serialTime = time;
+      }
+      report << "scaling " << width << "x" << height << " on " << threads << (threads > 1 ? " threads" : " thread")
+        << (pin ? " pinned" : "") << ": " << time << " ms per frame | speedup " << serialTime / time
+        << " | efficiency " << 100 * serialTime / time / threads << "%" << std::endl;
+      if (threads == scalingThreads) {
+        break;
+      }
+    }
+  }
+
+  if (pickTriangles > 0) {
+    g3::TriangleMesh terrain;
+    g3::loadTerrain(terrain, std::max(1.0, std::sqrt(pickTriangles / 2.0)));
+    std::vector<g3::MeshInstance> instances { { &terrain, g3::Mat4{} } };
+    g3::loadIdentity(instances[0].worldMatrix);
+    g3::SceneBvh scene;
+    scene.update(instances);
+    g3::Picker picker;
+
+    unsigned long start = clock_time();
+    picker.getTriangleBvh(terrain);
+    unsigned long buildTime = clock_time() - start;
+
+    const unsigned int GRID = 32;
+    unsigned int hits = 0;
+    start = clock_time();
+    for (unsigned int y = 0; y < GRID; y++) {
+      for (unsigned int x = 0; x < GRID; x++) {
+        g3::Ray ray = g3::createPickingRay(state.camera, width, height,
+          (x + 0.5f) * width / GRID, (y + 0.5f) * height / GRID);
+        hits += picker.pick(instances, scene, ray).instance >= 0;
+      }
+    }
+    unsigned long pickTime = clock_time() - start;
+
+    report << "picking " << terrain.nFaces << " triangles"
+      << " | build " << buildTime / 1e6 << " ms"
+      << " | avg pick " << pickTime / 1e3 / (GRID * GRID) << " us"
+      << " | " << hits << "/" << GRID * GRID << " rays hit" << std::endl;
+  }
+
+  if (tracePath) {
+    std::ofstream trace(tracePath);
+    g3::Profiler::get().writeChromeTrace(trace);
+  }
+
+  return 0;
+}
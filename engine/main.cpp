@@ -1,7 +1,10 @@
 
 #include <iostream>
+#include <fstream>
+#include <cstdlib>
 #include <gtkmm/window.h>
 #include "World.h"
+#include "Profiler.h"
 
 
 int main (int argc, char** argv)
@@ -21,5 +24,13 @@ int main (int argc, char** argv)
   window.add(world);
   world.show();
 
-  return app->run(window);
+  int status = app->run(window);
+
+  // G3_TRACE=file.json writes the profile zones as a Chrome trace
+  if (const char* tracePath = std::getenv("G3_TRACE")) {
+    std::ofstream trace(tracePath);
+    g3::Profiler::get().writeChromeTrace(trace);
+  }
+
+  return status;
 }
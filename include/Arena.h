@@ -0,0 +1,167 @@
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "FrameBuffer.h"
+
+namespace g3
+{
+
+/**
+ * A linear allocator for the short-lived arrays of a frame.
+ *
+ * Allocating bumps an offset into a block of memory, and everything is
+ * released at once by reset or rewind; nothing is freed one by one. When a
+ * frame needs more than the arena holds another block is added, and reset
+ * merges the blocks into one of their total size, so after a frame or two
+ * the frames of a steady scene do not touch the heap at all.
+ *
+ * Only types that need no destructor can be placed in an arena.
+ */
+class FrameArena
+{
+  public:
+
+  /**
+   * The size of the first block in bytes.
+   */
+  static constexpr std::size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+  /**
+   * A position in the arena to rewind to.
+   */
+  struct Marker
+  {
+    std::size_t block;
+    std::size_t offset;
+  };
+
+  FrameArena();
+
+  FrameArena(const FrameArena&) = delete;
+  FrameArena& operator=(const FrameArena&) = delete;
+
+  /**
+   * Allocates uninitialized memory.
+   *
+   * @param alignment A power of two up to BUFFER_ALIGNMENT.
+   */
+  void* allocate(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t));
+
+  /**
+   * Allocates an array of n default constructed objects.
+   */
+  template <typename T>
+  T* allocate(std::size_t n);
+
+  /**
+   * Releases everything allocated, keeping the memory for the next frame.
+   */
+  void reset();
+
+  /**
+   * Returns the current position, see rewind.
+   */
+  Marker getMarker() const { return { current, offset }; }
+
+  /**
+   * Releases everything allocated since the marker was taken.
+   */
+  void rewind(const Marker& marker) { current = marker.block; offset = marker.offset; }
+
+  /**
+   * Returns the size of all the blocks in bytes.
+   */
+  std::size_t getCapacity() const;
+
+  /**
+   * Returns the number of blocks.
+   */
+  std::size_t getBlockCount() const { return blocks.size(); }
+
+  /**
+   * Returns the number of blocks all the arenas have taken from the heap
+   * so far. They bypass operator new, so counting them is the way to see
+   * that steady frames keep their arenas as they are.
+   */
+  static unsigned long getAllocatedBlockCount();
+
+  private:
+
+  /**
+   * A block of memory aligned to BUFFER_ALIGNMENT bytes.
+   */
+  struct Block
+  {
+    std::unique_ptr<unsigned char[], AlignedDeleter> data;
+    std::size_t size;
+  };
+
+  /**
+   * The blocks, used in order.
+   */
+  std::vector<Block> blocks;
+
+  /**
+   * The index of the block being filled.
+   */
+  std::size_t current;
+
+  /**
+   * The first free byte of the block being filled.
+   */
+  std::size_t offset;
+};
+
+/**
+ * Releases the allocations made in an arena during the lifetime of the
+ * scope, for scratch arrays of a single step.
+ */
+class ArenaScope
+{
+  public:
+
+  explicit ArenaScope(FrameArena& arena): arena {arena}, marker {arena.getMarker()} {}
+
+  ~ArenaScope() { arena.rewind(marker); }
+
+  ArenaScope(const ArenaScope&) = delete;
+  ArenaScope& operator=(const ArenaScope&) = delete;
+
+  private:
+
+  FrameArena& arena;
+  FrameArena::Marker marker;
+};
+
+/**
+ * Returns the arena of the calling thread, for workers and for code that
+ * has no frame arena at hand. It is never reset; users release what they
+ * allocate with an ArenaScope.
+ */
+FrameArena& threadArena();
+
+/**
+ * Allocates an array of n default constructed objects.
+ */
+template <typename T>
+T* FrameArena::allocate(std::size_t n)
+{
+  static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+  static_assert(alignof(T) <= BUFFER_ALIGNMENT, "blocks are not aligned enough");
+
+  T* array = static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+  for (std::size_t i = 0; i < n; i++) {
+    new (&array[i]) T;
+  }
+  return array;
+}
+
+} // namespace g3
+
+#endif // ARENA_H
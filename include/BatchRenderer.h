@@ -0,0 +1,125 @@
+
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "Camera.h"
+#include "FrameBuffer.h"
+#include "Renderer.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+
+namespace g3
+{
+
+/**
+ * Renders one scene from many cameras, the frames of different cameras at
+ * the same time on the threads of a pool.
+ *
+ * Every thread of the pool has a worker of its own: a Renderer with its
+ * caches, a FrameBuffer and a copy of the frame state that it changes the
+ * camera of. The meshes, the levels of detail and the textures of the
+ * state are shared, they are only read. The workers take the cameras one
+ * at a time from a shared counter, so that slow frames do not hold the
+ * others up, and hand every frame to a callback while they hold it.
+ */
+class BatchRenderer
+{
+  public:
+
+  /**
+   * @param pool The threads that render the frames, one frame each at a
+   * time. The renderers run the loops within their frames on it too, which
+   * the threads left without a camera help with.
+   */
+  explicit BatchRenderer(ThreadPool& pool = defaultThreadPool());
+
+  /**
+   * Renders the state from every camera into a frame of w x h pixels, and
+   * returns when all of them are done. Every frame is handed to
+   * done(camera, frame, stats) on the thread that rendered it, which must
+   * be safe to call concurrently; the frame is reused for the next camera of
+   * the thread after the call.
+   */
+  template <class Callback>
+  void render(const FrameState& state, const std::vector<Camera>& cameras, unsigned int w, unsigned int h,
+              Callback done);
+
+  /**
+   * Returns the sum of the counters of the frames of the last batch.
+   */
+  const FrameStats& getStats() const { return stats; }
+
+  /**
+   * Returns the number of frames rendered at the same time.
+   */
+  unsigned int getWorkerCount() const { return workers.size(); }
+
+  private:
+
+  /**
+   * The renderer, the frame and the state of a thread.
+   */
+  struct Worker
+  {
+    Renderer renderer;
+    std::unique_ptr<FrameBuffer> frame;
+    FrameState state;
+    FrameStats stats;
+  };
+
+  /**
+   * Hands the state and the size of the frames to the workers.
+   */
+  void beginBatch(const FrameState& state, unsigned int w, unsigned int h);
+
+  /**
+   * Renders the frame of a camera with a worker.
+   */
+  void renderCamera(Worker& worker, const Camera& camera);
+
+  /**
+   * Sums the counters of the workers.
+   */
+  void endBatch();
+
+  ThreadPool& pool;
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  /**
+   * The next camera to render.
+   */
+  std::atomic<std::size_t> nextCamera;
+
+  FrameStats stats;
+};
+
+/**
+ * Renders the state from every camera.
+ */
+template <class Callback>
+void BatchRenderer::render(const FrameState& state, const std::vector<Camera>& cameras, unsigned int w,
+                           unsigned int h, Callback done)
+{
+  beginBatch(state, w, h);
+
+  // a chunk per worker, which renders cameras until there are none left
+  pool.parallelFor(0, workers.size(), 1, [&](std::size_t first, std::size_t last) {
+    for (std::size_t i = first; i < last; i++) {
+      Worker& worker = *workers[i];
+      for (std::size_t camera = nextCamera++; camera < cameras.size(); camera = nextCamera++) {
+        renderCamera(worker, cameras[camera]);
+        done(camera, static_cast<const FrameBuffer&>(*worker.frame), worker.renderer.getStats());
+      }
+    }
+  });
+
+  endBatch();
+}
+
+} // namespace g3
+
+#endif // BATCHRENDERER_H
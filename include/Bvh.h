@@ -0,0 +1,214 @@
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "Geometry.h"
+
+namespace g3
+{
+
+/**
+ * A bounding volume hierarchy over a set of boxes, the items. The items are
+ * referred to by their index in the array the hierarchy was built from.
+ *
+ * The tree is built top down with the surface area heuristic. When the items
+ * move but their number stays the same, refit() updates the boxes of the
+ * existing tree, which is much cheaper than building it again but lets the
+ * quality of the tree degrade; getCost() tells when a rebuild pays off.
+ */
+class Bvh
+{
+  public:
+
+  /**
+   * The maximum number of items in a leaf.
+   */
+  static constexpr unsigned int MAX_LEAF_SIZE = 4;
+
+  /**
+   * The number of bins the split candidates are sampled from per node.
+   */
+  static constexpr unsigned int BINS = 16;
+
+  /**
+   * Builds the tree over n boxes.
+   */
+  void build(const Aabb* bounds, unsigned int n);
+
+  /**
+   * Updates the boxes of the tree after the items moved. bounds must have as
+   * many items as the tree was built from.
+   */
+  void refit(const Aabb* bounds);
+
+  /**
+   * Returns the surface area heuristic cost of the tree, relative to the
+   * surface area of the root: the expected number of node visits and item
+   * tests of a random ray.
+   */
+  float getCost() const;
+
+  /**
+   * Returns the number of items.
+   */
+  unsigned int getSize() const { return items.size(); }
+
+  /**
+   * Returns the number of nodes.
+   */
+  unsigned int getNodeCount() const { return nodes.size(); }
+
+  /**
+   * Calls visit(item) for every item whose box is not outside the frustum.
+   */
+  template<class Visitor>
+  void cull(const Frustum& frustum, Visitor visit) const;
+
+  /**
+   * Finds the closest item hit by a ray. The items are visited roughly front
+   * to back, with hit(item, tMax) being called for every item whose box the
+   * ray enters closer than tMax. hit must return true and lower tMax if it
+   * finds a closer intersection with the item.
+   *
+   * @param tMax The maximum distance, receives the distance of the closest hit.
+   * @return The closest item hit, or -1.
+   */
+  template<class HitTest>
+  int intersect(const Ray& ray, float& tMax, HitTest hit) const;
+
+  private:
+
+  /**
+   * A node of the tree. The children of an inner node are stored next to
+   * each other, after their parent.
+   */
+  struct Node
+  {
+    /**
+     * The box around all the items under the node.
+     */
+    Aabb bounds;
+
+    /**
+     * The index of the left child, the right one follows it. 0 for leaves,
+     * as the root is never a child.
+     */
+    unsigned int left;
+
+    /**
+     * The range of the items under the node in the items array.
+     */
+    unsigned int first, count;
+  };
+
+  /**
+   * Splits the node recursively.
+   */
+  void subdivide(unsigned int node, const Aabb& centerBounds, const Aabb* bounds, const Vec3* centers);
+
+  /**
+   * The nodes, the root being the first.
+   */
+  std::vector<Node> nodes;
+
+  /**
+   * The indices of the items, ordered so that every leaf refers to a range.
+   */
+  std::vector<unsigned int> items;
+
+  /**
+   * The traversal stack, kept to avoid allocating on every query.
+   */
+  mutable std::vector<unsigned int> stack;
+};
+
+/**
+ * Calls visit(item) for every item whose box is not outside the frustum.
+ */
+template<class Visitor>
+void Bvh::cull(const Frustum& frustum, Visitor visit) const
+{
+  if (nodes.empty()) {
+    return;
+  }
+
+  stack.clear();
+  stack.push_back(0);
+  while (!stack.empty()) {
+    const Node& node = nodes[stack.back()];
+    stack.pop_back();
+
+    Containment c = classify(frustum, node.bounds);
+    if (c == Containment::OUTSIDE) {
+      continue;
+    }
+
+    if (node.left == 0 || c == Containment::INSIDE) {
+      // a leaf, or a subtree inside the frustum that needs no more tests
+      for (unsigned int i = node.first; i < node.first + node.count; i++) {
+        visit(items[i]);
+      }
+    } else {
+      stack.push_back(node.left);
+      stack.push_back(node.left + 1);
+    }
+  }
+}
+
+/**
+ * Finds the closest item hit by a ray.
+ */
+template<class HitTest>
+int Bvh::intersect(const Ray& ray, float& tMax, HitTest hit) const
+{
+  int closest = -1;
+  float tNear;
+  if (nodes.empty() || !g3::intersect(ray, nodes[0].bounds, tMax, tNear)) {
+    return closest;
+  }
+
+  stack.clear();
+  stack.push_back(0);
+  while (!stack.empty()) {
+    const Node& node = nodes[stack.back()];
+    stack.pop_back();
+
+    // a hit found since the node was pushed may be closer than its box
+    if (!g3::intersect(ray, node.bounds, tMax, tNear)) {
+      continue;
+    }
+
+    if (node.left == 0) {
+      for (unsigned int i = node.first; i < node.first + node.count; i++) {
+        if (hit(items[i], tMax)) {
+          closest = items[i];
+        }
+      }
+      continue;
+    }
+
+    // visit the nearer child first by pushing it last
+    float tLeft, tRight;
+    bool left = g3::intersect(ray, nodes[node.left].bounds, tMax, tLeft);
+    bool right = g3::intersect(ray, nodes[node.left + 1].bounds, tMax, tRight);
+    if (left && right) {
+      if (tLeft < tRight) {
+        stack.push_back(node.left + 1);
+        stack.push_back(node.left);
+      } else {
+        stack.push_back(node.left);
+        stack.push_back(node.left + 1);
+      }
+    } else if (left) {
+      stack.push_back(node.left);
+    } else if (right) {
+      stack.push_back(node.left + 1);
+    }
+  }
+  return closest;
+}
+
+} // namespace g3
+
+#endif // BVH_H
@@ -0,0 +1,127 @@
+
+#ifndef DIRTYREGIONS_H
+#define DIRTYREGIONS_H
+
+#include <vector>
+
+namespace g3
+{
+
+/**
+ * A rectangle of the window, the pixels [left, right) x [top, bottom).
+ */
+struct ScreenRect
+{
+  int left, top, right, bottom;
+
+  bool isEmpty() const { return left >= right || top >= bottom; }
+
+  long getArea() const { return isEmpty() ? 0 : (long)(right - left) * (bottom - top); }
+
+  bool intersects(const ScreenRect& other) const
+  {
+    return left < other.right && other.left < right && top < other.bottom && other.top < bottom;
+  }
+};
+
+/**
+ * Tracks the parts of the window that change from frame to frame, so that
+ * a frame buffer that still holds an earlier frame is brought up to date by
+ * redrawing only them.
+ *
+ * Every frame adds the rectangles where it differs from the frame before.
+ * The frame buffers are told apart by their address: one that held frame
+ * n - k needs the rectangles of the last k frames, merged into tiles; one
+ * that is new or older than the history is redrawn whole.
+ */
+class DirtyRegions
+{
+  public:
+
+  /**
+   * The regions are aligned to tiles of TILE_SIZE x TILE_SIZE pixels.
+   */
+  static const int TILE_SIZE = 16;
+
+  /**
+   * The number of frames whose rectangles are kept.
+   */
+  static const unsigned int HISTORY = 4;
+
+  /**
+   * Beyond this share of the window in regions, or this number of
+   * regions, the frame is redrawn whole.
+   */
+  static constexpr float MAX_COVERAGE = 0.5f;
+  static const unsigned int MAX_REGIONS = 8;
+
+  DirtyRegions();
+
+  /**
+   * Starts a frame of the given size.
+   *
+   * @param changed Whether everything may have changed since the last frame,
+   * which then has no regions: the camera moved, or the lights.
+   */
+  void beginFrame(int width, int height, bool changed);
+
+  /**
+   * Adds a rectangle where the frame differs from the last one.
+   */
+  void add(const ScreenRect& rect);
+
+  /**
+   * Finds the regions to redraw in a frame buffer to bring it to the frame.
+   *
+   * @param target The address of the frame buffer.
+   * @param regions Set to the regions, disjoint.
+   * @return False if the frame buffer must be redrawn whole.
+   */
+  bool getRegions(const void* target, std::vector<ScreenRect>& regions) const;
+
+  /**
+   * Records that a frame buffer holds the frame.
+   */
+  void endFrame(const void* target);
+
+  private:
+
+  /**
+   * The rectangles where a frame differs from the one before.
+   */
+  struct Frame
+  {
+    unsigned long number;
+    bool changed;
+    std::vector<ScreenRect> rects;
+  };
+
+  /**
+   * A frame buffer and the number of the frame it holds.
+   */
+  struct Target
+  {
+    const void* address;
+    unsigned long frame;
+  };
+
+  /**
+   * The last frames, frame n at n % HISTORY.
+   */
+  Frame frames[HISTORY];
+
+  /**
+   * The frame buffers drawn last, most recent first.
+   */
+  std::vector<Target> targets;
+
+  /**
+   * The number of the current frame, and its size.
+   */
+  unsigned long frame;
+  int width, height;
+};
+
+} // namespace g3
+
+#endif // DIRTYREGIONS_H
@@ -0,0 +1,165 @@
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace g3
+{
+
+/**
+ * A packed 32-bit color. The channels are laid out in memory in R, G, B, A
+ * byte order, which is the pixel format of an 8 bit RGBA Gdk::Pixbuf, so the
+ * color buffer can be presented without any conversion.
+ */
+using Color = std::uint32_t;
+
+/**
+ * Creates a packed RGBA color.
+ */
+constexpr Color createRGBA(int r, int g, int b, int a)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  return ((Color)(r & 0xff) << 24) | ((Color)(g & 0xff) << 16)
+       | ((Color)(b & 0xff) << 8) | (Color)(a & 0xff);
+#else
+  return ((Color)(a & 0xff) << 24) | ((Color)(b & 0xff) << 16)
+       | ((Color)(g & 0xff) << 8) | (Color)(r & 0xff);
+#endif
+}
+
+/**
+ * Alignment of the buffers in bytes (one cache line).
+ */
+const std::size_t BUFFER_ALIGNMENT = 64;
+
+/**
+ * Allocates memory aligned to BUFFER_ALIGNMENT bytes.
+ * Throws std::bad_alloc on failure.
+ */
+void* alignedAlloc(std::size_t bytes);
+
+/**
+ * Releases memory allocated by alignedAlloc.
+ */
+struct AlignedDeleter
+{
+  void operator()(void* ptr) const;
+};
+
+/**
+ * An engine owned color and depth buffer.
+ *
+ * Every row starts on a cache line boundary: the row stride is the width
+ * rounded up to a multiple of 16 pixels. Both buffers share the same stride,
+ * so a pixel has the same index in each of them.
+ */
+class FrameBuffer
+{
+  public:
+  FrameBuffer(unsigned int w, unsigned int h);
+
+  FrameBuffer(const FrameBuffer&) = delete;
+  FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+  /**
+   * The width and the height that resize rounds the memory of the buffers
+   * up to, in pixels.
+   */
+  static const unsigned int RESIZE_STEP = 128;
+
+  /**
+   * Changes the size of the buffer, leaving its pixels undefined. The memory
+   * is kept while the new size fits into it, and when it does not, the new
+   * memory is rounded up to RESIZE_STEP pixels in both directions, so that
+   * resizing a window a few pixels at a time does not allocate at every
+   * step. Shrinking never releases memory.
+   */
+  void resize(unsigned int w, unsigned int h);
+
+  /**
+   * Fills the color buffer with the given color and resets the depth buffer
+   * to infinity.
+   */
+  void clear(Color clearColor);
+
+  /**
+   * Clears the rows [top, bottom) only, like clear, the padding at the end
+   * of the rows included, so that bands of rows cleared on different
+   * threads leave the buffers as clear does.
+   */
+  void clearRows(Color clearColor, unsigned int top, unsigned int bottom);
+
+  /**
+   * Clears the pixels [left, right) x [top, bottom) only, like clear.
+   */
+  void clear(Color clearColor, unsigned int left, unsigned int top, unsigned int right, unsigned int bottom);
+
+  /**
+   * Resets the depth buffer to infinity, leaving the colors as they are.
+   */
+  void clearDepth();
+
+  /**
+   * Returns the index of the pixel (x, y) in the color and depth buffers.
+   */
+  std::size_t indexOf(unsigned int x, unsigned int y) const { return y * stride + x; }
+
+  unsigned int getWidth() const { return width; }
+  unsigned int getHeight() const { return height; }
+
+  /**
+   * Returns the number of pixels between the start of two rows.
+   */
+  unsigned int getStride() const { return stride; }
+
+  /**
+   * Returns the number of pixels the memory of the buffers holds.
+   */
+  std::size_t getCapacity() const { return capacity; }
+
+  Color* getColorBuffer() { return colorBuffer.get(); }
+  const Color* getColorBuffer() const { return colorBuffer.get(); }
+
+  float* getDepthBuffer() { return depthBuffer.get(); }
+  const float* getDepthBuffer() const { return depthBuffer.get(); }
+
+  private:
+
+  /**
+   * The width of the buffer in pixels.
+   */
+  unsigned int width;
+
+  /**
+   * The height of the buffer in pixels.
+   */
+  unsigned int height;
+
+  /**
+   * The row stride in pixels.
+   */
+  unsigned int stride;
+
+  /**
+   * The number of pixels the memory of the buffers holds, at least stride
+   * times height.
+   */
+  std::size_t capacity;
+
+  /**
+   * Color buffer, see Color for the pixel format.
+   */
+  std::unique_ptr<Color[], AlignedDeleter> colorBuffer;
+
+  /**
+   * Depth buffer.
+   */
+  std::unique_ptr<float[], AlignedDeleter> depthBuffer;
+};
+
+} // namespace g3
+
+#endif // FRAMEBUFFER_H
@@ -0,0 +1,244 @@
+
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+namespace g3
+{
+
+/**
+ * A histogram of frame times with buckets of one millisecond. The last
+ * bucket collects every frame time that does not fit in the others.
+ */
+class FrameTimeHistogram
+{
+  public:
+
+  /**
+   * The number of buckets.
+   */
+  static constexpr unsigned int BUCKETS = 100;
+
+  /**
+   * The width of a bucket in nanoseconds.
+   */
+  static constexpr unsigned long BUCKET_WIDTH = 1000000;
+
+  FrameTimeHistogram();
+
+  /**
+   * Adds a frame time in nanoseconds.
+   */
+  void add(unsigned long frameTime);
+
+  /**
+   * Removes every sample.
+   */
+  void reset();
+
+  /**
+   * Returns the number of samples in a bucket.
+   */
+  unsigned long getCount(unsigned int bucket) const { return counts[bucket]; }
+
+  /**
+   * Returns the number of samples.
+   */
+  unsigned long getTotal() const { return total; }
+
+  /**
+   * Returns the frame time in nanoseconds that the given fraction (0..1) of
+   * the samples does not exceed, rounded up to the bucket boundary.
+   */
+  unsigned long percentile(float fraction) const;
+
+  private:
+
+  /**
+   * The number of samples per bucket.
+   */
+  unsigned long counts[BUCKETS];
+
+  /**
+   * The number of samples.
+   */
+  unsigned long total;
+};
+
+/**
+ * Paces the frames.
+ *
+ * The simulation advances in fixed steps, independently of how fast the
+ * frames are rendered: every tick reports how many steps are due and the
+ * fraction of a step that is left over, which is used to interpolate the
+ * rendered state. The measured render times drive a detail level, so the
+ * renderer is asked to do less work under load instead of skipping frames.
+ *
+ * With dynamic resolution, the render times drive the resolution of the
+ * frames first: under load it is lowered as far as MIN_RESOLUTION_SCALE
+ * before the detail is reduced, and it is restored after the detail. The
+ * scale follows the moving average of the render times towards a share of
+ * the target frame time, in steps of RESOLUTION_STEP.
+ */
+class FrameScheduler
+{
+  public:
+
+  /**
+   * The maximum number of simulation steps run in a single tick. If the
+   * simulation falls further behind, the remaining time is dropped.
+   */
+  static constexpr unsigned int MAX_STEPS = 5;
+
+  /**
+   * The highest, cheapest detail level.
+   */
+  static constexpr unsigned int MAX_DETAIL_LEVEL = 2;
+
+  /**
+   * The lowest resolution scale of dynamic resolution.
+   */
+  static constexpr float MIN_RESOLUTION_SCALE = 0.25f;
+
+  /**
+   * The resolution scales of dynamic resolution are multiples of this, so
+   * that small changes of the load do not resize the frames.
+   */
+  static constexpr float RESOLUTION_STEP = 0.05f;
+
+  /**
+   * @param targetFrameTime The target frame time in nanoseconds.
+   * @param simulationStep The length of a simulation step in nanoseconds.
+   */
+  FrameScheduler(unsigned long targetFrameTime, unsigned long simulationStep);
+
+  /**
+   * Starts a tick.
+   *
+   * @param now The current time point in nanoseconds.
+   * @return The number of simulation steps to run.
+   */
+  unsigned int tick(unsigned long now);
+
+  /**
+   * Returns the fraction of a simulation step that elapsed after the last
+   * step, between 0 and 1.
+   */
+  float getInterpolation() const;
+
+  /**
+   * Records a presented frame.
+   *
+   * @param now The current time point in nanoseconds.
+   * @param renderTime The time spent rendering the frame in nanoseconds.
+   */
+  void framePresented(unsigned long now, unsigned long renderTime);
+
+  /**
+   * Returns the achieved frames per second.
+   */
+  float getFps() const;
+
+  /**
+   * Returns the average render time divided by the target frame time.
+   */
+  float getLoad() const { return load; }
+
+  /**
+   * Returns how much the renderer should reduce its work, 0 is full detail.
+   */
+  unsigned int getDetailLevel() const { return detailLevel; }
+
+  /**
+   * Turns dynamic resolution on or off. Off, the resolution scale is 1.
+   */
+  void setDynamicResolution(bool enabled);
+
+  bool hasDynamicResolution() const { return dynamicResolution; }
+
+  /**
+   * Returns the share of the resolution of the target that the frames
+   * should be rendered at, see FrameState::resolutionScale.
+   */
+  float getResolutionScale() const { return resolutionScale; }
+
+  /**
+   * Returns the histogram of the times between two presented frames.
+   */
+  const FrameTimeHistogram& getFrameTimes() const { return frameTimes; }
+
+  /**
+   * Returns the histogram of the render times.
+   */
+  const FrameTimeHistogram& getRenderTimes() const { return renderTimes; }
+
+  unsigned long getTargetFrameTime() const { return targetFrameTime; }
+  unsigned long getSimulationStep() const { return simulationStep; }
+
+  private:
+
+  /**
+   * Moves the resolution scale towards the load that the target frame time
+   * leaves room for.
+   */
+  void adaptResolution();
+
+  /**
+   * The target frame time in nanoseconds.
+   */
+  unsigned long targetFrameTime;
+
+  /**
+   * The length of a simulation step in nanoseconds.
+   */
+  unsigned long simulationStep;
+
+  /**
+   * The time point of the last tick, 0 before the first tick.
+   */
+  unsigned long lastTick;
+
+  /**
+   * Elapsed time not yet consumed by simulation steps.
+   */
+  unsigned long accumulator;
+
+  /**
+   * The time point of the last presented frame, 0 before the first one.
+   */
+  unsigned long lastPresent;
+
+  /**
+   * Exponential moving average of the time between presented frames.
+   */
+  float averageFrameTime;
+
+  /**
+   * Exponential moving average of the render time divided by the target.
+   */
+  float load;
+
+  /**
+   * The current detail level.
+   */
+  unsigned int detailLevel;
+
+  /**
+   * The number of frames since the detail level changed.
+   */
+  unsigned int framesAtLevel;
+
+  /**
+   * Whether the resolution follows the load, the resolution scale, and the
+   * number of frames since it changed.
+   */
+  bool dynamicResolution;
+  float resolutionScale;
+  unsigned int framesAtScale;
+
+  FrameTimeHistogram frameTimes;
+  FrameTimeHistogram renderTimes;
+};
+
+} // namespace g3
+
+#endif // FRAMESCHEDULER_H
@@ -0,0 +1,228 @@
+
+#ifndef FRAMESINK_H
+#define FRAMESINK_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FrameBuffer.h"
+
+namespace g3
+{
+
+/**
+ * The formats a FrameSink writes the frames in.
+ */
+enum class FrameFormat
+{
+  /**
+   * The RGBA bytes of the pixels, row after row, one frame after the other
+   * in a single file or pipe.
+   */
+  RAW,
+
+  /**
+   * One binary PPM (P6) file per frame.
+   */
+  PPM,
+
+  /**
+   * One PNG file per frame, RGB and uncompressed: the I/O thread keeps up
+   * with the renderer rather than spending its time deflating.
+   */
+  PNG,
+
+  /**
+   * A YUV4MPEG2 stream in a single file or pipe, 4:2:0 with the full range
+   * BT.601 colors of JPEG. The header tags the range as full, which video
+   * encoders such as ffmpeg read it with.
+   */
+  Y4M
+};
+
+/**
+ * Returns the name of a frame format: raw, ppm, png or y4m.
+ */
+const char* getFrameFormatName(FrameFormat format);
+
+/**
+ * Parses the name of a frame format.
+ *
+ * @return false if the name is unknown.
+ */
+bool parseFrameFormat(const char* name, FrameFormat& format);
+
+/**
+ * Writes rendered frames to files or a pipe on a background I/O thread.
+ *
+ * The sink owns the buffers the frames are rendered into, like a SwapChain:
+ * the producer renders into the back buffer and presents it, which queues
+ * the buffer for the I/O thread and hands the producer a free one, without
+ * copying the pixels. The queue holds QUEUE_SIZE frames. When the I/O falls
+ * that far behind, present drops the frame and the producer renders the
+ * next one into the same buffer, so the render loop never waits for the
+ * disk, unless the sink is asked to wait instead, for output that must not
+ * miss frames.
+ *
+ * The frames of a sink keep its size.
+ */
+class FrameSink
+{
+  public:
+
+  /**
+   * The number of frames that can wait for the I/O thread.
+   */
+  static constexpr unsigned int QUEUE_SIZE = 3;
+
+  /**
+   * Opens the output and starts the I/O thread.
+   *
+   * @param path The file of RAW and Y4M, "-" for the standard output, or
+   * for PPM and PNG a printf pattern of the files with the number of the
+   * frame as an int, such as frame%05d.png.
+   * @param framesPerSecond The frame rate that Y4M declares.
+   * @param wait Whether present waits for the I/O thread when the queue is
+   * full, rather than dropping the frame.
+   * @throws std::runtime_error if the file cannot be opened, or if the
+   * pattern holds other conversions than a single one of an int, %d or %i
+   * with flags, a width and a precision, since it is a printf format.
+   */
+  FrameSink(FrameFormat format, const std::string& path, unsigned int w, unsigned int h,
+            unsigned int framesPerSecond = 30, bool wait = false);
+
+  /**
+   * Writes the queued frames and closes the output.
+   */
+  ~FrameSink();
+
+  FrameSink(const FrameSink&) = delete;
+  FrameSink& operator=(const FrameSink&) = delete;
+
+  /**
+   * Returns the buffer the producer renders into.
+   */
+  FrameBuffer& getBackBuffer() { return *buffers[back]; }
+
+  /**
+   * Queues the back buffer for writing and hands the producer a new back
+   * buffer.
+   *
+   * @return false if the queue was full and the frame was dropped.
+   */
+  bool present();
+
+  /**
+   * Waits until the queued frames are written, and flushes the output.
+   */
+  void flush();
+
+  /**
+   * Returns the number of frames written, dropped, and that failed to be
+   * written because a file could not be opened or written.
+   */
+  unsigned long getWrittenCount() const;
+  unsigned long getDroppedCount() const;
+  unsigned long getFailedCount() const;
+
+  private:
+
+  /**
+   * The body of the I/O thread.
+   */
+  void ioLoop();
+
+  /**
+   * Encodes a frame into bytes and writes them out. Runs on the I/O thread.
+   *
+   * @return false if the frame could not be written.
+   */
+  bool write(const FrameBuffer& frame, unsigned long number);
+
+  /**
+   * Encodes a frame into bytes in the format of the sink. RAW needs no
+   * encoding.
+   */
+  void encodePpm(const FrameBuffer& frame);
+  void encodePng(const FrameBuffer& frame);
+  void encodeY4m(const FrameBuffer& frame, unsigned long number);
+
+  FrameFormat format;
+  std::string path;
+  unsigned int framesPerSecond;
+  bool wait;
+
+  /**
+   * The output of RAW and Y4M, and whether the sink opened it, or nullptr.
+   */
+  std::FILE* stream;
+  bool ownsStream;
+
+  /**
+   * The back buffer, the queued ones and the free ones.
+   */
+  std::unique_ptr<FrameBuffer> buffers[QUEUE_SIZE + 1];
+
+  /**
+   * The index of the back buffer.
+   */
+  unsigned int back;
+
+  /**
+   * The queued buffers in the order they were presented, a ring of count
+   * indices from head, and the number of the frame of each buffer.
+   */
+  unsigned int queue[QUEUE_SIZE + 1];
+  unsigned int head, count;
+  unsigned long numbers[QUEUE_SIZE + 1];
+
+  /**
+   * The free buffers.
+   */
+  unsigned int freeBuffers[QUEUE_SIZE + 1];
+  unsigned int freeCount;
+
+  /**
+   * Whether the I/O thread writes a frame, which it took off the queue.
+   */
+  bool writing;
+
+  /**
+   * The number of the next queued frame.
+   */
+  unsigned long nextNumber;
+
+  unsigned long written, dropped, failed;
+
+  /**
+   * Guards the queue, the free buffers and the counts.
+   */
+  mutable std::mutex mutex;
+
+  /**
+   * Signals the I/O thread that a frame was queued or that the sink stops,
+   * and the producer that a buffer was freed.
+   */
+  std::condition_variable frameQueued;
+  std::condition_variable bufferFreed;
+
+  bool stopping;
+
+  /**
+   * The bytes of the frame being written, and the scanlines of PNG, kept
+   * from frame to frame.
+   */
+  std::vector<std::uint8_t> bytes;
+  std::vector<std::uint8_t> scanlines;
+
+  std::thread ioThread;
+};
+
+} // namespace g3
+
+#endif // FRAMESINK_H
@@ -0,0 +1,133 @@
+
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include "Vec.h"
+#include "Mat.h"
+
+namespace g3
+{
+
+/**
+ * An axis aligned bounding box.
+ */
+struct Aabb
+{
+  /**
+   * The corner with the smallest coordinates.
+   */
+  Vec3 min;
+
+  /**
+   * The corner with the largest coordinates.
+   */
+  Vec3 max;
+};
+
+/**
+ * Returns a box that contains nothing, ready to be grown.
+ */
+Aabb createEmptyAabb();
+
+/**
+ * Grows the box to contain the point.
+ */
+void grow(Aabb& box, const Vec3& point);
+
+/**
+ * Grows the box to contain another box. Cheaper than merge in loops, as
+ * nothing is copied.
+ */
+void grow(Aabb& box, const Aabb& other);
+
+/**
+ * Returns the smallest box containing both boxes.
+ */
+Aabb merge(const Aabb& lhs, const Aabb& rhs);
+
+/**
+ * Returns the center of the box.
+ */
+Vec3 center(const Aabb& box);
+
+/**
+ * Returns the surface area of the box, 0 for an empty box.
+ */
+float surfaceArea(const Aabb& box);
+
+/**
+ * Returns the box containing the box transformed by an affine matrix in row
+ * major order.
+ */
+Aabb transformAabb(const Aabb& box, const Mat4& mat);
+
+/**
+ * A ray, the points origin + t * direction for t >= 0.
+ */
+struct Ray
+{
+  Vec3 origin;
+  Vec3 direction;
+
+  /**
+   * 1 / direction per axis, used by the slab test.
+   */
+  Vec3 invDirection;
+};
+
+/**
+ * Creates a ray.
+ */
+Ray createRay(const Vec3& origin, const Vec3& direction);
+
+/**
+ * Intersects a ray with a box.
+ *
+ * @param tMax Intersections further than this are ignored.
+ * @param tNear Receives the distance along the ray where it enters the box,
+ * 0 if the origin is inside.
+ * @return true if the ray hits the box closer than tMax.
+ */
+bool intersect(const Ray& ray, const Aabb& box, float tMax, float& tNear);
+
+/**
+ * A view frustum described by six planes (a, b, c, d), the inside being
+ * where a*x + b*y + c*z + d >= 0.
+ */
+struct Frustum
+{
+  Vec4 planes[6];
+};
+
+/**
+ * Extracts the frustum of a view projection matrix in row major order.
+ *
+ * The visible part of the projected x and y range is given explicitly,
+ * because the window mapping may show only a part of [-1, 1] (see the zoom
+ * factor of the Camera).
+ *
+ * @param halfWidth Half of the visible x range after projection.
+ * @param halfHeight Half of the visible y range after projection.
+ */
+Frustum createFrustum(const Mat4& viewProj, float halfWidth, float halfHeight);
+
+/**
+ * How a box relates to a frustum.
+ */
+enum class Containment
+{
+  OUTSIDE,
+  INTERSECTING,
+  INSIDE
+};
+
+/**
+ * Classifies a box against a frustum. The test is conservative: boxes near
+ * the corners of the frustum may be reported as intersecting although they
+ * are outside.
+ */
+Containment classify(const Frustum& frustum, const Aabb& box);
+
+} // namespace g3
+
+#endif // GEOMETRY_H
@@ -0,0 +1,149 @@
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace g3
+{
+
+/**
+ * The instruction sets that the kernels are compiled for.
+ */
+enum class Isa
+{
+  SCALAR,
+  SSE41,
+  AVX2,
+  AVX512
+};
+
+/**
+ * The inner loops of the math and raster code. Every instruction set has its
+ * own table of kernels; the best one the CPU supports is chosen once, on
+ * first use. The G3_ISA environment variable (scalar, sse4.1, avx2, avx512)
+ * overrides the choice, which is useful for benchmarking.
+ */
+struct Kernels
+{
+  /**
+   * The instruction set of the kernels.
+   */
+  Isa isa;
+
+  /**
+   * Multiplies two 4x4 row major matrices: res = lhs * rhs.
+   * res may not alias lhs or rhs.
+   */
+  void (*multiplyMat4)(const float* lhs, const float* rhs, float* res);
+
+  /**
+   * Transforms n points with a 4x4 row major matrix followed by the
+   * perspective divide, like transformP3. The points of in are x, y, z
+   * triplets that start every stride floats, so they can be read straight
+   * out of an array of vertices; out receives packed triplets.
+   * out may not alias in.
+   */
+  void (*transformPoints)(const float* in, std::size_t stride, float* out, std::size_t n, const float* mat);
+
+  /**
+   * Fills a span of n 32-bit values, used for colors and depth values.
+   * Large spans bypass the cache.
+   */
+  void (*fill32)(std::uint32_t* dst, std::size_t n, std::uint32_t value);
+
+  /**
+   * Intersects a ray with a packet of TRIANGLE_PACKET_SIZE triangles with
+   * the Moller-Trumbore test, from both sides.
+   *
+   * The packet is stored as structure of arrays, TRIANGLE_PACKET_SIZE floats
+   * each: the x, y, z of the first corners, then of the first edges, then of
+   * the second edges. Unused lanes hold zero edges and never hit. The ray is
+   * the origin followed by the direction.
+   *
+   * @param distance Hits at or beyond it are ignored, receives the distance
+   * of the closest hit in units of the ray direction.
+   * @return The lane of the closest hit, or -1.
+   */
+  int (*intersectTriangles)(const float* packet, const float* ray, float* distance);
+
+  /**
+   * Lights n vertices with the diffuse (Lambert) model and packs their
+   * colors, like createRGBA with an alpha of 255.
+   *
+   * The positions and the normals are x, y, z triplets that start every
+   * stride floats. Every light is LIGHT_SIZE floats: x, y, z, w, r, g, b and
+   * 1 / range^2. A directional light has w = 0 and x, y, z is the unit
+   * vector towards the light; a point light has w = 1 and x, y, z is its
+   * position, and its intensity falls to 0 at the range. The material is
+   * the color without any light (r, g, b, unused) followed by the diffuse
+   * color (r, g, b, unused).
+   */
+  void (*lightVertices)(const float* positions, const float* normals, std::size_t stride, std::size_t n,
+                        const float* lights, std::size_t lightCount, const float* material, std::uint32_t* colors);
+
+  /**
+   * Merges a span of n pixels into another: where the source depth is less
+   * than the destination depth, the source color and depth replace those of
+   * the destination. An infinite source depth leaves a pixel alone.
+   */
+  void (*mergeMinDepth)(std::uint32_t* dstColor, float* dstDepth, const std::uint32_t* srcColor,
+                        const float* srcDepth, std::size_t n);
+
+  /**
+   * Scales a row of colors along x: every column is x << 8 | weight, and
+   * out receives in[x] and in[x + 1] blended channel by channel, the second
+   * one by weight / BLEND_ONE, rounded. in[x + 1] is always read.
+   */
+  void (*scaleRow)(const std::uint32_t* in, const std::uint32_t* columns, std::uint32_t* out, std::size_t n);
+
+  /**
+   * Blends two rows of n colors channel by channel, the second one by
+   * weight / BLEND_ONE, rounded, like scaleRow.
+   */
+  void (*blendRows)(const std::uint32_t* a, const std::uint32_t* b, std::uint32_t* out, std::size_t n,
+                    unsigned int weight);
+};
+
+/**
+ * The number of triangles intersectTriangles tests at once.
+ */
+constexpr unsigned int TRIANGLE_PACKET_SIZE = 8;
+
+/**
+ * The number of floats of a light for lightVertices.
+ */
+constexpr unsigned int LIGHT_SIZE = 8;
+
+/**
+ * The weight of a color taken whole by scaleRow and blendRows. The weights
+ * are 6 bits, so that they fit signed bytes, which the SIMD versions
+ * multiply the channels by.
+ */
+constexpr unsigned int BLEND_ONE = 64;
+
+/**
+ * Returns the kernels chosen for this process.
+ */
+const Kernels& kernels();
+
+/**
+ * Returns the kernels of an instruction set, or nullptr if the CPU (or the
+ * compiler) does not support it.
+ */
+const Kernels* getKernels(Isa isa);
+
+/**
+ * Returns the best instruction set supported by the CPU.
+ */
+Isa detectIsa();
+
+/**
+ * Returns the name of an instruction set, as accepted by G3_ISA.
+ */
+const char* getIsaName(Isa isa);
+
+} // namespace g3
+
+#endif // KERNELS_H
@@ -0,0 +1,97 @@
+
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include <vector>
+#include "FrameBuffer.h"
+#include "Mat.h"
+#include "Vec.h"
+
+namespace g3
+{
+
+/**
+ * A light infinitely far away, like the sun.
+ */
+struct DirectionalLight
+{
+  /**
+   * The direction towards the light in world space, need not be normalized.
+   */
+  Vec3 direction;
+
+  /**
+   * The color of the light, 1 is full intensity.
+   */
+  Vec3 color;
+};
+
+/**
+ * A light at a point, fading out with the distance.
+ */
+struct PointLight
+{
+  /**
+   * The position of the light in world space.
+   */
+  Vec3 position;
+
+  /**
+   * The color of the light at its position, 1 is full intensity.
+   */
+  Vec3 color;
+
+  /**
+   * The distance at which the light has faded out.
+   */
+  float range;
+};
+
+/**
+ * The lights of a scene.
+ */
+struct Lighting
+{
+  /**
+   * The light that reaches every surface from all around.
+   */
+  Vec3 ambient {0.25f, 0.25f, 0.25f};
+
+  /**
+   * The directional lights, a sun from above by default.
+   */
+  std::vector<DirectionalLight> directionalLights { { Vec3{-0.4f, 1, -0.5f}, Vec3{0.8f, 0.8f, 0.75f} } };
+
+  /**
+   * The point lights.
+   */
+  std::vector<PointLight> pointLights;
+
+  /**
+   * Returns the number of lights, the ambient light aside.
+   */
+  std::size_t getLightCount() const { return directionalLights.size() + pointLights.size(); }
+};
+
+/**
+ * Packs the lights in the layout of Kernels::lightVertices, in the model
+ * space of a mesh instance. Lighting in model space saves transforming the
+ * normals; world matrices are taken to be rigid motions, so that distances
+ * are the same in both spaces.
+ *
+ * @param toModel The inverse of the world matrix of the instance.
+ * @param lights Receives LIGHT_SIZE floats per light.
+ */
+void packLights(const Lighting& lighting, const Mat4& toModel, float* lights);
+
+/**
+ * Packs the material of a surface of the given color for
+ * Kernels::lightVertices: the ambient light is reflected by the color.
+ *
+ * @param material Receives 8 floats.
+ */
+void packMaterial(const Lighting& lighting, Color color, float* material);
+
+} // namespace g3
+
+#endif // LIGHTING_H
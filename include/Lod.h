@@ -0,0 +1,68 @@
+
+#ifndef LOD_H
+#define LOD_H
+
+#include <vector>
+#include "Mesh.h"
+
+namespace g3
+{
+
+/**
+ * Simplified versions of a mesh, the levels of detail, for drawing it when
+ * it covers only a few pixels.
+ */
+struct LodChain
+{
+  /**
+   * The simplified meshes, from the finest to the coarsest. Each has about
+   * LOD_REDUCTION times the faces of the one before, the first one compared
+   * to the source mesh.
+   */
+  std::vector<TriangleMesh> levels;
+
+  /**
+   * The error of each level: about the largest distance in model space
+   * between its surface and the surface of the source mesh.
+   */
+  std::vector<float> errors;
+};
+
+/**
+ * The ratio of the face counts of consecutive levels of detail.
+ */
+constexpr float LOD_REDUCTION = 0.25f;
+
+/**
+ * Meshes are not simplified below this many faces.
+ */
+constexpr unsigned int LOD_MIN_FACES = 12;
+
+/**
+ * Builds the levels of detail of a mesh by edge collapses ordered by the
+ * quadric error metric (Garland and Heckbert). Every collapse moves the
+ * merged vertex to the point that minimizes the squared distances to the
+ * planes of the faces around it; collapses that would flip a face are left
+ * out and border edges are kept in place. The levels are reordered for
+ * locality by optimizeMesh.
+ *
+ * This is meant to run at load time: 100000 faces take about 0.7 s.
+ *
+ * @param maxLevels The maximum number of levels.
+ */
+void buildLodChain(const TriangleMesh& mesh, LodChain& chain, unsigned int maxLevels = 6);
+
+/**
+ * Selects the coarsest level of detail whose error stays below a number of
+ * pixels on the screen.
+ *
+ * @param pixelsPerUnit The size on the screen, in pixels, of a model space
+ * unit at the position of the mesh.
+ * @param maxPixelError The largest error allowed on the screen, in pixels.
+ * @return 0 for the source mesh, i for chain.levels[i - 1].
+ */
+unsigned int selectLod(const LodChain& chain, float pixelsPerUnit, float maxPixelError);
+
+} // namespace g3
+
+#endif // LOD_H
@@ -25,7 +25,7 @@ class Mat
   Mat():mScalars{} {}
 
   Mat(std::initializer_list<float> values): mScalars() {
-  std::size_t i = 0, j = 0;
+  std::size_t i = 0;
     for (float f : values) {
       if (i == N*N) break;
       mScalars[i++] = f;
@@ -105,6 +105,13 @@ class Mat
   float mScalars[N*N];
 };
 
+/**
+ * Matrix multiplication of 4x4 matrices, done by the kernel chosen for the
+ * CPU (see Kernels.h).
+ */
+template<>
+Mat<4> Mat<4>::operator*(const Mat<4>& other) const;
+
 /**
  * Scalar multiplication operator overloading
  */
@@ -150,6 +157,12 @@ using Mat4 = Mat<4>;
  */
 Vec3 transformP3(const Vec3& vec, const Mat4& mat);
 
+/**
+ * Transforms n 3D points with a 4x4 matrix, like transformP3 but done by the
+ * kernel chosen for the CPU (see Kernels.h). out may not alias in.
+ */
+void transformP3(const Vec3* in, Vec3* out, std::size_t n, const Mat4& mat);
+
 /**
  * Transforms a 3D vector with a 4x4 matrix.
  */
@@ -186,7 +199,7 @@ Mat4 createTranslationMatrix(const float valX, const float valY, const float val
 /**
  * PI constant
  */
-const float PI = 3.14159265358979;
+constexpr float PI = 3.14159265358979;
 
 /**
  * Converts degrees to radians.
@@ -215,6 +228,11 @@ constexpr float toDeg(const float rad)
  */
 Mat4 transponse(const Mat4& mat);
 
+/**
+ * Inverts a matrix. A singular matrix gives a matrix of infinities and NaNs.
+ */
+Mat4 inverse(const Mat4& mat);
+
 
 /**
  * Returns a rotation matrix in row major order that can be used to rotate 
@@ -277,6 +295,17 @@ Mat4 createLookAtLHMatrix(const Vec3& eye, const Vec3& target, const Vec3& up);
  */
 Mat4 createPerspectiveFovLHMatrix(float fieldOfViewY, float aspectRatio, float zNearPlane, float zFarPlane);
 
+/**
+ * Creates a left-handed orthographic projection matrix.
+ *
+ * @param width Width of the view volume.
+ * @param height Height of the view volume.
+ * @param zNearPlane Z-value of the near view plane.
+ * @param zFarPlane Z-value of the far view plane.
+ * @return A left-handed orthographic projection matrix.
+ */
+Mat4 createOrthographicLHMatrix(float width, float height, float zNearPlane, float zFarPlane);
+
 /**
  * Prints the matrix in four rows.
  */
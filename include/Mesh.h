@@ -0,0 +1,136 @@
+
+#ifndef MESH_H
+#define MESH_H
+
+#include <memory>
+#include "Vec.h"
+#include "Mat.h"
+#include "Geometry.h"
+
+namespace g3
+{
+
+/**
+ * The information we store at the vertex level.
+ */
+struct Vertex
+{
+  /**
+   * Position of the vertex in model space.
+   */
+  Vec3 pos;
+
+  /**
+   * The unit normal of the surface at the vertex in model space, see
+   * computeNormals.
+   */
+  Vec3 normal;
+
+  /**
+   * The texture coordinates of the vertex, see Texture::sample.
+   */
+  Vec2 uv;
+};
+
+/**
+ * The distance between the vertices of an array in floats, for the batched
+ * kernels that read their positions and normals in place.
+ */
+constexpr std::size_t VERTEX_STRIDE = sizeof(Vertex) / sizeof(float);
+
+/**
+ * A triangle face, defined by three indices into the vertex array.
+ *
+ * The faces of a mesh wind the same way: seen from the outside, the
+ * vertices go counterclockwise in a right-handed frame, so the cross product
+ * of the edges from the first vertex to the second and to the third points
+ * out of the surface.
+ */
+struct Triangle
+{
+  /**
+   * Indices of the vertices.
+   */
+  unsigned int vertexIndex[3];
+
+  /**
+   * The unit normal of the face in model space, see computeNormals.
+   */
+  Vec3 normal;
+};
+
+/**
+ * Describes an indexed triangle mesh.
+ */
+struct TriangleMesh
+{
+  /**
+   * The number of vertices.
+   */
+  unsigned int nVertices;
+
+  /**
+   * The vertices of the mesh.
+   */
+  std::unique_ptr<Vertex[]> vertices;
+
+  /**
+   * The number of faces.
+   */
+  unsigned int nFaces;
+
+  /**
+   * The faces of the mesh.
+   */
+  std::unique_ptr<Triangle[]> faces;
+
+  /**
+   * The box around the vertices in model space, see computeBounds.
+   */
+  Aabb bounds;
+
+  /**
+   * Rotation around the x, y and z axes in radians.
+   */
+  float rotationX, rotationY, rotationZ;
+
+  /**
+   * Location of the mesh in world space.
+   */
+  Vec3 loc;
+};
+
+/**
+ * Loads a cube triangle mesh. Every side has its own four vertices, so that
+ * the sides keep their own normals and map the whole of a texture.
+ */
+void loadCube(TriangleMesh& mesh);
+
+/**
+ * Loads a rolling terrain: a square grid of 2 * divisions^2 triangles,
+ * 8 units wide, displaced by a few waves. Used as a large test mesh. A
+ * texture repeats every 2 units.
+ */
+void loadTerrain(TriangleMesh& mesh, unsigned int divisions);
+
+/**
+ * Returns the box around the vertices of the mesh in model space. Loaders
+ * store it in the bounds of the mesh.
+ */
+Aabb computeBounds(const TriangleMesh& mesh);
+
+/**
+ * Computes the normals of the faces and of the vertices of a mesh. A vertex
+ * normal is the average of the normals of the faces around the vertex,
+ * weighted by their areas. Loaders compute them once at load time.
+ */
+void computeNormals(TriangleMesh& mesh);
+
+/**
+ * Calculates the world transformation matrix of the triangle mesh object.
+ */
+Mat4 getWorldMatrix(TriangleMesh& mesh);
+
+} // namespace g3
+
+#endif // MESH_H
@@ -0,0 +1,46 @@
+
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include "Mesh.h"
+
+namespace g3
+{
+
+/**
+ * The number of vertices in the vertex cache that the face order is
+ * optimized for.
+ */
+constexpr unsigned int VERTEX_CACHE_SIZE = 32;
+
+/**
+ * Reorders the faces of a mesh so that consecutive faces share vertices,
+ * with the linear-speed vertex cache optimization of Tom Forsyth: faces are
+ * emitted greedily by the score of their vertices, which favours vertices
+ * used recently and vertices with few faces left.
+ */
+void optimizeVertexCache(TriangleMesh& mesh);
+
+/**
+ * Renumbers the vertices of a mesh in the order the faces first use them,
+ * so that walking the faces reads the vertex array mostly forwards. Vertices
+ * no face uses move to the end.
+ */
+void optimizeVertexFetch(TriangleMesh& mesh);
+
+/**
+ * Reorders the faces and then the vertices of a mesh for locality. This is
+ * the pass that meshes get at load time.
+ */
+void optimizeMesh(TriangleMesh& mesh);
+
+/**
+ * Returns the average cache miss ratio of the faces of a mesh: the vertices
+ * a first-in first-out cache of the given size misses per face, between 0.5
+ * for a large regular grid in the best order and 3.
+ */
+float computeAcmr(const TriangleMesh& mesh, unsigned int cacheSize = 16);
+
+} // namespace g3
+
+#endif // MESHOPTIMIZER_H
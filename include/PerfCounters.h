@@ -0,0 +1,81 @@
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <cstdint>
+
+namespace g3
+{
+
+/**
+ * Hardware performance counters of the calling thread, read through the
+ * perf events of Linux. Only user space events are counted, which most
+ * systems allow without privileges.
+ *
+ * Counters the processor or the system does not offer are left out; on
+ * other systems, or where perf events are forbidden (in most containers),
+ * none is available and the counts stay 0.
+ */
+class PerfCounters
+{
+  public:
+
+  /**
+   * The counted events.
+   */
+  enum Counter
+  {
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_REFERENCES,
+    CACHE_MISSES,
+    L1D_READ_MISSES,
+    COUNTER_COUNT
+  };
+
+  /**
+   * Opens the counters, stopped and at 0.
+   */
+  PerfCounters();
+
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  /**
+   * Returns true if the counter could be opened.
+   */
+  bool isAvailable(Counter counter) const { return fds[counter] >= 0; }
+
+  /**
+   * Starts counting, adding to the counts so far.
+   */
+  void start();
+
+  /**
+   * Stops counting.
+   */
+  void stop();
+
+  /**
+   * Returns the count of an event while the counters ran.
+   */
+  std::uint64_t get(Counter counter) const;
+
+  /**
+   * Returns a short name of the counter, for reports.
+   */
+  static const char* getName(Counter counter);
+
+  private:
+
+  /**
+   * The file descriptors of the counters, -1 for the unavailable ones.
+   */
+  int fds[COUNTER_COUNT];
+};
+
+} // namespace g3
+
+#endif // PERFCOUNTERS_H
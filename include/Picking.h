@@ -0,0 +1,126 @@
+
+#ifndef PICKING_H
+#define PICKING_H
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "Bvh.h"
+#include "Geometry.h"
+#include "Kernels.h"
+#include "Mesh.h"
+#include "Scene.h"
+
+namespace g3
+{
+
+/**
+ * TRIANGLE_PACKET_SIZE triangles of a mesh in the layout of
+ * Kernels::intersectTriangles.
+ */
+struct alignas(32) TrianglePacket
+{
+  /**
+   * The first corners, then the first and the second edges, per axis.
+   */
+  float data[9][TRIANGLE_PACKET_SIZE];
+
+  /**
+   * The face index of every lane.
+   */
+  unsigned int faces[TRIANGLE_PACKET_SIZE];
+};
+
+/**
+ * A bounding volume hierarchy over the triangles of a mesh, for ray casting.
+ *
+ * The triangles are sorted along a Morton curve and grouped into packets of
+ * neighbouring triangles, so that the leaves of the tree are packets that
+ * are tested at once by the SIMD kernels.
+ */
+class TriangleBvh
+{
+  public:
+
+  /**
+   * Builds the tree over the faces of the mesh as they are now.
+   */
+  explicit TriangleBvh(const TriangleMesh& mesh);
+
+  /**
+   * Finds the closest face that a ray in model space hits.
+   *
+   * @param distance Hits at or beyond it are ignored, receives the distance
+   * of the hit in units of the ray direction.
+   * @param face Receives the index of the face hit.
+   * @return true if a face was hit.
+   */
+  bool intersect(const Ray& ray, float& distance, unsigned int& face) const;
+
+  private:
+
+  /**
+   * The triangles.
+   */
+  std::vector<TrianglePacket> packets;
+
+  /**
+   * The tree over the packets.
+   */
+  Bvh bvh;
+};
+
+/**
+ * The result of picking.
+ */
+struct PickHit
+{
+  /**
+   * The index of the instance hit, -1 if nothing was hit.
+   */
+  int instance;
+
+  /**
+   * The index of the face hit in the mesh of the instance.
+   */
+  unsigned int face;
+
+  /**
+   * The distance from the origin of the ray to the hit, in world units if
+   * the ray direction is normalized.
+   */
+  float distance;
+};
+
+/**
+ * Finds the face under a ray among mesh instances. The triangle trees of the
+ * meshes are built on their first use and kept, so meshes must not change
+ * while a picker refers to them.
+ */
+class Picker
+{
+  public:
+
+  /**
+   * Casts a world space ray at the instances.
+   *
+   * @param scene The hierarchy over the instances, up to date.
+   */
+  PickHit pick(const std::vector<MeshInstance>& instances, const SceneBvh& scene, const Ray& ray);
+
+  /**
+   * Returns the triangle tree of a mesh, building it on first use.
+   */
+  const TriangleBvh& getTriangleBvh(const TriangleMesh& mesh);
+
+  private:
+
+  /**
+   * The triangle trees of the meshes picked so far.
+   */
+  std::unordered_map<const TriangleMesh*, std::unique_ptr<TriangleBvh>> meshes;
+};
+
+} // namespace g3
+
+#endif // PICKING_H
@@ -0,0 +1,223 @@
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+namespace g3
+{
+
+/**
+ * A completed profile zone.
+ */
+struct ProfileEvent
+{
+  /**
+   * The name of the zone. Must be a string literal.
+   */
+  const char* name;
+
+  /**
+   * Start and end time stamps in profiler ticks.
+   */
+  std::uint64_t start, end;
+};
+
+/**
+ * A ring buffer of the zones completed by one thread.
+ *
+ * Only the owning thread writes it, so recording an event needs no locking;
+ * once the ring is full the oldest events are overwritten.
+ */
+struct ProfileBuffer
+{
+  /**
+   * The number of events in the ring, a power of two.
+   */
+  static constexpr std::size_t CAPACITY = 1 << 14;
+
+  ProfileBuffer(unsigned int threadId): threadId {threadId}, count {0} {}
+
+  /**
+   * Records an event. Called by the owning thread only.
+   */
+  void record(const char* name, std::uint64_t start, std::uint64_t end)
+  {
+    std::uint64_t n = count.load(std::memory_order_relaxed);
+    ProfileEvent& event = events[n & (CAPACITY - 1)];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    count.store(n + 1, std::memory_order_release);
+  }
+
+  /**
+   * A small, stable number identifying the thread in the trace.
+   */
+  unsigned int threadId;
+
+  /**
+   * The number of events recorded so far.
+   */
+  std::atomic<std::uint64_t> count;
+
+  /**
+   * The events.
+   */
+  ProfileEvent events[CAPACITY];
+};
+
+/**
+ * Collects profile zones from every thread and exports them in the Chrome
+ * trace event format (load the file in chrome://tracing or Perfetto).
+ *
+ * Time stamps come from the time stamp counter where available and from
+ * CLOCK_MONOTONIC otherwise. A zone costs two time stamp reads and a few
+ * stores into a thread local buffer, so profiling can stay enabled in
+ * release builds. Define G3_NO_PROFILER to compile the zones out entirely.
+ */
+class Profiler
+{
+  public:
+
+  /**
+   * Returns the profiler of the process.
+   */
+  static Profiler& get();
+
+  /**
+   * Returns the current time stamp in profiler ticks.
+   */
+  static std::uint64_t now()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+#endif
+  }
+
+  /**
+   * Returns the buffer of the calling thread, creating it on first use.
+   */
+  ProfileBuffer& getThreadBuffer()
+  {
+    static thread_local ProfileBuffer* buffer = nullptr;
+    if (buffer == nullptr) {
+      buffer = createThreadBuffer();
+    }
+    return *buffer;
+  }
+
+  /**
+   * Enables or disables recording. Enabled by default.
+   */
+  void setEnabled(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+
+  bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+  /**
+   * Writes the recorded zones of every thread as Chrome trace event JSON.
+   * Can be called while other threads keep recording; events overwritten
+   * during the export are left out.
+   */
+  void writeChromeTrace(std::ostream& out) const;
+
+  /**
+   * Returns the number of profiler ticks per nanosecond, measured against
+   * CLOCK_MONOTONIC since the profiler was created.
+   */
+  double getTicksPerNanosecond() const;
+
+  private:
+
+  Profiler();
+
+  /**
+   * Registers a buffer for the calling thread.
+   */
+  ProfileBuffer* createThreadBuffer();
+
+  /**
+   * Whether zones are recorded.
+   */
+  std::atomic<bool> enabled;
+
+  /**
+   * Time stamp and monotonic time in nanoseconds when the profiler was
+   * created, used to convert ticks to time.
+   */
+  std::uint64_t startTicks, startTime;
+
+  /**
+   * Guards buffers.
+   */
+  mutable std::mutex buffersMutex;
+
+  /**
+   * The buffers of every thread that ever recorded a zone. They are kept
+   * after their thread finished so that its zones can still be exported.
+   */
+  std::vector<std::unique_ptr<ProfileBuffer>> buffers;
+};
+
+/**
+ * Records the lifetime of a scope as a profile zone.
+ */
+class ProfileZone
+{
+  public:
+
+  /**
+   * @param name The name of the zone. Must be a string literal.
+   */
+  explicit ProfileZone(const char* name):
+  name {Profiler::get().isEnabled() ? name : nullptr},
+  start {this->name ? Profiler::now() : 0}
+  {
+  }
+
+  ~ProfileZone()
+  {
+    if (name) {
+      Profiler::get().getThreadBuffer().record(name, start, Profiler::now());
+    }
+  }
+
+  ProfileZone(const ProfileZone&) = delete;
+  ProfileZone& operator=(const ProfileZone&) = delete;
+
+  private:
+
+  const char* name;
+  std::uint64_t start;
+};
+
+} // namespace g3
+
+#define G3_PROFILE_CONCAT_(a, b) a##b
+#define G3_PROFILE_CONCAT(a, b) G3_PROFILE_CONCAT_(a, b)
+
+/**
+ * Profiles the rest of the enclosing scope under the given name.
+ */
+#ifdef G3_NO_PROFILER
+#define G3_PROFILE_ZONE(name)
+#else
+#define G3_PROFILE_ZONE(name) g3::ProfileZone G3_PROFILE_CONCAT(profileZone, __LINE__) (name)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,738 @@
+
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Arena.h"
+#include "Camera.h"
+#include "DirtyRegions.h"
+#include "FrameBuffer.h"
+#include "Geometry.h"
+#include "Lighting.h"
+#include "Mat.h"
+#include "Scene.h"
+#include "SampleBuffer.h"
+#include "ShadowMap.h"
+#include "StaticLayer.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+#include "Upscaler.h"
+
+namespace g3
+{
+
+/**
+ * How the meshes are drawn.
+ */
+enum class ShadingMode
+{
+  /**
+   * The edges of the faces in the color of the instance.
+   */
+  WIREFRAME,
+
+  /**
+   * Filled faces, each lit once at its center with its face normal.
+   */
+  FLAT,
+
+  /**
+   * Filled faces with the colors of their lit vertices interpolated across
+   * them (Gouraud shading).
+   */
+  GOURAUD
+};
+
+/**
+ * Returns the name of a shading mode: wireframe, flat or gouraud.
+ */
+const char* getShadingModeName(ShadingMode mode);
+
+/**
+ * Parses the name of a shading mode.
+ *
+ * @return false if the name is unknown.
+ */
+bool parseShadingMode(const char* name, ShadingMode& mode);
+
+/**
+ * The state that a frame is rendered from. It is a copy of everything the
+ * renderer needs that the GUI thread may change while a frame is drawn.
+ */
+struct FrameState
+{
+  /**
+   * The camera that we look from.
+   */
+  Camera camera;
+
+  /**
+   * The meshes to render.
+   */
+  std::vector<MeshInstance> instances;
+
+  /**
+   * How the meshes are drawn.
+   */
+  ShadingMode shading = ShadingMode::WIREFRAME;
+
+  /**
+   * The lights of the filled shading modes.
+   */
+  Lighting lighting;
+
+  /**
+   * How the textures of the instances are sampled.
+   */
+  TextureFilter textureFilter = TextureFilter::BILINEAR;
+
+  /**
+   * Whether the filled shading modes go through the visibility buffer: the
+   * faces are rasterized into the depth buffer and a buffer of triangle
+   * identifiers only, and a single pass over the screen then shades every
+   * visible pixel once, whatever the depth complexity.
+   */
+  bool visibilityBuffer = false;
+
+  /**
+   * Whether the first directional light casts shadows in the filled
+   * shading modes. The scene is rendered from the light into a shadow map
+   * first, in a pass that writes depth only.
+   */
+  bool shadows = false;
+
+  /**
+   * The width and the height of the shadow map in texels.
+   */
+  unsigned int shadowMapSize = 1024;
+
+  /**
+   * Whether the edges of the faces and the lines are antialiased with 4
+   * samples per pixel. The coverage and the depth are per sample, the
+   * shading once per pixel. The visibility buffer is not used with it.
+   */
+  bool msaa = false;
+
+  /**
+   * Whether only the regions of the target that changed since it was last
+   * drawn into are redrawn, see DirtyRegions. The frame changes where the
+   * world matrices of the instances do; anything else that changes, the
+   * camera, the lights, the shading or the set of instances, redraws the
+   * whole frame, and so does every frame with shadows. The meshes and the
+   * textures themselves are taken not to change.
+   */
+  bool dirtyRegions = false;
+
+  /**
+   * The resolution the frame is rendered at, as a share of the target's in
+   * each direction. Below 1 the frame is rendered into a smaller buffer and
+   * scaled up to the target with bilinear filtering, which trades the
+   * sharpness for the time of the pixels.
+   */
+  float resolutionScale = 1;
+
+  /**
+   * The lowest resolution scale a user can ask for.
+   */
+  static constexpr float MIN_USER_RESOLUTION_SCALE = 0.1f;
+
+  /**
+   * How much work the renderer should leave out, 0 is full detail.
+   * See FrameScheduler::getDetailLevel.
+   */
+  unsigned int detailLevel = 0;
+};
+
+/**
+ * Implements the graphics pipeline. It does not depend on the GUI, so it can
+ * run on any thread and render into any frame buffer.
+ */
+class Renderer
+{
+  public:
+
+  Renderer();
+
+  /**
+   * Renders the scene into the target buffer, at the resolution scale of
+   * the state.
+   */
+  void render(FrameBuffer& target, const FrameState& state);
+
+  /**
+   * Returns the buffer that the last frame rendered at a resolution scale
+   * below 1 was rendered into, or nullptr.
+   */
+  const FrameBuffer* getScaledTarget() const { return scaledTarget.get(); }
+
+  /**
+   * Renders the depth of the faces of the scene that face the camera into
+   * the target, leaving its colors alone. It is the pass that fills shadow
+   * maps, through the camera; its cost against render is the cost of the
+   * colors.
+   */
+  void renderDepth(FrameBuffer& target, const FrameState& state);
+
+  /**
+   * Returns the shadow map of the last frame rendered with shadows.
+   */
+  const ShadowMap& getShadowMap() const { return shadowMap; }
+
+  /**
+   * Returns the counters of the last rendered frame. The render time is
+   * left for the caller to fill in.
+   */
+  const FrameStats& getStats() const { return lastStats; }
+
+  /**
+   * Enables counting the covered pixels after each frame, which is needed
+   * for the overdraw ratio but costs a pass over the depth buffer.
+   */
+  void setCountCoverage(bool enable) { countCoverage = enable; }
+
+  /**
+   * Sets the threads that clear the target, transform the vertices and
+   * rasterize the faces of large meshes, and shade the visibility buffer.
+   * The pool of the engine is used by default.
+   */
+  void setThreadPool(ThreadPool& pool) { this->pool = &pool; }
+
+  private:
+
+  /**
+   * A vertex of a triangle being filled.
+   */
+  struct RasterVertex
+  {
+    /**
+     * The window coordinates and the depth.
+     */
+    float x, y, z;
+
+    /**
+     * The inverse of the clip space w, which interpolates linearly on the
+     * screen, like the texture coordinates divided by w.
+     */
+    float invW;
+
+    /**
+     * The texture coordinates.
+     */
+    float u, v;
+
+    /**
+     * The lit color.
+     */
+    Color color;
+
+    /**
+     * The light of the shadow casting light in the color, which the
+     * shadows take away.
+     */
+    Color sunColor;
+
+    /**
+     * The shadow map coordinates.
+     */
+    float sx, sy, sz;
+  };
+
+  /**
+   * A depth buffer to rasterize into, and the pixels of it that may be
+   * drawn.
+   */
+  struct DepthTarget
+  {
+    float* depth;
+    std::size_t stride;
+    ScreenRect bounds;
+
+    /**
+     * The counters of the tested and the written pixels.
+     */
+    FrameStats* stats;
+  };
+
+  /**
+   * Interpolates the attributes of a triangle and shades its pixels. Its
+   * features, a texture, the filter and the shadows, are bits of a number
+   * that selects an instantiation of the pixel loops, so that the loops do
+   * not test them per pixel.
+   */
+  struct TriangleShader;
+
+  /**
+   * The faces of a mesh instance drawn into the visibility buffer, kept
+   * until the shading pass.
+   */
+  struct VisibilityDraw
+  {
+    /**
+     * The identifier of the first face of the mesh; face i is firstId + i.
+     */
+    std::uint32_t firstId;
+
+    const TriangleMesh* mesh;
+
+    /**
+     * The vertices of the mesh on the screen, in the frame arena.
+     */
+    const RasterVertex* vertices;
+
+    /**
+     * The lit color of every face in flat shading, nullptr in Gouraud
+     * shading, and the light of the shadow casting light in it.
+     */
+    const Color* faceColors;
+    const Color* faceSunColors;
+
+    const Texture* texture;
+  };
+
+  /**
+   * Renders the scene into the target buffer at its full resolution.
+   */
+  void renderFrame(FrameBuffer& target, const FrameState& state);
+
+  /**
+   * Counts the pixels of the target whose depth was written.
+   */
+  unsigned long countCoveredPixels() const;
+
+  /**
+   * Clears the buffers within the scissor rectangle.
+   */
+  void clear();
+
+  /**
+   * Compares the frame with the last one and finds the regions of the
+   * target that must be redrawn, when the frame state asks for it.
+   *
+   * @return False if the whole target must be redrawn.
+   */
+  bool findDirtyRegions(const Mat4& viewProjMat);
+
+  /**
+   * Returns the rectangle of the window that the bounds of an instance
+   * cover, with a margin for the lines, or the whole window if they reach
+   * behind the camera.
+   *
+   * @param toWindow The matrix from world space to the window coordinates.
+   */
+  ScreenRect getScreenRect(const Aabb& bounds, const Mat4& toWindow) const;
+
+  /**
+   * Clears the scissor rectangle of the target and draws the scene into
+   * it.
+   *
+   * @param dirty Whether the instances that do not cover the scissor
+   * rectangle by their screen rectangle are left out.
+   */
+  void renderScissor(const Mat4& viewProjMat, bool deferred, bool dirty);
+
+  /**
+   * Renders the wireframe of a mesh instance.
+   */
+  void renderWireframe(const MeshInstance& instance, const TriangleMesh& mesh, const Mat4& viewProjMat);
+
+  /**
+   * Renders the lit, filled faces of a mesh instance that face the camera.
+   */
+  void renderShaded(const MeshInstance& instance, const TriangleMesh& mesh, const Mat4& viewProjMat);
+
+  /**
+   * Rasterizes the faces of a mesh instance into a depth buffer only.
+   *
+   * @param toWindow The matrix from model space to the window coordinates
+   * and the depth of the target.
+   * @param cullBackFaces Whether the faces seen from behind by the camera
+   * are left out.
+   */
+  void renderDepthOnly(const MeshInstance& instance, const TriangleMesh& mesh, const Mat4& toWindow,
+                       const DepthTarget& depthTarget, bool cullBackFaces);
+
+  /**
+   * Renders the shadow map of the first directional light.
+   */
+  void renderShadowMap(const Mat4& viewProjMat);
+
+  /**
+   * Starts a frame: sets the target and the state, and resets the counters
+   * and the frame arena.
+   */
+  void beginFrame(FrameBuffer& target, const FrameState& state);
+
+  /**
+   * Returns the matrix from clip space to the window coordinates of the
+   * target, the inverse of which mapXToWin and mapYToWin do after the
+   * perspective division.
+   */
+  Mat4 createWindowMatrix() const;
+
+  /**
+   * Returns the depth buffer of the target, within the scissor rectangle.
+   */
+  DepthTarget getDepthTarget();
+
+  /**
+   * Selects the level of detail of an instance by its size on the screen.
+   *
+   * @param index The index of the instance in the frame state.
+   */
+  const TriangleMesh& selectMesh(unsigned int index, const Mat4& viewProjMat) const;
+
+  /**
+   * Renders the axes and the grid ground.
+   */
+  void renderAxesAndGrid(const Mat4& viewProjMat);
+
+  /**
+   * Captures the axes and the grid into the static layer once the view of
+   * the frame has held for two frames, so that the next frames of the view
+   * merge them rather than draw them.
+   *
+   * @return Whether the frame merges the static layer.
+   */
+  bool prepareStaticLayer(const Mat4& viewProjMat);
+
+  /**
+   * Maps the x coordinate to the window coordinate system
+   */
+  int mapXToWin(float x);
+
+  /**
+   * Maps the y coordinate to the window coordinate system
+   */
+  int mapYToWin(float y);
+
+  /**
+   * Draws a point on the screen.
+   */
+  void drawPoint(int x, int y, float z, Color color);
+
+  /**
+   * Draws a line.
+   */
+  void drawLine(int x0, int y0, float z0, int x1, int y1, float z1, Color color);
+
+  /**
+   * Draws a line of a pixel's width into the samples, as a quad of two
+   * triangles between window coordinates.
+   */
+  void drawLineMultisample(float x0, float y0, float z0, float x1, float y1, float z1, Color color);
+
+  /**
+   * Fills a triangle, interpolating the depth and the colors of its
+   * vertices. With a texture, the texture coordinates are interpolated in
+   * perspective and the sampled texels are modulated by the colors.
+   */
+  void drawTriangle(const DepthTarget& depthTarget, const RasterVertex& v0, const RasterVertex& v1,
+                    const RasterVertex& v2, const Texture* texture);
+
+  /**
+   * Fills a triangle with the pixel loop of a combination of the features
+   * of the shader, which drawTriangle picks from a table.
+   */
+  template <unsigned int FEATURES>
+  void fillTriangle(const DepthTarget& depthTarget, const TriangleShader& shader, const RasterVertex& v0,
+                    const RasterVertex& v1, const RasterVertex& v2);
+
+  /**
+   * Shades the pixels [first, last) of a row of the visibility buffer, which
+   * show the face of the shader, with the pixel loop of its features.
+   */
+  template <unsigned int FEATURES>
+  void shadeSpan(const TriangleShader& shader, unsigned int y, unsigned int first, unsigned int last) const;
+
+  /**
+   * Rasterizes a triangle into the depth buffer and, where it is visible,
+   * writes its identifier into the visibility buffer.
+   */
+  void drawTriangleVisibility(const DepthTarget& depthTarget, const RasterVertex& v0, const RasterVertex& v1,
+                              const RasterVertex& v2, std::uint32_t id);
+
+  /**
+   * Draws the faces of a mesh in parallel over bands of rows of the scissor
+   * rectangle. The faces are sorted into bins by the bands they reach, in
+   * their order, and the thread of a band calls draw(depthTarget, face) for
+   * the faces of its bin with a depth target limited to the band, so that
+   * every pixel sees the faces in the same order as when drawn one after
+   * the other.
+   *
+   * @param raster The window coordinates of the vertices of the mesh.
+   * @param faces The indices of the faces to draw.
+   */
+  template <class DrawFunction>
+  void drawBinned(const TriangleMesh& mesh, const RasterVertex* raster, const unsigned int* faces,
+                  unsigned int faceCount, DrawFunction draw);
+
+  /**
+   * Calls pixel(index, b1, b2) for every pixel of a triangle that passes
+   * the depth test, after writing its depth. b1 and b2 are the weights of
+   * the second and the third vertex at the pixel center. With a pixel
+   * function that does nothing, this is the depth only path of the depth
+   * passes: the compiler leaves out everything but the depth.
+   */
+  template <class PixelFunction>
+  void rasterize(const DepthTarget& depthTarget, const RasterVertex& v0, const RasterVertex& v1,
+                 const RasterVertex& v2, PixelFunction pixel);
+
+  /**
+   * Rasterizes a triangle into the samples of the target: the coverage and
+   * the depth test are per sample, and shade(b1, b2) is called once for
+   * every pixel where a sample passes, with the weights of the second and
+   * the third vertex at the centroid of the covered samples. The pixels
+   * that the triangle covers entirely in a compressed tile are drawn like
+   * without multisampling.
+   */
+  template <class ShadeFunction>
+  void rasterizeMultisample(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2,
+                            ShadeFunction shade);
+
+  /**
+   * Sizes the visibility buffer to the target, cleared.
+   */
+  void prepareVisibilityBuffer();
+
+  /**
+   * Shades the pixels of the visibility buffer within the scissor
+   * rectangle, in parallel over the rows.
+   */
+  void shadeVisibilityBuffer();
+
+  /**
+   * Shades the pixels of the visibility buffer in the rows [first, last)
+   * of the scissor rectangle and clears them for the next frame.
+   *
+   * @return The number of shaded pixels.
+   */
+  unsigned long shadeVisibilityRows(unsigned int first, unsigned int last);
+
+  /**
+   * The threads of the parallel loops of the frames.
+   */
+  ThreadPool* pool;
+
+  /**
+   * The hierarchy the instances are culled with, refitted every frame.
+   */
+  SceneBvh sceneBvh;
+
+  /**
+   * The transient arrays of the frame being rendered, released at the start
+   * of the next frame.
+   */
+  FrameArena arena;
+
+  /**
+   * The depth of the scene seen from the shadow casting light.
+   */
+  ShadowMap shadowMap;
+
+  /**
+   * Whether the shadow map of the frame being rendered is in use.
+   */
+  bool shadowing;
+
+  /**
+   * The samples of the frame being rendered with multisampling.
+   */
+  SampleBuffer samples;
+
+  /**
+   * Whether the frame being rendered is multisampled.
+   */
+  bool multisampling;
+
+  /**
+   * The identifiers of the visible faces, 0 where there is none, with the
+   * stride of the target. The shading pass leaves it cleared.
+   */
+  std::unique_ptr<std::uint32_t[], AlignedDeleter> visibility;
+
+  /**
+   * The number of identifiers the visibility buffer holds.
+   */
+  std::size_t visibilitySize;
+
+  /**
+   * The meshes drawn into the visibility buffer this frame, in the order of
+   * their identifiers.
+   */
+  std::vector<VisibilityDraw> visibilityDraws;
+
+  /**
+   * The identifier of the next face drawn into the visibility buffer.
+   */
+  std::uint32_t nextVisibilityId;
+
+  /**
+   * The buffer that frames below full resolution are rendered into before
+   * they are scaled up, and their state, whose zoom is scaled down with the
+   * resolution.
+   */
+  std::unique_ptr<FrameBuffer> scaledTarget;
+  FrameState scaledState;
+
+  /**
+   * Scales the frames below full resolution up to their targets.
+   */
+  Upscaler upscaler;
+
+  /**
+   * The axes and the grid of the last view that held for two frames, and
+   * the view of the last frame.
+   */
+  StaticLayer staticLayer;
+  StaticLayer::View lastView;
+
+  /**
+   * The buffer the axes and the grid are drawn into to be captured, kept
+   * from view to view.
+   */
+  std::unique_ptr<FrameBuffer> layerTarget;
+
+  /**
+   * Whether the frame being rendered merges the static layer.
+   */
+  bool layered;
+
+  /**
+   * The changes from frame to frame, and the regions of the target to
+   * redraw in the frame being rendered.
+   */
+  DirtyRegions dirtyRegions;
+  std::vector<ScreenRect> regions;
+
+  /**
+   * The state of the last frame rendered with dirty regions, and the
+   * screen rectangles of its instances and of those of the frame being
+   * rendered.
+   */
+  FrameState previousState;
+  std::vector<ScreenRect> previousInstanceRects;
+  std::vector<ScreenRect> instanceRects;
+
+  /**
+   * The pixels of the target that the frame being rendered draws into.
+   */
+  ScreenRect scissor;
+
+  /**
+   * The buffer of the frame being rendered.
+   */
+  FrameBuffer* target;
+
+  /**
+   * The state of the frame being rendered.
+   */
+  const FrameState* state;
+
+  /**
+   * The counters of the frame being rendered, frameStats but during the
+   * shadow pass. They belong to the renderer rather than to the thread: a
+   * thread waiting for a parallel loop may render the frame of another
+   * renderer in the meantime.
+   */
+  FrameStats* stats;
+  FrameStats frameStats;
+
+  /**
+   * The counters of the last rendered frame.
+   */
+  FrameStats lastStats;
+
+  /**
+   * Whether the covered pixels are counted.
+   */
+  bool countCoverage;
+
+  /**
+   * The width of the target buffer.
+   */
+  unsigned int width;
+
+  /**
+   * The height of the target buffer.
+   */
+  unsigned int height;
+};
+
+/**
+ * The vertical field of view of the camera in radians.
+ */
+const float FIELD_OF_VIEW = 0.78f;
+
+/**
+ * The distance of the near plane from the camera.
+ */
+const float NEAR_PLANE = 0.01f;
+
+/**
+ * The distance of the far plane from the camera.
+ */
+const float FAR_PLANE = 25.0f;
+
+/**
+ * The largest error, in pixels, that a level of detail may show at full
+ * detail. It doubles with every detail level the scheduler drops.
+ */
+const float LOD_PIXEL_ERROR = 0.5f;
+
+/**
+ * The number of rows of the visibility buffer shaded by a task of the
+ * shading pass.
+ */
+const unsigned int VISIBILITY_ROWS_PER_TASK = 8;
+
+/**
+ * The number of rows cleared by a task of the clear.
+ */
+const unsigned int CLEAR_ROWS_PER_TASK = 32;
+
+/**
+ * The number of vertices transformed and lit by a task.
+ */
+const unsigned int VERTICES_PER_TASK = 2048;
+
+/**
+ * The number of faces of a mesh from which they are binned and rasterized
+ * in parallel, when the renderer has more than one thread.
+ */
+const unsigned int BINNED_FACES = 256;
+
+/**
+ * The number of rows of a band of the binned rasterization.
+ */
+const unsigned int ROWS_PER_BAND = 32;
+
+/**
+ * Creates the view projection matrix the renderer uses for a camera.
+ *
+ * @param aspectRatio The width of the target divided by its height.
+ */
+Mat4 createViewProjMatrix(const Camera& camera, float aspectRatio);
+
+/**
+ * Returns the frustum that the renderer shows of the world through a camera
+ * into a target of the given size.
+ */
+Frustum createViewFrustum(const Camera& camera, unsigned int width, unsigned int height);
+
+/**
+ * Creates the world space ray through a point of a target of the given size,
+ * for picking. The ray starts at the near plane and its direction is
+ * normalized, so distances along it are in world units.
+ */
+Ray createPickingRay(const Camera& camera, unsigned int width, unsigned int height, float x, float y);
+
+/**
+ * The color the frame is cleared with.
+ */
+const Color CLEAR_COLOR = createRGBA(0xfa, 0xfa, 0xd2, 0xff);
+
+} // namespace g3
+
+#endif // RENDERER_H
@@ -0,0 +1,144 @@
+
+#ifndef SAMPLEBUFFER_H
+#define SAMPLEBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "FrameBuffer.h"
+
+namespace g3
+{
+
+/**
+ * The samples of 4x multisampling, stored compressed by tiles of the frame
+ * buffer. A tile starts out compressed: each of its pixels has 4 equal
+ * samples, held by the color and the depth of the frame buffer itself. A
+ * triangle or a line that covers only some samples of a pixel expands its
+ * tile into a block of 4 colors and depths per pixel, and resolve averages
+ * the samples of the expanded tiles back into the frame buffer. The
+ * interiors of the faces keep their tiles compressed, so the memory and the
+ * resolve stay close to those of a single sample.
+ */
+class SampleBuffer
+{
+  public:
+
+  /**
+   * The number of samples of a pixel.
+   */
+  static const unsigned int SAMPLES = 4;
+
+  /**
+   * The width and the height of a tile in pixels.
+   */
+  static const unsigned int TILE_SIZE = 4;
+
+  /**
+   * The positions of the samples relative to the pixel center, on a
+   * rotated grid so that near horizontal and near vertical edges both get
+   * 4 steps of coverage.
+   */
+  static constexpr float SAMPLE_X[SAMPLES] { -0.125f, 0.375f, -0.375f, 0.125f };
+  static constexpr float SAMPLE_Y[SAMPLES] { -0.375f, -0.125f, 0.125f, 0.375f };
+
+  /**
+   * The coverage mask of a pixel whose samples are all covered.
+   */
+  static const unsigned int FULL_MASK = (1u << SAMPLES) - 1;
+
+  /**
+   * The samples of an expanded tile, pixel after pixel, row after row.
+   */
+  struct Tile
+  {
+    float depth[TILE_SIZE * TILE_SIZE][SAMPLES];
+    Color color[TILE_SIZE * TILE_SIZE][SAMPLES];
+  };
+
+  SampleBuffer();
+
+  SampleBuffer(const SampleBuffer&) = delete;
+  SampleBuffer& operator=(const SampleBuffer&) = delete;
+
+  /**
+   * Compresses every tile for a frame of the given size. The blocks of the
+   * expanded tiles are kept for the next frames.
+   */
+  void reset(unsigned int width, unsigned int height);
+
+  /**
+   * Returns the samples of the tile of a pixel, or nullptr while the tile
+   * is compressed.
+   */
+  Tile* getTile(unsigned int x, unsigned int y) const
+  {
+    std::uint32_t block = tiles[(y / TILE_SIZE) * tilesX + x / TILE_SIZE];
+    return block ? blocks[block - 1].get() : nullptr;
+  }
+
+  /**
+   * Returns the index of a pixel in its tile.
+   */
+  static unsigned int indexInTile(unsigned int x, unsigned int y)
+  {
+    return (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+  }
+
+  /**
+   * Expands the compressed tile of a pixel: every sample takes the color
+   * and the depth of its pixel in the target.
+   */
+  Tile* expand(unsigned int x, unsigned int y, const FrameBuffer& target);
+
+  /**
+   * Writes the average color and the nearest depth of the samples of every
+   * expanded tile into the target.
+   */
+  void resolve(FrameBuffer& target) const;
+
+  /**
+   * Returns the number of tiles expanded since the last reset.
+   */
+  std::size_t getExpandedTileCount() const { return expanded.size(); }
+
+  /**
+   * Returns the memory the samples of the frame take beyond the frame
+   * buffer, in bytes: the tile table and the blocks of the expanded tiles.
+   */
+  std::size_t getMemorySize() const;
+
+  /**
+   * Returns the position of the centroid of the covered samples of a pixel,
+   * relative to the pixel center. It is inside the triangle that covers
+   * them, unlike the pixel center on the edges.
+   */
+  static void getCentroid(unsigned int mask, float& x, float& y);
+
+  private:
+
+  /**
+   * The number of tiles along x and y.
+   */
+  unsigned int tilesX, tilesY;
+
+  /**
+   * The block of every tile plus 1, 0 where it is compressed.
+   */
+  std::vector<std::uint32_t> tiles;
+
+  /**
+   * The indices of the expanded tiles, for resolving and resetting them.
+   */
+  std::vector<unsigned int> expanded;
+
+  /**
+   * The blocks, the first expanded.size() of which are in use.
+   */
+  std::vector<std::unique_ptr<Tile>> blocks;
+};
+
+} // namespace g3
+
+#endif // SAMPLEBUFFER_H
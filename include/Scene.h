@@ -0,0 +1,138 @@
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+#include "Bvh.h"
+#include "FrameBuffer.h"
+#include "Geometry.h"
+#include "Lod.h"
+#include "Mat.h"
+#include "Mesh.h"
+#include "Texture.h"
+
+namespace g3
+{
+
+/**
+ * The color meshes are drawn with by default.
+ */
+const Color WIREFRAME_COLOR = createRGBA(0, 0, 128, 255);
+
+/**
+ * A mesh placed in the world. Many instances may share a mesh.
+ */
+struct MeshInstance
+{
+  /**
+   * The geometry. It must outlive the instance and not change while it is
+   * rendered.
+   */
+  const TriangleMesh* mesh;
+
+  /**
+   * The model to world transformation.
+   */
+  Mat4 worldMatrix;
+
+  /**
+   * The color of the wireframe.
+   */
+  Color color = WIREFRAME_COLOR;
+
+  /**
+   * The levels of detail of the mesh, or nullptr to always draw the mesh
+   * itself. Like the mesh, they must outlive the instance.
+   */
+  const LodChain* lods = nullptr;
+
+  /**
+   * The texture mapped onto the filled faces by the texture coordinates of
+   * the vertices, or nullptr to fill them with the color. Like the mesh, it
+   * must outlive the instance.
+   */
+  const Texture* texture = nullptr;
+};
+
+/**
+ * Keeps a bounding volume hierarchy over the world space boxes of a list of
+ * instances up to date, for culling and picking.
+ *
+ * Every update refits the tree to the moved instances, and builds it again
+ * only when the number of instances changed or the refitted tree became
+ * REBUILD_COST_RATIO times as expensive as a fresh one.
+ */
+class SceneBvh
+{
+  public:
+
+  /**
+   * How much the cost of the tree may grow by refitting before it is built
+   * again.
+   */
+  static constexpr float REBUILD_COST_RATIO = 1.5f;
+
+  SceneBvh();
+
+  /**
+   * Updates the tree to the current world matrices of the instances.
+   */
+  void update(const std::vector<MeshInstance>& instances);
+
+  /**
+   * Calls visit(instance) with the index of every instance that is not
+   * outside the frustum.
+   */
+  template<class Visitor>
+  void cull(const Frustum& frustum, Visitor visit) const { bvh.cull(frustum, visit); }
+
+  /**
+   * Returns the index of the instance whose box the ray hits first, or -1.
+   *
+   * @param distance Receives the distance along the ray.
+   */
+  int pick(const Ray& ray, float& distance) const;
+
+  /**
+   * Finds the closest instance hit by a ray with a custom test of the
+   * instances, see Bvh::intersect.
+   */
+  template<class HitTest>
+  int intersect(const Ray& ray, float& distance, HitTest hit) const { return bvh.intersect(ray, distance, hit); }
+
+  /**
+   * Returns the world space box of an instance.
+   */
+  const Aabb& getBounds(unsigned int instance) const { return bounds[instance]; }
+
+  /**
+   * Returns how many times the tree has been built.
+   */
+  unsigned int getBuildCount() const { return buildCount; }
+
+  private:
+
+  /**
+   * The tree over the boxes.
+   */
+  Bvh bvh;
+
+  /**
+   * The world space boxes of the instances.
+   */
+  std::vector<Aabb> bounds;
+
+  /**
+   * The cost of the tree right after it was built.
+   */
+  float builtCost;
+
+  /**
+   * How many times the tree has been built.
+   */
+  unsigned int buildCount;
+};
+
+} // namespace g3
+
+#endif // SCENE_H
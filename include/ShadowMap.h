@@ -0,0 +1,95 @@
+
+#ifndef SHADOWMAP_H
+#define SHADOWMAP_H
+
+#include <memory>
+#include "FrameBuffer.h"
+#include "Geometry.h"
+#include "Mat.h"
+#include "Vec.h"
+
+namespace g3
+{
+
+/**
+ * The depth of the scene seen from a directional light, for telling which
+ * points the light reaches. The map is square, and its matrix takes world
+ * space points to map coordinates: x and y in texels, and the depth from
+ * 0 at the light side of the scene to 1 at the other side.
+ */
+class ShadowMap
+{
+  public:
+
+  ShadowMap();
+
+  ShadowMap(const ShadowMap&) = delete;
+  ShadowMap& operator=(const ShadowMap&) = delete;
+
+  /**
+   * Sizes the map to size x size texels. The contents are undefined until
+   * it is cleared.
+   */
+  void resize(unsigned int size);
+
+  /**
+   * Resets every texel to the far side of the scene.
+   */
+  void clear();
+
+  /**
+   * Returns the width and the height of the map in texels.
+   */
+  unsigned int getSize() const { return size; }
+
+  float* getDepthBuffer() { return depth.get(); }
+  const float* getDepthBuffer() const { return depth.get(); }
+
+  /**
+   * Returns the matrix from world space to map coordinates.
+   */
+  const Mat4& getMatrix() const { return matrix; }
+
+  /**
+   * Points the map from a directional light at a box of the world.
+   *
+   * @param direction The direction towards the light.
+   */
+  void setLight(const Vec3& direction, const Aabb& bounds);
+
+  /**
+   * Returns how much of a point in map coordinates the light reaches,
+   * from 0 in full shadow to 1: the fraction of the 3x3 texels around it
+   * that are not nearer the light (percentage closer filtering). Points
+   * off the map are lit.
+   */
+  float getVisibility(float x, float y, float z) const;
+
+  private:
+
+  /**
+   * The depth of every texel, row after row.
+   */
+  std::unique_ptr<float[], AlignedDeleter> depth;
+
+  /**
+   * The width and the height in texels.
+   */
+  unsigned int size;
+
+  /**
+   * The matrix from world space to map coordinates.
+   */
+  Mat4 matrix;
+};
+
+/**
+ * How much nearer the light than a point the map must be for the point to
+ * be in shadow, in map depth. It keeps lit surfaces from shadowing
+ * themselves where the texels of the map step across them.
+ */
+const float SHADOW_BIAS = 0.004f;
+
+} // namespace g3
+
+#endif // SHADOWMAP_H
@@ -0,0 +1,106 @@
+
+#ifndef STATICLAYER_H
+#define STATICLAYER_H
+
+#include <cstddef>
+#include <vector>
+#include "Camera.h"
+#include "FrameBuffer.h"
+
+namespace g3
+{
+
+/**
+ * The pixels that a static part of the scene draws, one that depends on the
+ * view only, kept to be merged into the next frames of the same view rather
+ * than drawn again. The axes and the grid are such a part.
+ *
+ * The pixels are kept row by row, in spans that join the drawn pixels less
+ * than GAP apart: the pixels of a span that were not drawn have an infinite
+ * depth, which the merge leaves alone, and one merge of a span is cheaper
+ * than many of its pieces.
+ */
+class StaticLayer
+{
+  public:
+
+  /**
+   * Drawn pixels of a row closer than this are kept in one span.
+   */
+  static const unsigned int GAP = 16;
+
+  /**
+   * What the layer depends on: the camera and the size of the frame, and
+   * the detail level, which thins out the grid.
+   */
+  struct View
+  {
+    Camera camera;
+    unsigned int width, height;
+    unsigned int detailLevel;
+
+    bool operator==(const View& other) const;
+    bool operator!=(const View& other) const { return !(*this == other); }
+  };
+
+  StaticLayer();
+
+  /**
+   * Returns whether the layer holds the pixels of a view.
+   */
+  bool holds(const View& view) const { return valid && view == this->view; }
+
+  /**
+   * Keeps the pixels of the source whose depth was written as the layer of
+   * a view.
+   */
+  void capture(const FrameBuffer& source, const View& view);
+
+  /**
+   * Forgets the pixels, so that the layer holds no view.
+   */
+  void invalidate() { valid = false; }
+
+  /**
+   * Merges the pixels of the layer in [left, right) x [top, bottom) into
+   * the target, where they are nearer than those of the target.
+   */
+  void merge(FrameBuffer& target, unsigned int left, unsigned int top, unsigned int right, unsigned int bottom) const;
+
+  /**
+   * Returns the number of pixels the spans of the layer hold.
+   */
+  std::size_t getPixelCount() const { return depths.size(); }
+
+  private:
+
+  /**
+   * The pixels [left, right) of row y, at offset in colors and depths.
+   */
+  struct Span
+  {
+    unsigned int y, left, right;
+    std::size_t offset;
+  };
+
+  /**
+   * The spans, row after row and left to right.
+   */
+  std::vector<Span> spans;
+
+  /**
+   * The colors and the depths of the pixels of the spans.
+   */
+  std::vector<Color> colors;
+  std::vector<float> depths;
+
+  /**
+   * Whether the layer holds the pixels of the view.
+   */
+  bool valid;
+  View view;
+};
+
+} // namespace g3
+
+#endif // STATICLAYER_H
@@ -0,0 +1,147 @@
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <iostream>
+
+namespace g3
+{
+
+/**
+ * Counters describing the work done for a frame.
+ */
+struct FrameStats
+{
+  /**
+   * The number of mesh instances rendered.
+   */
+  unsigned long instances;
+
+  /**
+   * The number of mesh instances skipped because they were outside the view.
+   */
+  unsigned long instancesCulled;
+
+  /**
+   * The number of transformed vertices.
+   */
+  unsigned long vertices;
+
+  /**
+   * The number of rasterized triangles.
+   */
+  unsigned long triangles;
+
+  /**
+   * The number of triangles skipped because they faced away from the camera
+   * or reached in front of the near plane.
+   */
+  unsigned long trianglesCulled;
+
+  /**
+   * The number of rasterized lines.
+   */
+  unsigned long lines;
+
+  /**
+   * The number of lines rejected because they were entirely off-screen.
+   */
+  unsigned long linesCulled;
+
+  /**
+   * The number of on-screen pixels that went through the depth test.
+   */
+  unsigned long pixelsTested;
+
+  /**
+   * The number of pixels that passed the depth test and were written.
+   */
+  unsigned long pixelsWritten;
+
+  /**
+   * The number of pixels that failed the depth test.
+   */
+  unsigned long depthRejects;
+
+  /**
+   * The number of pixels rejected because they were off-screen.
+   */
+  unsigned long offscreenRejects;
+
+  /**
+   * The number of pixels whose color was computed by a filled shading mode.
+   * Drawing front to back or into the visibility buffer brings it down to
+   * the covered pixels.
+   */
+  unsigned long pixelsShaded;
+
+  /**
+   * The number of tiles of the frame whose pixels were expanded into 4
+   * samples by multisampling, see SampleBuffer.
+   */
+  unsigned long expandedTiles;
+
+  /**
+   * The memory the samples of multisampling took beyond the frame buffer,
+   * in bytes.
+   */
+  unsigned long sampleBytes;
+
+  /**
+   * The time spent resolving the samples of multisampling into the frame
+   * buffer in nanoseconds.
+   */
+  unsigned long resolveTime;
+
+  /**
+   * The number of pixels cleared and drawn again: the whole frame, or the
+   * regions that changed since the target was last drawn into.
+   */
+  unsigned long redrawnPixels;
+
+  /**
+   * The number of distinct pixels covered at the end of the frame. Only
+   * counted when requested, because it needs a pass over the depth buffer.
+   */
+  unsigned long coveredPixels;
+
+  /**
+   * The time spent rendering the frame in nanoseconds.
+   */
+  unsigned long renderTime;
+
+  /**
+   * Adds the counters of another thread or frame.
+   */
+  FrameStats& operator+=(const FrameStats& other);
+
+  /**
+   * Returns the number of written pixels per covered pixel. 1 means every
+   * pixel was written once.
+   */
+  float getOverdraw() const { return coveredPixels ? pixelsWritten / (float)coveredPixels : 0; }
+
+  /**
+   * Returns the number of depth tested pixels per covered pixel.
+   */
+  float getDepthComplexity() const { return coveredPixels ? pixelsTested / (float)coveredPixels : 0; }
+};
+
+/**
+ * Writes the names of the columns written by writeCsvRow.
+ */
+void writeCsvHeader(std::ostream& out);
+
+/**
+ * Writes the counters of a frame as a line of comma separated values.
+ */
+void writeCsvRow(std::ostream& out, unsigned long frame, const FrameStats& stats);
+
+/**
+ * Prints the counters in a single line.
+ */
+std::ostream& operator<<(std::ostream& out, const FrameStats& stats);
+
+} // namespace g3
+
+#endif // STATS_H
@@ -0,0 +1,106 @@
+
+#ifndef SWAPCHAIN_H
+#define SWAPCHAIN_H
+
+#include <atomic>
+#include <memory>
+#include "FrameBuffer.h"
+
+namespace g3
+{
+
+/**
+ * A lock-free triple buffer between one producer (the render thread) and one
+ * consumer (the GUI thread).
+ *
+ * The producer always owns the back buffer and the consumer always owns the
+ * front buffer. The third buffer holds the most recently completed frame and
+ * is exchanged atomically, so neither side ever waits for the other: the
+ * renderer can start a new frame at once and the consumer always presents
+ * the newest finished one.
+ */
+class SwapChain
+{
+  public:
+
+  /**
+   * The number of buffers in the chain.
+   */
+  static constexpr unsigned int SIZE = 3;
+
+  SwapChain(unsigned int w, unsigned int h);
+
+  SwapChain(const SwapChain&) = delete;
+  SwapChain& operator=(const SwapChain&) = delete;
+
+  /**
+   * Returns the buffer the producer renders into.
+   */
+  FrameBuffer& getBackBuffer() { return *buffers[back]; }
+
+  /**
+   * Returns the index of the back buffer. Data kept per index next to the
+   * buffers is published together with the buffer by present().
+   */
+  unsigned int getBackIndex() const { return back; }
+
+  /**
+   * Publishes the back buffer as the newest completed frame and hands the
+   * producer a new back buffer. Called by the producer.
+   */
+  void present();
+
+  /**
+   * Takes the newest completed frame if there is one. Called by the consumer.
+   *
+   * @return true if the front buffer changed.
+   */
+  bool acquire();
+
+  /**
+   * Returns the buffer the consumer presents.
+   */
+  const FrameBuffer& getFrontBuffer() const { return *buffers[front]; }
+
+  /**
+   * Returns the index of the front buffer.
+   */
+  unsigned int getFrontIndex() const { return front; }
+
+  /**
+   * Returns the buffer at the given index. Only meant for setting up the
+   * buffers before the producer starts.
+   */
+  FrameBuffer& getBuffer(unsigned int ind) { return *buffers[ind]; }
+
+  private:
+
+  /**
+   * Marks that the ready buffer holds a frame the consumer has not seen yet.
+   */
+  static constexpr unsigned int FRESH = 4;
+
+  /**
+   * The buffers.
+   */
+  std::unique_ptr<FrameBuffer> buffers[SIZE];
+
+  /**
+   * Index of the buffer owned by the producer.
+   */
+  unsigned int back;
+
+  /**
+   * Index of the buffer owned by the consumer.
+   */
+  unsigned int front;
+
+  /**
+   * Index of the completed buffer in between, combined with the FRESH flag.
+   */
+  std::atomic<unsigned int> ready;
+};
+
+} // namespace g3
+
+#endif // SWAPCHAIN_H
@@ -0,0 +1,185 @@
+
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "FrameBuffer.h"
+
+namespace g3
+{
+
+/**
+ * How the texels of a texture are laid out in memory.
+ */
+enum class TextureLayout
+{
+  /**
+   * Row after row, like an image file.
+   */
+  LINEAR,
+
+  /**
+   * Along a Morton (Z-order) curve: the bits of x and y are interleaved, so
+   * every aligned 4x4 block of texels fills one cache line and neighbours in
+   * any direction are close in memory. Sampling a rotated surface then
+   * touches about as many cache lines as sampling an upright one.
+   */
+  MORTON
+};
+
+/**
+ * How a texture is sampled.
+ */
+enum class TextureFilter
+{
+  /**
+   * The nearest texel of the nearest mip level.
+   */
+  NEAREST,
+
+  /**
+   * The four nearest texels of the nearest mip level, weighted by distance.
+   */
+  BILINEAR
+};
+
+/**
+ * An image mapped onto surfaces, with its mip chain: every level is half the
+ * size of the one before, down to a single texel, so that minified surfaces
+ * sample a level whose texels are about as big as the pixels.
+ *
+ * The width and the height are powers of two, and the texture repeats in
+ * both directions.
+ */
+class Texture
+{
+  public:
+
+  /**
+   * Creates a texture from a row major image and builds its mip chain.
+   * Throws std::invalid_argument if a size is not a power of two.
+   */
+  Texture(unsigned int width, unsigned int height, const Color* pixels,
+          TextureLayout layout = TextureLayout::MORTON);
+
+  /**
+   * Returns the number of mip levels.
+   */
+  unsigned int getLevelCount() const { return levels.size(); }
+
+  /**
+   * Returns the width of a mip level in texels.
+   */
+  unsigned int getWidth(unsigned int level = 0) const { return levels[level].width; }
+
+  /**
+   * Returns the height of a mip level in texels.
+   */
+  unsigned int getHeight(unsigned int level = 0) const { return levels[level].height; }
+
+  /**
+   * Returns the layout of the texels.
+   */
+  TextureLayout getLayout() const { return layout; }
+
+  /**
+   * Returns a texel of a mip level. The coordinates wrap around.
+   */
+  Color fetch(unsigned int level, int x, int y) const
+  {
+    const Level& l = levels[level];
+    return texels[l.offset + offsetsX[l.offsetsX + (x & (l.width - 1))]
+                           + offsetsY[l.offsetsY + (y & (l.height - 1))]];
+  }
+
+  /**
+   * Samples the texture at texture coordinates u, v, where 0 and 1 are the
+   * edges of the image.
+   *
+   * @param lod The level of detail: the base 2 logarithm of the texels of
+   * the first level per pixel. The level nearest to it is sampled.
+   */
+  Color sample(float u, float v, float lod, TextureFilter filter) const;
+
+  /**
+   * Samples the texture with either filter, see sample; the pixel loops call
+   * the one they were instantiated for rather than testing the filter.
+   */
+  Color sampleNearest(float u, float v, float lod) const;
+  Color sampleBilinear(float u, float v, float lod) const;
+
+  private:
+
+  /**
+   * Returns the mip level nearest to a level of detail.
+   */
+  unsigned int selectLevel(float lod) const
+  {
+    int maxLevel = levels.size() - 1;
+    return (lod > 0) ? std::min((int)(lod + 0.5f), maxLevel) : 0;
+  }
+
+  /**
+   * A mip level.
+   */
+  struct Level
+  {
+    unsigned int width, height;
+
+    /**
+     * The base 2 logarithm of the smaller side.
+     */
+    unsigned int minLog;
+
+    /**
+     * The index of the first texel of the level.
+     */
+    std::size_t offset;
+
+    /**
+     * The index of the first offset of the level in offsetsX and offsetsY.
+     */
+    std::size_t offsetsX, offsetsY;
+  };
+
+  /**
+   * Returns the index of a texel within its level.
+   */
+  std::size_t indexOf(const Level& level, unsigned int x, unsigned int y) const;
+
+  /**
+   * The parts of the indices of the texels of every level that depend on x
+   * and on y, which add up to the index of a texel in either layout, so
+   * fetching a texel takes two lookups rather than interleaving bits.
+   */
+  std::vector<unsigned int> offsetsX, offsetsY;
+
+  /**
+   * The layout of the texels.
+   */
+  TextureLayout layout;
+
+  /**
+   * The mip levels, the full image first.
+   */
+  std::vector<Level> levels;
+
+  /**
+   * The texels of all the levels.
+   */
+  std::unique_ptr<Color[], AlignedDeleter> texels;
+};
+
+/**
+ * Creates a checkerboard texture of size x size texels with cells x cells
+ * squares, shaded towards the edges of every square so filtering shows.
+ */
+Texture createCheckerboardTexture(unsigned int size, unsigned int cells,
+                                  TextureLayout layout = TextureLayout::MORTON);
+
+} // namespace g3
+
+#endif // TEXTURE_H
@@ -0,0 +1,188 @@
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace g3
+{
+
+/**
+ * A fixed set of worker threads for data parallel loops, which share out
+ * the work by stealing it. The thread that calls parallelFor works along
+ * with the workers, so a pool of one thread has no workers and runs the
+ * loops inline.
+ *
+ * Every thread has a deque of tasks, ranges of a loop. A thread splits the
+ * range it runs in halves, pushes one half onto the bottom of its deque and
+ * goes on with the other, until the range is a chunk; idle threads steal
+ * the largest halves from the top of the deques of the others. A thread
+ * waiting for a loop runs tasks meanwhile, so a loop started from within a
+ * chunk runs in parallel as well.
+ *
+ * One thread outside the pool runs a loop on it at a time; a loop started
+ * from another one while the pool is busy runs inline on that thread rather
+ * than waiting, and so does a loop started from within a chunk of another
+ * pool, whose threads are busy already.
+ */
+class ThreadPool
+{
+  public:
+
+  /**
+   * Creates a pool of the given number of threads, the caller included,
+   * or of one per hardware thread if it is 0.
+   *
+   * @param pinned Whether every worker is bound to a processor of its own,
+   * in the order of the processors the process may run on, so that it keeps
+   * its caches. The calling threads are left as they are.
+   */
+  explicit ThreadPool(unsigned int threadCount = 0, bool pinned = false);
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /**
+   * Returns the number of threads that run the loops, the caller included.
+   */
+  unsigned int getThreadCount() const { return threadCount; }
+
+  /**
+   * Returns whether the workers are bound to processors.
+   */
+  bool isPinned() const { return pinned; }
+
+  /**
+   * Calls body(first, last) on consecutive chunks of grain indices of the
+   * range [begin, end), in parallel, and returns when all of them are done.
+   * The body must be safe to call concurrently.
+   */
+  template <class Body>
+  void parallelFor(std::size_t begin, std::size_t end, std::size_t grain, Body body);
+
+  private:
+
+  /**
+   * Calls a type erased body on a chunk.
+   */
+  using ChunkFunction = void (*)(void* body, std::size_t first, std::size_t last);
+
+  /**
+   * A loop being run, on the stack of the thread that waits for it.
+   */
+  struct Loop;
+
+  /**
+   * The deque of tasks of a thread.
+   */
+  struct Deque;
+
+  /**
+   * Runs a loop, see parallelFor. The body is not copied, so a loop does
+   * not allocate.
+   */
+  void run(std::size_t begin, std::size_t end, std::size_t grain, ChunkFunction function, void* body);
+
+  /**
+   * Runs a range of a loop on a thread of the pool, pushing halves of it
+   * onto the deque of the thread.
+   */
+  void runRange(unsigned int thread, Loop& loop, std::size_t first, std::size_t last);
+
+  /**
+   * Takes a task from the deque of a thread, or steals one from another
+   * deque, and runs it.
+   *
+   * @return false if there was no task.
+   */
+  bool runTask(unsigned int thread);
+
+  /**
+   * Wakes up the sleeping workers for new tasks.
+   */
+  void wakeWorkers();
+
+  /**
+   * The body of the worker threads.
+   */
+  void workerLoop(unsigned int thread);
+
+  /**
+   * The number of threads, which the workers read while the others start,
+   * unlike the size of workers.
+   */
+  unsigned int threadCount;
+
+  bool pinned;
+
+  /**
+   * The deques of the threads; the first one is that of the caller.
+   */
+  std::unique_ptr<Deque[]> deques;
+
+  /**
+   * The worker threads.
+   */
+  std::vector<std::thread> workers;
+
+  /**
+   * Held by the thread outside the pool that runs a loop, which has the
+   * first deque.
+   */
+  std::mutex callerMutex;
+
+  /**
+   * Wakes up the sleeping workers.
+   */
+  std::mutex mutex;
+  std::condition_variable wake;
+
+  /**
+   * Incremented whenever a task is pushed, so that a worker does not fall
+   * asleep on a task it missed, and the number of sleeping workers.
+   */
+  std::atomic<unsigned long> epoch;
+  std::atomic<unsigned int> sleepers;
+
+  /**
+   * Tells the workers to exit.
+   */
+  std::atomic<bool> stopping;
+};
+
+/**
+ * Returns the pool shared by the engine, with a thread per hardware thread,
+ * or as many threads as the environment variable G3_THREADS sets. The
+ * workers are pinned if G3_PIN_THREADS is set.
+ */
+ThreadPool& defaultThreadPool();
+
+/**
+ * Calls body(first, last) on consecutive chunks of the range.
+ */
+template <class Body>
+void ThreadPool::parallelFor(std::size_t begin, std::size_t end, std::size_t grain, Body body)
+{
+  if (begin >= end) {
+    return;
+  }
+  if (threadCount == 1 || end - begin <= grain) {
+    body(begin, end);
+    return;
+  }
+  run(begin, end, grain, [](void* body, std::size_t first, std::size_t last) {
+    (*static_cast<Body*>(body))(first, last);
+  }, &body);
+}
+
+} // namespace g3
+
+#endif // THREADPOOL_H
@@ -0,0 +1,70 @@
+
+#ifndef UPSCALER_H
+#define UPSCALER_H
+
+#include <cstdint>
+#include <vector>
+#include "FrameBuffer.h"
+
+namespace g3
+{
+
+/**
+ * Scales frames rendered below the resolution of the window up to it, with
+ * bilinear filtering: the pixel centers of the target sample the source
+ * between the centers of its pixels, and the edges are clamped.
+ *
+ * The filter is separable. Each source row is scaled along x once, into one
+ * of two rows kept from target row to target row, and each target row is a
+ * blend of two of them with a single weight. Both passes are kernels, the
+ * scaleRow and blendRows of Kernels.
+ */
+class Upscaler
+{
+  public:
+
+  Upscaler();
+
+  /**
+   * Scales the colors of the source to the size of the target. The depth of
+   * the target is left alone.
+   */
+  void upscale(const FrameBuffer& source, FrameBuffer& target);
+
+  private:
+
+  /**
+   * Scales a row of the source along x into one of the kept rows, unless it
+   * holds it already.
+   *
+   * @return The kept row.
+   */
+  const Color* scaleRow(const FrameBuffer& source, unsigned int y);
+
+  /**
+   * The first source pixel of every target column, and the weight of the
+   * second one out of BLEND_ONE, x << 8 | weight, as scaleRow takes them.
+   */
+  std::vector<std::uint32_t> columns;
+
+  /**
+   * The widths that the columns map between.
+   */
+  unsigned int sourceWidth, targetWidth;
+
+  /**
+   * Two source rows scaled along x, and the source row each one holds, or
+   * -1.
+   */
+  std::vector<Color> rows[2];
+  int rowSource[2];
+
+  /**
+   * The kept row to scale the next row into.
+   */
+  unsigned int nextRow;
+};
+
+} // namespace g3
+
+#endif // UPSCALER_H
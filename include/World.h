@@ -3,25 +3,44 @@
 #define SCREEN_H
 
 #include <gtkmm.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "Camera.h"
+#include "FrameScheduler.h"
 #include "Mesh.h"
+#include "Picking.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "SwapChain.h"
+#include "Texture.h"
 
 namespace g3
 {
 /**
- * Implements the graphics pipeline.
+ * The window that shows the scene. The frames are rendered by a Renderer on
+ * a separate render thread and the GUI thread only presents the newest
+ * completed one, so event handling never waits for rasterization.
  */
 class World: public Gtk::DrawingArea {
 
   public:
   World(unsigned int w, unsigned int h);
-  virtual ~World(){};
+  virtual ~World();
 
   /**
-   * This idle callback function is executed as often as possible, 
-   * hence it is ideal for processing intensive tasks.
+   * The timer callback that paces the frames. Runs the due simulation steps
+   * and requests a new frame.
    */
-  bool on_idle();
+  bool on_tick();
+
+  /**
+   * Returns the frame scheduler, which exposes the achieved frame rate and
+   * the frame time histograms.
+   */
+  const FrameScheduler& getScheduler() const { return scheduler; }
 
   /**
    * The drawing function, called by the GUI.
@@ -33,48 +52,48 @@ class World: public Gtk::DrawingArea {
    */
   virtual bool on_scroll_event(GdkEventScroll* event);
 
-  private:
-
   /**
-   * Clears the buffers.
+   * Picks the face under the mouse and highlights its mesh. Called by the GUI.
    */
-  void clear();
+  virtual bool on_button_press_event(GdkEventButton* event);
 
   /**
-   * Renders the scene.
+   * Takes the new size of the window for the next frames. Called by the GUI.
    */
-  void render();
+  virtual void on_size_allocate(Gtk::Allocation& allocation);
+
+  private:
 
   /**
-   * Renders the cube wireframe.
+   * Draws the frame rate and the counters of the presented frame.
    */
-  void renderWireframe(const Mat4& viewProjMat);
+  void drawStatsOverlay(const Cairo::RefPtr<Cairo::Context>& cr);
 
   /**
-   * Renders the axes and the grid ground.
+   * Returns the pixbuf of a buffer of the swap chain, wrapping it again if
+   * the render thread resized the buffer since.
    */
-  void renderAxesAndGrid(const Mat4& viewProjMat);
+  const Glib::RefPtr<Gdk::Pixbuf>& getPixbuf(const FrameBuffer& buffer, unsigned int index);
 
   /**
-   * Maps the x coordinate to the window coordinate system
+   * Presents a completed frame. Called on the GUI thread by frameReady.
    */
-  int mapXToWin(float x);
+  void on_frame_ready();
 
   /**
-   * Maps the y coordinate to the window coordinate system
+   * Advances the simulation by one fixed step.
    */
-  int mapYToWin(float y);
-
+  void simulate();
 
   /**
-   * Draws a point on the screen.
+   * Hands a copy of the current scene state to the render thread.
    */
-  void drawPoint(int x, int y, float z, unsigned long color);
+  void requestFrame();
 
   /**
-   * Draws a line.
+   * The body of the render thread.
    */
-  void drawLine(int x0, int y0, float z0, int x1, int y1, float z1, unsigned long color);
+  void renderLoop();
 
   /**
    * Returns a time point in nanoseconds.
@@ -84,41 +103,47 @@ class World: public Gtk::DrawingArea {
   unsigned long clock_time();
 
   /**
-   * The width of the screen.
+   * The width of the screen, which follows the window.
    */
   unsigned int width;
 
   /**
-   * The height of the screen
+   * The height of the screen, which follows the window.
    */
   unsigned int height;
 
   /**
-   * Front buffer.
+   * The buffers that the render thread renders into and the GUI presents.
    */
-  Glib::RefPtr<Gdk::Pixbuf> frontBuffer;
+  SwapChain swapChain;
 
   /**
-   * Depth buffer
+   * Pixbufs wrapping the color buffers of the swap chain without copying.
    */
-  std::unique_ptr<float[]> depthBuffer;
+  Glib::RefPtr<Gdk::Pixbuf> pixbufs[SwapChain::SIZE];
 
   /**
-   * The target frame time in nanoseconds.
+   * Paces the frames and the simulation.
    *
    * 30 FPS = 33.3 milliseconds/frame == 33300000 nanoseconds/frame.
    */
-  unsigned long targetFrameTime;
+  FrameScheduler scheduler;
 
   /**
-   * The beginning of a frame.
+   * The rotation of the cube in radians after the last simulation step.
    */
-  unsigned long startFrameTime;
+  float cubeAngle;
 
   /**
-   * The end of a frame.
+   * The rotation of the cube in radians before the last simulation step.
    */
-  unsigned long finishFrameTime;
+  float previousCubeAngle;
+
+  /**
+   * The time spent rendering the last completed frame in nanoseconds.
+   * Written by the render thread.
+   */
+  std::atomic<unsigned long> lastRenderTime;
 
   /**
    * The camera that we look from.
@@ -130,13 +155,120 @@ class World: public Gtk::DrawingArea {
    */
   TriangleMesh cube;
 
-};
+  /**
+   * The meshes placed in the scene.
+   */
+  std::vector<MeshInstance> instances;
 
-/**
- * Creates an RGBA color as a long.
- */
-unsigned long createRGBA(int r, int g, int b, int a);
+  /**
+   * The hierarchy over the instances for picking, updated on each click.
+   */
+  SceneBvh pickingBvh;
+
+  /**
+   * Casts the picking rays.
+   */
+  Picker picker;
+
+  /**
+   * Renders the frames on the render thread.
+   */
+  Renderer renderer;
+
+  /**
+   * Guards pendingState, framePending and running.
+   */
+  std::mutex stateMutex;
+
+  /**
+   * Signals the render thread that a frame was requested or that it should
+   * stop.
+   */
+  std::condition_variable frameRequested;
+
+  /**
+   * The state of the next frame to render.
+   */
+  FrameState pendingState;
+
+  /**
+   * The size of the next frame to render. The render thread resizes the
+   * back buffer to it, so that the buffers follow the window one at a time
+   * without waiting for the GUI.
+   */
+  unsigned int pendingWidth, pendingHeight;
+
+  /**
+   * Whether pendingState has not been rendered yet.
+   */
+  bool framePending;
+
+  /**
+   * Whether the render thread should keep running.
+   */
+  bool running;
+
+  /**
+   * The counters of the frame in each buffer of the swap chain.
+   */
+  FrameStats frameStats[SwapChain::SIZE];
+
+  /**
+   * Whether the counters are drawn over the frame.
+   */
+  bool showStats;
+
+  /**
+   * How the meshes are drawn, set by G3_SHADING.
+   */
+  ShadingMode shading;
+
+  /**
+   * Whether the filled faces are shaded through the visibility buffer, set
+   * by G3_VISIBILITY.
+   */
+  bool visibilityBuffer;
+
+  /**
+   * Whether the sun casts shadows in the filled shading modes, set by
+   * G3_SHADOWS.
+   */
+  bool shadows;
 
+  /**
+   * Whether the edges are antialiased with 4 samples per pixel, set by
+   * G3_MSAA.
+   */
+  bool msaa;
+
+  /**
+   * Whether only the regions of the buffers that changed are redrawn, set
+   * by G3_DIRTY.
+   */
+  bool dirtyRegions;
+
+  /**
+   * The share of the window's resolution the frames are rendered at, set by
+   * G3_SCALE. With dynamic resolution the scheduler chooses it instead.
+   */
+  float resolutionScale;
+
+  /**
+   * The texture of the cube in the filled shading modes, set by G3_TEXTURE.
+   */
+  Texture cubeTexture;
+
+  /**
+   * Wakes up the GUI thread when the render thread completed a frame.
+   */
+  Glib::Dispatcher frameReady;
+
+  /**
+   * The render thread.
+   */
+  std::thread renderThread;
+
+};
 
 }
 
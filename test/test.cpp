@@ -2,14 +2,77 @@
 #include <cassert>
 #include <iostream>
 #include <utility>
+#include <algorithm>
+#include <vector>
+#include <cstring>
 #include "Vec.h"
 #include "Mat.h"
 #include "Quaternion.h"
+#include "FrameBuffer.h"
+#include "SwapChain.h"
+#include "FrameScheduler.h"
+#include "FrameSink.h"
+#include "Profiler.h"
+#include "Stats.h"
+#include "Kernels.h"
+#include "Bvh.h"
+#include "Scene.h"
+#include "Renderer.h"
+#include "Picking.h"
+#include "Lod.h"
+#include "MeshOptimizer.h"
+#include "Arena.h"
+#include "BatchRenderer.h"
+#include "Texture.h"
+#include "ThreadPool.h"
+#include "SampleBuffer.h"
+#include "ShadowMap.h"
+#include "DirtyRegions.h"
+#include "StaticLayer.h"
+#include "Upscaler.h"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 
 using namespace std;
 using namespace g3;
 
+/**
+ * The number of allocations made through operator new so far.
+ *
+ * The replacements are kept out of line: inlined, GCC pairs the free of
+ * operator delete with the new of its caller and warns of a mismatch.
+ */
+static std::atomic<unsigned long> heapAllocations {0};
 
+__attribute__((noinline))
+void* operator new(std::size_t size)
+{
+  heapAllocations++;
+  if (void* ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline))
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+__attribute__((noinline))
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
 
 int main (int argc, char** argv)
 {
@@ -126,6 +189,1530 @@ int main (int argc, char** argv)
   Vec3 cross = crossProduct(cross1, cross2);
   assert((cross[0]==-1) && (cross[1]==8) && (cross[2]==-5));
 
+  // packed color is laid out as R, G, B, A bytes
+  Color rgba = createRGBA(1, 2, 3, 4);
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&rgba);
+  assert((bytes[0]==1) && (bytes[1]==2) && (bytes[2]==3) && (bytes[3]==4));
+
+  // frame buffer rows are cache line aligned
+  FrameBuffer fb(33, 7);
+  assert(fb.getStride() == 48);
+  assert(reinterpret_cast<std::size_t>(fb.getColorBuffer()) % BUFFER_ALIGNMENT == 0);
+  assert(reinterpret_cast<std::size_t>(fb.getDepthBuffer()) % BUFFER_ALIGNMENT == 0);
+  fb.clear(rgba);
+  assert(fb.getColorBuffer()[fb.indexOf(32, 6)] == rgba);
+  assert(fb.getDepthBuffer()[fb.indexOf(32, 6)] > 1e30f);
+
+  // a resized frame buffer keeps its memory while the size fits into it,
+  // and rounds the memory up when it grows
+  std::size_t capacity = fb.getCapacity();
+  const Color* memory = fb.getColorBuffer();
+  fb.resize(20, 9);
+  assert(fb.getStride() == 32 && fb.getCapacity() == capacity && fb.getColorBuffer() == memory);
+  fb.resize(200, 7);
+  assert(fb.getStride() == 208 && fb.getCapacity() == 256 * 128);
+  fb.resize(250, 120);
+  assert(fb.getCapacity() == 256 * 128);
+  fb.resize(33, 7);
+  fb.clear(rgba);
+  assert(fb.getColorBuffer()[fb.indexOf(32, 6)] == rgba);
+
+  // swap chain hands the newest completed frame to the consumer
+  SwapChain chain(4, 4);
+  assert(!chain.acquire());
+  FrameBuffer* first = &chain.getBackBuffer();
+  chain.present();
+  FrameBuffer* second = &chain.getBackBuffer();
+  chain.present();
+  assert((first != second) && (&chain.getBackBuffer() == first));
+  assert(chain.acquire() && (&chain.getFrontBuffer() == second));
+  assert(!chain.acquire());
+
+  // scheduler runs fixed simulation steps and keeps the remainder
+  FrameScheduler scheduler(30000000, 10000000);
+  assert(scheduler.tick(1000000000) == 0);
+  assert(scheduler.tick(1025000000) == 2);
+  assert(std::abs(scheduler.getInterpolation() - 0.5f) < 1e-4f);
+  assert(scheduler.tick(3000000000) == FrameScheduler::MAX_STEPS);
+
+  // scheduler reduces the detail under load
+  for (unsigned long t = 1; t <= 100; t++) {
+    scheduler.framePresented(t * 40000000, 40000000);
+  }
+  assert(scheduler.getDetailLevel() > 0);
+  assert(std::abs(scheduler.getFps() - 25) < 0.5f);
+  assert(scheduler.getFrameTimes().getTotal() == 99);
+  assert(scheduler.getRenderTimes().percentile(0.99f) == 41000000);
+
+  // dynamic resolution brings a render time that goes with the pixels to
+  // the target, then gives the resolution back when the load goes away,
+  // and reduces the detail only at the lowest resolution
+  {
+    FrameScheduler dynamic(10000000, 10000000);
+    dynamic.setDynamicResolution(true);
+    unsigned long now = 0;
+    auto present = [&](float fullTime, int count) {
+      for (int n = 0; n < count; n++) {
+        float scale = dynamic.getResolutionScale();
+        now += 10000000;
+        dynamic.framePresented(now, fullTime * scale * scale);
+      }
+    };
+    present(20e6f, 200);
+    assert(dynamic.getResolutionScale() < 0.7f && dynamic.getResolutionScale() > 0.5f);
+    assert(dynamic.getLoad() > 0.5f && dynamic.getLoad() < 0.9f && dynamic.getDetailLevel() == 0);
+    present(2e6f, 200);
+    assert(dynamic.getResolutionScale() == 1 && dynamic.getDetailLevel() == 0);
+    present(1e9f, 200);
+    assert(dynamic.getResolutionScale() == FrameScheduler::MIN_RESOLUTION_SCALE && dynamic.getDetailLevel() > 0);
+    dynamic.setDynamicResolution(false);
+    assert(dynamic.getResolutionScale() == 1);
+  }
+
+  // profile zones of every thread end up in the trace
+  {
+    G3_PROFILE_ZONE("test main");
+    std::thread worker([] { G3_PROFILE_ZONE("test worker"); });
+    worker.join();
+  }
+  std::ostringstream trace;
+  Profiler::get().writeChromeTrace(trace);
+  assert(trace.str().find("{\"name\":\"test main\",\"ph\":\"X\"") != string::npos);
+  assert(trace.str().find("{\"name\":\"test worker\",\"ph\":\"X\"") != string::npos);
+
+  // frame counters add up and give the overdraw ratio
+  FrameStats frameStats {};
+  frameStats.pixelsWritten = 30;
+  frameStats.coveredPixels = 20;
+  FrameStats workerStats {};
+  workerStats.pixelsWritten = 10;
+  frameStats += workerStats;
+  assert(frameStats.getOverdraw() == 2);
+
+  // every kernel variant the CPU supports matches the scalar kernels
+  const Kernels& scalar = *getKernels(Isa::SCALAR);
+  float lhs[16], rhs[16], expectedMat[16], points[3*13], expectedPoints[3*13];
+  for (int n = 0; n < 16; n++) {
+    lhs[n] = std::sin(n + 1.0f) * 3;
+    rhs[n] = std::cos(n * 0.7f) * 2;
+  }
+  for (int n = 0; n < 3*13; n++) {
+    points[n] = std::sin(n * 1.3f) * 5;
+  }
+  scalar.multiplyMat4(lhs, rhs, expectedMat);
+  scalar.transformPoints(points, 3, expectedPoints, 13, expectedMat);
+  // one point lands on w == 0 and must be left undivided
+  points[3*12] = points[3*12+1] = points[3*12+2] = 0;
+  expectedMat[15] = 0;
+  scalar.transformPoints(points, 3, expectedPoints, 13, expectedMat);
+
+  // the same points every 7 floats, as in an array of vertices
+  float spreadPoints[7*13];
+  for (int n = 0; n < 7*13; n++) {
+    spreadPoints[n] = (n % 7 < 3) ? points[n / 7 * 3 + n % 7] : -1;
+  }
+
+  // vertices with unit normals and a directional, a point and a weak light
+  float lightPositions[3*21], lightNormals[3*21], material[8] { 0.1f, 0.1f, 0.2f, 0, 0.8f, 0.5f, 0.3f, 0 };
+  for (int n = 0; n < 21; n++) {
+    Vec3 normal = normalize(Vec3{ std::sin(n * 0.9f), std::cos(n * 1.7f), std::sin(n * 2.3f) + 0.1f });
+    for (int k = 0; k < 3; k++) {
+      lightPositions[3*n + k] = std::cos(n * 0.4f + k) * 3;
+      lightNormals[3*n + k] = normal[k];
+    }
+  }
+  float lights[3 * LIGHT_SIZE] {
+    0.6f, 0.8f, 0, 0,      1, 0.9f, 0.8f, 0,
+    1, 2, -1, 1,           0.5f, 0.5f, 1, 1 / 36.0f,
+    -2, 0.5f, 1, 1,        3, 0, 0, 1 / 4.0f
+  };
+  std::uint32_t expectedColors[21];
+  scalar.lightVertices(lightPositions, lightNormals, 3, 21, lights, 3, material, expectedColors);
+
+  for (Isa isa : { Isa::SCALAR, Isa::SSE41, Isa::AVX2, Isa::AVX512 }) {
+    const Kernels* variant = getKernels(isa);
+    if (!variant) {
+      std::cout << "skipping unsupported kernels: " << getIsaName(isa) << std::endl;
+      continue;
+    }
+    assert(variant->isa == isa);
+
+    float product[16];
+    variant->multiplyMat4(lhs, rhs, product);
+    product[15] = 0;
+    for (int n = 0; n < 15; n++) {
+      assert(std::abs(product[n] - expectedMat[n]) <= 1e-5f * (1 + std::abs(expectedMat[n])));
+    }
+
+    // every count up to 13 exercises the tails, the guard must stay intact
+    for (std::size_t count = 0; count <= 13; count++) {
+      float transformed[3*13 + 1];
+      transformed[3*count] = 42;
+      variant->transformPoints(points, 3, transformed, count, expectedMat);
+      assert(transformed[3*count] == 42);
+      for (std::size_t n = 0; n < 3*count; n++) {
+        assert(std::abs(transformed[n] - expectedPoints[n]) <= 1e-4f * (1 + std::abs(expectedPoints[n])));
+      }
+
+      variant->transformPoints(spreadPoints, 7, transformed, count, expectedMat);
+      assert(transformed[3*count] == 42);
+      for (std::size_t n = 0; n < 3*count; n++) {
+        assert(std::abs(transformed[n] - expectedPoints[n]) <= 1e-4f * (1 + std::abs(expectedPoints[n])));
+      }
+    }
+
+    // colors may differ by rounding, every count exercises the tails
+    for (std::size_t count = 0; count <= 21; count++) {
+      std::uint32_t colors[22];
+      colors[count] = 42;
+      variant->lightVertices(lightPositions, lightNormals, 3, count, lights, 3, material, colors);
+      assert(colors[count] == 42);
+      for (std::size_t n = 0; n < count; n++) {
+        for (int shift = 0; shift < 32; shift += 8) {
+          int channel = colors[n] >> shift & 0xff, expected = expectedColors[n] >> shift & 0xff;
+          assert(std::abs(channel - expected) <= 1);
+        }
+      }
+    }
+
+    // unaligned spans, small and streamed
+    for (std::size_t count : { (std::size_t)37, (std::size_t)100003 }) {
+      std::vector<std::uint32_t> span(count + 2, 7);
+      variant->fill32(&span[1], count, 0xdeadbeef);
+      assert(span[0] == 7 && span[count + 1] == 7);
+      assert(std::count(span.begin(), span.end(), 0xdeadbeef) == (long)count);
+    }
+
+    // every count exercises the tails, the nearer depth wins and an equal
+    // one keeps the destination
+    for (std::size_t count = 0; count <= 37; count++) {
+      std::uint32_t dstColor[38], srcColor[38];
+      float dstDepth[38], srcDepth[38];
+      for (std::size_t n = 0; n < 38; n++) {
+        dstColor[n] = n;
+        srcColor[n] = 100 + n;
+        dstDepth[n] = (n % 3) * 0.5f;
+        srcDepth[n] = (n % 4 == 3) ? std::numeric_limits<float>::infinity() : (n % 5) * 0.25f;
+      }
+      variant->mergeMinDepth(dstColor, dstDepth, srcColor, srcDepth, count);
+      for (std::size_t n = 0; n < 38; n++) {
+        bool nearer = n < count && (n % 4 != 3) && (n % 5) * 0.25f < (n % 3) * 0.5f;
+        assert(dstColor[n] == (nearer ? 100 + n : n));
+        assert(dstDepth[n] == (nearer ? (n % 5) * 0.25f : (n % 3) * 0.5f));
+      }
+    }
+
+    // the blends match the scalar rounding exactly, at every count, and the
+    // whole weights keep the colors
+    std::uint32_t first[40], second[40], columns[37], blended[38], expectedBlend[37];
+    for (std::size_t n = 0; n < 40; n++) {
+      first[n] = 0x01020304u * (n + 7) ^ 0xff00ff00u;
+      second[n] = 0x04030201u * (3 * n + 1);
+    }
+    for (std::size_t n = 0; n < 37; n++) {
+      columns[n] = (n * 5 % 38) << 8 | (n * 7 % (BLEND_ONE + 1));
+    }
+    for (std::size_t count = 0; count <= 37; count++) {
+      blended[count] = 42;
+      variant->scaleRow(first, columns, blended, count);
+      scalar.scaleRow(first, columns, expectedBlend, count);
+      assert(blended[count] == 42 && std::equal(blended, blended + count, expectedBlend));
+      for (unsigned int weight : { 0u, 21u, BLEND_ONE }) {
+        variant->blendRows(first, second, blended, count, weight);
+        scalar.blendRows(first, second, expectedBlend, count, weight);
+        assert(blended[count] == 42 && std::equal(blended, blended + count, expectedBlend));
+      }
+    }
+    variant->blendRows(first, second, blended, 37, 0);
+    assert(std::equal(blended, blended + 37, first));
+    variant->blendRows(first, second, blended, 37, BLEND_ONE);
+    assert(std::equal(blended, blended + 37, second));
+  }
+
+  // the batched transform matches transformP3
+  Vec3 batchIn[] { {1, 2, 3}, {-4, 5, 0.5f}, {0, 0, 0} };
+  Vec3 batchOut[3];
+  Mat4 batchMat = createPerspectiveFovLHMatrix(0.78f, 1.5f, 0.01f, 25.0f) * createTranslationMatrix(1, 2, 3);
+  transformP3(batchIn, batchOut, 3, batchMat);
+  for (int n = 0; n < 3; n++) {
+    Vec3 single = transformP3(batchIn[n], batchMat);
+    assert((single - batchOut[n]).length() <= 1e-5f * (1 + single.length()));
+  }
+
+  // a matrix times its inverse is the identity
+  Mat4 invertible = createRotationXMatrix(0.3f) * createScaleMatrix(2, 1, 0.5f) * createTranslationMatrix(1, -2, 5);
+  Mat4 identity = invertible * inverse(invertible);
+  for (int n = 0; n < 16; n++) {
+    assert(std::abs(identity[n] - ((n % 5 == 0) ? 1 : 0)) <= 1e-5f);
+  }
+  // the projection is badly conditioned: a point brought back into the world
+  // slides along its ray by millimeters, but it still projects to the same
+  // spot, well within a pixel of a target 1000 pixels wide
+  Mat4 viewProj = createViewProjMatrix({ Vec3{17, 10, -20}, Vec3{1, 0, 2}, 1280 }, 1.5f);
+  Vec3 clip = transformP3(Vec3{4, 2, -2}, viewProj);
+  Vec3 roundTrip = transformP3(transformP3(clip, inverse(viewProj)), viewProj);
+  for (int n = 0; n < 3; n++) {
+    assert(std::abs(roundTrip[n] - clip[n]) < 1e-3f);
+  }
+
+  // the bvh finds the same boxes as testing all of them
+  {
+    std::vector<Aabb> boxes;
+    for (int n = 0; n < 200; n++) {
+      Vec3 c { std::sin(n * 1.7f) * 20, std::cos(n * 0.9f) * 5, std::sin(n * 0.3f) * 20 };
+      Vec3 e { 0.2f + (n % 3), 0.5f, 0.2f + (n % 5) * 0.3f };
+      boxes.push_back({ c - e, c + e });
+    }
+    Bvh bvh;
+    bvh.build(boxes.data(), boxes.size());
+    assert(bvh.getSize() == 200 && bvh.getNodeCount() <= 2 * 200 - 1);
+
+    Camera view { Vec3{17, 10, -20}, Vec3{1, 0, 2}, 1280 };
+    Frustum frustum = createViewFrustum(view, 900, 600);
+    auto checkCull = [&]() {
+      std::vector<unsigned int> visible;
+      bvh.cull(frustum, [&](unsigned int item) { visible.push_back(item); });
+      std::sort(visible.begin(), visible.end());
+      std::vector<unsigned int> expected;
+      for (unsigned int n = 0; n < boxes.size(); n++) {
+        if (classify(frustum, boxes[n]) != Containment::OUTSIDE) expected.push_back(n);
+      }
+      assert(visible == expected);
+      assert(!visible.empty() && visible.size() < boxes.size());
+    };
+    auto checkRay = [&](const Ray& ray) {
+      float best = INFINITY;
+      int expected = -1;
+      for (unsigned int n = 0; n < boxes.size(); n++) {
+        float t;
+        if (intersect(ray, boxes[n], best, t) && t < best) { best = t; expected = n; }
+      }
+      float tMax = INFINITY;
+      int hit = bvh.intersect(ray, tMax, [&](unsigned int item, float& tMax) {
+        float t;
+        if (intersect(ray, boxes[item], tMax, t) && t < tMax) { tMax = t; return true; }
+        return false;
+      });
+      assert(hit == expected && (hit < 0 || tMax == best));
+    };
+    checkCull();
+    for (int n = 0; n < 50; n++) {
+      checkRay(createRay(Vec3{0, 20, 0}, Vec3{std::sin(n * 0.4f), -1, std::cos(n * 0.4f)}));
+    }
+
+    // moved boxes are found after a refit
+    for (Aabb& box : boxes) {
+      box.min[1] += 3;
+      box.max[1] += 3;
+    }
+    bvh.refit(boxes.data());
+    checkCull();
+    checkRay(createRay(Vec3{0, 20, 0}, Vec3{0.1f, -1, 0.2f}));
+  }
+
+  // the scene bvh refits while the instances move and picks through the screen
+  {
+    TriangleMesh mesh;
+    loadCube(mesh);
+    assert(mesh.bounds.min[0] == -1 && mesh.bounds.max[2] == 1);
+
+    std::vector<MeshInstance> instances;
+    for (int n = 0; n < 10; n++) {
+      instances.push_back({ &mesh, createTranslationMatrix(n * 10.0f, 0, 0) });
+    }
+    SceneBvh scene;
+    scene.update(instances);
+    instances[3].worldMatrix = createRotationYMatrix(0.5f) * createTranslationMatrix(30.5f, 0, 0);
+    scene.update(instances);
+    assert(scene.getBuildCount() == 1);
+    assert(std::abs(center(scene.getBounds(3))[0] - 30.5f) < 1e-5f);
+    instances.pop_back();
+    scene.update(instances);
+    assert(scene.getBuildCount() == 2);
+
+    // the center of the window looks at the camera target
+    Camera view { Vec3{40, 10, -20}, Vec3{40, 0, 0}, 1280 };
+    float distance;
+    Ray ray = createPickingRay(view, 900, 600, 450, 300);
+    assert(scene.pick(ray, distance) == 4);
+    Vec3 point = ray.origin + ray.direction * distance;
+    assert(std::abs(point[2] + 1) < 1e-3f && std::abs(point[1] - 0.5f) < 1e-3f);
+    ray = createPickingRay(view, 900, 600, 0, 0);
+    assert(scene.pick(ray, distance) == -1);
+  }
+
+  // every triangle kernel finds the same closest hit as the scalar one
+  {
+    const unsigned int N = TRIANGLE_PACKET_SIZE;
+    alignas(32) float packet[9 * N];
+    for (unsigned int n = 0; n < 9 * N; n++) {
+      packet[n] = std::sin(n * 2.3f) * ((n < 3 * N) ? 1 : 3);
+    }
+    // the last lane is padding
+    for (unsigned int k = 3; k < 9; k++) {
+      packet[k * N + N - 1] = 0;
+    }
+    const Kernels& scalar = *getKernels(Isa::SCALAR);
+    for (Isa isa : { Isa::SSE41, Isa::AVX2, Isa::AVX512 }) {
+      const Kernels* variant = getKernels(isa);
+      if (!variant) continue;
+      int hits = 0;
+      for (int r = 0; r < 200; r++) {
+        float ray[6] { std::sin(r * 0.7f), std::cos(r * 1.1f), -4, std::sin(r * 0.3f) * 0.5f, std::cos(r * 0.5f) * 0.5f, 1 };
+        float expected = INFINITY, distance = INFINITY;
+        int lane = scalar.intersectTriangles(packet, ray, &expected);
+        assert(variant->intersectTriangles(packet, ray, &distance) == lane);
+        assert(lane != (int)N - 1);
+        hits += lane >= 0;
+        if (lane >= 0) {
+          assert(std::abs(distance - expected) <= 1e-4f * expected);
+          // a closer limit hides the hit
+          float limit = expected * 0.5f;
+          assert(variant->intersectTriangles(packet, ray, &limit) != lane || limit < expected);
+        }
+      }
+      assert(hits > 0);
+    }
+  }
+
+  // picking finds the closest face of the mesh under the ray
+  {
+    TriangleMesh terrain;
+    loadTerrain(terrain, 40);
+    assert(terrain.nFaces == 2 * 40 * 40 && terrain.bounds.min[0] == -4);
+
+    std::vector<MeshInstance> instances { { &terrain, createTranslationMatrix(0, -1, 0) },
+                                          { &terrain, createTranslationMatrix(0, 1, 0) } };
+    SceneBvh scene;
+    scene.update(instances);
+    Picker picker;
+
+    for (int n = 0; n < 50; n++) {
+      Ray ray = createRay(Vec3{std::sin(n * 0.9f) * 3, 5, std::cos(n * 1.3f) * 3}, Vec3{0.05f, -1, 0.02f});
+      PickHit hit = picker.pick(instances, scene, ray);
+      // straight down: the upper terrain is hit first
+      assert(hit.instance == 1);
+
+      // the same face as testing all the faces one by one
+      float best = INFINITY;
+      unsigned int bestFace = 0;
+      for (unsigned int f = 0; f < terrain.nFaces; f++) {
+        alignas(32) float packet[9 * TRIANGLE_PACKET_SIZE] {};
+        const unsigned int* index = terrain.faces[f].vertexIndex;
+        for (int k = 0; k < 3; k++) {
+          float v0 = terrain.vertices[index[0]].pos[k] + ((k == 1) ? 1 : 0);
+          packet[k * TRIANGLE_PACKET_SIZE] = v0;
+          packet[(3 + k) * TRIANGLE_PACKET_SIZE] = terrain.vertices[index[1]].pos[k] - terrain.vertices[index[0]].pos[k];
+          packet[(6 + k) * TRIANGLE_PACKET_SIZE] = terrain.vertices[index[2]].pos[k] - terrain.vertices[index[0]].pos[k];
+        }
+        float r[6] { ray.origin[0], ray.origin[1], ray.origin[2], ray.direction[0], ray.direction[1], ray.direction[2] };
+        if (getKernels(Isa::SCALAR)->intersectTriangles(packet, r, &best) == 0) {
+          bestFace = f;
+        }
+      }
+      assert(hit.face == bestFace);
+      assert(std::abs(hit.distance - best) <= 1e-4f * best);
+    }
+
+    Ray miss = createRay(Vec3{0, 5, 0}, Vec3{0, 1, 0});
+    assert(picker.pick(instances, scene, miss).instance == -1);
+  }
+
+  // the levels of detail get coarser, stay in shape and are chosen by size
+  {
+    TriangleMesh terrain;
+    loadTerrain(terrain, 30);
+    LodChain lods;
+    buildLodChain(terrain, lods);
+    assert(lods.levels.size() >= 3 && lods.levels.size() == lods.errors.size());
+
+    unsigned int faces = terrain.nFaces;
+    float error = 0;
+    for (std::size_t n = 0; n < lods.levels.size(); n++) {
+      const TriangleMesh& level = lods.levels[n];
+      assert(level.nFaces < faces && level.nFaces >= LOD_MIN_FACES);
+      assert(lods.errors[n] >= error);
+      faces = level.nFaces;
+      error = lods.errors[n];
+      for (unsigned int f = 0; f < level.nFaces; f++) {
+        for (unsigned int index : level.faces[f].vertexIndex) {
+          assert(index < level.nVertices);
+        }
+      }
+      // the border is kept, so the box barely changes
+      assert((level.bounds.min - terrain.bounds.min).length() < 0.1f);
+      assert((level.bounds.max - terrain.bounds.max).length() < 0.1f);
+    }
+    assert(lods.levels[0].nFaces <= terrain.nFaces * LOD_REDUCTION * 1.1f);
+
+    assert(selectLod(lods, 1e6f, 1) == 0);
+    assert(selectLod(lods, 1e-6f, 1) == lods.levels.size());
+    assert(selectLod(lods, 1 / lods.errors[1], 1) == 2);
+
+    // zoomed out, the terrain is drawn with far fewer lines
+    FrameBuffer target(300, 200);
+    Renderer renderer;
+    FrameState frame;
+    frame.camera = { Vec3{17, 10, -20}, Vec3{1, 0, 2}, 10 };
+    frame.instances.push_back({ &terrain, createTranslationMatrix(1, 0, 2) });
+    renderer.render(target, frame);
+    unsigned long fullLines = renderer.getStats().lines;
+    frame.instances[0].lods = &lods;
+    renderer.render(target, frame);
+    assert(renderer.getStats().lines * 4 < fullLines);
+  }
+
+  // reordering for the vertex cache keeps the faces and cuts the misses
+  {
+    TriangleMesh terrain;
+    loadTerrain(terrain, 40);
+    float gridAcmr = computeAcmr(terrain);
+
+    // scramble the faces as an unordered source would
+    std::unique_ptr<Triangle[]> scrambled(new Triangle[terrain.nFaces]);
+    for (unsigned int i = 0; i < terrain.nFaces; i++) {
+      scrambled[i] = terrain.faces[(i * 7919ul) % terrain.nFaces];
+    }
+    terrain.faces = std::move(scrambled);
+    float scrambledAcmr = computeAcmr(terrain);
+
+    auto corners = [](const TriangleMesh& mesh) {
+      std::vector<std::vector<float>> result;
+      for (unsigned int f = 0; f < mesh.nFaces; f++) {
+        std::vector<float> face;
+        for (unsigned int index : mesh.faces[f].vertexIndex) {
+          for (int k = 0; k < 3; k++) face.push_back(mesh.vertices[index].pos[k]);
+        }
+        result.push_back(face);
+      }
+      std::sort(result.begin(), result.end());
+      return result;
+    };
+    std::vector<std::vector<float>> before = corners(terrain);
+
+    FrameBuffer target(300, 200);
+    Renderer renderer;
+    FrameState frame;
+    frame.camera = { Vec3{17, 10, -20}, Vec3{1, 0, 2}, 100 };
+    frame.instances.push_back({ &terrain, createTranslationMatrix(1, 0, 2) });
+    renderer.render(target, frame);
+    FrameStats scrambledStats = renderer.getStats();
+
+    optimizeMesh(terrain);
+    assert(corners(terrain) == before);
+    float optimizedAcmr = computeAcmr(terrain);
+    assert(optimizedAcmr < gridAcmr && optimizedAcmr < scrambledAcmr / 2);
+
+    // the vertices come in the order the faces use them
+    unsigned int next = 0;
+    for (unsigned int f = 0; f < terrain.nFaces; f++) {
+      for (unsigned int index : terrain.faces[f].vertexIndex) {
+        assert(index <= next);
+        next = std::max(next, index + 1);
+      }
+    }
+    assert(next == terrain.nVertices);
+
+    // the same lines are drawn and every vertex is transformed once, by a
+    // renderer of its own, which draws the axes and the grid too instead of
+    // merging them from its static layer
+    Renderer optimized;
+    optimized.render(target, frame);
+    assert(optimized.getStats().lines == scrambledStats.lines);
+    assert(optimized.getStats().vertices == scrambledStats.vertices);
+    assert(scrambledStats.vertices < terrain.nVertices + 64);
+  }
+
+  // the arena hands out aligned memory, rewinds and merges its blocks
+  {
+    FrameArena arena;
+    char* a = static_cast<char*>(arena.allocate(3, 1));
+    double* b = arena.allocate<double>(4);
+    assert(reinterpret_cast<std::uintptr_t>(b) % alignof(double) == 0);
+    assert(reinterpret_cast<char*>(b) >= a + 3);
+    assert(arena.allocate(100, 64) != nullptr);
+
+    FrameArena::Marker marker = arena.getMarker();
+    {
+      ArenaScope scope(arena);
+      arena.allocate(1000);
+    }
+    assert(arena.getMarker().block == marker.block && arena.getMarker().offset == marker.offset);
+
+    // a frame bigger than the block spills into more blocks, the next
+    // frames get them as one
+    unsigned long blocks = FrameArena::getAllocatedBlockCount();
+    arena.allocate(FrameArena::MIN_BLOCK_SIZE);
+    assert(arena.getBlockCount() == 2 && FrameArena::getAllocatedBlockCount() == blocks + 1);
+    std::size_t capacity = arena.getCapacity();
+    arena.reset();
+    assert(arena.getBlockCount() == 1 && arena.getCapacity() == capacity);
+    arena.allocate(FrameArena::MIN_BLOCK_SIZE + 1000);
+    assert(arena.getBlockCount() == 1 && FrameArena::getAllocatedBlockCount() == blocks + 2);
+  }
+
+  // steady frames render without touching the heap
+  {
+    TriangleMesh cube, terrain;
+    loadCube(cube);
+    loadTerrain(terrain, 30);
+    optimizeMesh(terrain);
+    LodChain lods;
+    buildLodChain(terrain, lods);
+
+    FrameBuffer target(300, 200);
+    Renderer renderer;
+    FrameState frame;
+    frame.camera = { Vec3{17, 10, -20}, Vec3{1, 0, 2}, 100 };
+    for (int i = 0; i < 50; i++) {
+      frame.instances.push_back({ &cube, createTranslationMatrix(i % 10 * 4.0f, 0, i / 10 * 4.0f) });
+    }
+    frame.instances.push_back({ &terrain, createTranslationMatrix(1, 0, 2), WIREFRAME_COLOR, &lods });
+
+    auto renderFrames = [&](int count) {
+      for (int n = 0; n < count; n++) {
+        for (int i = 0; i < 50; i++) {
+          frame.instances[i].worldMatrix = createRotationMatrix(createQuaternion(Vec3{0, 1, 0}, n * 0.1f))
+            * createTranslationMatrix(i % 10 * 4.0f, 0, i / 10 * 4.0f);
+        }
+        renderer.render(target, frame);
+      }
+    };
+    renderFrames(3);
+    // the arenas take their blocks from the heap around operator new
+    unsigned long before = heapAllocations, blocks = FrameArena::getAllocatedBlockCount();
+    renderFrames(10);
+    assert(heapAllocations == before && FrameArena::getAllocatedBlockCount() == blocks);
+  }
+
+  // normals point out of the meshes
+  {
+    TriangleMesh cube, terrain;
+    loadCube(cube);
+    loadTerrain(terrain, 10);
+    for (unsigned int f = 0; f < cube.nFaces; f++) {
+      const Triangle& face = cube.faces[f];
+      Vec3 c = cube.vertices[face.vertexIndex[0]].pos + cube.vertices[face.vertexIndex[1]].pos
+               + cube.vertices[face.vertexIndex[2]].pos;
+      assert(std::abs(face.normal.length() - 1) < 1e-5f && dotProduct(face.normal, c) > 0);
+    }
+    for (unsigned int i = 0; i < cube.nVertices; i++) {
+      assert(dotProduct(cube.vertices[i].normal, cube.vertices[i].pos) > 0);
+    }
+    for (unsigned int i = 0; i < terrain.nVertices; i++) {
+      assert(terrain.vertices[i].normal[1] > 0.5f);
+    }
+  }
+
+  // lit faces cover every pixel once and take the color of the light
+  {
+    TriangleMesh quad;
+    quad.nVertices = 4;
+    quad.vertices.reset(new Vertex[4]);
+    quad.vertices[0].pos = Vec3{2, 2, 0};
+    quad.vertices[1].pos = Vec3{2, 4, 0};
+    quad.vertices[2].pos = Vec3{4, 4, 0};
+    quad.vertices[3].pos = Vec3{4, 2, 0};
+    quad.nFaces = 2;
+    quad.faces.reset(new Triangle[2] { { {0, 1, 2} }, { {0, 2, 3} } });
+    quad.bounds = computeBounds(quad);
+    computeNormals(quad);
+    assert(quad.faces[0].normal[2] < -0.99f && quad.vertices[3].normal[2] < -0.99f);
+
+    FrameBuffer target(300, 200);
+    Renderer renderer;
+    renderer.setCountCoverage(true);
+    FrameState frame;
+    frame.camera = { Vec3{0, 0, -10}, Vec3{0, 0, 0}, 60 };
+    frame.detailLevel = 2;
+    frame.lighting.ambient = Vec3{0, 0, 0};
+    frame.lighting.directionalLights = { { Vec3{0, 0, -1}, Vec3{1, 1, 1} } };
+    // the second frame of the view captures the axes and the grid, which
+    // the next ones merge without testing their pixels
+    for (int n = 0; n < 3; n++) {
+      renderer.render(target, frame);
+    }
+    FrameStats empty = renderer.getStats();
+
+    Color color = createRGBA(200, 100, 50, 255);
+    frame.instances.push_back({ &quad, Mat4{}, color });
+    loadIdentity(frame.instances[0].worldMatrix);
+    for (ShadingMode mode : { ShadingMode::FLAT, ShadingMode::GOURAUD }) {
+      frame.shading = mode;
+      renderer.render(target, frame);
+      const FrameStats& stats = renderer.getStats();
+      assert(stats.triangles == 2 && stats.trianglesCulled == 0);
+
+      unsigned long tested = stats.pixelsTested - empty.pixelsTested;
+      assert(tested > 500 && tested == stats.coveredPixels - empty.coveredPixels);
+      unsigned long lit = 0;
+      for (unsigned int y = 0; y < target.getHeight(); y++) {
+        for (unsigned int x = 0; x < target.getWidth(); x++) {
+          lit += target.getColorBuffer()[target.indexOf(x, y)] == color;
+        }
+      }
+      assert(lit == tested);
+    }
+
+    // turned around, the quad faces away and is culled
+    frame.instances[0].worldMatrix = createRotationMatrix(createQuaternion(Vec3{0, 1, 0}, 3.14159f));
+    renderer.render(target, frame);
+    assert(renderer.getStats().triangles == 0 && renderer.getStats().trianglesCulled == 2);
+  }
+
+  // the grid behind a cube stays hidden where the faces cover it: the lines
+  // take their depths from their ends like the faces do, with and without
+  // multisampling, where the pixels on the edges of the faces blend
+  {
+    TriangleMesh cube;
+    loadCube(cube);
+    FrameState frame;
+    frame.camera = { Vec3{0, 6, -8}, Vec3{0, 0, 0}, 150 };
+    frame.instances.push_back({ &cube, createTranslationMatrix(0, 2, 0), createRGBA(200, 100, 50, 255) });
+    for (bool msaa : { false, true }) {
+      for (ShadingMode mode : { ShadingMode::FLAT, ShadingMode::GOURAUD }) {
+        frame.shading = mode;
+        frame.msaa = msaa;
+        FrameBuffer background(300, 200), gridless(300, 200), grid(300, 200);
+        FrameState empty = frame;
+        empty.detailLevel = 2;
+        empty.instances.clear();
+        Renderer().render(background, empty);
+        frame.detailLevel = 2;
+        Renderer().render(gridless, frame);
+        frame.detailLevel = 0;
+        Renderer().render(grid, frame);
+
+        auto isCovered = [&](unsigned int x, unsigned int y) {
+          std::size_t i = gridless.indexOf(x, y);
+          return gridless.getColorBuffer()[i] != background.getColorBuffer()[i];
+        };
+        unsigned long covered = 0;
+        for (unsigned int y = 1; y + 1 < grid.getHeight(); y++) {
+          for (unsigned int x = 1; x + 1 < grid.getWidth(); x++) {
+            bool inside = isCovered(x, y) && (!msaa || (isCovered(x - 1, y) && isCovered(x + 1, y)
+                                                        && isCovered(x, y - 1) && isCovered(x, y + 1)));
+            if (inside) {
+              covered++;
+              assert(grid.getColorBuffer()[grid.indexOf(x, y)] == gridless.getColorBuffer()[grid.indexOf(x, y)]);
+            }
+          }
+        }
+        assert(covered > 1000);
+      }
+    }
+  }
+
+  // textures store the same texels in either layout, with averaged mips
+  {
+    std::vector<Color> pixels(16 * 8);
+    for (unsigned int i = 0; i < pixels.size(); i++) {
+      pixels[i] = createRGBA(i % 16 * 16, i / 16 * 32, (i * 7) % 256, 255);
+    }
+    Texture linear(16, 8, pixels.data(), TextureLayout::LINEAR);
+    Texture morton(16, 8, pixels.data(), TextureLayout::MORTON);
+    assert(morton.getLevelCount() == 5 && morton.getWidth(4) == 1 && morton.getHeight(4) == 1);
+    assert(morton.getWidth(3) == 2 && morton.getHeight(3) == 1);
+    for (unsigned int level = 0; level < morton.getLevelCount(); level++) {
+      for (unsigned int y = 0; y < morton.getHeight(level); y++) {
+        for (unsigned int x = 0; x < morton.getWidth(level); x++) {
+          assert(morton.fetch(level, x, y) == linear.fetch(level, x, y));
+        }
+      }
+    }
+    for (unsigned int y = 0; y < 8; y++) {
+      for (unsigned int x = 0; x < 16; x++) {
+        assert(morton.fetch(0, x, y) == pixels[y * 16 + x]);
+        assert(morton.fetch(0, x + 16, y - 8) == pixels[y * 16 + x]);
+      }
+    }
+    // a level 1 texel averages the red of two columns and the green of two
+    // rows
+    Color texel = morton.fetch(1, 3, 2);
+    assert((texel & 0xff) == 3 * 32 + 8);
+    assert(((texel >> 8) & 0xff) == 4 * 32 + 16);
+
+    // at texel centers both filters return the texel, between two texels
+    // bilinear filtering blends them
+    for (TextureFilter filter : { TextureFilter::NEAREST, TextureFilter::BILINEAR }) {
+      assert(morton.sample(5.5f / 16, 2.5f / 8, 0, filter) == pixels[2 * 16 + 5]);
+      assert(morton.sample(2.5f / 8, 1.5f / 4, 1.2f, filter) == morton.fetch(1, 2, 1));
+      assert(morton.sample(5.5f / 16, 2.5f / 8, 9, filter) == morton.fetch(4, 0, 0));
+    }
+    assert((morton.sample(6.0f / 16, 2.5f / 8, -1, TextureFilter::BILINEAR) & 0xff) == 88);
+    assert(morton.sampleBilinear(6.0f / 16, 2.5f / 8, -1) == morton.sample(6.0f / 16, 2.5f / 8, -1, TextureFilter::BILINEAR));
+    assert(morton.sampleNearest(6.0f / 16, 2.5f / 8, -1) == pixels[2 * 16 + 6]);
+
+    bool thrown = false;
+    try {
+      Texture(12, 8, pixels.data());
+    } catch (const std::invalid_argument&) {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+
+  // texture coordinates are interpolated in perspective: the middle of a
+  // floor receding from the camera is above the middle of its image, off
+  // the axes in the middle column
+  {
+    TriangleMesh floor;
+    floor.nVertices = 4;
+    floor.vertices.reset(new Vertex[4]);
+    floor.vertices[0].pos = Vec3{-2, 0, 0};
+    floor.vertices[1].pos = Vec3{-2, 0, 8};
+    floor.vertices[2].pos = Vec3{2, 0, 8};
+    floor.vertices[3].pos = Vec3{2, 0, 0};
+    floor.vertices[0].uv = Vec2{0, 0};
+    floor.vertices[1].uv = Vec2{0, 1};
+    floor.vertices[2].uv = Vec2{1, 1};
+    floor.vertices[3].uv = Vec2{1, 0};
+    floor.nFaces = 2;
+    floor.faces.reset(new Triangle[2] { { {0, 1, 2} }, { {0, 2, 3} } });
+    floor.bounds = computeBounds(floor);
+    computeNormals(floor);
+
+    // the near half of the texture is red, the far half blue
+    Color near = createRGBA(255, 0, 0, 255), far = createRGBA(0, 0, 255, 255);
+    Color pixels[] { near, near, far, far };
+    Texture texture(2, 2, pixels);
+
+    FrameBuffer target(300, 200);
+    Renderer renderer;
+    FrameState frame;
+    frame.camera = { Vec3{0, 3, -4}, Vec3{0, 0, 4}, 120 };
+    frame.detailLevel = 2;
+    frame.shading = ShadingMode::FLAT;
+    frame.textureFilter = TextureFilter::NEAREST;
+    frame.lighting.ambient = Vec3{0, 0, 0};
+    frame.lighting.directionalLights = { { Vec3{0, 1, 0}, Vec3{1, 1, 1} } };
+    frame.instances.push_back({ &floor, Mat4{} });
+    loadIdentity(frame.instances[0].worldMatrix);
+    frame.instances[0].texture = &texture;
+    renderer.render(target, frame);
+    assert(renderer.getStats().triangles == 2);
+
+    Mat4 viewProj = createViewProjMatrix(frame.camera, 1.5f);
+    auto rowOf = [&](float z) { return -transformP3(Vec3{0, 0, z}, viewProj)[1] * 120 + 100; };
+    float nearRow = rowOf(0), middleRow = rowOf(4), farRow = rowOf(8);
+    assert(farRow > 2 && nearRow < 198);
+    assert((nearRow + farRow) / 2 - middleRow > 6);
+    for (int y = farRow + 2; y < nearRow - 1; y++) {
+      if (std::abs(y + 0.5f - middleRow) < 1) continue;
+      assert(target.getColorBuffer()[target.indexOf(170, y)] == (y > middleRow ? near : far));
+    }
+  }
+
+  // a parallel loop runs every chunk once, also from several threads
+  {
+    ThreadPool pool(4);
+    assert(pool.getThreadCount() == 4);
+    std::vector<int> visits(1000, 0);
+    pool.parallelFor(0, visits.size(), 7, [&](std::size_t first, std::size_t last) {
+      assert(last - first <= 7);
+      for (std::size_t i = first; i < last; i++) {
+        visits[i]++;
+      }
+    });
+    assert(std::count(visits.begin(), visits.end(), 1) == 1000);
+
+    std::atomic<unsigned long> sum {0};
+    std::thread other([&] {
+      pool.parallelFor(0, 1000, 10, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++) sum += i;
+      });
+    });
+    pool.parallelFor(0, 1000, 10, [&](std::size_t first, std::size_t last) {
+      for (std::size_t i = first; i < last; i++) sum += i;
+    });
+    other.join();
+    assert(sum == 2 * 999 * 1000 / 2);
+  }
+
+  // the chunks of loops started from within chunks are stolen by the other
+  // threads, and a pinned pool works like the others
+  {
+    ThreadPool pool(4, true);
+    assert(pool.isPinned() && pool.getThreadCount() == 4);
+    std::vector<std::atomic<int>> visits(300);
+    for (std::atomic<int>& visit : visits) {
+      visit = 0;
+    }
+    pool.parallelFor(0, 30, 1, [&](std::size_t first, std::size_t last) {
+      for (std::size_t i = first; i < last; i++) {
+        pool.parallelFor(10 * i, 10 * i + 10, 3, [&](std::size_t first, std::size_t last) {
+          assert(last - first <= 3);
+          for (std::size_t j = first; j < last; j++) {
+            visits[j]++;
+          }
+        });
+      }
+    });
+    assert(std::all_of(visits.begin(), visits.end(), [](const std::atomic<int>& visit) { return visit == 1; }));
+  }
+
+  // a large mesh is cleared, transformed and rasterized in bands on several
+  // threads into the same pixels, with the same counters, as on one
+  {
+    TriangleMesh terrain;
+    loadTerrain(terrain, 64);
+    Texture texture = createCheckerboardTexture(64, 4);
+    FrameState frame;
+    frame.camera = { Vec3{0, 6, -8}, Vec3{0, 0, 0}, 150 };
+    frame.lighting.directionalLights = { { Vec3{1, 1, 0}, Vec3{0.8f, 0.8f, 0.8f} } };
+    frame.shadows = true;
+    frame.instances.push_back({ &terrain, Mat4{}, createRGBA(200, 200, 200, 255) });
+    loadIdentity(frame.instances[0].worldMatrix);
+    ThreadPool serial(1), parallel(4);
+    for (ShadingMode mode : { ShadingMode::FLAT, ShadingMode::GOURAUD }) {
+      for (bool deferred : { false, true }) {
+        frame.shading = mode;
+        frame.visibilityBuffer = deferred;
+        frame.instances[0].texture = mode == ShadingMode::GOURAUD ? &texture : nullptr;
+        FrameBuffer expected(300, 200), target(300, 200);
+        Renderer one, four;
+        one.setThreadPool(serial);
+        four.setThreadPool(parallel);
+        one.render(expected, frame);
+        four.render(target, frame);
+        const FrameStats& a = one.getStats();
+        const FrameStats& b = four.getStats();
+        assert(a.triangles > BINNED_FACES && a.pixelsWritten > 10000);
+        assert(a.triangles == b.triangles && a.vertices == b.vertices && a.pixelsTested == b.pixelsTested
+               && a.pixelsWritten == b.pixelsWritten && a.pixelsShaded == b.pixelsShaded);
+        assert(std::equal(expected.getColorBuffer(), expected.getColorBuffer() + expected.getStride() * 200,
+                          target.getColorBuffer()));
+      }
+    }
+  }
+
+  // the visibility buffer shades every visible pixel once, the way the
+  // faces are shaded when they are drawn
+  {
+    TriangleMesh cube;
+    loadCube(cube);
+    Texture texture = createCheckerboardTexture(64, 4);
+
+    FrameState frame;
+    frame.camera = { Vec3{0, 0, -12}, Vec3{0, 0, 0}, 200 };
+    frame.detailLevel = 2;
+    for (int i = 0; i < 8; i++) {
+      // a row of cubes going away from the camera, drawn back to front
+      cube.loc = Vec3{0.4f * i, 0.3f * i, 8.0f - 2 * i};
+      cube.rotationX = cube.rotationY = 0.3f * i;
+      frame.instances.push_back({ &cube, getWorldMatrix(cube), createRGBA(40 * i, 200, 100, 255) });
+      frame.instances.back().texture = (i % 2) ? &texture : nullptr;
+    }
+
+    for (ShadingMode mode : { ShadingMode::FLAT, ShadingMode::GOURAUD }) {
+      frame.shading = mode;
+      FrameBuffer forward(300, 200), deferred(300, 200);
+      Renderer renderer;
+      renderer.setCountCoverage(true);
+      frame.visibilityBuffer = false;
+      // from the third frame of the view on, the axes are merged, not drawn
+      for (int repeat = 0; repeat < 3; repeat++) {
+        renderer.render(forward, frame);
+      }
+      FrameStats forwardStats = renderer.getStats();
+      frame.visibilityBuffer = true;
+      for (int repeat = 0; repeat < 2; repeat++) {
+        renderer.render(deferred, frame);
+      }
+      FrameStats deferredStats = renderer.getStats();
+
+      assert(deferredStats.pixelsWritten == forwardStats.pixelsWritten);
+      assert(deferredStats.pixelsShaded < forwardStats.pixelsShaded);
+      assert(deferredStats.pixelsShaded <= deferredStats.coveredPixels);
+
+      unsigned long different = 0;
+      for (unsigned int y = 0; y < 200; y++) {
+        for (unsigned int x = 0; x < 300; x++) {
+          Color a = forward.getColorBuffer()[forward.indexOf(x, y)];
+          Color b = deferred.getColorBuffer()[deferred.indexOf(x, y)];
+          assert(forward.getDepthBuffer()[forward.indexOf(x, y)] == deferred.getDepthBuffer()[deferred.indexOf(x, y)]);
+          for (int k = 0; k < 32; k += 8) {
+            assert(std::abs((int)((a >> k) & 0xff) - (int)((b >> k) & 0xff)) <= 1);
+          }
+          different += a != b;
+        }
+      }
+      // the weights are computed rather than stepped, a few channels round
+      // the other way
+      assert(different < 50);
+    }
+  }
+
+  // a cube casts its shadow on a floor, through the shadow map of the sun
+  {
+    Mat4 ortho = createOrthographicLHMatrix(4, 2, 1, 5);
+    Vec3 corner = transformP3(Vec3{2, 1, 5}, ortho);
+    assert(std::abs(corner[0] - 1) < 1e-6f && std::abs(corner[1] - 1) < 1e-6f && std::abs(corner[2] - 1) < 1e-6f);
+    assert(std::abs(transformP3(Vec3{0, 0, 1}, ortho)[2]) < 1e-6f);
+
+    // a cleared map lights everything, and so is anything off the map
+    ShadowMap map;
+    map.resize(16);
+    map.setLight(Vec3{0, 1, 0}, Aabb{ Vec3{-1, -1, -1}, Vec3{1, 1, 1} });
+    map.clear();
+    Vec3 top = transformP3(Vec3{0, 1, 0}, map.getMatrix());
+    Vec3 bottom = transformP3(Vec3{0, -1, 0}, map.getMatrix());
+    assert(top[2] < bottom[2]);
+    assert(map.getVisibility(top[0], top[1], bottom[2]) == 1);
+    map.getDepthBuffer()[map.getSize() * (int)top[1] + (int)top[0]] = top[2];
+    assert(map.getVisibility(top[0], top[1], bottom[2]) < 1);
+    assert(map.getVisibility(top[0], top[1], top[2]) == 1);
+    assert(map.getVisibility(-5, top[1], 1) == 1);
+
+    TriangleMesh floor;
+    floor.nVertices = 4;
+    floor.vertices.reset(new Vertex[4]);
+    floor.vertices[0].pos = Vec3{-4, 0, -4};
+    floor.vertices[1].pos = Vec3{-4, 0, 4};
+    floor.vertices[2].pos = Vec3{4, 0, 4};
+    floor.vertices[3].pos = Vec3{4, 0, -4};
+    floor.nFaces = 2;
+    floor.faces.reset(new Triangle[2] { { {0, 1, 2} }, { {0, 2, 3} } });
+    floor.bounds = computeBounds(floor);
+    computeNormals(floor);
+    TriangleMesh cube;
+    loadCube(cube);
+
+    // the sun shines from the right, the shadow of the cube falls on the
+    // left of it
+    FrameState frame;
+    frame.camera = { Vec3{0, 6, -8}, Vec3{0, 0, 0}, 150 };
+    frame.detailLevel = 2;
+    frame.lighting.directionalLights = { { Vec3{1, 1, 0}, Vec3{0.8f, 0.8f, 0.8f} } };
+    frame.instances.push_back({ &floor, Mat4{}, createRGBA(200, 200, 200, 255) });
+    loadIdentity(frame.instances[0].worldMatrix);
+    frame.instances.push_back({ &cube, createTranslationMatrix(0, 2, 0), createRGBA(200, 100, 50, 255) });
+
+    Mat4 viewProj = createViewProjMatrix(frame.camera, 1.5f);
+    auto pixelOf = [&](const FrameBuffer& target, Vec3 p) {
+      Vec3 q = transformP3(p, viewProj);
+      return target.getColorBuffer()[target.indexOf(q[0] * 150 / 1.5f + 150, -q[1] * 150 + 100)];
+    };
+    for (ShadingMode mode : { ShadingMode::FLAT, ShadingMode::GOURAUD }) {
+      frame.shading = mode;
+      FrameBuffer lit(300, 200), shadowed(300, 200), deferred(300, 200);
+      Renderer renderer;
+      frame.shadows = false;
+      renderer.render(lit, frame);
+      FrameStats litStats = renderer.getStats();
+      // a renderer of its own draws the axes and the grid again, where the
+      // first merges them from its static layer
+      frame.shadows = true;
+      Renderer shadowing;
+      shadowing.render(shadowed, frame);
+      assert(shadowing.getStats().triangles == litStats.triangles);
+      assert(shadowing.getStats().pixelsWritten == litStats.pixelsWritten);
+      frame.visibilityBuffer = true;
+      renderer.render(deferred, frame);
+      frame.visibilityBuffer = false;
+
+      Vec3 inShadow {-2, 0, -0.5f}, inLight {2.5f, 0, -0.5f};
+      assert((pixelOf(shadowed, inShadow) & 0xff) + 40 < (pixelOf(lit, inShadow) & 0xff));
+      assert(pixelOf(shadowed, inLight) == pixelOf(lit, inLight));
+      for (unsigned int y = 0; y < 200; y++) {
+        for (unsigned int x = 0; x < 300; x++) {
+          Color a = shadowed.getColorBuffer()[shadowed.indexOf(x, y)];
+          Color b = deferred.getColorBuffer()[deferred.indexOf(x, y)];
+          for (int k = 0; k < 32; k += 8) {
+            assert(std::abs((int)((a >> k) & 0xff) - (int)((b >> k) & 0xff)) <= 1);
+          }
+        }
+      }
+
+      // the depth pass finds the depth of the faces the color pass finds,
+      // but where the lines of the grid are in front
+      FrameBuffer depth(300, 200);
+      renderer.renderDepth(depth, frame);
+      assert(renderer.getStats().triangles == litStats.triangles);
+      unsigned long faces = 0, equal = 0;
+      for (unsigned int y = 0; y < 200; y++) {
+        for (unsigned int x = 0; x < 300; x++) {
+          float z = depth.getDepthBuffer()[depth.indexOf(x, y)];
+          if (std::isfinite(z)) {
+            faces++;
+            equal += z == lit.getDepthBuffer()[lit.indexOf(x, y)];
+            assert(lit.getDepthBuffer()[lit.indexOf(x, y)] <= z);
+          }
+        }
+      }
+      assert(faces > 10000 && equal > faces * 9 / 10);
+    }
+  }
+
+  // multisampling expands only the tiles on the edges, and blends them
+  {
+    FrameBuffer plane(10, 6);
+    plane.clear(createRGBA(0, 0, 0, 255));
+    SampleBuffer samples;
+    samples.reset(10, 6);
+    assert(samples.getTile(9, 5) == nullptr && samples.getExpandedTileCount() == 0);
+    SampleBuffer::Tile* tile = samples.expand(9, 5, plane);
+    assert(samples.getTile(8, 4) == tile && samples.getTile(7, 4) == nullptr);
+    unsigned int pixel = SampleBuffer::indexInTile(9, 5);
+    assert(tile->color[pixel][3] == createRGBA(0, 0, 0, 255));
+    tile->color[pixel][0] = tile->color[pixel][1] = createRGBA(255, 100, 0, 255);
+    tile->depth[pixel][1] = 0.5f;
+    samples.resolve(plane);
+    assert(plane.getColorBuffer()[plane.indexOf(9, 5)] == createRGBA(128, 50, 0, 255));
+    assert(plane.getDepthBuffer()[plane.indexOf(9, 5)] == 0.5f);
+    assert(samples.getMemorySize() == 3 * 2 * sizeof(std::uint32_t) + sizeof(SampleBuffer::Tile));
+    samples.reset(10, 6);
+    assert(samples.getTile(9, 5) == nullptr);
+
+    float cx, cy;
+    SampleBuffer::getCentroid(SampleBuffer::FULL_MASK, cx, cy);
+    assert(cx == 0 && cy == 0);
+
+    TriangleMesh cube;
+    loadCube(cube);
+    cube.loc = Vec3{0, 0, 0};
+    cube.rotationX = cube.rotationY = 0.5f;
+    FrameState frame;
+    frame.camera = { Vec3{0, 0, -8}, Vec3{0, 0, 0}, 150 };
+    frame.detailLevel = 2;
+    frame.shading = ShadingMode::FLAT;
+    frame.instances.push_back({ &cube, getWorldMatrix(cube), createRGBA(200, 120, 60, 255) });
+
+    FrameBuffer single(300, 200), multi(300, 200);
+    Renderer renderer;
+    renderer.render(single, frame);
+    FrameStats singleStats = renderer.getStats();
+    frame.msaa = true;
+    renderer.render(multi, frame);
+    FrameStats multiStats = renderer.getStats();
+
+    // the interiors are drawn the same, the edges are blended
+    unsigned long different = 0, blended = 0;
+    for (unsigned int y = 0; y < 200; y++) {
+      for (unsigned int x = 0; x < 300; x++) {
+        Color a = single.getColorBuffer()[single.indexOf(x, y)];
+        Color b = multi.getColorBuffer()[multi.indexOf(x, y)];
+        different += a != b;
+        blended += (b != CLEAR_COLOR) && ((b & 0xff) != ((b >> 8) & 0xff) * 200 / 120)
+                   && single.getDepthBuffer()[single.indexOf(x, y)] == std::numeric_limits<float>::infinity();
+      }
+    }
+    assert(different > 100 && different < 300 * 200 / 20);
+    assert(blended > 50);
+    assert(multiStats.pixelsShaded < singleStats.pixelsShaded * 11 / 10);
+
+    // the expanded tiles take far less than the 3 more samples of every pixel
+    std::size_t frameBytes = single.getStride() * 200 * (sizeof(Color) + sizeof(float));
+    assert(multiStats.expandedTiles > 0 && multiStats.sampleBytes < frameBytes / 2);
+    assert(singleStats.expandedTiles == 0 && singleStats.sampleBytes == 0);
+  }
+
+  {
+    // a frame buffer is brought up to date by the rectangles, in tiles, of
+    // the frames it missed
+    DirtyRegions dirty;
+    std::vector<ScreenRect> regions;
+    int front, back;
+    dirty.beginFrame(160, 120, false);
+    assert(!dirty.getRegions(&front, regions));
+    dirty.endFrame(&front);
+    dirty.beginFrame(160, 120, false);
+    dirty.add({ 10, 10, 20, 20 });
+    assert(dirty.getRegions(&front, regions) && regions.size() == 1);
+    assert(regions[0].left == 0 && regions[0].top == 0 && regions[0].right == 32 && regions[0].bottom == 32);
+    assert(!dirty.getRegions(&back, regions));
+    dirty.endFrame(&back);
+    dirty.beginFrame(160, 120, false);
+    dirty.add({ 25, 5, 40, 12 });
+    dirty.add({ 100, 100, 170, 130 });
+    assert(dirty.getRegions(&back, regions) && regions.size() == 2);
+    assert(regions[0].getArea() == 32 * 16 && regions[1].getArea() == 64 * 24);
+    assert(dirty.getRegions(&front, regions) && regions.size() == 2);
+    assert(regions[0].left == 0 && regions[0].right == 48 && regions[0].bottom == 32);
+    assert(!regions[0].intersects(regions[1]));
+    dirty.endFrame(&front);
+
+    // the bounds of two rectangles take in one seen before them
+    dirty.beginFrame(160, 120, false);
+    dirty.add({ 16, 16, 32, 32 });
+    dirty.add({ 0, 0, 32, 16 });
+    dirty.add({ 0, 0, 16, 48 });
+    assert(dirty.getRegions(&front, regions) && regions.size() == 1);
+    assert(regions[0].left == 0 && regions[0].top == 0 && regions[0].right == 32 && regions[0].bottom == 48);
+    dirty.endFrame(&front);
+
+    // a frame that changed everywhere, a new size or too many pixels
+    // redraw whole
+    dirty.beginFrame(160, 120, true);
+    assert(!dirty.getRegions(&front, regions));
+    dirty.endFrame(&front);
+    dirty.beginFrame(160, 120, false);
+    assert(dirty.getRegions(&front, regions) && regions.empty());
+    assert(!dirty.getRegions(&back, regions));
+    dirty.endFrame(&front);
+    dirty.beginFrame(200, 120, false);
+    assert(!dirty.getRegions(&front, regions));
+    dirty.endFrame(&front);
+    dirty.beginFrame(200, 120, false);
+    dirty.add({ 0, 0, 200, 70 });
+    assert(!dirty.getRegions(&front, regions));
+
+    // a moving cube among still ones, drawn into two frame buffers in
+    // turn, looks like the frames drawn whole
+    TriangleMesh cube;
+    loadCube(cube);
+    FrameState frame;
+    frame.camera = { Vec3{0, 4, -10}, Vec3{0, 0, 0}, 250 };
+    frame.dirtyRegions = true;
+    for (int i = 0; i < 3; i++) {
+      cube.loc = Vec3{i * 3.0f - 3, 0, 0};
+      frame.instances.push_back({ &cube, getWorldMatrix(cube), createRGBA(200, 120, 60, 255) });
+    }
+    FrameState full = frame;
+    full.dirtyRegions = false;
+
+    const ShadingMode modes[] { ShadingMode::WIREFRAME, ShadingMode::GOURAUD, ShadingMode::FLAT };
+    for (int variant = 0; variant < 4; variant++) {
+      frame.shading = full.shading = modes[variant % 3];
+      frame.visibilityBuffer = full.visibilityBuffer = variant == 2;
+      frame.msaa = full.msaa = variant == 3;
+      FrameBuffer buffers[2] { {300, 200}, {300, 200} };
+      FrameBuffer expected(300, 200);
+      Renderer renderer, reference;
+      for (int n = 0; n < 6; n++) {
+        cube.loc = Vec3{-3, 0, n * 0.2f};
+        cube.rotationY = n * 0.1f;
+        frame.instances[0].worldMatrix = full.instances[0].worldMatrix = getWorldMatrix(cube);
+        FrameBuffer& target = buffers[n % 2];
+        renderer.render(target, frame);
+        reference.render(expected, full);
+        unsigned long redrawn = renderer.getStats().redrawnPixels;
+        assert(n < 2 ? redrawn == 300 * 200 : redrawn < 300 * 200 / 3);
+
+        unsigned long different = 0;
+        for (unsigned int y = 0; y < 200; y++) {
+          for (unsigned int x = 0; x < 300; x++) {
+            different += target.getColorBuffer()[target.indexOf(x, y)]
+                         != expected.getColorBuffer()[expected.indexOf(x, y)];
+          }
+        }
+        assert(different == 0);
+      }
+    }
+  }
+
+  {
+    // the pixels of a static layer merge back where they were drawn, in
+    // front of farther ones only
+    FrameBuffer source(40, 8), target(40, 8);
+    source.clear(CLEAR_COLOR);
+    auto draw = [&](unsigned int x, unsigned int y, float depth) {
+      source.getDepthBuffer()[source.indexOf(x, y)] = depth;
+      source.getColorBuffer()[source.indexOf(x, y)] = x;
+    };
+    draw(3, 2, 0.5f);
+    draw(5, 2, 0.2f);
+    draw(30, 2, 0.1f);
+    draw(10, 6, 0.7f);
+    StaticLayer layer;
+    StaticLayer::View view { { Vec3{0, 0, -5}, Vec3{0, 0, 0}, 100 }, 40, 8, 0 };
+    assert(!layer.holds(view));
+    layer.capture(source, view);
+    assert(layer.holds(view) && layer.getPixelCount() == 3 + 1 + 1);
+
+    target.clear(CLEAR_COLOR);
+    target.getDepthBuffer()[target.indexOf(5, 2)] = 0.1f;
+    layer.merge(target, 0, 0, 20, 8);
+    assert(target.getColorBuffer()[target.indexOf(3, 2)] == 3 && target.getDepthBuffer()[target.indexOf(3, 2)] == 0.5f);
+    assert(target.getColorBuffer()[target.indexOf(4, 2)] == CLEAR_COLOR);
+    assert(target.getColorBuffer()[target.indexOf(5, 2)] == CLEAR_COLOR);
+    assert(target.getColorBuffer()[target.indexOf(10, 6)] == 10);
+    assert(target.getColorBuffer()[target.indexOf(30, 2)] == CLEAR_COLOR);
+    view.camera.zoomFactor = 120;
+    assert(!layer.holds(view));
+
+    // the frames of a still view merge the axes and the grid into the
+    // pixels they were drawn into
+    TriangleMesh cube;
+    loadCube(cube);
+    FrameState frame;
+    frame.camera = { Vec3{6, 5, -10}, Vec3{0, 0, 0}, 250 };
+    frame.instances.push_back({ &cube, getWorldMatrix(cube) });
+    FrameBuffer buffers[3] { {300, 200}, {300, 200}, {300, 200} };
+    Renderer renderer;
+    FrameStats stats[3];
+    for (int n = 0; n < 3; n++) {
+      renderer.render(buffers[n], frame);
+      stats[n] = renderer.getStats();
+    }
+    assert(stats[2].lines + 3 + 18 == stats[0].lines);
+    for (int n = 1; n < 3; n++) {
+      assert(std::memcmp(buffers[0].getColorBuffer(), buffers[n].getColorBuffer(),
+                         buffers[0].getStride() * 200 * sizeof(Color)) == 0);
+      assert(std::memcmp(buffers[0].getDepthBuffer(), buffers[n].getDepthBuffer(),
+                         buffers[0].getStride() * 200 * sizeof(float)) == 0);
+    }
+
+    // the merged grid stays behind a face in front of it: it shows only
+    // where a frame without it shows the axes or nothing
+    frame.camera = { Vec3{0, 6, -8}, Vec3{0, 0, 0}, 150 };
+    frame.shading = ShadingMode::FLAT;
+    frame.instances[0].worldMatrix = createTranslationMatrix(0, 2, 0);
+    FrameState gridless = frame, empty = frame;
+    gridless.detailLevel = empty.detailLevel = 2;
+    empty.instances.clear();
+    FrameBuffer faces(300, 200), background(300, 200);
+    Renderer().render(faces, gridless);
+    Renderer().render(background, empty);
+    for (int n = 0; n < 3; n++) {
+      renderer.render(buffers[n], frame);
+    }
+    assert(renderer.getStats().lines < stats[0].lines);
+    unsigned long grid = 0;
+    for (unsigned int i = 0; i < faces.getStride() * faces.getHeight(); i++) {
+      if (buffers[2].getColorBuffer()[i] != faces.getColorBuffer()[i]) {
+        assert(faces.getColorBuffer()[i] == background.getColorBuffer()[i]);
+        grid++;
+      }
+    }
+    assert(grid > 100);
+  }
+
+  {
+    // the upscaler keeps the corners and a uniform color, and halfway
+    // between two pixels blends them evenly
+    FrameBuffer source(3, 2), target(12, 8);
+    source.clear(createRGBA(10, 20, 30, 255));
+    source.getColorBuffer()[source.indexOf(0, 0)] = createRGBA(200, 0, 0, 255);
+    source.getColorBuffer()[source.indexOf(2, 1)] = createRGBA(0, 0, 200, 255);
+    Upscaler upscaler;
+    upscaler.upscale(source, target);
+    assert(target.getColorBuffer()[target.indexOf(0, 0)] == createRGBA(200, 0, 0, 255));
+    assert(target.getColorBuffer()[target.indexOf(11, 7)] == createRGBA(0, 0, 200, 255));
+    assert(target.getColorBuffer()[target.indexOf(11, 0)] == createRGBA(10, 20, 30, 255));
+    assert(target.getColorBuffer()[target.indexOf(0, 7)] == createRGBA(10, 20, 30, 255));
+    FrameBuffer half(1, 2), line(4, 3);
+    half.getColorBuffer()[0] = createRGBA(0, 0, 0, 255);
+    half.getColorBuffer()[half.indexOf(0, 1)] = createRGBA(100, 200, 50, 255);
+    upscaler.upscale(half, line);
+    assert(line.getColorBuffer()[line.indexOf(3, 0)] == createRGBA(0, 0, 0, 255));
+    assert(line.getColorBuffer()[line.indexOf(0, 1)] == createRGBA(50, 100, 25, 255));
+    assert(line.getColorBuffer()[line.indexOf(2, 2)] == createRGBA(100, 200, 50, 255));
+
+    // a frame rendered at half the resolution and scaled up shows the faces
+    // where the full one does, but for the blur of their edges
+    TriangleMesh cube;
+    loadCube(cube);
+    FrameState frame;
+    frame.camera = { Vec3{6, 5, -10}, Vec3{0, 0, 0}, 250 };
+    frame.shading = ShadingMode::FLAT;
+    frame.instances.push_back({ &cube, getWorldMatrix(cube) });
+    FrameBuffer full(300, 200), scaled(300, 200);
+    Renderer renderer;
+    renderer.render(full, frame);
+    frame.resolutionScale = 0.5f;
+    renderer.render(scaled, frame);
+    assert(renderer.getScaledTarget()->getWidth() == 150 && renderer.getScaledTarget()->getHeight() == 100);
+    unsigned int different = 0;
+    for (unsigned int y = 0; y < 200; y++) {
+      for (unsigned int x = 0; x < 300; x++) {
+        Color a = full.getColorBuffer()[full.indexOf(x, y)], b = scaled.getColorBuffer()[scaled.indexOf(x, y)];
+        for (int shift = 0; shift < 24; shift += 8) {
+          if (std::abs((int)(a >> shift & 0xff) - (int)(b >> shift & 0xff)) > 64) {
+            different++;
+            break;
+          }
+        }
+      }
+    }
+    assert(different < 300 * 200 / 20);
+  }
+
+  {
+    // the sinks write what the frames hold in every format, and count
+    // every presented frame as written or dropped
+    const char* tmp = std::getenv("TMPDIR");
+    std::string prefix = std::string(tmp ? tmp : "/tmp") + "/g3-test-sink";
+    auto readFile = [](const std::string& name) {
+      std::ifstream file(name, std::ios::binary);
+      return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    };
+    auto fillFrame = [](FrameBuffer& frame, unsigned int number) {
+      for (unsigned int y = 0; y < frame.getHeight(); y++) {
+        for (unsigned int x = 0; x < frame.getWidth(); x++) {
+          frame.getColorBuffer()[frame.indexOf(x, y)] = createRGBA(x * 40 + number, y * 80, 200, 255);
+        }
+      }
+    };
+    std::string rgb;
+    for (unsigned int y = 0; y < 3; y++) {
+      for (unsigned int x = 0; x < 5; x++) {
+        rgb += { (char)(x * 40 + 1), (char)(y * 80), (char)200 };
+      }
+    }
+
+    for (FrameFormat format : { FrameFormat::RAW, FrameFormat::PPM, FrameFormat::PNG, FrameFormat::Y4M }) {
+      bool sequence = format == FrameFormat::PPM || format == FrameFormat::PNG;
+      std::string path = prefix + (sequence ? "%d." : ".") + getFrameFormatName(format);
+      {
+        FrameSink sink(format, path, 5, 3, 25, true);
+        for (unsigned int n = 0; n < 2; n++) {
+          fillFrame(sink.getBackBuffer(), n);
+          assert(sink.present());
+        }
+        sink.flush();
+        assert(sink.getWrittenCount() == 2 && sink.getDroppedCount() == 0 && sink.getFailedCount() == 0);
+      }
+
+      std::string name = sequence ? prefix + "1." + getFrameFormatName(format) : path;
+      std::string bytes = readFile(name);
+      std::remove(name.c_str());
+      if (sequence) {
+        std::remove((prefix + "0." + getFrameFormatName(format)).c_str());
+      }
+      if (format == FrameFormat::RAW) {
+        assert(bytes.size() == 2 * 5 * 3 * 4);
+        Color pixel;
+        std::memcpy(&pixel, bytes.data() + 5 * 3 * 4 + (2 * 5 + 4) * 4, 4);
+        assert(pixel == createRGBA(4 * 40 + 1, 2 * 80, 200, 255));
+      } else if (format == FrameFormat::PPM) {
+        assert(bytes == "P6\n5 3\n255\n" + rgb);
+      } else if (format == FrameFormat::PNG) {
+        // the stored blocks hold the scanlines, and the chunk after them
+        // is the standard IEND with its CRC
+        assert(bytes.compare(0, 8, "\x89PNG\r\n\x1a\n") == 0);
+        assert(bytes.compare(bytes.size() - 12, 12, std::string("\0\0\0\0IEND\xae\x42\x60\x82", 12)) == 0);
+        std::size_t data = bytes.find("IDAT") + 4;
+        assert(bytes.compare(data, 3, "\x78\x01\x01") == 0);
+        for (unsigned int y = 0; y < 3; y++) {
+          assert(bytes[data + 7 + y * 16] == 0);
+          assert(bytes.compare(data + 7 + y * 16 + 1, 15, rgb, y * 15, 15) == 0);
+        }
+      } else {
+        // the stream says its range is full, where white and black keep
+        // their luma, and a gray has no chroma
+        std::string header = "YUV4MPEG2 W5 H3 F25:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n";
+        std::size_t frameSize = 6 + 5 * 3 + 2 * 3 * 2;
+        assert(bytes.size() == header.size() + 2 * frameSize && bytes.compare(0, header.size(), header) == 0);
+        assert(bytes.compare(header.size() + frameSize, 6, "FRAME\n") == 0);
+      }
+    }
+
+    FrameSink y4m(FrameFormat::Y4M, prefix + ".y4m", 2, 2, 30, true);
+    y4m.getBackBuffer().clear(createRGBA(255, 255, 255, 255));
+    y4m.present();
+    y4m.getBackBuffer().clear(createRGBA(0, 0, 0, 255));
+    y4m.getBackBuffer().getColorBuffer()[0] = createRGBA(128, 128, 128, 255);
+    y4m.present();
+    y4m.flush();
+    std::string yuv = readFile(prefix + ".y4m");
+    std::size_t first = yuv.find("FRAME\n") + 6, second = yuv.find("FRAME\n", first) + 6;
+    assert(yuv.compare(first, 6, "\xff\xff\xff\xff\x80\x80") == 0);
+    assert(yuv.compare(second, 6, std::string("\x80\0\0\0\x80\x80", 6)) == 0);
+    std::remove((prefix + ".y4m").c_str());
+
+    // a sink that drops frames never waits, every frame is accounted for
+    FrameSink dropping(FrameFormat::RAW, prefix + ".raw", 64, 64);
+    for (unsigned int n = 0; n < 20; n++) {
+      dropping.present();
+    }
+    dropping.flush();
+    assert(dropping.getWrittenCount() + dropping.getDroppedCount() == 20);
+    std::remove((prefix + ".raw").c_str());
+
+    // a pattern of file names takes the frame number in one int conversion
+    FrameSink padded(FrameFormat::PPM, prefix + "%%%-+05.3i.ppm", 2, 2);
+    for (const char* pattern : { ".png", "%s.png", "%d%d.png", "%ld.png", "%d%.png", "%5" }) {
+      bool thrown = false;
+      try {
+        FrameSink(FrameFormat::PNG, prefix + pattern, 2, 2);
+      } catch (const std::runtime_error&) {
+        thrown = true;
+      }
+      assert(thrown);
+    }
+  }
+
+  {
+    // a batch on four threads renders every camera as a renderer of its own
+    // does, and a loop nested in a chunk runs inline
+    TriangleMesh cube;
+    loadCube(cube);
+    FrameState frame;
+    frame.shading = ShadingMode::GOURAUD;
+    frame.instances.push_back({ &cube, getWorldMatrix(cube) });
+    std::vector<Camera> cameras;
+    for (int n = 0; n < 7; n++) {
+      cameras.push_back({ Vec3{6.0f - n, 5, -10.0f + n}, Vec3{0, 0, 0}, 200.0f + 10 * n });
+    }
+    ThreadPool pool(4);
+    BatchRenderer batch(pool);
+    std::vector<std::vector<Color>> colors(cameras.size());
+    std::atomic<unsigned long> pixels {0};
+    batch.render(frame, cameras, 120, 80, [&](std::size_t camera, const FrameBuffer& target, const FrameStats& stats) {
+      colors[camera].assign(target.getColorBuffer(), target.getColorBuffer() + target.getStride() * 80);
+      pixels += stats.pixelsWritten;
+      pool.parallelFor(0, 100, 1, [](std::size_t, std::size_t) {});
+    });
+    assert(batch.getWorkerCount() == 4 && batch.getStats().pixelsWritten == pixels);
+    for (std::size_t n = 0; n < cameras.size(); n++) {
+      Renderer renderer;
+      FrameBuffer expected(120, 80);
+      frame.camera = cameras[n];
+      renderer.render(expected, frame);
+      assert(colors[n].size() == expected.getStride() * 80);
+      assert(std::equal(colors[n].begin(), colors[n].end(), expected.getColorBuffer()));
+    }
+  }
+
+  {
+    // the renderers of a batch share its pool for the loops within their
+    // frames, whose waiting threads take up the frames of other cameras, and
+    // every frame keeps its own pixels and counters
+    TriangleMesh terrain;
+    loadTerrain(terrain, 32);
+    FrameState frame;
+    frame.shading = ShadingMode::FLAT;
+    frame.instances.push_back({ &terrain, Mat4{}, createRGBA(200, 200, 200, 255) });
+    loadIdentity(frame.instances[0].worldMatrix);
+    std::vector<Camera> cameras;
+    for (int n = 0; n < 12; n++) {
+      float angle = n * 0.5f;
+      cameras.push_back({ Vec3{8 * std::cos(angle), 5, 8 * std::sin(angle)}, Vec3{0, 0, 0}, 150 });
+    }
+    ThreadPool pool(4), serial(1);
+    std::vector<FrameStats> expectedStats;
+    std::vector<std::vector<Color>> expectedColors;
+    for (const Camera& camera : cameras) {
+      Renderer renderer;
+      renderer.setThreadPool(serial);
+      FrameBuffer expected(160, 120);
+      frame.camera = camera;
+      renderer.render(expected, frame);
+      expectedStats.push_back(renderer.getStats());
+      expectedColors.emplace_back(expected.getColorBuffer(), expected.getColorBuffer() + expected.getStride() * 120);
+    }
+    FrameStats total {};
+    for (const FrameStats& stats : expectedStats) {
+      total += stats;
+    }
+
+    BatchRenderer batch(pool);
+    for (int round = 0; round < 10; round++) {
+      std::vector<int> delivered(cameras.size(), 0);
+      batch.render(frame, cameras, 160, 120, [&](std::size_t camera, const FrameBuffer& target, const FrameStats& stats) {
+        delivered[camera]++;
+        // the axes and the grid of a view that holds come from the static
+        // layer, so only the counters of the faces are the same every time
+        const FrameStats& expected = expectedStats[camera];
+        assert(stats.triangles == expected.triangles && stats.pixelsShaded == expected.pixelsShaded);
+        assert(std::equal(expectedColors[camera].begin(), expectedColors[camera].end(), target.getColorBuffer()));
+      });
+      assert(std::count(delivered.begin(), delivered.end(), 1) == (long)cameras.size());
+      assert(batch.getStats().triangles == total.triangles && batch.getStats().pixelsShaded == total.pixelsShaded);
+    }
+  }
+
   std::cout << "test ok" << std::endl;
   return 0;
 }